@@ -117,7 +117,7 @@ const FieldDefinition *BinaryInputBehaviour::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void BinaryInputBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void BinaryInputBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
@@ -357,8 +357,8 @@ void ButtonBehaviour::sendClick(DsClickType aClickType)
   if (!device.getDeviceContainer().signalDeviceUserAction(device, true)) {
     // button press not consumed on global level, forward to upstream dS
     LOG(LOG_NOTICE,"ButtonBehaviour: Pushing value = %d, clickType %d\n", buttonPressed, aClickType);
-    // issue a state property push
-    pushBehaviourState();
+    // issue a state property push (as an event: every click must reach the vdSM, even when the connection is busy)
+    pushBehaviourState(true);
     // also let device container know for local click handling
     // TODO: more elegant solution for this
     device.getDeviceContainer().checkForLocalClickHandling(*this, aClickType);
@@ -407,7 +407,7 @@ const FieldDefinition *ButtonBehaviour::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void ButtonBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void ButtonBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, NULL); // no common flags in base class
   // get the fields
@@ -104,7 +104,7 @@ bool ClimateControlBehaviour::applyScene(DsScenePtr aScene)
 #pragma mark - persistence
 
 /// load values from passed row
-void ClimateControlBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void ClimateControlBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   // get the data
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
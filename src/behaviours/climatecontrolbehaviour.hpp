@@ -138,7 +138,7 @@ namespace p44 {
       outputflag_summerMode = inherited::outputflag_nextflag<<0,
       outputflag_nextflag = inherited::outputflag_nextflag<<1
     };
-    virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
+    virtual void loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
 
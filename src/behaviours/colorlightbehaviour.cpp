@@ -118,7 +118,7 @@ const FieldDefinition *ColorLightScene::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void ColorLightScene::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void ColorLightScene::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
@@ -268,7 +268,7 @@ void ColorLightBehaviour::saveChannelsToScene(DsScenePtr aScene)
   // now save color specific scene information
   ColorLightScenePtr colorLightScene = boost::dynamic_pointer_cast<ColorLightScene>(aScene);
   if (colorLightScene) {
-    colorLightScene->colorMode = colorMode;
+    colorLightScene->setRepVar(colorLightScene->colorMode, colorMode);
     // save the values and adjust don't cares according to color mode
     switch (colorMode) {
       case colorLightModeHueSaturation: {
@@ -713,7 +713,7 @@ const FieldDefinition *RGBColorLightBehaviour::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void RGBColorLightBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void RGBColorLightBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
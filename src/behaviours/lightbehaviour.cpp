@@ -446,7 +446,7 @@ const FieldDefinition *LightBehaviour::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void LightBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void LightBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // read onThreshold only if not NULL
@@ -93,7 +93,7 @@ const FieldDefinition *MovingLightScene::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void MovingLightScene::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void MovingLightScene::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
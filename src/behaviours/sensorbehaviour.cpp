@@ -119,7 +119,7 @@ const FieldDefinition *SensorBehaviour::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void SensorBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void SensorBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
@@ -110,7 +110,10 @@ public:
     UpnpDeviceContainerPtr upnpDeviceContainer = UpnpDeviceContainerPtr(new UpnpDeviceContainer(1, deviceContainer.get(), 2));
     upnpDeviceContainer->addClassToDeviceContainer();
     // now start running the mainloop
-    return run();
+    int exitCode = run();
+    // make sure all parameters are on disk before exiting
+    deviceContainer->flushParams();
+    return exitCode;
   }
 
   virtual void initialize()
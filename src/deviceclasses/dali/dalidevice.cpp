@@ -385,6 +385,18 @@ void DaliDevice::applyChannelValues(DoneCB aDoneCB, bool aForDimming)
 }
 
 
+bool DaliDevice::pendingBrightness(Brightness &aBrightness, MLMicroSeconds &aTransitionTime)
+{
+  LightBehaviourPtr lightBehaviour = boost::dynamic_pointer_cast<LightBehaviour>(output);
+  if (lightBehaviour && lightBehaviour->brightnessNeedsApplying()) {
+    aBrightness = lightBehaviour->brightnessForHardware();
+    aTransitionTime = lightBehaviour->transitionTimeToNewBrightness();
+    return true;
+  }
+  return false;
+}
+
+
 // optimized DALI dimming implementation
 void DaliDevice::dimChannel(DsChannelType aChannelType, DsDimMode aDimMode)
 {
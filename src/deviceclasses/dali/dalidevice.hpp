@@ -175,6 +175,12 @@ namespace p44 {
     ///   in a single channel (and not switching between color modes etc.)
     virtual void applyChannelValues(DoneCB aDoneCB, bool aForDimming);
 
+    /// get new brightness waiting to be applied with next applyChannelValues()
+    /// @param aBrightness will be set to the brightness to apply
+    /// @param aTransitionTime will be set to the transition time to use
+    /// @return true if there is a new brightness to apply
+    bool pendingBrightness(Brightness &aBrightness, MLMicroSeconds &aTransitionTime);
+
     /// start or stop dimming (optimized DALI version)
     /// @param aChannel the channelType to start or stop dimming for
     /// @param aDimMode according to DsDimMode: 1=start dimming up, -1=start dimming down, 0=stop dimming
@@ -23,6 +23,8 @@
 
 #include "dalidevice.hpp"
 
+#include <set>
+
 using namespace p44;
 
 
@@ -109,6 +111,8 @@ void DaliDeviceContainer::collectDevices(CompletedCB aCompletedCB, bool aIncreme
 
 void DaliDeviceContainer::deviceListReceived(CompletedCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, ErrorPtr aError)
 {
+  // remember what is on the bus (broadcasts reach all of these ballasts, not only those we have devices for)
+  busInventory = aError ? DaliComm::ShortAddressListPtr() : aDeviceListPtr;
   // check if any devices
   if (aError || aDeviceListPtr->size()==0)
     return aCompletedCB(aError); // no devices to query, completed
@@ -347,6 +351,61 @@ void DaliDeviceContainer::groupCollected(VdcApiRequestPtr aRequest)
 
 
 
+#pragma mark - batched applying of channel values
+
+void DaliDeviceContainer::applyChannelValuesBatch(DeviceVector &aDevices)
+{
+  // when all ballasts on the bus get the same new brightness, a single broadcast replaces one command per device
+  // Note: a broadcast reaches every ballast on the bus, so it is only safe when the batch covers exactly
+  //   the ballasts found by the last bus scan (no ballasts without a device, no composite devices)
+  if (aDevices.size()>1 && busInventory && aDevices.size()==busInventory->size()) {
+    bool sameBrightness = true;
+    uint8_t power = 0;
+    MLMicroSeconds transitionTime = 0;
+    std::set<DaliAddress> batchAddresses;
+    for (DeviceVector::iterator pos = aDevices.begin(); pos!=aDevices.end(); ++pos) {
+      DaliDevicePtr dev = boost::dynamic_pointer_cast<DaliDevice>(*pos);
+      Brightness b;
+      MLMicroSeconds tt;
+      if (!dev || dev->brightnessDimmer->isDummy || !dev->pendingBrightness(b, tt)) {
+        sameBrightness = false;
+        break;
+      }
+      batchAddresses.insert(dev->brightnessDimmer->deviceInfo.shortAddress);
+      uint8_t p = dev->brightnessDimmer->brightnessToArcpower(b);
+      if (pos==aDevices.begin()) {
+        power = p;
+        transitionTime = tt;
+      }
+      else if (p!=power || tt!=transitionTime) {
+        sameBrightness = false;
+        break;
+      }
+    }
+    if (sameBrightness && batchAddresses!=std::set<DaliAddress>(busInventory->begin(), busInventory->end())) {
+      // batch does not cover the entire bus
+      sameBrightness = false;
+    }
+    if (sameBrightness) {
+      for (DeviceVector::iterator pos = aDevices.begin(); pos!=aDevices.end(); ++pos) {
+        DaliDevicePtr dev = boost::dynamic_pointer_cast<DaliDevice>(*pos);
+        Brightness b;
+        MLMicroSeconds tt;
+        dev->pendingBrightness(b, tt);
+        // fade time is per device (only sent when changed), brightness is sent as broadcast below
+        dev->brightnessDimmer->setTransitionTime(tt);
+        dev->brightnessDimmer->currentBrightness = b;
+      }
+      LOG(LOG_INFO, "DALI: all %d ballasts on the bus get same new brightness -> broadcast arc power = %d\n", (int)aDevices.size(), (int)power);
+      daliComm->daliSendDirectPower(DaliBroadcast, power);
+    }
+  }
+  // let devices complete applying (sends individual commands for those not covered by the broadcast)
+  inherited::applyChannelValuesBatch(aDevices);
+}
+
+
+
 #pragma mark - Self test
 
 void DaliDeviceContainer::selfTest(CompletedCB aCompletedCB)
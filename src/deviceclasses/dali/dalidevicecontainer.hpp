@@ -56,6 +56,8 @@ namespace p44 {
 
 		DaliPersistence db;
 
+    DaliComm::ShortAddressListPtr busInventory; ///< short addresses of all ballasts found by the last bus scan
+
   public:
     DaliDeviceContainer(int aInstanceNumber, DeviceContainer *aDeviceContainerP, int aTag);
 
@@ -94,6 +96,12 @@ namespace p44 {
     /// @return true if there is an icon, false if not
     virtual bool getDeviceIcon(string &aIcon, bool aWithData, const char *aResolutionPrefix);
 
+  protected:
+
+    /// apply channel values of a batch of devices, using a DALI broadcast when all devices get the same brightness
+    /// @param aDevices the devices which have new channel values ready to be applied
+    virtual void applyChannelValuesBatch(DeviceVector &aDevices);
+
   private:
 
     void deviceListReceived(CompletedCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, ErrorPtr aError);
@@ -95,7 +95,7 @@ void OlaDeviceContainer::olaThreadRoutine(ChildThreadWrapper &aThread)
   if (olaClientP && dmxBufferP) {
     dmxBufferP->Blackout();
     if (olaClientP->Setup()) {
-      while (true) {
+      while (!aThread.shouldTerminate()) {
         pthread_mutex_lock(&olaBufferAccess);
         bool ok = olaClientP->SendDMX(DMX512_UNIVERSE, *dmxBufferP, ola::client::StreamingClient::SendArgs());
         pthread_mutex_unlock(&olaBufferAccess);
@@ -97,7 +97,7 @@ const FieldDefinition *SparkLightScene::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void SparkLightScene::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void SparkLightScene::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
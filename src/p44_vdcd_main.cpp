@@ -254,14 +254,20 @@ public:
       { 0,   "staticdevices", false, "enable support for statically defined devices" },
       { 'C', "vdsmport",      true,  "port;port number/service name for vdSM to connect to (default pbuf:" DEFAULT_PBUF_VDSMSERVICE ", JSON:" DEFAULT_JSON_VDSMSERVICE ")" },
       { 'i', "vdsmnonlocal",  false, "allow vdSM connections from non-local clients" },
+      { 0  , "apicoalesce",   true,  "microseconds;collect outgoing vDC API messages for this time and send them in one write (0=until end of mainloop cycle)" },
       { 'w', "startupdelay",  true,  "seconds;delay startup" },
       { 0  , "announcepause", true,  "milliseconds;pause between device announcements at startup" },
+      { 0  , "announcewindow",true,  "count;max number of device announcements waiting for acknowledgement at the same time" },
+      { 0  , "skipknown",     false, "do not announce devices again the vdSM has already acknowledged unchanged in an earlier session" },
       { 'l', "loglevel",      true,  "level;set max level of log message detail to show on stdout" },
       { 0  , "errlevel",      true,  "level;set max level for log messages to go to stderr as well" },
       { 0  , "mainloopstats", true,  "interval;0=no stats, 1..N interval (5Sec steps)" },
+      { 0  , "tickless",      false, "run mainloop in tickless mode (only wake up for timers and I/O)" },
       { 0  , "dontlogerrors", false, "don't duplicate error messages (see --errlevel) on stdout" },
+      { 0  , "asynclog",      false, "write log messages from a background thread (logging does not block the mainloop)" },
       { 's', "sqlitedir",     true,  "dirpath;set SQLite DB directory (default = " DEFAULT_DBDIR ")" },
       { 0  , "icondir",       true,  "icon directory;specifiy path to directory containing device icons" },
+      { 0  , "iconcache",     true,  "kilobytes;memory to use for caching device icons (default 256, 0=no caching)" },
       { 'W', "cfgapiport",    true,  "port;server port number for web configuration JSON API (default=none)" },
       { 0  , "cfgapinonlocal",false, "allow web configuration JSON API from non-local clients" },
       { 0  , "sparkcore",     true,  "sparkCoreID:authToken;add spark core based cloud device" },
@@ -314,6 +320,10 @@ public:
     int errlevel = selfTesting ? LOG_EMERG: LOG_ERR; // testing by default only reports to stdout
     getIntOption("errlevel", errlevel);
     SETERRLEVEL(errlevel, !getOption("dontlogerrors"));
+    globalLogger.setAsync(getOption("asynclog"));
+
+    // mainloop mode
+    MainLoop::currentMainLoop().setTickless(getOption("tickless"));
 
     // startup delay?
     int startupDelay = 0; // no delay
@@ -359,6 +369,10 @@ public:
       const char *icondir = NULL;
       getStringOption("icondir", icondir);
       p44VdcHost->setIconDir(icondir);
+      int iconCacheKB;
+      if (getIntOption("iconcache", iconCacheKB)) {
+        p44VdcHost->setIconCacheSize(iconCacheKB*1024);
+      }
       string s;
 
       // - set dSUID mode
@@ -392,6 +406,11 @@ public:
       if (getIntOption("announcepause", announcePause)){
         p44VdcHost->setAnnouncePause(announcePause*MilliSecond);
       }
+      int announceWindow;
+      if (getIntOption("announcewindow", announceWindow)){
+        p44VdcHost->setAnnounceWindow(announceWindow);
+      }
+      p44VdcHost->setSkipKnownAnnouncements(getOption("skipknown"));
 
       // - set custom mainloop statistics output interval
       int mainloopStatsInterval;
@@ -415,6 +434,10 @@ public:
       getStringOption("vdsmport", vdsmport);
       p44VdcHost->vdcApiServer->setConnectionParams(NULL, vdsmport, SOCK_STREAM, AF_INET);
       p44VdcHost->vdcApiServer->setAllowNonlocalConnections(getOption("vdsmnonlocal"));
+      int apiCoalesceUs;
+      if (getIntOption("apicoalesce", apiCoalesceUs)) {
+        p44VdcHost->vdcApiServer->setOutputCoalescing(true, apiCoalesceUs*MicroSecond);
+      }
 
 
       // Create Web configuration JSON API server
@@ -474,7 +497,10 @@ public:
       p44VdcHost->setActivityMonitor(boost::bind(&P44Vdcd::activitySignal, this));
     }
     // app now ready to run
-    return run();
+    int exitCode = run();
+    // make sure all parameters are on disk before exiting
+    if (p44VdcHost) p44VdcHost->flushParams();
+    return exitCode;
   }
 
 
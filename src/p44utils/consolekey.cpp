@@ -138,17 +138,21 @@ ConsoleKeyManager *ConsoleKeyManager::sharedKeyManager()
 }
 
 
+#define STDIN 0
+
 ConsoleKeyManager::ConsoleKeyManager() :
   termInitialized(false)
 {
-  // install polling
-  MainLoop::currentMainLoop().registerIdleHandler(this, boost::bind(&ConsoleKeyManager::consoleKeyPoll, this));
+  // make sure terminal is not line buffered any more, so key presses are signalled immediately
+  kbHit();
+  // get notified of console input
+  MainLoop::currentMainLoop().registerPollHandler(STDIN, POLLIN, boost::bind(&ConsoleKeyManager::consoleKeyPoll, this, _3));
 }
 
 
 ConsoleKeyManager::~ConsoleKeyManager()
 {
-  MainLoop::currentMainLoop().unregisterIdleHandlers(this);
+  MainLoop::currentMainLoop().unregisterPollHandler(STDIN);
 }
 
 
@@ -174,8 +178,6 @@ void ConsoleKeyManager::setKeyPressHandler(ConsoleKeyPressCB aHandler)
 
 int ConsoleKeyManager::kbHit()
 {
-  static const int STDIN = 0;
-
   if (!termInitialized) {
     // Use termios to turn off line buffering
     termios term;
@@ -186,15 +188,20 @@ int ConsoleKeyManager::kbHit()
     termInitialized = true;
   }
   // return number of bytes waiting
-  int bytesWaiting;
+  int bytesWaiting = 0;
   ioctl(STDIN, FIONREAD, &bytesWaiting);
   return bytesWaiting;
 }
 
 
 
-bool ConsoleKeyManager::consoleKeyPoll()
+bool ConsoleKeyManager::consoleKeyPoll(int aPollFlags)
 {
+  if (kbHit()<=0) {
+    // signalled but no data means end of file (e.g. stdin is /dev/null) or error - stop monitoring
+    MainLoop::currentMainLoop().unregisterPollHandler(STDIN);
+    return false;
+  }
   // process all pending console input
   while (kbHit()>0) {
     char  c = getchar();
@@ -227,7 +234,7 @@ bool ConsoleKeyManager::consoleKeyPoll()
       }
     }
   }
-  return true; // done for this cycle
+  return true; // handled input
 }
 
 
@@ -118,7 +118,7 @@ namespace p44 {
 
   private:
     int kbHit();
-    bool consoleKeyPoll();
+    bool consoleKeyPoll(int aPollFlags);
 
   };
 
@@ -141,6 +141,19 @@ void DigitalIo::set(bool aState)
 }
 
 
+bool DigitalIo::setInputChangedHandler(InputChangedCB aInputChangedCB)
+{
+  if (!aInputChangedCB) return ioPin->setInputChangedHandler(NULL);
+  return ioPin->setInputChangedHandler(boost::bind(&DigitalIo::inputChanged, this, aInputChangedCB, _1));
+}
+
+
+void DigitalIo::inputChanged(InputChangedCB aInputChangedCB, bool aNewPinState)
+{
+  aInputChangedCB(aNewPinState!=inverted);
+}
+
+
 void DigitalIo::on()
 {
   set(true);
@@ -170,7 +183,9 @@ bool DigitalIo::toggle()
 ButtonInput::ButtonInput(const char* aName, bool aInverted) :
   DigitalIo(aName, false, aInverted, false),
   repeatActiveReport(Never),
-  lastActiveReport(Never)
+  lastActiveReport(Never),
+  changeReporting(false),
+  checkTicket(0)
 {
   // save params
   lastState = false; // assume inactive to start with
@@ -180,6 +195,17 @@ ButtonInput::ButtonInput(const char* aName, bool aInverted) :
 
 ButtonInput::~ButtonInput()
 {
+  stopMonitoring();
+}
+
+
+void ButtonInput::stopMonitoring()
+{
+  if (changeReporting) {
+    setInputChangedHandler(NULL);
+    changeReporting = false;
+  }
+  MainLoop::currentMainLoop().cancelExecutionTicket(checkTicket);
   MainLoop::currentMainLoop().unregisterIdleHandlers(this);
 }
 
@@ -189,12 +215,20 @@ void ButtonInput::setButtonHandler(ButtonHandlerCB aButtonHandler, bool aPressAn
   reportPressAndRelease = aPressAndRelease;
   repeatActiveReport = aRepeatActiveReport;
   buttonHandler = aButtonHandler;
+  stopMonitoring();
   if (buttonHandler) {
-    MainLoop::currentMainLoop().registerIdleHandler(this, boost::bind(&ButtonInput::poll, this, _1));
-  }
-  else {
-    // unregister
-    MainLoop::currentMainLoop().unregisterIdleHandlers(this);
+    if (setInputChangedHandler(boost::bind(&ButtonInput::inputChanged, this, _1))) {
+      // pin reports changes (edge interrupt or console key), no polling needed
+      changeReporting = true;
+      checkTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&ButtonInput::checkTimer, this)); // initial check
+    }
+    else {
+      // fallback: poll once per mainloop cycle
+      if (MainLoop::currentMainLoop().isTickless()) {
+        LOG(LOG_WARNING,"ButtonInput %s cannot report changes, will only be checked when mainloop wakes up for other reasons in tickless mode\n", getName().c_str());
+      }
+      MainLoop::currentMainLoop().registerIdleHandler(this, boost::bind(&ButtonInput::poll, this, _1));
+    }
   }
 }
 
@@ -202,6 +236,19 @@ void ButtonInput::setButtonHandler(ButtonHandlerCB aButtonHandler, bool aPressAn
 #define DEBOUNCE_TIME 1000 // 1mS
 
 bool ButtonInput::poll(MLMicroSeconds aTimestamp)
+{
+  checkInput(aTimestamp);
+  return true;
+}
+
+
+void ButtonInput::inputChanged(bool aNewState)
+{
+  checkInput(MainLoop::now());
+}
+
+
+void ButtonInput::checkInput(MLMicroSeconds aTimestamp)
 {
   bool newState = isSet();
   if (newState!=lastState && aTimestamp-lastChangeTime>DEBOUNCE_TIME) {
@@ -224,7 +271,27 @@ bool ButtonInput::poll(MLMicroSeconds aTimestamp)
       buttonHandler(true, false, aTimestamp-lastChangeTime);
     }
   }
-  return true;
+  if (changeReporting) {
+    // no polling: schedule timer for debounce re-check or next repeated active report, if any
+    MainLoop::currentMainLoop().cancelExecutionTicket(checkTicket);
+    MLMicroSeconds checkAt = Never;
+    if (newState!=lastState) {
+      checkAt = lastChangeTime+DEBOUNCE_TIME+1; // change still within debounce time, re-check afterwards
+    }
+    else if (newState && repeatActiveReport!=Never) {
+      checkAt = lastActiveReport+repeatActiveReport;
+    }
+    if (checkAt!=Never) {
+      checkTicket = MainLoop::currentMainLoop().executeOnceAt(boost::bind(&ButtonInput::checkTimer, this), checkAt);
+    }
+  }
+}
+
+
+void ButtonInput::checkTimer()
+{
+  checkTicket = 0; // has fired
+  checkInput(MainLoop::now());
 }
 
 
@@ -235,15 +302,16 @@ IndicatorOutput::IndicatorOutput(const char* aName, bool aInverted, bool aInitia
   DigitalIo(aName, true, aInverted, aInitiallyOn),
   switchOffAt(Never),
   blinkOnTime(Never),
-  blinkOffTime(Never)
+  blinkOffTime(Never),
+  blinkToggleAt(Never),
+  timerTicket(0)
 {
-  MainLoop::currentMainLoop().registerIdleHandler(this, boost::bind(&IndicatorOutput::timer, this, _1));
 }
 
 
 IndicatorOutput::~IndicatorOutput()
 {
-  MainLoop::currentMainLoop().unregisterIdleHandlers(this);
+  MainLoop::currentMainLoop().cancelExecutionTicket(timerTicket);
 }
 
 
@@ -256,6 +324,7 @@ void IndicatorOutput::onFor(MLMicroSeconds aOnTime)
     switchOffAt = MainLoop::now()+aOnTime;
   else
     switchOffAt = Never;
+  scheduleTimer();
 }
 
 
@@ -265,6 +334,7 @@ void IndicatorOutput::blinkFor(MLMicroSeconds aOnTime, MLMicroSeconds aBlinkPeri
   blinkOnTime =  (aBlinkPeriod*aOnRatioPercent*10)/1000;
   blinkOffTime = aBlinkPeriod - blinkOnTime;
   blinkToggleAt = MainLoop::now()+blinkOnTime;
+  scheduleTimer();
 }
 
 
@@ -273,6 +343,7 @@ void IndicatorOutput::stop()
   blinkOnTime = Never;
   blinkOffTime = Never;
   switchOffAt = Never;
+  MainLoop::currentMainLoop().cancelExecutionTicket(timerTicket);
 }
 
 
@@ -293,8 +364,24 @@ void IndicatorOutput::steadyOn()
 
 
 
-bool IndicatorOutput::timer(MLMicroSeconds aTimestamp)
+void IndicatorOutput::scheduleTimer()
 {
+  // timer is needed for the earlier of switching off and next blink toggle
+  MLMicroSeconds nextTime = switchOffAt;
+  if (blinkOnTime!=Never && (nextTime==Never || blinkToggleAt<nextTime)) {
+    nextTime = blinkToggleAt;
+  }
+  MainLoop::currentMainLoop().cancelExecutionTicket(timerTicket);
+  if (nextTime!=Never) {
+    timerTicket = MainLoop::currentMainLoop().executeOnceAt(boost::bind(&IndicatorOutput::timer, this, _1), nextTime);
+  }
+}
+
+
+void IndicatorOutput::timer(MLMicroSeconds aTimestamp)
+{
+  timerTicket = 0; // this timer has fired
+  aTimestamp = MainLoop::now(); // actual time, cycle start time might be earlier
   // check off time first
   if (switchOffAt!=Never && aTimestamp>=switchOffAt) {
     stop();
@@ -311,6 +398,6 @@ bool IndicatorOutput::timer(MLMicroSeconds aTimestamp)
         blinkToggleAt = aTimestamp + blinkOffTime;
       }
     }
+    scheduleTimer();
   }
-  return true;
 }
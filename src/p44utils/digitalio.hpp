@@ -79,6 +79,15 @@ namespace p44 {
     /// toggle state of output and return new state
     /// @return new state of output after toggling (for inputs, just returns state like isSet() does)
     bool toggle();
+
+    /// install handler to be called when input state changes
+    /// @param aInputChangedCB handler to be called with the new (logic) state, NULL to remove handler
+    /// @return false if the pin cannot report changes by itself (and must be polled instead)
+    bool setInputChangedHandler(InputChangedCB aInputChangedCB);
+
+  private:
+
+    void inputChanged(InputChangedCB aInputChangedCB, bool aNewPinState);
   };
 	typedef boost::intrusive_ptr<DigitalIo> DigitalIoPtr;
 	
@@ -103,8 +112,14 @@ namespace p44 {
     ButtonHandlerCB buttonHandler;
     MLMicroSeconds repeatActiveReport;
     MLMicroSeconds lastActiveReport;
+    bool changeReporting; ///< set if the pin reports changes by itself, so no polling is needed
+    long checkTicket; ///< timer for debounce re-check and active state repeat in changeReporting mode
 
     bool poll(MLMicroSeconds aTimestamp);
+    void inputChanged(bool aNewState);
+    void checkInput(MLMicroSeconds aTimestamp);
+    void checkTimer();
+    void stopMonitoring();
     
   public:
     /// Create pushbutton
@@ -137,8 +152,10 @@ namespace p44 {
     MLMicroSeconds blinkOnTime;
     MLMicroSeconds blinkOffTime;
     MLMicroSeconds blinkToggleAt;
+    long timerTicket;
 
-    bool timer(MLMicroSeconds aTimestamp);
+    void scheduleTimer();
+    void timer(MLMicroSeconds aTimestamp);
 
   public:
     /// Create indicator output
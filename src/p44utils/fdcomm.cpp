@@ -34,6 +34,19 @@
 using namespace p44;
 
 FdComm::FdComm(MainLoop &aMainLoop) :
+  rxBuffer(NULL),
+  rxBufferSize(0),
+  rxStart(0),
+  rxEnd(0),
+  txOffset(0),
+  txQueuedBytes(0),
+  txQueuedBytesPeak(0),
+  txCoalesce(false),
+  txCoalesceWindow(0),
+  txCoalesceTicket(0),
+  txBuffersQueued(0),
+  txCalls(0),
+  txDrainedTicket(0),
   dataFd(-1),
   mainLoop(aMainLoop)
 {
@@ -44,6 +57,21 @@ FdComm::~FdComm()
 {
   // unregister handlers
   setFd(-1);
+  mainLoop.cancelExecutionTicket(txCoalesceTicket);
+  mainLoop.cancelExecutionTicket(txDrainedTicket);
+  if (rxBuffer) {
+    free(rxBuffer);
+    rxBuffer = NULL;
+  }
+  // free transmit buffers
+  while (!txQueue.empty()) {
+    free(txQueue.front().data);
+    txQueue.pop_front();
+  }
+  for (TxBufferPool::iterator pos = txPool.begin(); pos!=txPool.end(); ++pos) {
+    free(pos->data);
+  }
+  txPool.clear();
 }
 
 
@@ -54,6 +82,17 @@ void FdComm::setFd(int aFd)
       // unregister previous fd
       mainLoop.unregisterPollHandler(dataFd);
       dataFd = -1;
+      // buffered data from previous fd is meaningless now
+      // Note: data queued while no fd was set (e.g. sent from the connection status handler) is kept for the new fd
+      rxStart = 0;
+      rxEnd = 0;
+      while (!txQueue.empty()) {
+        releaseTransmitBuffer(txQueue.front());
+        txQueue.pop_front();
+      }
+      txOffset = 0;
+      txQueuedBytes = 0;
+      mainLoop.cancelExecutionTicket(txCoalesceTicket);
     }
     dataFd = aFd;
     if (dataFd>=0) {
@@ -149,9 +188,10 @@ void FdComm::setTransmitHandler(FdCommCB aTransmitHandler)
 {
   if (transmitHandler.empty()!=aTransmitHandler.empty()) {
     transmitHandler = aTransmitHandler;
-    if (dataFd>=0) {
+    if (dataFd>=0 && !txCoalesceTicket) {
       // If connected already, update poll flags to include ready-for-transmit
       // (otherwise, flags will be set when connection opens)
+      // Note: while collecting data for coalesced sending, POLLOUT is enabled only afterwards
       if (transmitHandler.empty())
         mainLoop.changePollFlags(dataFd, 0, POLLOUT); // clear POLLOUT
       else
@@ -178,6 +218,188 @@ size_t FdComm::transmitBytes(size_t aNumBytes, const uint8_t *aBytes, ErrorPtr &
 }
 
 
+size_t FdComm::transmitVector(const struct iovec *aIov, int aIovCnt, ErrorPtr &aError)
+{
+  // if not connected now, we can't write
+  if (dataFd<0) {
+    // waiting for connection to open
+    return 0; // cannot transmit data yet
+  }
+  // connection is open, write now
+  ssize_t res = writev(dataFd, aIov, aIovCnt);
+  if (res<0) {
+    if (errno==EWOULDBLOCK)
+      return 0; // nothing transmitted
+    aError = SysError::errNo("FdComm::transmitVector: ");
+    return 0; // nothing transmitted
+  }
+  return res;
+}
+
+
+FdTransmitBuffer FdComm::newTransmitBuffer(size_t aMinSize)
+{
+  FdTransmitBuffer buf;
+  // try to reuse a pooled buffer
+  for (TxBufferPool::iterator pos = txPool.begin(); pos!=txPool.end(); ++pos) {
+    if (pos->capacity>=aMinSize) {
+      buf = *pos;
+      txPool.erase(pos);
+      buf.size = aMinSize;
+      return buf;
+    }
+  }
+  // none suitable, allocate new one
+  buf.capacity = aMinSize<FDCOMM_MIN_TXBUFFER_SIZE ? FDCOMM_MIN_TXBUFFER_SIZE : aMinSize;
+  buf.data = (uint8_t *)malloc(buf.capacity);
+  buf.size = aMinSize;
+  return buf;
+}
+
+
+void FdComm::releaseTransmitBuffer(FdTransmitBuffer &aBuffer)
+{
+  if (!aBuffer.data) return;
+  if (txPool.size()<FDCOMM_TXBUFFER_POOL_SIZE && aBuffer.capacity<=FDCOMM_TXBUFFER_POOL_MAX_BUFFER) {
+    // keep for reuse
+    txPool.push_back(aBuffer);
+  }
+  else {
+    free(aBuffer.data);
+  }
+  aBuffer.data = NULL;
+  aBuffer.capacity = 0;
+  aBuffer.size = 0;
+}
+
+
+ErrorPtr FdComm::queueTransmitBuffer(FdTransmitBuffer &aBuffer)
+{
+  if (!aBuffer.data) {
+    return SysError::err(ENOMEM, "FdComm::queueTransmitBuffer: ");
+  }
+  if (aBuffer.size==0) {
+    // nothing to send
+    releaseTransmitBuffer(aBuffer);
+    return ErrorPtr();
+  }
+  bool wasEmpty = txQueue.empty();
+  txQueue.push_back(aBuffer);
+  txQueuedBytes += aBuffer.size;
+  if (txQueuedBytes>txQueuedBytesPeak) txQueuedBytesPeak = txQueuedBytes;
+  txBuffersQueued++;
+  // queue owns the buffer now
+  aBuffer.data = NULL;
+  aBuffer.capacity = 0;
+  aBuffer.size = 0;
+  if (wasEmpty) {
+    if (txCoalesce) {
+      // start collecting, send later
+      if (!txCoalesceTicket) {
+        if (transmitHandler && dataFd>=0) mainLoop.changePollFlags(dataFd, 0, POLLOUT); // no POLLOUT while collecting
+        txCoalesceTicket = mainLoop.executeOnce(boost::bind(&FdComm::endTransmitCoalescing, this), txCoalesceWindow);
+      }
+      return ErrorPtr();
+    }
+    // nothing was waiting, try to send right now
+    return flushTransmitQueue();
+  }
+  return ErrorPtr();
+}
+
+
+void FdComm::setTransmitCoalescing(bool aCoalesce, MLMicroSeconds aWindow)
+{
+  txCoalesce = aCoalesce;
+  txCoalesceWindow = aWindow;
+  if (!txCoalesce && txCoalesceTicket) {
+    // send what we have collected so far now
+    mainLoop.cancelExecutionTicket(txCoalesceTicket);
+    txCoalesceTicket = mainLoop.executeOnce(boost::bind(&FdComm::endTransmitCoalescing, this));
+  }
+}
+
+
+void FdComm::endTransmitCoalescing()
+{
+  FdCommPtr keepMeAlive(this); // make sure this object lives until routine terminates
+  txCoalesceTicket = 0;
+  if (transmitHandler) {
+    // let the owner of the queue send the data (and handle completion)
+    transmitHandler(ErrorPtr());
+    if (transmitHandler && dataFd>=0) {
+      // more to send, continue when fd is ready to accept data
+      mainLoop.changePollFlags(dataFd, POLLOUT, 0);
+    }
+  }
+  else {
+    flushTransmitQueue();
+  }
+}
+
+
+ErrorPtr FdComm::queueTransmitBytes(size_t aNumBytes, const uint8_t *aBytes)
+{
+  FdTransmitBuffer buf = newTransmitBuffer(aNumBytes);
+  if (buf.data) memcpy(buf.data, aBytes, aNumBytes);
+  return queueTransmitBuffer(buf);
+}
+
+
+ErrorPtr FdComm::flushTransmitQueue()
+{
+  ErrorPtr err;
+  if (txCoalesceTicket) return err; // still collecting data
+  bool hadData = !txQueue.empty();
+  bool hold = txQueue.size()>FDCOMM_MAX_IOVECS;
+  if (hold) holdTransmit(true); // multiple write calls needed, avoid sending partial segments
+  while (!txQueue.empty()) {
+    // collect as many buffers as possible into one writev() call
+    struct iovec iov[FDCOMM_MAX_IOVECS];
+    int iovCnt = 0;
+    size_t offs = txOffset;
+    for (TxBufferQueue::iterator pos = txQueue.begin(); pos!=txQueue.end() && iovCnt<FDCOMM_MAX_IOVECS; ++pos) {
+      iov[iovCnt].iov_base = pos->data+offs;
+      iov[iovCnt].iov_len = pos->size-offs;
+      iovCnt++;
+      offs = 0; // only first buffer can be partially sent
+    }
+    size_t sentBytes = transmitVector(iov, iovCnt, err);
+    txCalls++;
+    if (!Error::isOK(err) || sentBytes==0) break; // error or cannot send more now
+    txQueuedBytes -= sentBytes;
+    // recycle fully sent buffers, advance offset in partially sent one
+    while (sentBytes>0) {
+      FdTransmitBuffer &front = txQueue.front();
+      size_t rem = front.size-txOffset;
+      if (sentBytes<rem) {
+        txOffset += sentBytes;
+        break;
+      }
+      sentBytes -= rem;
+      txOffset = 0;
+      releaseTransmitBuffer(front);
+      txQueue.pop_front();
+    }
+    if (txOffset>0) break; // partially sent, fd is full now
+  }
+  if (hold) holdTransmit(false);
+  if (hadData && txQueue.empty() && txDrainedHandler && !txDrainedTicket) {
+    // all sent, let the owner know (but not from here, as it will likely queue more data)
+    txDrainedTicket = mainLoop.executeOnce(boost::bind(&FdComm::transmitQueueDrained, this));
+  }
+  return err;
+}
+
+
+void FdComm::transmitQueueDrained()
+{
+  FdCommPtr keepMeAlive(this); // make sure this object lives until routine terminates
+  txDrainedTicket = 0;
+  if (txDrainedHandler) txDrainedHandler();
+}
+
+
 bool FdComm::transmitString(string &aString)
 {
   ErrorPtr err;
@@ -229,6 +451,57 @@ ErrorPtr FdComm::receiveAndAppendToString(string &aString, ssize_t aMaxBytes)
 }
 
 
+ErrorPtr FdComm::receiveIntoBuffer()
+{
+  ErrorPtr err;
+  size_t ready = numBytesReady();
+  if (ready==0) ready = 1; // still try to read, to get EOF or error condition
+  if (rxStart==rxEnd) {
+    // buffer is empty, restart at beginning (no copying needed)
+    rxStart = 0;
+    rxEnd = 0;
+  }
+  if (rxBufferSize-rxEnd<ready) {
+    // not enough room at the end
+    if (rxStart>0) {
+      // move unconsumed data to beginning of buffer
+      memmove(rxBuffer, rxBuffer+rxStart, rxEnd-rxStart);
+      rxEnd -= rxStart;
+      rxStart = 0;
+    }
+    if (rxBufferSize-rxEnd<ready) {
+      // still not enough room, grow buffer
+      size_t newSize = rxBufferSize>0 ? 2*rxBufferSize : FDCOMM_INITIAL_RXBUFFER_SIZE;
+      if (newSize<rxEnd+ready) newSize = rxEnd+ready;
+      uint8_t *newBuffer = (uint8_t *)realloc(rxBuffer, newSize);
+      if (!newBuffer) {
+        return SysError::err(ENOMEM, "FdComm::receiveIntoBuffer: ");
+      }
+      rxBuffer = newBuffer;
+      rxBufferSize = newSize;
+    }
+  }
+  // read as much as fits into the buffer
+  size_t b = receiveBytes(rxBufferSize-rxEnd, rxBuffer+rxEnd, err);
+  if (Error::isOK(err)) {
+    rxEnd += b;
+  }
+  return err;
+}
+
+
+void FdComm::consumeReceiveBuffer(size_t aNumBytes)
+{
+  if (aNumBytes>rxEnd-rxStart) aNumBytes = rxEnd-rxStart;
+  rxStart += aNumBytes;
+  if (rxStart==rxEnd) {
+    // all consumed
+    rxStart = 0;
+    rxEnd = 0;
+  }
+}
+
+
 ErrorPtr FdComm::receiveString(string &aString, ssize_t aMaxBytes)
 {
   aString.erase();
@@ -35,11 +35,25 @@
 #include <unistd.h>
 #include <sys/select.h>
 #include <sys/param.h>
+#include <sys/uio.h>
 #include <errno.h>
 
+#include <deque>
+
 
 using namespace std;
 
+// initial size of the FdComm receive buffer (grows when needed)
+#define FDCOMM_INITIAL_RXBUFFER_SIZE 4096
+// minimal size of a transmit buffer (buffers are reused, so allocating a bit more increases the chance of reuse)
+#define FDCOMM_MIN_TXBUFFER_SIZE 1024
+// max number of unused transmit buffers kept for reuse
+#define FDCOMM_TXBUFFER_POOL_SIZE 8
+// transmit buffers larger than this are not kept for reuse
+#define FDCOMM_TXBUFFER_POOL_MAX_BUFFER (64*1024)
+// max number of buffers passed to a single writev() call
+#define FDCOMM_MAX_IOVECS 64
+
 namespace p44 {
 
 
@@ -52,12 +66,40 @@ namespace p44 {
   typedef boost::function<void (ErrorPtr aError)> FdCommCB;
 
 
+  /// buffer for queued transmitting
+  typedef struct {
+    uint8_t *data; ///< the buffer
+    size_t capacity; ///< allocated size of the buffer
+    size_t size; ///< number of bytes to be sent
+  } FdTransmitBuffer;
+
+
   /// wrapper for non-blocking I/O on a file descriptor
   class FdComm : public P44Obj
   {
     FdCommCB receiveHandler;
     FdCommCB transmitHandler;
 
+    uint8_t *rxBuffer; ///< receive buffer, allocated on first use and reused for the lifetime of the object
+    size_t rxBufferSize; ///< allocated size of rxBuffer
+    size_t rxStart; ///< index of first unconsumed byte in rxBuffer
+    size_t rxEnd; ///< index of first free byte in rxBuffer
+
+    typedef std::deque<FdTransmitBuffer> TxBufferQueue;
+    TxBufferQueue txQueue; ///< buffers queued for sending
+    size_t txOffset; ///< number of bytes of the first buffer in txQueue already sent
+    size_t txQueuedBytes; ///< total number of bytes queued and not yet sent
+    size_t txQueuedBytesPeak; ///< highest value txQueuedBytes ever had
+    typedef std::vector<FdTransmitBuffer> TxBufferPool;
+    TxBufferPool txPool; ///< unused buffers available for reuse
+    bool txCoalesce; ///< if set, queued data is not sent immediately, but collected for txCoalesceWindow
+    MLMicroSeconds txCoalesceWindow; ///< time window for collecting data before sending, 0=until end of current mainloop cycle
+    long txCoalesceTicket; ///< timer for sending collected data
+    size_t txBuffersQueued; ///< statistics: number of buffers queued for sending
+    size_t txCalls; ///< statistics: number of transmit system calls for queued data
+    SimpleCB txDrainedHandler; ///< called when all queued data has been sent
+    long txDrainedTicket; ///< pending call of txDrainedHandler
+
   protected:
 
     int dataFd;
@@ -89,6 +131,74 @@ namespace p44 {
     virtual size_t transmitBytes(size_t aNumBytes, const uint8_t *aBytes, ErrorPtr &aError);
 
 
+    /// write data from multiple buffers (non-blocking)
+    /// @param aIov array of buffers
+    /// @param aIovCnt number of buffers in aIov
+    /// @param aError reference to ErrorPtr. Will be left untouched if no error occurs
+    /// @return number ob bytes actually written, can be 0 (e.g. if connection is still in process of opening)
+    virtual size_t transmitVector(const struct iovec *aIov, int aIovCnt, ErrorPtr &aError);
+
+
+    /// @name queued transmitting
+    /// @note the transmit queue holds owned buffers (no copying of unsent data), which are flushed using writev().
+    ///   Buffers are recycled after sending, so steady traffic does not cause heap allocations.
+    /// @{
+
+    /// get a buffer for queued transmitting
+    /// @param aMinSize number of bytes the buffer must be able to hold
+    /// @return buffer (possibly reused) with capacity>=aMinSize, and size set to aMinSize.
+    ///   Must be passed to queueTransmitBuffer() or releaseTransmitBuffer().
+    FdTransmitBuffer newTransmitBuffer(size_t aMinSize);
+
+    /// return a buffer to the pool without sending it
+    /// @param aBuffer buffer obtained from newTransmitBuffer()
+    void releaseTransmitBuffer(FdTransmitBuffer &aBuffer);
+
+    /// queue buffer for transmission, and try to send immediately if nothing else is queued
+    /// @param aBuffer buffer obtained from newTransmitBuffer(), with size set to the number of bytes to be sent.
+    ///   Ownership passes to the transmit queue.
+    /// @return error, if any
+    /// @note caller must enable a transmit handler calling flushTransmitQueue() when transmitQueueBytes()>0 after this call
+    ErrorPtr queueTransmitBuffer(FdTransmitBuffer &aBuffer);
+
+    /// queue bytes for transmission (copies them into a pooled buffer)
+    /// @param aNumBytes number of bytes to send
+    /// @param aBytes bytes to send
+    /// @return error, if any
+    ErrorPtr queueTransmitBytes(size_t aNumBytes, const uint8_t *aBytes);
+
+    /// send as much as possible of the transmit queue
+    /// @return error, if any
+    ErrorPtr flushTransmitQueue();
+
+    /// @return number of bytes queued and not yet sent
+    size_t transmitQueueBytes() { return txQueuedBytes; };
+
+    /// @return highest number of bytes ever queued at the same time
+    size_t transmitQueuePeakBytes() { return txQueuedBytesPeak; };
+
+    /// @return number of buffers queued for transmission so far
+    size_t transmitQueueBuffersQueued() { return txBuffersQueued; };
+
+    /// @return number of write calls made to send queued buffers so far
+    size_t transmitQueueWriteCalls() { return txCalls; };
+
+    /// enable or disable coalescing of queued data
+    /// @param aCoalesce if set, data queued with queueTransmitBuffer() is not sent immediately, but collected
+    ///   and then sent with as few write calls as possible
+    /// @param aWindow how long to collect data after the first buffer was queued. 0 means collecting until
+    ///   the end of the current mainloop cycle
+    /// @note while data is being collected, the transmit handler is not called
+    void setTransmitCoalescing(bool aCoalesce, MLMicroSeconds aWindow = 0);
+
+    /// install callback for transmit queue being drained
+    /// @param aDrainedHandler will be called (from the mainloop, not from within flushTransmitQueue()) when
+    ///   all queued data has been sent. Allows higher level code to hold back data while the connection is busy.
+    void setTransmitQueueDrainedHandler(SimpleCB aDrainedHandler) { txDrainedHandler = aDrainedHandler; };
+
+    /// @}
+
+
     /// transmit string
     /// @param aString string to transmit
     /// @return true if string could be sent in one single attempt, false if not (truncated, not ready, error)
@@ -112,6 +222,28 @@ namespace p44 {
     /// read data and append to string
     ErrorPtr receiveAndAppendToString(string &aString, ssize_t aMaxBytes = -1);
 
+    /// @name buffered receiving
+    /// @note the receive buffer allows framers to parse messages in place, without any per-message heap allocation.
+    ///   Unconsumed data is only moved when there is not enough room left at the end of the buffer.
+    /// @{
+
+    /// read all data ready into the receive buffer
+    /// @return error, if any
+    ErrorPtr receiveIntoBuffer();
+
+    /// @return pointer to first unconsumed byte in the receive buffer
+    /// @note the pointer is valid until the next call to receiveIntoBuffer()
+    uint8_t *receiveBufferData() { return rxBuffer+rxStart; };
+
+    /// @return number of unconsumed bytes in the receive buffer
+    size_t receiveBufferBytes() { return rxEnd-rxStart; };
+
+    /// consume bytes from the receive buffer
+    /// @param aNumBytes number of bytes to remove from the beginning of the buffered data
+    void consumeReceiveBuffer(size_t aNumBytes);
+
+    /// @}
+
     /// install callback for data becoming ready to read
     /// @param aCallBack will be called when data is ready for reading (receiveBytes()) or an asynchronous error occurs on the file descriptor
     void setReceiveHandler(FdCommCB aReceiveHandler);
@@ -130,9 +262,16 @@ namespace p44 {
     /// an exception (HUP or error) occurs on the file descriptor
     virtual void dataExceptionHandler(int aFd, int aPollFlags);
 
+    /// this is intended to be overridden in subclasses, and is called around sending a burst of queued data
+    /// which needs more than one write call
+    /// @param aHold if set, partial data should be held back (e.g. TCP_CORK) until called again with aHold==false
+    virtual void holdTransmit(bool aHold) { /* NOP in base class */ };
+
   private:
 
     bool dataMonitorHandler(MLMicroSeconds aCycleStartTime, int aFd, int aPollFlags);
+    void endTransmitCoalescing();
+    void transmitQueueDrained();
   };
 
 
@@ -130,6 +130,9 @@ GpioPin::GpioPin(int aGpioNo, bool aOutput, bool aInitialState) :
 GpioPin::~GpioPin()
 {
   if (gpioFD>0) {
+    if (inputChangedCB) {
+      MainLoop::currentMainLoop().unregisterPollHandler(gpioFD);
+    }
     close(gpioFD);
   }
 }
@@ -170,6 +173,54 @@ void GpioPin::setState(bool aState)
 }
 
 
+bool GpioPin::setInputChangedHandler(InputChangedCB aInputChangedCB)
+{
+  if (output || gpioFD<0) return !aInputChangedCB; // outputs and non-working pins do not report changes
+  if (!aInputChangedCB) {
+    // remove handler
+    if (inputChangedCB) {
+      MainLoop::currentMainLoop().unregisterPollHandler(gpioFD);
+      setEdge("none");
+      inputChangedCB = NULL;
+    }
+    return true;
+  }
+  // have the kernel generate interrupts on both edges
+  if (!setEdge("both")) {
+    return false; // GPIO does not support interrupts, must be polled
+  }
+  inputChangedCB = aInputChangedCB;
+  // read the value once to clear the pending state, then wait for POLLPRI
+  getState();
+  MainLoop::currentMainLoop().registerPollHandler(gpioFD, POLLPRI, boost::bind(&GpioPin::edgeDetected, this, _3));
+  return true;
+}
+
+
+bool GpioPin::setEdge(const char *aEdge)
+{
+  string name = string_format("%s/gpio%d/edge", GPIO_SYS_CLASS_PATH, gpioNo);
+  int tempFd = open(name.c_str(), O_WRONLY);
+  if (tempFd<0) {
+    DBGLOG(LOG_DEBUG,"GPIO %d has no edge file (%s), cannot report changes\n", gpioNo, strerror(errno));
+    return false;
+  }
+  bool ok = write(tempFd, aEdge, strlen(aEdge))>=0;
+  close(tempFd);
+  return ok;
+}
+
+
+bool GpioPin::edgeDetected(int aPollFlags)
+{
+  if ((aPollFlags & POLLPRI)==0) return false;
+  // reading the value also acknowledges the edge
+  bool newState = getState();
+  if (inputChangedCB) inputChangedCB(newState);
+  return true;
+}
+
+
 //  Sysfs Interface for Userspace (OPTIONAL)
 //  ========================================
 //  Platforms which use the "gpiolib" implementors framework may choose to
@@ -69,6 +69,7 @@ namespace p44 {
     bool output;
     int gpioNo;
     int gpioFD;
+    InputChangedCB inputChangedCB;
   public:
 
     /// Create general purpose I/O pin
@@ -85,7 +86,17 @@ namespace p44 {
     /// set state of output (NOP for inputs)
     /// @param aState new state to set output to
     virtual void setState(bool aState);
-    
+
+    /// install handler to be called when input state changes
+    /// @param aInputChangedCB handler to be called when the input changes state, NULL to remove handler
+    /// @return false if the GPIO cannot generate interrupts (no "edge" support in sysfs)
+    virtual bool setInputChangedHandler(InputChangedCB aInputChangedCB);
+
+  private:
+
+    bool setEdge(const char *aEdge);
+    bool edgeDetected(int aPollFlags);
+
   };
 
 
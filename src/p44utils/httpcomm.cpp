@@ -21,13 +21,537 @@
 
 #include "httpcomm.hpp"
 
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // not available on all platforms
+#endif
+
+// defaults for the shared persistent connection pool
+#define HTTPCLIENT_DEFAULT_MAX_CONNECTIONS_PER_HOST 2
+#define HTTPCLIENT_DEFAULT_MAX_PIPELINE_DEPTH 4
+#define HTTPCLIENT_DEFAULT_IDLE_TIMEOUT (15*Second)
+#define HTTPCLIENT_DEFAULT_RESPONSE_TIMEOUT (30*Second)
+
 
 using namespace p44;
 
+
+#pragma mark - HttpClientRequest
+
+
+HttpClientRequest::HttpClientRequest(const string &aHost, uint16_t aPort, const string &aMethod, const string &aDoc, const char *aContentType, const string &aBody) :
+  host(aHost),
+  port(string_format("%d", aPort)),
+  responseStarted(false),
+  retried(false),
+  statusCode(0)
+{
+  // Note: non-idempotent requests (POST) are never pipelined nor repeated
+  idempotent = aMethod=="GET" || aMethod=="HEAD" || aMethod=="PUT" || aMethod=="DELETE" || aMethod=="OPTIONS";
+  expectsBody = aMethod!="HEAD";
+  requestText = string_format(
+    "%s %s HTTP/1.1\r\n"
+    "Host: %s\r\n",
+    aMethod.c_str(),
+    aDoc.empty() ? "/" : aDoc.c_str(),
+    aPort==80 ? aHost.c_str() : hostKey().c_str()
+  );
+  if (aBody.length()>0) {
+    string_format_append(requestText,
+      "Content-Type: %s; charset=UTF-8\r\n"
+      "Content-Length: %ld\r\n",
+      nonNullCStr(aContentType),
+      (long)aBody.length()
+    );
+  }
+  requestText.append("\r\n");
+  requestText.append(aBody);
+}
+
+
+#pragma mark - HttpClientConnection
+
+
+HttpClientConnection::HttpClientConnection(MainLoop &aMainLoop, HttpClientPool &aPool, const string &aHost, const string &aPort) :
+  inherited(aMainLoop),
+  pool(aPool),
+  responseState(awaitingHeaders),
+  bodyRemaining(0),
+  closeAfterResponse(false),
+  ended(false),
+  completedResponses(0),
+  timeoutTicket(0)
+{
+  setConnectionParams(aHost.c_str(), aPort.c_str(), SOCK_STREAM);
+  // requests are sent in one piece, don't let Nagle hold back pipelined requests
+  setTcpNoDelay(true);
+  setReceiveHandler(boost::bind(&HttpClientConnection::gotData, this, _1));
+}
+
+
+HttpClientConnection::~HttpClientConnection()
+{
+  mainLoop.cancelExecutionTicket(timeoutTicket);
+}
+
+
+bool HttpClientConnection::canAccept(HttpClientRequestPtr aRequest, int aMaxPipelineDepth)
+{
+  if (ended || closeAfterResponse) return false; // connection is going away
+  if (requests.empty()) return true; // unused connection
+  if (!aRequest->idempotent || (int)requests.size()>=aMaxPipelineDepth) return false;
+  // only pipeline behind idempotent requests
+  for (HttpClientRequestList::iterator pos = requests.begin(); pos!=requests.end(); ++pos) {
+    if (!(*pos)->idempotent) return false;
+  }
+  return true;
+}
+
+
+void HttpClientConnection::sendRequest(HttpClientRequestPtr aRequest)
+{
+  requests.push_back(aRequest);
+  transmitBuffer.append(aRequest->requestText);
+  scheduleTimeout();
+  transmitPending();
+}
+
+
+void HttpClientConnection::connectionStatus(SocketCommPtr aSocketComm, ErrorPtr aError)
+{
+  if (Error::isOK(aError)) {
+    // connection established, send what we have
+    LOG(LOG_DEBUG, "HttpClientConnection: connected to %s:%s\n", getHost(), getPort());
+    transmitPending();
+  }
+  else {
+    endConnection(aError);
+  }
+}
+
+
+void HttpClientConnection::transmitPending()
+{
+  if (ended) return;
+  if (transmitBuffer.size()>0 && dataFd>=0) {
+    // Note: send() with MSG_NOSIGNAL to avoid SIGPIPE when server has closed a kept-alive connection
+    ssize_t res = send(dataFd, transmitBuffer.c_str(), transmitBuffer.size(), MSG_NOSIGNAL);
+    if (res<0) {
+      if (errno!=EAGAIN && errno!=EWOULDBLOCK) {
+        endConnection(SysError::errNo("HttpClientConnection send: "));
+        return;
+      }
+      res = 0;
+    }
+    transmitBuffer.erase(0, res);
+  }
+  if (transmitBuffer.size()>0)
+    setTransmitHandler(boost::bind(&HttpClientConnection::canSendData, this, _1));
+  else
+    setTransmitHandler(NULL);
+}
+
+
+void HttpClientConnection::canSendData(ErrorPtr aError)
+{
+  if (!Error::isOK(aError))
+    endConnection(aError);
+  else
+    transmitPending();
+}
+
+
+void HttpClientConnection::gotData(ErrorPtr aError)
+{
+  HttpClientConnectionPtr keepMeAlive(this); // make sure this object lives until routine terminates
+  if (Error::isOK(aError)) {
+    aError = receiveAndAppendToString(receiveBuffer);
+    #ifdef TCP_QUICKACK
+    // servers often send headers and body in separate segments; a delayed ACK would stall the body
+    // (quickack mode is not permanent and must be re-enabled after each read)
+    int one = 1;
+    setsockopt(dataFd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+    #endif
+  }
+  if (!Error::isOK(aError)) {
+    endConnection(aError);
+    return;
+  }
+  if (!requests.empty() && receiveBuffer.size()>0) {
+    requests.front()->responseStarted = true;
+  }
+  scheduleTimeout();
+  while (!ended && processResponseData()) {
+    // processed one step, try next
+  }
+}
+
+
+bool HttpClientConnection::processResponseData()
+{
+  if (requests.empty()) {
+    if (receiveBuffer.size()>0) {
+      LOG(LOG_WARNING, "HttpClientConnection: %s:%s sent unexpected data - ignored\n", getHost(), getPort());
+      receiveBuffer.clear();
+    }
+    return false;
+  }
+  HttpClientRequestPtr req = requests.front();
+  switch (responseState) {
+    case awaitingHeaders: {
+      size_t e = receiveBuffer.find("\r\n\r\n");
+      if (e==string::npos) return false; // headers not complete yet
+      if (!parseResponseHeaders(e+4)) {
+        endConnection(ErrorPtr(new HttpCommError(HttpCommError_protocol, "invalid HTTP response")));
+        return false;
+      }
+      return true;
+    }
+    case readingBody:
+    case readingChunk: {
+      size_t n = receiveBuffer.size();
+      if (n>bodyRemaining) n = bodyRemaining;
+      req->response.append(receiveBuffer, 0, n);
+      receiveBuffer.erase(0, n);
+      bodyRemaining -= n;
+      if (bodyRemaining>0) return false; // need more data
+      if (responseState==readingBody) {
+        responseComplete();
+        return true;
+      }
+      // chunk data is terminated by CRLF
+      if (receiveBuffer.size()<2) return false;
+      receiveBuffer.erase(0, 2);
+      responseState = awaitingChunkSize;
+      return true;
+    }
+    case awaitingChunkSize: {
+      size_t e = receiveBuffer.find("\r\n");
+      if (e==string::npos) return false;
+      size_t chunkSize = (size_t)strtoul(receiveBuffer.c_str(), NULL, 16); // ignores chunk extensions
+      receiveBuffer.erase(0, e+2);
+      if (chunkSize==0) {
+        responseState = awaitingTrailer;
+      }
+      else {
+        bodyRemaining = chunkSize;
+        responseState = readingChunk;
+      }
+      return true;
+    }
+    case awaitingTrailer: {
+      size_t e = receiveBuffer.find("\r\n");
+      if (e==string::npos) return false;
+      receiveBuffer.erase(0, e+2);
+      if (e==0) responseComplete(); // empty line ends the trailer
+      return true;
+    }
+    case readingUntilClose: {
+      req->response.append(receiveBuffer);
+      receiveBuffer.clear();
+      return false;
+    }
+  }
+  return false;
+}
+
+
+bool HttpClientConnection::parseResponseHeaders(size_t aHeaderSize)
+{
+  HttpClientRequestPtr req = requests.front();
+  string hdr = receiveBuffer.substr(0, aHeaderSize);
+  receiveBuffer.erase(0, aHeaderSize);
+  int vMajor, vMinor, status;
+  if (sscanf(hdr.c_str(), "HTTP/%d.%d %d", &vMajor, &vMinor, &status)!=3) return false;
+  bool keepAlive = vMajor>1 || (vMajor==1 && vMinor>=1); // HTTP/1.1 defaults to persistent connections
+  long contentLength = -1;
+  bool chunked = false;
+  size_t lineStart = hdr.find("\r\n")+2;
+  while (lineStart<hdr.size()) {
+    size_t lineEnd = hdr.find("\r\n", lineStart);
+    if (lineEnd==string::npos || lineEnd==lineStart) break; // end of headers
+    string line = hdr.substr(lineStart, lineEnd-lineStart);
+    lineStart = lineEnd+2;
+    size_t colon = line.find(':');
+    if (colon==string::npos) continue;
+    string name = line.substr(0, colon);
+    string value = trimWhiteSpace(line.substr(colon+1));
+    string lname = lowerCase(name);
+    if (lname=="content-length") {
+      contentLength = atol(value.c_str());
+    }
+    else if (lname=="transfer-encoding") {
+      chunked = lowerCase(value).find("chunked")!=string::npos;
+    }
+    else if (lname=="connection") {
+      string lvalue = lowerCase(value);
+      if (lvalue.find("close")!=string::npos) keepAlive = false;
+      else if (lvalue.find("keep-alive")!=string::npos) keepAlive = true;
+    }
+    if (status>=200 && req->responseHeaders) {
+      (*req->responseHeaders)[name] = value;
+    }
+  }
+  if (status<200) {
+    // interim response (100 Continue etc.), final response follows
+    return true;
+  }
+  req->statusCode = status;
+  if (!keepAlive) closeAfterResponse = true;
+  if (!req->expectsBody || status==204 || status==304) {
+    responseComplete();
+  }
+  else if (chunked) {
+    responseState = awaitingChunkSize;
+  }
+  else if (contentLength>=0) {
+    bodyRemaining = (size_t)contentLength;
+    responseState = readingBody;
+    if (bodyRemaining==0) responseComplete();
+  }
+  else {
+    // no length info, body extends until server closes the connection
+    responseState = readingUntilClose;
+    closeAfterResponse = true;
+  }
+  return true;
+}
+
+
+void HttpClientConnection::responseComplete()
+{
+  HttpClientConnectionPtr keepMeAlive(this); // make sure this object lives until routine terminates
+  HttpClientRequestPtr req = requests.front();
+  requests.pop_front();
+  responseState = awaitingHeaders;
+  bodyRemaining = 0;
+  completedResponses++;
+  if (closeAfterResponse) {
+    // server does not keep the connection, requests pipelined behind this one go back to the pool
+    endConnection(ErrorPtr());
+  }
+  else {
+    scheduleTimeout();
+  }
+  // deliver
+  if (req->completionCB) {
+    HttpClientRequestCB cb = req->completionCB;
+    req->completionCB.clear();
+    cb(req, ErrorPtr());
+  }
+  if (!ended) {
+    // connection has capacity again
+    pool.dispatchRequests(string(getHost())+":"+getPort());
+  }
+}
+
+
+void HttpClientConnection::endConnection(ErrorPtr aError)
+{
+  if (ended) return;
+  HttpClientConnectionPtr keepMeAlive(this); // make sure this object lives until routine terminates
+  if (responseState==readingUntilClose && Error::isError(aError, SocketCommError::domain(), SocketCommErrorHungUp)) {
+    // server closing connection marks end of response body
+    responseComplete(); // will end connection because closeAfterResponse is set
+    return;
+  }
+  ended = true;
+  mainLoop.cancelExecutionTicket(timeoutTicket);
+  setTransmitHandler(NULL);
+  closeConnection();
+  HttpClientRequestList unanswered;
+  unanswered.swap(requests);
+  pool.connectionEnded(this, unanswered, aError);
+}
+
+
+void HttpClientConnection::scheduleTimeout()
+{
+  mainLoop.cancelExecutionTicket(timeoutTicket);
+  timeoutTicket = mainLoop.executeOnce(
+    boost::bind(&HttpClientConnection::timedOut, this),
+    requests.empty() ? pool.idleTimeout : pool.responseTimeout
+  );
+}
+
+
+void HttpClientConnection::timedOut()
+{
+  timeoutTicket = 0;
+  if (requests.empty()) {
+    // idle for too long, close
+    LOG(LOG_DEBUG, "HttpClientConnection: closing idle connection to %s:%s\n", getHost(), getPort());
+    endConnection(ErrorPtr());
+  }
+  else {
+    LOG(LOG_WARNING, "HttpClientConnection: no response from %s:%s\n", getHost(), getPort());
+    endConnection(ErrorPtr(new HttpCommError(HttpCommError_timeout, "no response from server")));
+  }
+}
+
+
+#pragma mark - HttpClientPool
+
+
+static HttpClientPool *sharedHttpClientPool = NULL;
+
+
+HttpClientPool::HttpClientPool(MainLoop &aMainLoop) :
+  mainLoop(aMainLoop),
+  maxConnectionsPerHost(HTTPCLIENT_DEFAULT_MAX_CONNECTIONS_PER_HOST),
+  maxPipelineDepth(HTTPCLIENT_DEFAULT_MAX_PIPELINE_DEPTH),
+  idleTimeout(HTTPCLIENT_DEFAULT_IDLE_TIMEOUT),
+  responseTimeout(HTTPCLIENT_DEFAULT_RESPONSE_TIMEOUT)
+{
+}
+
+
+HttpClientPool &HttpClientPool::sharedPool()
+{
+  if (!sharedHttpClientPool) {
+    sharedHttpClientPool = new HttpClientPool(MainLoop::currentMainLoop());
+  }
+  return *sharedHttpClientPool;
+}
+
+
+size_t HttpClientPool::numConnections()
+{
+  size_t n = 0;
+  for (ConnectionMap::iterator pos = connections.begin(); pos!=connections.end(); ++pos) {
+    n += pos->second.size();
+  }
+  return n;
+}
+
+
+void HttpClientPool::submitRequest(HttpClientRequestPtr aRequest)
+{
+  string key = aRequest->hostKey();
+  waitingRequests[key].push_back(aRequest);
+  dispatchRequests(key);
+}
+
+
+void HttpClientPool::dispatchRequests(const string &aHostKey)
+{
+  RequestMap::iterator wpos = waitingRequests.find(aHostKey);
+  if (wpos==waitingRequests.end()) return;
+  HttpClientRequestList &waiting = wpos->second;
+  ConnectionList &conns = connections[aHostKey];
+  while (!waiting.empty()) {
+    HttpClientRequestPtr req = waiting.front();
+    HttpClientConnectionPtr conn;
+    // - prefer an unused connection
+    for (ConnectionList::iterator pos = conns.begin(); pos!=conns.end(); ++pos) {
+      if ((*pos)->canAccept(req, 1)) {
+        conn = *pos;
+        break;
+      }
+    }
+    // - otherwise open a new connection
+    if (!conn && (int)conns.size()<maxConnectionsPerHost) {
+      conn = HttpClientConnectionPtr(new HttpClientConnection(mainLoop, *this, req->host, req->port));
+      ErrorPtr err = conn->initiateConnection();
+      if (!Error::isOK(err)) {
+        // cannot even start connecting (e.g. host name does not resolve)
+        waiting.pop_front();
+        requestFailed(req, err);
+        continue;
+      }
+      conn->setConnectionStatusHandler(boost::bind(&HttpClientConnection::connectionStatus, conn.get(), _1, _2));
+      conns.push_back(conn);
+    }
+    // - otherwise pipeline on the least busy connection
+    if (!conn) {
+      for (ConnectionList::iterator pos = conns.begin(); pos!=conns.end(); ++pos) {
+        if ((*pos)->canAccept(req, maxPipelineDepth) && (!conn || (*pos)->pendingRequests()<conn->pendingRequests())) {
+          conn = *pos;
+        }
+      }
+    }
+    if (!conn) break; // all connections busy, request must wait
+    waiting.pop_front();
+    conn->sendRequest(req);
+  }
+}
+
+
+void HttpClientPool::connectionEnded(HttpClientConnectionPtr aConnection, HttpClientRequestList &aUnanswered, ErrorPtr aError)
+{
+  string key = string(aConnection->getHost())+":"+aConnection->getPort();
+  ConnectionList &conns = connections[key];
+  for (ConnectionList::iterator pos = conns.begin(); pos!=conns.end(); ++pos) {
+    if (pos->get()==aConnection.get()) {
+      conns.erase(pos);
+      break;
+    }
+  }
+  // connection object might still be executing, release it later from mainloop
+  if (endedConnections.empty()) {
+    mainLoop.executeOnce(boost::bind(&HttpClientPool::releaseEndedConnections, this));
+  }
+  endedConnections.push_back(aConnection);
+  // requests that did not get a response
+  HttpClientRequestList &waiting = waitingRequests[key];
+  HttpClientRequestList failed;
+  for (HttpClientRequestList::reverse_iterator pos = aUnanswered.rbegin(); pos!=aUnanswered.rend(); ++pos) {
+    HttpClientRequestPtr req = *pos;
+    if (Error::isOK(aError)) {
+      // server closed connection regularly before answering pipelined requests, send again
+      waiting.push_front(req);
+    }
+    else if (req->idempotent && !req->responseStarted && !req->retried && aConnection->completedResponses>0) {
+      // kept-alive connection was probably closed by the server in the meantime, try once more
+      LOG(LOG_INFO, "HttpClientPool: repeating request to %s on new connection\n", key.c_str());
+      req->retried = true;
+      req->responseStarted = false;
+      waiting.push_front(req);
+    }
+    else {
+      failed.push_front(req);
+    }
+  }
+  for (HttpClientRequestList::iterator pos = failed.begin(); pos!=failed.end(); ++pos) {
+    requestFailed(*pos, aError);
+  }
+  dispatchRequests(key);
+}
+
+
+void HttpClientPool::releaseEndedConnections()
+{
+  endedConnections.clear();
+}
+
+
+void HttpClientPool::requestFailed(HttpClientRequestPtr aRequest, ErrorPtr aError)
+{
+  // always report failures from mainloop, as the caller might be in the middle of submitting (and would
+  // recurse into submitting its next request from the completion handler)
+  mainLoop.executeOnce(boost::bind(&HttpClientPool::deliverFailure, this, aRequest, aError));
+}
+
+
+void HttpClientPool::deliverFailure(HttpClientRequestPtr aRequest, ErrorPtr aError)
+{
+  // Note: request might have been cancelled in the meantime
+  if (aRequest->completionCB) {
+    HttpClientRequestCB cb = aRequest->completionCB;
+    aRequest->completionCB.clear();
+    cb(aRequest, aError);
+  }
+}
+
+
+#pragma mark - HttpComm
+
+
 HttpComm::HttpComm(MainLoop &aMainLoop) :
   mainLoop(aMainLoop),
   requestInProgress(false),
-  mgConn(NULL),
   responseDataFd(-1)
 {
 }
@@ -59,14 +583,16 @@ HttpComm::~HttpComm()
 
 
 
-void HttpComm::requestThread(ChildThreadWrapper &aThread)
+// runs on subthread: only access aRequest, never the HttpComm (which might be gone after cancelling)
+void HttpComm::requestThread(HttpThreadRequestPtr aRequest, ChildThreadWrapper &aThread)
 {
   string protocol, hostSpec, host, doc;
   uint16_t port;
+  ErrorPtr requestError;
+  string response;
+  struct mg_connection *mgConn;
 
-  requestError.reset();
-  response.clear();
-  splitURL(requestURL.c_str(), &protocol, &hostSpec, &doc, NULL, NULL);
+  splitURL(aRequest->requestURL.c_str(), &protocol, &hostSpec, &doc, NULL, NULL);
   bool useSSL = false;
   if (protocol=="http") {
     port = 80;
@@ -84,7 +610,7 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
     // now issue request
     const size_t ebufSz = 100;
     char ebuf[ebufSz];
-    if (requestBody.length()>0) {
+    if (aRequest->requestBody.length()>0) {
       // is a request which sends data in the HTTP message body (e.g. POST)
       mgConn = mg_download(
         host.c_str(),
@@ -97,12 +623,12 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
         "Content-Length: %ld\r\n"
         "\r\n"
         "%s",
-        method.c_str(),
+        aRequest->method.c_str(),
         doc.c_str(),
         host.c_str(),
-        contentType.c_str(),
-        requestBody.length(),
-        requestBody.c_str()
+        aRequest->contentType.c_str(),
+        aRequest->requestBody.length(),
+        aRequest->requestBody.c_str()
       );
     }
     else {
@@ -116,7 +642,7 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
         "Host: %s\r\n"
 //        "Content-Type: %s; charset=UTF-8\r\n"
         "\r\n",
-        method.c_str(),
+        aRequest->method.c_str(),
         doc.c_str(),
         host.c_str()
 //        ,contentType.c_str()
@@ -128,18 +654,18 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
     else {
       // successfully initiated connection
       // - get headers if requested
-      if (responseHeaders) {
+      if (aRequest->responseHeaders) {
         struct mg_request_info *requestInfo = mg_get_request_info(mgConn);
         if (requestInfo) {
           for (int i=0; i<requestInfo->num_headers; i++) {
-            (*responseHeaders)[requestInfo->http_headers[i].name] = requestInfo->http_headers[i].value;
+            (*aRequest->responseHeaders)[requestInfo->http_headers[i].name] = requestInfo->http_headers[i].value;
           }
         }
       }
       // - read data
       const size_t bufferSz = 2048;
       uint8_t *bufferP = new uint8_t[bufferSz];
-      while (true) {
+      while (!aThread.shouldTerminate()) {
         ssize_t res = mg_read(mgConn, bufferP, bufferSz);
         if (res==0) {
           // connection has closed, all bytes read
@@ -152,9 +678,9 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
         }
         else {
           // data read
-          if (responseDataFd>=0) {
+          if (aRequest->responseDataFd>=0) {
             // write to fd
-            write(responseDataFd, bufferP, res);
+            write(aRequest->responseDataFd, bufferP, res);
           }
           else {
             // collect in string
@@ -166,6 +692,9 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
       mg_close_connection(mgConn);
     }
   }
+  // deliver result
+  aRequest->response = response;
+  aRequest->requestError = requestError;
   // ending the thread function will call the requestThreadSignal on the main thread
 }
 
@@ -174,21 +703,55 @@ void HttpComm::requestThread(ChildThreadWrapper &aThread)
 void HttpComm::requestThreadSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode)
 {
   DBGLOG(LOG_DEBUG,"HttpComm: Received signal from child thread: %d\n", aSignalCode);
-  if (aSignalCode==threadSignalCompleted) {
+  if (aSignalCode==threadSignalFailedToStart) {
+    // treat like a completed request that could not connect
+    LOG(LOG_WARNING,"HttpComm: could not start HTTP request thread\n");
+    threadRequest.reset();
+    response.clear();
+    requestError = ErrorPtr(new HttpCommError(HttpCommError_noConnection, "request thread could not be started"));
+    requestCompleted();
+  }
+  else if (aSignalCode==threadSignalCompleted) {
     DBGLOG(LOG_DEBUG,"- HTTP subthread exited - request completed\n");
-    requestInProgress = false; // thread completed
-    // call back with result of request
-    // Note: as this callback might initiate another request already and overwrite the callback, copy it here
-    HttpCommCB cb = responseCallback;
-    string resp = response;
-    ErrorPtr reqErr = requestError;
-    // release child thread object now
-    responseCallback.clear();
-    childThread.reset();
-    // now execute callback
-    if (cb) {
-      cb(resp, reqErr);
+    if (threadRequest) {
+      response.swap(threadRequest->response);
+      requestError = threadRequest->requestError;
+      threadRequest.reset();
     }
+    requestCompleted();
+  }
+}
+
+
+void HttpComm::pooledRequestDone(HttpClientRequestPtr aRequest, ErrorPtr aError)
+{
+  DBGLOG(LOG_DEBUG,"HttpComm: request on persistent connection completed with status %d\n", aRequest->statusCode);
+  response.swap(aRequest->response);
+  if (responseDataFd>=0) {
+    // write to fd
+    write(responseDataFd, response.c_str(), response.size());
+    response.clear();
+  }
+  requestError = aError;
+  pooledRequest.reset();
+  requestCompleted();
+}
+
+
+void HttpComm::requestCompleted()
+{
+  requestInProgress = false; // request completed
+  // call back with result of request
+  // Note: as this callback might initiate another request already and overwrite the callback, copy it here
+  HttpCommCB cb = responseCallback;
+  string resp = response;
+  ErrorPtr reqErr = requestError;
+  // release child thread object now
+  responseCallback.clear();
+  childThread.reset();
+  // now execute callback
+  if (cb) {
+    cb(resp, reqErr);
   }
 }
 
@@ -210,7 +773,6 @@ bool HttpComm::httpRequest(
   responseHeaders.reset();
   if (aSaveHeaders)
     responseHeaders = HttpHeaderMapPtr(new HttpHeaderMap);
-  requestURL = aURL;
   responseCallback = aResponseCallback;
   method = aMethod;
   requestBody = nonNullCStr(aRequestBody);
@@ -218,20 +780,52 @@ bool HttpComm::httpRequest(
     contentType = aContentType; // use specified content type
   else
     contentType = defaultContentType(); // use default for the class
-  // now let subthread handle this
   requestInProgress = true;
-  childThread = MainLoop::currentMainLoop().executeInThread(
-    boost::bind(&HttpComm::requestThread, this, _1),
-    boost::bind(&HttpComm::requestThreadSignal, this, _1, _2)
-  );
-  return true; // could be initiated (even if immediately ended due to error, but callback was called)
+  string protocol, hostSpec, doc, host;
+  uint16_t port = 80;
+  splitURL(aURL, &protocol, &hostSpec, &doc, NULL, NULL);
+  splitHost(hostSpec.c_str(), &host, &port);
+  // the pool connects from the mainloop, so it can only be used when no (blocking) name resolution is needed
+  struct in6_addr hostAddr;
+  bool numericHost = inet_pton(AF_INET, host.c_str(), &hostAddr)==1 || inet_pton(AF_INET6, host.c_str(), &hostAddr)==1;
+  if (protocol=="http" && numericHost) {
+    // plain http to an IP address: run non-blocking on a persistent connection from the shared pool
+    pooledRequest = HttpClientRequestPtr(new HttpClientRequest(host, port, method, doc, contentType.c_str(), requestBody));
+    pooledRequest->responseHeaders = responseHeaders;
+    pooledRequest->setCompletionHandler(boost::bind(&HttpComm::pooledRequestDone, this, _1, _2));
+    HttpClientPool::sharedPool().submitRequest(pooledRequest);
+  }
+  else {
+    // https, host names (resolved on the subthread), or invalid: let subthread handle this
+    // - subthread gets its own copy of the request, as it may outlive this object when cancelled
+    threadRequest = HttpThreadRequestPtr(new HttpThreadRequest);
+    threadRequest->requestURL = aURL;
+    threadRequest->method = method;
+    threadRequest->contentType = contentType;
+    threadRequest->requestBody = requestBody;
+    threadRequest->responseHeaders = responseHeaders;
+    if (responseDataFd>=0) threadRequest->responseDataFd = dup(responseDataFd); // caller may close its fd right after cancelling
+    childThread = MainLoop::currentMainLoop().executeInThread(
+      boost::bind(&HttpComm::requestThread, threadRequest, _1),
+      boost::bind(&HttpComm::requestThreadSignal, this, _1, _2)
+    );
+  }
+  return true; // could be initiated (errors are reported to the callback later, from mainloop)
 }
 
 
 void HttpComm::cancelRequest()
 {
+  if (requestInProgress && pooledRequest) {
+    pooledRequest->cancel();
+    pooledRequest.reset();
+    requestInProgress = false; // prevent cancelling multiple times
+  }
   if (requestInProgress && childThread) {
+    // Note: does not wait for the subthread, which finishes on its own copy of the request
     childThread->cancel();
+    childThread.reset();
+    threadRequest.reset();
     requestInProgress = false; // prevent cancelling multiple times
   }
 }
@@ -24,6 +24,8 @@
 
 #include "p44_common.hpp"
 
+#include "socketcomm.hpp"
+
 #include "mongoose.h"
 
 using namespace std;
@@ -39,6 +41,8 @@ namespace p44 {
     HttpCommError_noConnection = 10001,
     HttpCommError_read = 10002,
     HttpCommError_write = 10003,
+    HttpCommError_timeout = 10004,
+    HttpCommError_protocol = 10005,
     HttpCommError_mongooseError = 20000
   };
 
@@ -67,6 +71,195 @@ namespace p44 {
   typedef boost::function<void (const string &aResponse, ErrorPtr aError)> HttpCommCB;
 
 
+  #pragma mark - persistent connection client
+
+  class HttpClientRequest;
+  class HttpClientConnection;
+  class HttpClientPool;
+
+  typedef boost::intrusive_ptr<HttpClientRequest> HttpClientRequestPtr;
+  typedef boost::intrusive_ptr<HttpClientConnection> HttpClientConnectionPtr;
+  typedef std::list<HttpClientRequestPtr> HttpClientRequestList;
+
+  /// callback for completed HttpClientRequest
+  /// @param aRequest the request, with statusCode, response and (if requested) responseHeaders set
+  /// @param aError an error object if the request failed, empty pointer otherwise
+  typedef boost::function<void (HttpClientRequestPtr aRequest, ErrorPtr aError)> HttpClientRequestCB;
+
+
+  /// a single HTTP/1.1 request to be executed on a persistent connection of the HttpClientPool
+  class HttpClientRequest : public P44Obj
+  {
+    friend class HttpClientConnection;
+    friend class HttpClientPool;
+
+    string host; ///< host name or address to connect to
+    string port; ///< port number as string
+    string requestText; ///< complete request (request line, headers and body) ready to send
+    bool idempotent; ///< set if request may be pipelined and repeated on a new connection
+    bool expectsBody; ///< not set for HEAD requests, which never get a response body
+    bool responseStarted; ///< set as soon as first response byte has arrived
+    bool retried; ///< set when request has already been repeated once after a connection failure
+    HttpClientRequestCB completionCB;
+
+  public:
+
+    int statusCode; ///< HTTP status code of the response
+    string response; ///< response body
+    HttpHeaderMapPtr responseHeaders; ///< if set before submitting, will receive the response headers
+
+    /// create request
+    /// @param aHost host name or address
+    /// @param aPort port number
+    /// @param aMethod HTTP method
+    /// @param aDoc document path (including query, if any)
+    /// @param aContentType content type of the body, NULL for none
+    /// @param aBody request body, empty for none
+    HttpClientRequest(const string &aHost, uint16_t aPort, const string &aMethod, const string &aDoc, const char *aContentType, const string &aBody);
+
+    /// set completion callback
+    void setCompletionHandler(HttpClientRequestCB aCompletionCB) { completionCB = aCompletionCB; };
+
+    /// cancel the request
+    /// @note the request might already be sent, so its response will still be read (to keep the connection in sync),
+    ///   but the completion handler will not be called any more
+    void cancel() { completionCB.clear(); };
+
+    /// @return key identifying the connection pool for this request's server
+    string hostKey() const { return host+":"+port; };
+
+  };
+
+
+  /// a keep-alive HTTP/1.1 client connection, operated by HttpClientPool
+  class HttpClientConnection : public SocketComm
+  {
+    typedef SocketComm inherited;
+    friend class HttpClientPool;
+
+    HttpClientPool &pool;
+    HttpClientRequestList requests; ///< requests sent (or queued for sending) on this connection, front is being answered
+    string transmitBuffer; ///< request data not yet accepted by the socket
+    string receiveBuffer; ///< response data not yet consumed by the parser
+
+    enum {
+      awaitingHeaders, ///< waiting for status line and headers
+      readingBody, ///< receiving bodyRemaining bytes
+      awaitingChunkSize, ///< waiting for size line of next chunk
+      readingChunk, ///< receiving bodyRemaining bytes of a chunk
+      awaitingTrailer, ///< waiting for end of trailer after last chunk
+      readingUntilClose ///< body ends when server closes connection
+    } responseState;
+    size_t bodyRemaining;
+    bool closeAfterResponse; ///< server will close connection after the current response
+    bool ended; ///< connection has ended and was returned to the pool
+    int completedResponses; ///< number of responses completed on this connection
+    long timeoutTicket;
+
+  public:
+
+    HttpClientConnection(MainLoop &aMainLoop, HttpClientPool &aPool, const string &aHost, const string &aPort);
+    virtual ~HttpClientConnection();
+
+    /// @return number of requests sent or waiting for response
+    size_t pendingRequests() { return requests.size(); };
+
+    /// check if request can be sent on this connection now
+    /// @param aRequest the request
+    /// @param aMaxPipelineDepth max number of requests waiting for response on the same connection
+    bool canAccept(HttpClientRequestPtr aRequest, int aMaxPipelineDepth);
+
+    /// send (or pipeline) a request on this connection
+    void sendRequest(HttpClientRequestPtr aRequest);
+
+  private:
+
+    void connectionStatus(SocketCommPtr aSocketComm, ErrorPtr aError);
+    void transmitPending();
+    void canSendData(ErrorPtr aError);
+    void gotData(ErrorPtr aError);
+    bool processResponseData();
+    bool parseResponseHeaders(size_t aHeaderSize);
+    void responseComplete();
+    void endConnection(ErrorPtr aError);
+    void scheduleTimeout();
+    void timedOut();
+
+  };
+
+
+  /// pool of keep-alive connections for non-blocking HTTP requests from the mainloop
+  class HttpClientPool
+  {
+    friend class HttpClientConnection;
+
+    typedef std::list<HttpClientConnectionPtr> ConnectionList;
+    typedef std::map<string, ConnectionList> ConnectionMap;
+    typedef std::map<string, HttpClientRequestList> RequestMap;
+
+    MainLoop &mainLoop;
+    ConnectionMap connections; ///< open (or opening) connections per host key
+    RequestMap waitingRequests; ///< requests waiting for a connection per host key
+    ConnectionList endedConnections; ///< ended connections, to be released from mainloop
+
+  public:
+
+    int maxConnectionsPerHost; ///< max number of simultaneous connections to the same server
+    int maxPipelineDepth; ///< max number of requests sent ahead on one connection without waiting for response
+    MLMicroSeconds idleTimeout; ///< idle connections will be closed after this time
+    MLMicroSeconds responseTimeout; ///< connection is considered dead when no response arrives within this time
+
+    HttpClientPool(MainLoop &aMainLoop);
+
+    /// get the shared pool for the current mainloop
+    static HttpClientPool &sharedPool();
+
+    /// submit a request for execution
+    /// @param aRequest the request. Its completion handler will be called (from mainloop) when request
+    ///   completes or fails, but never from within submitRequest() itself
+    /// @note the host should be a numeric address, as connecting resolves host names synchronously
+    void submitRequest(HttpClientRequestPtr aRequest);
+
+    /// @return number of open connections (for all hosts)
+    size_t numConnections();
+
+  private:
+
+    void dispatchRequests(const string &aHostKey);
+    void connectionEnded(HttpClientConnectionPtr aConnection, HttpClientRequestList &aUnanswered, ErrorPtr aError);
+    void releaseEndedConnections();
+    void requestFailed(HttpClientRequestPtr aRequest, ErrorPtr aError);
+    void deliverFailure(HttpClientRequestPtr aRequest, ErrorPtr aError);
+
+  };
+
+
+  #pragma mark - HttpComm
+
+
+  /// a request executed by a subthread (blocking mongoose client)
+  /// @note owned by the thread routine, so a cancelled routine can still finish safely after its HttpComm is gone
+  class HttpThreadRequest
+  {
+  public:
+    HttpThreadRequest() : responseDataFd(-1) {};
+    ~HttpThreadRequest() { if (responseDataFd>=0) close(responseDataFd); };
+
+    // request (set up before the thread is started)
+    string requestURL;
+    string method;
+    string contentType;
+    string requestBody;
+    int responseDataFd; ///< private duplicate of the caller's fd, -1 if response is collected in response
+    HttpHeaderMapPtr responseHeaders; ///< if set, response headers are stored here
+
+    // result (only valid after the thread has completed)
+    string response;
+    ErrorPtr requestError;
+  };
+  typedef boost::shared_ptr<HttpThreadRequest> HttpThreadRequestPtr;
+
+
   /// wrapper for non-blocking http client communication
   /// @note this class' implementation is not suitable for handling huge http requests and answers. It is
   ///   intended for accessing web APIs with short messages.
@@ -76,13 +269,12 @@ namespace p44 {
 
     HttpCommCB responseCallback;
 
-    // vars used in subthread, only access when !requestInProgress
-    string requestURL;
     string method;
     string contentType;
     string requestBody;
     int responseDataFd;
-    struct mg_connection *mgConn; // mongoose connection
+    HttpClientRequestPtr pooledRequest; // request in progress on a persistent connection
+    HttpThreadRequestPtr threadRequest; // request in progress on a subthread
 
   public:
 
@@ -94,7 +286,6 @@ namespace p44 {
 
     bool requestInProgress; ///< set when request is in progress and no new request can be issued
 
-    // vars used in subthread, only access when !requestInProgress
     ChildThreadWrapperPtr childThread;
     string response;
     ErrorPtr requestError;
@@ -114,6 +305,7 @@ namespace p44 {
     /// @param aSaveHeaders if true, responseHeaders will be set to a string,string map containing the headers
     /// @return false if no request could be initiated (already busy with another request).
     ///   If false, aHttpCallback will not be called
+    /// @note the callback is never called from within httpRequest() itself, not even for immediate failures
     bool httpRequest(
       const char *aURL,
       HttpCommCB aResponseCallback,
@@ -137,8 +329,12 @@ namespace p44 {
 
     virtual void requestThreadSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode);
 
+    /// called on the mainloop when a request has completed, with response and requestError set
+    virtual void requestCompleted();
+
   private:
-    void requestThread(ChildThreadWrapper &aThread);
+    static void requestThread(HttpThreadRequestPtr aRequest, ChildThreadWrapper &aThread);
+    void pooledRequestDone(HttpClientRequestPtr aRequest, ErrorPtr aError);
 
   };
 
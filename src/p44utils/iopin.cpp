@@ -46,6 +46,12 @@ SimPin::SimPin(const char *aName, bool aOutput, bool aInitialState) :
 }
 
 
+SimPin::~SimPin()
+{
+  if (consoleKey) consoleKey->setConsoleKeyHandler(NULL);
+}
+
+
 bool SimPin::getState()
 {
   if (output)
@@ -65,6 +71,23 @@ void SimPin::setState(bool aState)
 }
 
 
+bool SimPin::setInputChangedHandler(InputChangedCB aInputChangedCB)
+{
+  if (!consoleKey) return !aInputChangedCB; // outputs do not change by themselves
+  if (aInputChangedCB)
+    consoleKey->setConsoleKeyHandler(boost::bind(&SimPin::consoleKeyChanged, this, aInputChangedCB, _1));
+  else
+    consoleKey->setConsoleKeyHandler(NULL);
+  return true;
+}
+
+
+void SimPin::consoleKeyChanged(InputChangedCB aInputChangedCB, bool aNewState)
+{
+  aInputChangedCB(aNewState);
+}
+
+
 #pragma mark - digital output via system command
 
 
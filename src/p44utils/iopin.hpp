@@ -32,6 +32,11 @@ namespace p44 {
 
   #pragma mark - digital pins
 
+  /// input change handler
+  /// @param aNewState the new state of the pin
+  typedef boost::function<void (bool aNewState)> InputChangedCB;
+
+
   /// abstract wrapper class for digital I/O pin
   class IOPin : public P44Obj
   {
@@ -44,6 +49,12 @@ namespace p44 {
     /// set state of pin (NOP for inputs)
     /// @param aState new state to set output to
     virtual void setState(bool aState) = 0;
+
+    /// install handler to be called when input state changes
+    /// @param aInputChangedCB handler to be called from mainloop when the input state changes, NULL to remove handler
+    /// @return false if the pin cannot report changes by itself (and must be polled instead)
+    /// @note base class cannot report changes
+    virtual bool setInputChangedHandler(InputChangedCB aInputChangedCB) { return !aInputChangedCB; };
   };
   typedef boost::intrusive_ptr<IOPin> IOPinPtr;
   
@@ -60,6 +71,7 @@ namespace p44 {
   public:
     // create a simulated pin (using console I/O)
     SimPin(const char *aName, bool aOutput, bool aInitialState);
+    virtual ~SimPin();
 
     /// get state of pin
     /// @return current state (from actual GPIO pin for inputs, from last set state for outputs)
@@ -68,6 +80,15 @@ namespace p44 {
     /// set state of pin (NOP for inputs)
     /// @param aState new state to set output to
     virtual void setState(bool aState);
+
+    /// install handler to be called when input state changes
+    /// @param aInputChangedCB handler to be called when the console key changes state, NULL to remove handler
+    /// @return true (console keys report their changes)
+    virtual bool setInputChangedHandler(InputChangedCB aInputChangedCB);
+
+  private:
+
+    void consoleKeyChanged(InputChangedCB aInputChangedCB, bool aNewState);
   };
 
 
@@ -53,13 +53,13 @@ void JsonComm::gotData(ErrorPtr aError)
 {
   JsonCommPtr keepMeAlive(this); // make sure this object lives until routine terminates
   if (Error::isOK(aError)) {
-    // no error, read data we've got so far
-    size_t dataSz = numBytesReady();
-    if (dataSz>0) {
-      // temporary buffer
-      uint8_t *buf = new uint8_t[dataSz];
-      size_t receivedBytes = receiveBytes(dataSz, buf, aError);
-      if (Error::isOK(aError)) {
+    // no error, read data we've got so far into the receive buffer
+    aError = receiveIntoBuffer();
+    if (Error::isOK(aError)) {
+      // process in place (tokener keeps partial message state, so buffer is always consumed entirely)
+      uint8_t *buf = receiveBufferData();
+      size_t receivedBytes = receiveBufferBytes();
+      if (receivedBytes>0) {
         // check for end-of-message (LF), make spaces from any other ctrl char
         size_t bom = 0;
         while (bom<receivedBytes) {
@@ -122,9 +122,9 @@ void JsonComm::gotData(ErrorPtr aError)
           // now eom becomes the new bom
           bom = eom;
         } // while data to process
-      } // no read error
-      delete[] buf; buf = NULL;
-    } // some data seems to be ready
+        consumeReceiveBuffer(receivedBytes);
+      } // some data received
+    } // no read error
   } // no connection error
   if (!Error::isOK(aError)) {
     // error occurred, report
@@ -139,37 +139,42 @@ void JsonComm::gotData(ErrorPtr aError)
 
 ErrorPtr JsonComm::sendMessage(JsonObjectPtr aJsonObject)
 {
-  string json_string = aJsonObject->json_c_str();
-  json_string.append("\n");
-  return sendRaw(json_string);
+  // render JSON directly into a transmit buffer, with LF appended
+  const char *json = aJsonObject->json_c_str();
+  size_t jsonSize = strlen(json);
+  FdTransmitBuffer msgBuf = newTransmitBuffer(jsonSize+1);
+  if (msgBuf.data) {
+    memcpy(msgBuf.data, json, jsonSize);
+    msgBuf.data[jsonSize] = '\n';
+  }
+  return sendBuffer(msgBuf);
 }
 
 
 ErrorPtr JsonComm::sendRaw(string &aRawBytes)
 {
-  ErrorPtr err;
-  if (transmitBuffer.size()>0) {
-    // other messages are already waiting, append entire message
-    transmitBuffer.append(aRawBytes);
+  FdTransmitBuffer msgBuf = newTransmitBuffer(aRawBytes.size());
+  if (msgBuf.data) {
+    memcpy(msgBuf.data, aRawBytes.c_str(), aRawBytes.size());
   }
-  else {
-    size_t rawSize = aRawBytes.size();
-    // nothing in buffer yet, start new send
-    size_t sentBytes = transmitBytes(rawSize, (uint8_t *)aRawBytes.c_str(), err);
-    if (Error::isOK(err)) {
-      // check if all could be sent
-      if (sentBytes<rawSize) {
-        // Not everything (or maybe nothing, transmitBytes() can return 0) was sent
-        // - enable callback for ready-for-send
-        setTransmitHandler(boost::bind(&JsonComm::canSendData, this, _1));
-        // buffer the rest, canSendData handler will take care of writing it out
-        transmitBuffer.assign(aRawBytes.c_str()+sentBytes, rawSize-sentBytes);
-      }
-			else {
-				// all sent
-				// - disable transmit handler
-        setTransmitHandler(NULL);
-			}
+  return sendBuffer(msgBuf);
+}
+
+
+ErrorPtr JsonComm::sendBuffer(FdTransmitBuffer &aBuffer)
+{
+  // send (or queue behind other messages already waiting)
+  ErrorPtr err = queueTransmitBuffer(aBuffer);
+  if (Error::isOK(err)) {
+    if (transmitQueueBytes()>0) {
+      // Not everything (or maybe nothing) was sent
+      // - enable callback for ready-for-send, canSendData handler will take care of writing it out
+      setTransmitHandler(boost::bind(&JsonComm::canSendData, this, _1));
+    }
+    else {
+      // all sent
+      // - disable transmit handler
+      setTransmitHandler(NULL);
     }
   }
   return err;
@@ -178,7 +183,7 @@ ErrorPtr JsonComm::sendRaw(string &aRawBytes)
 
 void JsonComm::closeAfterSend()
 {
-  if (transmitBuffer.size()==0) {
+  if (transmitQueueBytes()==0) {
     // nothing buffered for later, close now
     closeConnection();
   }
@@ -192,25 +197,19 @@ void JsonComm::closeAfterSend()
 
 void JsonComm::canSendData(ErrorPtr aError)
 {
-  size_t bytesToSend = transmitBuffer.size();
-  if (bytesToSend>0 && Error::isOK(aError)) {
-    // send data from transmit buffer
-    size_t sentBytes = transmitBytes(bytesToSend, (const uint8_t *)transmitBuffer.c_str(), aError);
+  if (transmitQueueBytes()>0 && Error::isOK(aError)) {
+    // send data from transmit queue
+    aError = flushTransmitQueue();
     if (Error::isOK(aError)) {
-      if (sentBytes==bytesToSend) {
+      if (transmitQueueBytes()==0) {
         // all sent
-        transmitBuffer.erase();
-				// - disable transmit handler
+        // - disable transmit handler
         setTransmitHandler(NULL);
-      }
-      else {
-        // partially sent, remove sent bytes
-        transmitBuffer.erase(0, sentBytes);
-      }
-      // check for closing connection when no data pending to be sent any more
-      if (closeWhenSent && transmitBuffer.size()==0) {
-        closeWhenSent = false; // done
-        closeConnection();
+        // check for closing connection when no data pending to be sent any more
+        if (closeWhenSent) {
+          closeWhenSent = false; // done
+          closeConnection();
+        }
       }
     }
   }
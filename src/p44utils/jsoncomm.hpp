@@ -48,7 +48,6 @@ namespace p44 {
     bool ignoreUntilNextEOM;
 
     // JSON sending
-    string transmitBuffer;
     bool closeWhenSent;
 
   public:
@@ -77,6 +76,7 @@ namespace p44 {
 
   private:
     void gotData(ErrorPtr aError);
+    ErrorPtr sendBuffer(FdTransmitBuffer &aBuffer);
     void canSendData(ErrorPtr aError);
     
   };
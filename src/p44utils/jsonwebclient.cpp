@@ -36,47 +36,45 @@ JsonWebClient::~JsonWebClient()
 }
 
 
-void JsonWebClient::requestThreadSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode)
+void JsonWebClient::requestCompleted()
 {
   if (jsonResponseCallback) {
     // only if we have a json callback, we need to parse the response at all
-    if (aSignalCode==threadSignalCompleted) {
-      requestInProgress = false; // thread completed
-      JsonObjectPtr message;
-      if (Error::isOK(requestError)) {
-        // try to decode JSON
-        struct json_tokener* tokener = json_tokener_new();
-        struct json_object *o = json_tokener_parse_ex(tokener, response.c_str(), (int)response.size());
-        if (o==NULL) {
-          // error (or incomplete JSON, which is fine)
-          JsonErrors err = json_tokener_get_error(tokener);
-          if (err!=json_tokener_continue) {
-            // real error
-            requestError = ErrorPtr(new JsonError(err));
-          }
+    requestInProgress = false; // request completed
+    JsonObjectPtr message;
+    if (Error::isOK(requestError)) {
+      // try to decode JSON
+      struct json_tokener* tokener = json_tokener_new();
+      struct json_object *o = json_tokener_parse_ex(tokener, response.c_str(), (int)response.size());
+      if (o==NULL) {
+        // error (or incomplete JSON, which is fine)
+        JsonErrors err = json_tokener_get_error(tokener);
+        if (err!=json_tokener_continue) {
+          // real error
+          requestError = ErrorPtr(new JsonError(err));
         }
-        else {
-          // got JSON object
-          message = JsonObject::newObj(o);
-        }
-        json_tokener_free(tokener);
       }
-      // call back with result of request
-      LOG(LOG_DEBUG,"JsonWebClient: <- received JSON answer:\n%s\n", message ? message->json_c_str() : "<none>");
-      // Note: this callback might initiate another request already
-      if (jsonResponseCallback) {
-        // use this callback, but as callback routine might post another request immediately, we need to free the member first
-        JsonWebClientCB cb = jsonResponseCallback;
-        jsonResponseCallback.clear();
-        cb(message, requestError);
+      else {
+        // got JSON object
+        message = JsonObject::newObj(o);
       }
-      // release child thread object now
-      childThread.reset();
+      json_tokener_free(tokener);
+    }
+    // call back with result of request
+    LOG(LOG_DEBUG,"JsonWebClient: <- received JSON answer:\n%s\n", message ? message->json_c_str() : "<none>");
+    // Note: this callback might initiate another request already
+    if (jsonResponseCallback) {
+      // use this callback, but as callback routine might post another request immediately, we need to free the member first
+      JsonWebClientCB cb = jsonResponseCallback;
+      jsonResponseCallback.clear();
+      cb(message, requestError);
     }
+    // release child thread object now
+    childThread.reset();
   }
   else {
     // no JSON callback, let inherited handle this
-    inherited::requestThreadSignal(aChildThread, aSignalCode);
+    inherited::requestCompleted();
   }
 }
 
@@ -27,9 +27,62 @@ using namespace p44;
 
 p44::Logger globalLogger;
 
-Logger::Logger()
+
+namespace p44 {
+
+  /// header of a message record in a LogRing
+  typedef struct {
+    int level;
+    struct timeval time;
+    size_t len; ///< number of message bytes following the header
+  } LogRecordHeader;
+
+  /// single producer (logging thread), single consumer (holder of writerMutex) ring buffer
+  struct LogRing {
+    LogRing *next;
+    volatile size_t head; ///< write position (only modified by producer)
+    volatile size_t tail; ///< read position (only modified by consumer)
+    volatile unsigned long dropped; ///< messages dropped (only modified by producer)
+    unsigned long reportedDrops; ///< drops already reported (consumer only)
+    volatile bool orphaned; ///< set when owning thread has exited
+    uint8_t buffer[LOGGER_ASYNC_RINGBUFFER_SIZE];
+  };
+
+} // namespace p44
+
+
+static void ringCopyIn(LogRing *aRing, size_t aPos, const void *aData, size_t aSize)
+{
+  size_t offs = aPos & (LOGGER_ASYNC_RINGBUFFER_SIZE-1);
+  size_t first = LOGGER_ASYNC_RINGBUFFER_SIZE-offs;
+  if (first>aSize) first = aSize;
+  memcpy(aRing->buffer+offs, aData, first);
+  memcpy(aRing->buffer, (const uint8_t *)aData+first, aSize-first);
+}
+
+
+static void ringCopyOut(LogRing *aRing, size_t aPos, void *aData, size_t aSize)
+{
+  size_t offs = aPos & (LOGGER_ASYNC_RINGBUFFER_SIZE-1);
+  size_t first = LOGGER_ASYNC_RINGBUFFER_SIZE-offs;
+  if (first>aSize) first = aSize;
+  memcpy(aData, aRing->buffer+offs, first);
+  memcpy((uint8_t *)aData+first, aRing->buffer, aSize-first);
+}
+
+
+
+Logger::Logger() :
+  async(false),
+  rings(NULL),
+  writerWaiting(false),
+  writerStop(false),
+  droppedCount(0)
 {
   pthread_mutex_init(&reportMutex, NULL);
+  pthread_mutex_init(&writerMutex, NULL);
+  pthread_cond_init(&writerCond, NULL);
+  pthread_key_create(&ringKey, ringThreadExit);
   logLevel = LOGGER_DEFAULT_LOGLEVEL;
   stderrLevel = LOG_ERR;
   errToStdout = true;
@@ -54,58 +107,258 @@ bool Logger::logEnabled(int aErrLevel)
 void Logger::log(int aErrLevel, const char *aFmt, ... )
 {
   if (logEnabled(aErrLevel)) {
-    pthread_mutex_lock(&reportMutex);
     va_list args;
     va_start(args, aFmt);
+    LogRing *ring = async ? threadRing() : NULL;
+    if (ring) {
+      // asynchronous: only capture level, time and message here
+      char msgbuf[LOGGER_ASYNC_MAX_MESSAGE];
+      int n = vsnprintf(msgbuf, LOGGER_ASYNC_MAX_MESSAGE, aFmt, args);
+      va_end(args);
+      if (n<0) n = 0;
+      if (n>=LOGGER_ASYNC_MAX_MESSAGE) {
+        // truncated, make sure it still ends with LF
+        n = LOGGER_ASYNC_MAX_MESSAGE-1;
+        msgbuf[n-1] = '\n';
+      }
+      LogRecordHeader hdr;
+      hdr.level = aErrLevel;
+      gettimeofday(&hdr.time, NULL);
+      hdr.len = (size_t)n;
+      size_t head = ring->head;
+      __sync_synchronize(); // read tail after consumer has finished reading
+      if (LOGGER_ASYNC_RINGBUFFER_SIZE-(head-ring->tail) < sizeof(hdr)+hdr.len) {
+        // no room, drop
+        ring->dropped = ring->dropped+1;
+      }
+      else {
+        ringCopyIn(ring, head, &hdr, sizeof(hdr));
+        ringCopyIn(ring, head+sizeof(hdr), msgbuf, hdr.len);
+        __sync_synchronize(); // record must be complete before consumer can see it
+        ring->head = head+sizeof(hdr)+hdr.len;
+      }
+      if (aErrLevel<=LOG_CRIT) {
+        // fatal, make sure it is out before continuing
+        flush();
+      }
+      else {
+        __sync_synchronize(); // head must be visible before checking if writer sleeps (see writerThreadFunc())
+        if (writerWaiting) {
+          // writer sleeps or is about to: signal with mutex held, so the wakeup cannot get lost
+          pthread_mutex_lock(&writerMutex);
+          pthread_cond_signal(&writerCond);
+          pthread_mutex_unlock(&writerMutex);
+        }
+      }
+      return;
+    }
+    // synchronous
+    pthread_mutex_lock(&reportMutex);
     // format the message
     string message;
     string_format_v(message, false, aFmt, args);
     va_end(args);
-    // escape non-printables and detect multiline
-    bool isMultiline = false;
-    string::size_type i=0;
-    while (i<message.length()) {
-      char c = message[i];
-      if (c=='\n') {
-        if (i!=message.length()-1)
-          isMultiline = true; // not just trailing LF
-      }
-      else if (!isprint(c) && (uint8_t)c<0x80) {
-        // ASCII control character, but not bit 7 set (UTF8 component char)
-        message.replace(i, 1, string_format("\\x%02x", (unsigned)(c & 0xFF)));
-      }
-      i++;
-    }
-    // create date
-    char tsbuf[40];
-    char *p = tsbuf;
     struct timeval t;
     gettimeofday(&t, NULL);
-    p += strftime(p, sizeof(tsbuf), "[%Y-%m-%d %H:%M:%S", localtime(&t.tv_sec));
-    p += sprintf(p, ".%03d]", t.tv_usec/1000);
-    // output
-    if (aErrLevel<=stderrLevel) {
-      // must go to stderr anyway
-      fputs(tsbuf, stderr);
-      if (isMultiline)
-        fputs("\n", stderr);
-      else
-        fputs(" ", stderr);
-      fputs(message.c_str(), stderr);
-      fflush(stderr);
+    outputMessage(aErrLevel, t, message, true);
+    pthread_mutex_unlock(&reportMutex);
+  }
+}
+
+
+void Logger::outputMessage(int aErrLevel, const struct timeval &aTime, string &aMessage, bool aFlush)
+{
+  // escape non-printables and detect multiline
+  bool isMultiline = false;
+  string::size_type i=0;
+  while (i<aMessage.length()) {
+    char c = aMessage[i];
+    if (c=='\n') {
+      if (i!=aMessage.length()-1)
+        isMultiline = true; // not just trailing LF
     }
-    if (stdoutLogEnabled(aErrLevel) && (aErrLevel>stderrLevel || errToStdout)) {
-      // must go to stdout as well
-      fputs(tsbuf, stdout);
-      if (isMultiline)
-        fputs("\n", stdout);
-      else
-        fputs(" ", stdout);
-      fputs(message.c_str(), stdout);
-      fflush(stdout);
+    else if (!isprint(c) && (uint8_t)c<0x80) {
+      // ASCII control character, but not bit 7 set (UTF8 component char)
+      aMessage.replace(i, 1, string_format("\\x%02x", (unsigned)(c & 0xFF)));
+    }
+    i++;
+  }
+  // create date
+  char tsbuf[40];
+  char *p = tsbuf;
+  struct tm tm;
+  p += strftime(p, sizeof(tsbuf), "[%Y-%m-%d %H:%M:%S", localtime_r(&aTime.tv_sec, &tm));
+  p += sprintf(p, ".%03d]", (int)(aTime.tv_usec/1000));
+  // output
+  if (aErrLevel<=stderrLevel) {
+    // must go to stderr anyway
+    fputs(tsbuf, stderr);
+    if (isMultiline)
+      fputs("\n", stderr);
+    else
+      fputs(" ", stderr);
+    fputs(aMessage.c_str(), stderr);
+    if (aFlush) fflush(stderr);
+  }
+  if (stdoutLogEnabled(aErrLevel) && (aErrLevel>stderrLevel || errToStdout)) {
+    // must go to stdout as well
+    fputs(tsbuf, stdout);
+    if (isMultiline)
+      fputs("\n", stdout);
+    else
+      fputs(" ", stdout);
+    fputs(aMessage.c_str(), stdout);
+    if (aFlush) fflush(stdout);
+  }
+}
+
+
+#pragma mark - asynchronous logging
+
+
+void Logger::setAsync(bool aAsync)
+{
+  if (aAsync==async) return;
+  if (aAsync) {
+    writerStop = false;
+    if (pthread_create(&writerThread, NULL, writerThreadStart, this)!=0) {
+      log(LOG_ERR, "Logger: cannot start writer thread, logging remains synchronous\n");
+      return;
+    }
+    static bool atExitRegistered = false;
+    if (!atExitRegistered) {
+      atexit(flushAtExit);
+      atExitRegistered = true;
+    }
+    async = true;
+  }
+  else {
+    async = false;
+    // let writer thread write out everything and exit
+    pthread_mutex_lock(&writerMutex);
+    writerStop = true;
+    pthread_cond_signal(&writerCond);
+    pthread_mutex_unlock(&writerMutex);
+    pthread_join(writerThread, NULL);
+    flush();
+  }
+}
+
+
+LogRing *Logger::threadRing()
+{
+  LogRing *ring = (LogRing *)pthread_getspecific(ringKey);
+  if (!ring) {
+    // first message from this thread, create its ring
+    ring = new LogRing;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->reportedDrops = 0;
+    ring->orphaned = false;
+    pthread_mutex_lock(&writerMutex);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&writerMutex);
+    pthread_setspecific(ringKey, ring);
+  }
+  return ring;
+}
+
+
+void Logger::ringThreadExit(void *aRingP)
+{
+  // thread has exited, writer will delete ring when empty
+  static_cast<LogRing *>(aRingP)->orphaned = true;
+}
+
+
+void Logger::flushAtExit()
+{
+  globalLogger.flush();
+}
+
+
+void Logger::flush()
+{
+  pthread_mutex_lock(&writerMutex);
+  drainRings();
+  pthread_mutex_unlock(&writerMutex);
+}
+
+
+// must be called with writerMutex held
+bool Logger::drainRings()
+{
+  bool any = false;
+  LogRing **ringPP = &rings;
+  while (*ringPP) {
+    LogRing *ring = *ringPP;
+    size_t head = ring->head;
+    __sync_synchronize(); // read records only after seeing head
+    while (ring->tail!=head) {
+      LogRecordHeader hdr;
+      ringCopyOut(ring, ring->tail, &hdr, sizeof(hdr));
+      string message;
+      message.resize(hdr.len);
+      if (hdr.len>0) ringCopyOut(ring, ring->tail+sizeof(hdr), &message[0], hdr.len);
+      __sync_synchronize(); // done reading before producer may reuse the space
+      ring->tail = ring->tail+sizeof(hdr)+hdr.len;
+      outputMessage(hdr.level, hdr.time, message, false);
+      any = true;
+    }
+    unsigned long dropped = ring->dropped;
+    if (dropped!=ring->reportedDrops) {
+      struct timeval t;
+      gettimeofday(&t, NULL);
+      string message = string_format("*** Logger: %lu messages dropped (ring buffer full)\n", dropped-ring->reportedDrops);
+      droppedCount += dropped-ring->reportedDrops;
+      ring->reportedDrops = dropped;
+      outputMessage(LOG_WARNING, t, message, false);
+      any = true;
+    }
+    if (ring->orphaned && ring->tail==ring->head) {
+      // thread is gone and everything written, forget ring
+      *ringPP = ring->next;
+      delete ring;
+      continue;
+    }
+    ringPP = &ring->next;
+  }
+  if (any) {
+    // one flush per batch of messages
+    fflush(stderr);
+    fflush(stdout);
+  }
+  return any;
+}
+
+
+void *Logger::writerThreadStart(void *aLoggerP)
+{
+  return static_cast<Logger *>(aLoggerP)->writerThreadFunc();
+}
+
+
+void *Logger::writerThreadFunc()
+{
+  pthread_mutex_lock(&writerMutex);
+  while (!writerStop) {
+    if (!drainRings()) {
+      // nothing to do, announce that we are going to sleep...
+      writerWaiting = true;
+      __sync_synchronize();
+      // ...and check again, as a producer might have added a message before it could see writerWaiting.
+      // Producers seeing writerWaiting signal with the mutex held, which they get only once we wait.
+      if (!drainRings() && !writerStop) {
+        pthread_cond_wait(&writerCond, &writerMutex);
+      }
+      writerWaiting = false;
     }
-    pthread_mutex_unlock(&reportMutex);
   }
+  drainRings();
+  pthread_mutex_unlock(&writerMutex);
+  return NULL;
 }
 
 
@@ -39,6 +39,8 @@
 
 #include <syslog.h>
 
+#include <string>
+
 #include "p44obj.hpp"
 
 #if defined(DEBUG) || ALWAYS_DEBUG
@@ -71,6 +73,11 @@
 #define LOGENABLED(lvl) globalLogger.logEnabled(lvl)
 #define LOG(lvl,...) { if (globalLogger.logEnabled(lvl)) globalLogger.log(lvl,##__VA_ARGS__); }
 
+// asynchronous logging: size of the per-thread ring buffer (must be a power of 2)
+#define LOGGER_ASYNC_RINGBUFFER_SIZE (64*1024)
+// asynchronous logging: longer messages will be truncated
+#define LOGGER_ASYNC_MAX_MESSAGE 4000
+
 #define SETLOGLEVEL(lvl) globalLogger.setLogLevel(lvl)
 #define SETERRLEVEL(lvl, dup) globalLogger.setErrLevel(lvl, dup)
 #define LOGLEVEL (globalLogger.getLogLevel())
@@ -78,12 +85,26 @@
 
 namespace p44 {
 
+  struct LogRing;
+
   class Logger : public P44Obj
   {
     pthread_mutex_t reportMutex;
     int logLevel;
     int stderrLevel;
     bool errToStdout;
+
+    // asynchronous mode
+    volatile bool async; ///< set when messages are queued and written by the writer thread
+    pthread_key_t ringKey; ///< per-thread LogRing
+    LogRing *rings; ///< all per-thread rings (list modified with writerMutex held only)
+    pthread_mutex_t writerMutex; ///< held by whoever drains the rings (writer thread or flush())
+    pthread_cond_t writerCond; ///< signalled to wake writer thread
+    volatile bool writerWaiting; ///< set while writer thread waits for new messages
+    bool writerStop; ///< set to make writer thread exit
+    pthread_t writerThread;
+    unsigned long droppedCount; ///< total number of messages dropped because ring buffer was full
+
   public:
     Logger();
 
@@ -124,6 +145,34 @@ namespace p44 {
     /// @param aErrToStdout if set, messages that qualify for stderr will STILL be duplicated to stdout as well (default = true)
     void setErrLevel(int aStderrLevel, bool aErrToStdout);
 
+    /// enable or disable asynchronous logging
+    /// @param aAsync if set, log() only captures level, time and formatted message into a per-thread ring buffer,
+    ///   and a background thread renders the time stamp and does the actual output.
+    /// @note messages at LOG_CRIT and higher priority are flushed out before log() returns, and all pending messages
+    ///   are flushed at exit().
+    /// @note in asynchronous mode, messages from the same thread keep their order, but messages from different
+    ///   threads might be output slightly out of order.
+    void setAsync(bool aAsync);
+
+    /// @return true if logging asynchronously
+    bool isAsync() { return async; };
+
+    /// write out all messages pending in the ring buffers (NOP when not logging asynchronously)
+    void flush();
+
+    /// @return number of messages dropped so far because the ring buffer of the logging thread was full
+    unsigned long droppedMessages() { return droppedCount; };
+
+  private:
+
+    void outputMessage(int aErrLevel, const struct timeval &aTime, std::string &aMessage, bool aFlush);
+    LogRing *threadRing();
+    bool drainRings();
+    void *writerThreadFunc();
+    static void *writerThreadStart(void *aLoggerP);
+    static void ringThreadExit(void *aRingP);
+    static void flushAtExit();
+
   };
 
 } // namespace p44
@@ -27,6 +27,9 @@
 #include <unistd.h>
 #include <sys/param.h>
 #include <sys/wait.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #include "fdcomm.hpp"
 
@@ -34,6 +37,7 @@
 
 
 #define MAINLOOP_DEFAULT_CYCLE_TIME_uS 100000 // 100mS
+#define MAINLOOP_TICKLESS_MAX_SLEEP_uS 60000000 // 1 minute, tickless mode max sleep when nothing is scheduled
 
 
 using namespace p44;
@@ -100,19 +104,74 @@ ErrorPtr ExecError::exitStatus(int aExitStatus, const char *aContextMessage)
 
 
 MainLoop::MainLoop() :
+  idleHandlersChanged(false),
+  idleHandlersWoken(false),
+  idleHandlersCompleted(true),
+  pollFdsChanged(false),
+  stopWorkers(false),
+  numWorkerThreads(0),
+  idleWorkerThreads(0),
+  maxWorkerThreads(MAINLOOP_DEFAULT_MAX_THREADS),
+  maxPendingThreadJobs(MAINLOOP_DEFAULT_MAX_QUEUED_THREAD_JOBS),
+  postedThreadSignals(NULL),
+  threadSignalFd(-1),
+  threadSignalWriteFd(-1),
+  ticketNo(0),
 	terminated(false),
+  exitCode(EXIT_SUCCESS),
   loopCycleTime(MAINLOOP_DEFAULT_CYCLE_TIME_uS),
   cycleStartTime(Never),
-  exitCode(EXIT_SUCCESS),
-  idleHandlersChanged(false),
-  oneTimeHandlersChanged(false)
+  tickless(false)
 {
+  pthread_mutex_init(&threadPoolMutex, NULL);
+  pthread_cond_init(&threadPoolCond, NULL);
+  #if MAINLOOP_LINUX_EPOLL
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd<0) {
+    LOG(LOG_WARNING,"MainLoop: epoll_create1 failed (%s), falling back to poll()\n", strerror(errno));
+  }
+  pollHandlerGeneration = 0;
+  #endif
   #if MAINLOOP_STATISTICS
   statistics_reset();
   #endif
 }
 
 
+MainLoop::~MainLoop()
+{
+  // stop worker threads: ask running routines to terminate, and wait for the workers to exit
+  pthread_mutex_lock(&threadPoolMutex);
+  stopWorkers = true;
+  for (ThreadJobList::iterator pos = runningThreadJobs.begin(); pos!=runningThreadJobs.end(); ++pos) {
+    (*pos)->cancelRequested = true;
+  }
+  pthread_cond_broadcast(&threadPoolCond);
+  std::vector<pthread_t> workers;
+  workers.swap(workerThreads);
+  pthread_mutex_unlock(&threadPoolMutex);
+  for (std::vector<pthread_t>::iterator pos = workers.begin(); pos!=workers.end(); ++pos) {
+    pthread_join(*pos, NULL);
+  }
+  // discard signals no longer deliverable
+  collectThreadSignals();
+  while (!threadSignalsToDispatch.empty()) {
+    delete threadSignalsToDispatch.front();
+    threadSignalsToDispatch.pop_front();
+  }
+  #if MAINLOOP_LINUX_EPOLL
+  if (epollFd>=0) {
+    close(epollFd);
+    epollFd = -1;
+  }
+  #endif
+  if (threadSignalFd>=0) {
+    if (threadSignalWriteFd!=threadSignalFd) close(threadSignalWriteFd);
+    close(threadSignalFd);
+  }
+}
+
+
 void MainLoop::setLoopCycleTime(MLMicroSeconds aCycleTime)
 {
 	loopCycleTime = aCycleTime;
@@ -125,12 +184,28 @@ MLMicroSeconds MainLoop::remainingCycleTime()
 }
 
 
+void MainLoop::setTickless(bool aTickless)
+{
+  tickless = aTickless;
+  // make sure idle handlers get a chance to run at least once in the new mode
+  idleHandlersWoken = true;
+}
+
+
 void MainLoop::registerIdleHandler(void *aSubscriberP, IdleCB aCallback)
 {
 	IdleHandler h;
 	h.subscriberP = aSubscriberP;
 	h.callback = aCallback;
 	idleHandlers.push_back(h);
+  // new handler needs to run at least once
+  idleHandlersWoken = true;
+}
+
+
+void MainLoop::wakeIdleHandlers()
+{
+  idleHandlersWoken = true;
 }
 
 
@@ -173,32 +248,26 @@ long MainLoop::scheduleOneTimeHandler(OnetimeHandler &aHandler)
   size_t n = onetimeHandlers.size()+1;
   if (n>maxOneTimeHandlers) maxOneTimeHandlers = n;
   #endif
-	// insert in queue before first item that has a higher execution time
-	OnetimeHandlerList::iterator pos = onetimeHandlers.begin();
-  while (pos!=onetimeHandlers.end()) {
-    if (pos->executionTime>aHandler.executionTime) {
-      onetimeHandlers.insert(pos, aHandler);
-      oneTimeHandlersChanged = true;
-      return ticketNo;
-    }
-    ++pos;
-  }
-  // none executes later than this one, just append
-  onetimeHandlers.push_back(aHandler);
-  return ticketNo;
+  // append at the end of the heap, then move up to its place
+  size_t i = onetimeHandlers.size();
+  onetimeHandlers.push_back(OnetimeHandler());
+  OnetimeHandler &h = onetimeHandlers.back();
+  h.ticketNo = aHandler.ticketNo;
+  h.executionTime = aHandler.executionTime;
+  h.callback.swap(aHandler.callback); // avoid copying the functor
+  ticketIndex[h.ticketNo] = i;
+  siftOnetimeHandlerUp(i);
+  return aHandler.ticketNo;
 }
 
 
 void MainLoop::cancelExecutionTicket(long &aTicketNo)
 {
   if (aTicketNo==0) return; // no ticket, NOP
-  for (OnetimeHandlerList::iterator pos = onetimeHandlers.begin(); pos!=onetimeHandlers.end(); ++pos) {
-		if (pos->ticketNo==aTicketNo) {
-			pos = onetimeHandlers.erase(pos);
-      oneTimeHandlersChanged = true;
-      break;
-		}
-	}
+  TicketIndexMap::iterator pos = ticketIndex.find(aTicketNo);
+  if (pos!=ticketIndex.end()) {
+    removeOneTimeHandlerAt(pos->second);
+  }
   // reset the ticket
   aTicketNo = 0;
 }
@@ -214,23 +283,88 @@ bool MainLoop::rescheduleExecutionTicket(long aTicketNo, MLMicroSeconds aDelay)
 bool MainLoop::rescheduleExecutionTicketAt(long aTicketNo, MLMicroSeconds aExecutionTime)
 {
   if (aTicketNo==0) return false; // no ticket, no reschedule
-  for (OnetimeHandlerList::iterator pos = onetimeHandlers.begin(); pos!=onetimeHandlers.end(); ++pos) {
-		if (pos->ticketNo==aTicketNo) {
-      OnetimeHandler h = *pos;
-      // remove from queue
-			pos = onetimeHandlers.erase(pos);
-      // reschedule
-      h.executionTime = aExecutionTime;
-      scheduleOneTimeHandler(h);
-      // reschedule was possible
-      return true;
-		}
-	}
-  // no ticket found, could not reschedule
-  return false;
+  TicketIndexMap::iterator pos = ticketIndex.find(aTicketNo);
+  if (pos==ticketIndex.end()) {
+    // no ticket found, could not reschedule
+    return false;
+  }
+  // update execution time in place and restore heap order
+  size_t i = pos->second;
+  onetimeHandlers[i].executionTime = aExecutionTime;
+  if (siftOnetimeHandlerUp(i)==i) {
+    siftOnetimeHandlerDown(i);
+  }
+  // reschedule was possible
+  return true;
 }
 
 
+void MainLoop::removeOneTimeHandlerAt(size_t aIndex)
+{
+  ticketIndex.erase(onetimeHandlers[aIndex].ticketNo);
+  size_t last = onetimeHandlers.size()-1;
+  if (aIndex!=last) {
+    // move last element into the gap and restore heap order from there
+    swapOnetimeHandlers(aIndex, last);
+    onetimeHandlers.pop_back();
+    if (siftOnetimeHandlerUp(aIndex)==aIndex) {
+      siftOnetimeHandlerDown(aIndex);
+    }
+  }
+  else {
+    onetimeHandlers.pop_back();
+  }
+}
+
+
+bool MainLoop::onetimeHandlerBefore(size_t aIndexA, size_t aIndexB)
+{
+  const OnetimeHandler &a = onetimeHandlers[aIndexA];
+  const OnetimeHandler &b = onetimeHandlers[aIndexB];
+  // handlers with same execution time run in order of scheduling
+  return a.executionTime<b.executionTime || (a.executionTime==b.executionTime && a.ticketNo<b.ticketNo);
+}
+
+
+void MainLoop::swapOnetimeHandlers(size_t aIndexA, size_t aIndexB)
+{
+  OnetimeHandler &a = onetimeHandlers[aIndexA];
+  OnetimeHandler &b = onetimeHandlers[aIndexB];
+  std::swap(a.ticketNo, b.ticketNo);
+  std::swap(a.executionTime, b.executionTime);
+  a.callback.swap(b.callback);
+  ticketIndex[a.ticketNo] = aIndexA;
+  ticketIndex[b.ticketNo] = aIndexB;
+}
+
+
+size_t MainLoop::siftOnetimeHandlerUp(size_t aIndex)
+{
+  while (aIndex>0) {
+    size_t parent = (aIndex-1)/2;
+    if (!onetimeHandlerBefore(aIndex, parent)) break;
+    swapOnetimeHandlers(aIndex, parent);
+    aIndex = parent;
+  }
+  return aIndex;
+}
+
+
+size_t MainLoop::siftOnetimeHandlerDown(size_t aIndex)
+{
+  size_t n = onetimeHandlers.size();
+  while (true) {
+    size_t earliest = aIndex;
+    size_t child = 2*aIndex+1;
+    if (child<n && onetimeHandlerBefore(child, earliest)) earliest = child;
+    ++child;
+    if (child<n && onetimeHandlerBefore(child, earliest)) earliest = child;
+    if (earliest==aIndex) break;
+    swapOnetimeHandlers(aIndex, earliest);
+    aIndex = earliest;
+  }
+  return aIndex;
+}
 
 
 
@@ -375,33 +509,30 @@ void MainLoop::terminate(int aExitCode)
 bool MainLoop::runOnetimeHandlers()
 {
   ML_STAT_START
-  int rep = 5; // max 5 re-evaluations of list due to changes
+  int rep = 5; // max 5 executions of handlers scheduled from within handlers of this run
+  long firstNewTicket = ticketNo+1; // tickets from here on are created by callbacks during this run
   bool moreExecutionsInThisCycle = false;
-  do {
-    OnetimeHandlerList::iterator pos = onetimeHandlers.begin();
-    oneTimeHandlersChanged = false; // detect changes happening from callbacks
-    moreExecutionsInThisCycle = false; // no executions found pending for this cycle yet
-    while (pos!=onetimeHandlers.end()) {
-      if (pos->executionTime>=MainLoop::now()) {
-        // execution is in the future, so don't call yet
-        // - however, if run time is before end of this cycle, make sure we return false, so handlers will be called again in this cycle
-        if (pos->executionTime<cycleStartTime+loopCycleTime)
-          moreExecutionsInThisCycle = true; // next execution is pending before end of this cycle
-        break;
-      }
-      if (terminated) return true; // terminated means everything is considered complete
-      OneTimeCB cb = pos->callback; // get handler
-      pos = onetimeHandlers.erase(pos); // remove from queue
-      cb(cycleStartTime); // call handler
-      if (oneTimeHandlersChanged) {
-        // callback has caused change of onetime handlers list, pos gets invalid
-        break; // but done for now
-      }
-      ++pos;
+  while (!onetimeHandlers.empty()) {
+    OnetimeHandler &h = onetimeHandlers.front();
+    if (h.executionTime>=MainLoop::now()) {
+      // execution is in the future, so don't call yet
+      // - however, if run time is before end of this cycle, make sure we return false, so handlers will be called again in this cycle
+      if (h.executionTime<cycleStartTime+loopCycleTime)
+        moreExecutionsInThisCycle = true; // next execution is pending before end of this cycle
+      break;
     }
-  } while(oneTimeHandlersChanged && rep-->0); // limit repetitions due to changed one time handlers to prevent endless loop
+    if (terminated) return true; // terminated means everything is considered complete
+    if (h.ticketNo>=firstNewTicket && rep--<=0) {
+      // prevent endless loop of handlers immediately re-scheduling themselves
+      break;
+    }
+    OneTimeCB cb;
+    cb.swap(h.callback); // get handler
+    removeOneTimeHandlerAt(0); // remove from queue
+    cb(cycleStartTime); // call handler
+  }
   ML_STAT_ADD(oneTimeHandlerTime);
-  return !moreExecutionsInThisCycle && rep>0; // fully completed only if no more executions in this cycle and we've not ran out of repetitions due to changed handlers
+  return !moreExecutionsInThisCycle && rep>=0; // fully completed only if no more executions in this cycle and we've not ran out of repetitions due to newly scheduled handlers
 }
 
 
@@ -478,16 +609,31 @@ bool MainLoop::checkWait()
 
 
 
-void MainLoop::registerPollHandler(int aFD, int aPollFlags, IOPollCB aPollEventHandler)
+void MainLoop::registerPollHandler(int aFD, int aPollFlags, IOPollCB aPollEventHandler, bool aEdgeTriggered)
 {
-  if (aPollEventHandler.empty())
+  if (aPollEventHandler.empty()) {
     unregisterPollHandler(aFD); // no handler means unregistering handler
+    return;
+  }
   // register new handler
-  IOPollHandler h;
+  std::pair<IOPollHandlerMap::iterator, bool> ins = ioPollHandlers.insert(std::make_pair(aFD, IOPollHandler()));
+  IOPollHandler &h = ins.first->second;
+  if (ins.second) {
+    // new registration (not just replacing the handler of an existing one)
+    #if MAINLOOP_LINUX_EPOLL
+    h.generation = ++pollHandlerGeneration;
+    #else
+    h.generation = 0;
+    #endif
+  }
   h.monitoredFD = aFD;
   h.pollFlags = aPollFlags;
+  h.edgeTriggered = aEdgeTriggered;
   h.pollHandler = aPollEventHandler;
-	ioPollHandlers[aFD] = h;
+  pollFdsChanged = true;
+  #if MAINLOOP_LINUX_EPOLL
+  updateEpollRegistration(h);
+  #endif
 }
 
 
@@ -496,15 +642,22 @@ void MainLoop::changePollFlags(int aFD, int aSetPollFlags, int aClearPollFlags)
   IOPollHandlerMap::iterator pos = ioPollHandlers.find(aFD);
   if (pos!=ioPollHandlers.end()) {
     // found fd to set flags for
+    int newFlags;
     if (aClearPollFlags>=0) {
       // read modify write
       // - clear specified flags
-      pos->second.pollFlags &= ~aClearPollFlags;
-      pos->second.pollFlags |= aSetPollFlags;
+      newFlags = (pos->second.pollFlags & ~aClearPollFlags) | aSetPollFlags;
     }
     else {
       // just set
-      pos->second.pollFlags = aSetPollFlags;
+      newFlags = aSetPollFlags;
+    }
+    if (newFlags!=pos->second.pollFlags) {
+      pos->second.pollFlags = newFlags;
+      pollFdsChanged = true;
+      #if MAINLOOP_LINUX_EPOLL
+      updateEpollRegistration(pos->second);
+      #endif
     }
   }
 }
@@ -513,41 +666,145 @@ void MainLoop::changePollFlags(int aFD, int aSetPollFlags, int aClearPollFlags)
 
 void MainLoop::unregisterPollHandler(int aFD)
 {
-  ioPollHandlers.erase(aFD);
+  if (ioPollHandlers.erase(aFD)>0) {
+    pollFdsChanged = true;
+    #if MAINLOOP_LINUX_EPOLL
+    alwaysReadyFds.erase(aFD);
+    if (epollFd>=0) {
+      // remove from kernel set. Note: fails harmlessly if FD was already closed (closing removes it from the set)
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, aFD, NULL);
+    }
+    #endif
+  }
 }
 
 
+#if MAINLOOP_LINUX_EPOLL
+
+void MainLoop::updateEpollRegistration(IOPollHandler &aHandler)
+{
+  if (epollFd<0) return; // poll() fallback
+  if (aHandler.pollFlags==0) {
+    // disabled handler: remove from kernel set (epoll would still report POLLHUP/POLLERR otherwise)
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, aHandler.monitoredFD, NULL);
+    return;
+  }
+  struct epoll_event ev;
+  ev.events = (uint32_t)aHandler.pollFlags; // POLLxxx and EPOLLxxx have the same values on Linux
+  if (aHandler.edgeTriggered) ev.events |= EPOLLET;
+  // fd in the low, registration generation in the high 32 bits, to detect events for an fd closed and reused within one epoll_wait() batch
+  ev.data.u64 = ((uint64_t)aHandler.generation<<32) | (uint32_t)aHandler.monitoredFD;
+  int ret = epoll_ctl(epollFd, EPOLL_CTL_MOD, aHandler.monitoredFD, &ev);
+  if (ret<0 && errno==ENOENT) {
+    // not yet in the kernel set
+    ret = epoll_ctl(epollFd, EPOLL_CTL_ADD, aHandler.monitoredFD, &ev);
+  }
+  if (ret<0) {
+    if (errno==EPERM) {
+      // fd does not support epoll (regular file, /dev/null): poll() would always report it ready, so do the same
+      LOG(LOG_DEBUG,"MainLoop: fd %d cannot be monitored by epoll, treating it as always ready\n", aHandler.monitoredFD);
+      alwaysReadyFds.insert(aHandler.monitoredFD);
+    }
+    else {
+      LOG(LOG_ERR,"MainLoop: cannot add fd %d to epoll set: %s\n", aHandler.monitoredFD, strerror(errno));
+    }
+  }
+}
+
+#endif // MAINLOOP_LINUX_EPOLL
+
+
+bool MainLoop::callIOPollHandler(int aFD, int aPollFlags)
+{
+  // get handler, note that it might have been deleted in the meantime
+  IOPollHandlerMap::iterator pos = ioPollHandlers.find(aFD);
+  if (pos==ioPollHandlers.end()) return false;
+  return callIOPollHandler(pos, aPollFlags);
+}
+
+
+bool MainLoop::callIOPollHandler(IOPollHandlerMap::iterator aPos, int aPollFlags)
+{
+  ML_STAT_START
+  bool didHandle = aPos->second.pollHandler(cycleStartTime, aPos->first, aPollFlags); // false when handler just checked flags and found nothing to do
+  ML_STAT_ADD(ioHandlerTime);
+  return didHandle;
+}
+
 
 bool MainLoop::handleIOPoll(MLMicroSeconds aTimeout)
 {
-  // create poll structure
-  struct pollfd *pollFds = NULL;
-  size_t maxFDsToTest = ioPollHandlers.size();
-  if (maxFDsToTest>0) {
-    // allocate pollfd array (max, in case some are disabled, we'll need less)
-    pollFds = new struct pollfd[maxFDsToTest];
-  }
-  // fill poll structure
-  IOPollHandlerMap::iterator pos = ioPollHandlers.begin();
-  size_t numFDsToTest = 0;
-  // collect FDs
-  while (pos!=ioPollHandlers.end()) {
-    IOPollHandler h = pos->second;
-    if (h.pollFlags) {
-      // don't include handlers that are currently disabled (no flags set)
-      struct pollfd *pollfdP = &pollFds[numFDsToTest];
-      pollfdP->fd = h.monitoredFD;
-      pollfdP->events = h.pollFlags;
-      pollfdP->revents = 0; // no event returned so far
-      ++numFDsToTest;
-    }
-    ++pos;
+  #if MAINLOOP_LINUX_EPOLL
+  if (epollFd>=0) {
+    return handleIOPollWithEpoll(aTimeout);
+  }
+  #endif
+  return handleIOPollWithPoll(aTimeout);
+}
+
+
+#if MAINLOOP_LINUX_EPOLL
+
+bool MainLoop::handleIOPollWithEpoll(MLMicroSeconds aTimeout)
+{
+  // FDs not supported by epoll are always ready, so don't block when there are any
+  if (!alwaysReadyFds.empty()) aTimeout = 0;
+  // block until input becomes available or timeout
+  // Note: registrations are kept in the kernel, so cost only depends on the number of ready FDs
+  int numReadyFDs = epoll_wait(epollFd, epollEvents, MAINLOOP_MAX_EPOLL_EVENTS, aTimeout>0 ? (int)(aTimeout/MilliSecond) : 0);
+  // call handlers
+  for (int i = 0; i<numReadyFDs; i++) {
+    struct epoll_event *evP = &epollEvents[i];
+    int fd = (int)(uint32_t)(evP->data.u64 & 0xFFFFFFFF);
+    // get handler, note that it might have been deleted (and the fd reused for a new registration) in the meantime
+    IOPollHandlerMap::iterator pos = ioPollHandlers.find(fd);
+    if (pos==ioPollHandlers.end() || pos->second.generation!=(uint32_t)(evP->data.u64>>32)) continue; // stale event
+    callIOPollHandler(pos, (int)(evP->events & ~EPOLLET));
+  }
+  if (!alwaysReadyFds.empty()) {
+    // report always ready FDs for the events they are waiting for (copy, handlers might unregister)
+    FdSet readyFds = alwaysReadyFds;
+    for (FdSet::iterator pos = readyFds.begin(); pos!=readyFds.end(); ++pos) {
+      IOPollHandlerMap::iterator hpos = ioPollHandlers.find(*pos);
+      if (hpos==ioPollHandlers.end()) continue;
+      int readyFlags = hpos->second.pollFlags & (POLLIN|POLLOUT);
+      if (readyFlags) {
+        callIOPollHandler(hpos, readyFlags);
+        numReadyFDs++;
+      }
+    }
+  }
+  // return true if epoll actually reported something (not just timed out)
+  return numReadyFDs>0;
+}
+
+#endif // MAINLOOP_LINUX_EPOLL
+
+
+bool MainLoop::handleIOPollWithPoll(MLMicroSeconds aTimeout)
+{
+  if (pollFdsChanged) {
+    // registrations have changed, rebuild poll structure
+    pollFds.clear();
+    for (IOPollHandlerMap::iterator pos = ioPollHandlers.begin(); pos!=ioPollHandlers.end(); ++pos) {
+      IOPollHandler &h = pos->second;
+      if (h.pollFlags) {
+        // don't include handlers that are currently disabled (no flags set)
+        struct pollfd pfd;
+        pfd.fd = h.monitoredFD;
+        pfd.events = h.pollFlags;
+        pfd.revents = 0; // no event returned so far
+        pollFds.push_back(pfd);
+      }
+    }
+    pollFdsChanged = false;
   }
   // block until input becomes available or timeout
   int numReadyFDs = 0;
+  size_t numFDsToTest = pollFds.size();
   if (numFDsToTest>0) {
     // actual FDs to test
-    numReadyFDs = poll(pollFds, (int)numFDsToTest, (int)(aTimeout/MilliSecond));
+    numReadyFDs = poll(&pollFds[0], (int)numFDsToTest, (int)(aTimeout/MilliSecond));
   }
   else {
     // nothing to test, just await timeout
@@ -556,28 +813,19 @@ bool MainLoop::handleIOPoll(MLMicroSeconds aTimeout)
     }
   }
   // call handlers
-  bool didHandle = false;
   if (numReadyFDs>0) {
     // at least one of the flagged events has occurred in at least one FD
     // - find the FDs that are affected and call their handlers when needed
-    for (int i = 0; i<numFDsToTest; i++) {
+    // Note: handlers changing registrations only mark pollFds for rebuild in the next call, so iterating is safe
+    for (size_t i = 0; i<numFDsToTest; i++) {
       struct pollfd *pollfdP = &pollFds[i];
       if (pollfdP->revents) {
-        ML_STAT_START
         // an event has occurred for this FD
-        // - get handler, note that it might have been deleted in the meantime
-        IOPollHandlerMap::iterator pos = ioPollHandlers.find(pollfdP->fd);
-        if (pos!=ioPollHandlers.end()) {
-          // - there is a handler
-          if (pos->second.pollHandler(cycleStartTime, pollfdP->fd, pollfdP->revents))
-            didHandle = true; // really handled (not just checked flags and decided it's nothing to handle)
-        }
-        ML_STAT_ADD(ioHandlerTime);
+        callIOPollHandler(pollfdP->fd, pollfdP->revents);
+        pollfdP->revents = 0;
       }
     }
   }
-  // return the poll array
-  delete[] pollFds;
   // return true if poll actually reported something (not just timed out)
   return numReadyFDs>0;
 }
@@ -585,6 +833,81 @@ bool MainLoop::handleIOPoll(MLMicroSeconds aTimeout)
 
 
 
+void MainLoop::runCycle()
+{
+  cycleStartTime = now();
+  // start of a new cycle
+  while (!terminated) {
+    bool allCompleted = runOnetimeHandlers();
+    if (terminated) break;
+    if (!runIdleHandlers()) allCompleted = false;
+    if (terminated) break;
+    if (!checkWait()) allCompleted = false;
+    if (terminated) break;
+    MLMicroSeconds timeLeft = remainingCycleTime();
+    // if other handlers have not completed yet, don't wait for I/O, just quickly check
+    bool iohandled = false;
+    if (!allCompleted || timeLeft<=0) {
+      // no time to wait for I/O, just check
+      ML_STAT_START
+      iohandled = handleIOPoll(0);
+      ML_STAT_ADD(ioHandlerTime);
+    }
+    else {
+      // nothing to do except waiting for I/O
+      #if MAINLOOP_STATISTICS
+      statisticsWakeups++;
+      #endif
+      iohandled = handleIOPoll(timeLeft);
+      if (!iohandled) {
+        // timed out, end of cycle
+        break;
+      }
+      // not timed out, means we might still have some time left
+    }
+    // if no time left, end the cycle, otherwise re-run handlers
+    if (terminated || remainingCycleTime()<=0) {
+      break; // no more time, end the cycle here
+    }
+  } // not terminated
+}
+
+
+void MainLoop::runTicklessPass()
+{
+  cycleStartTime = now();
+  runOnetimeHandlers();
+  if (terminated) return;
+  // idle handlers only run when woken, or when they did not complete last time
+  if (idleHandlersWoken || !idleHandlersCompleted) {
+    idleHandlersWoken = false;
+    idleHandlersCompleted = runIdleHandlers();
+    if (terminated) return;
+  }
+  bool allCompleted = checkWait() && idleHandlersCompleted && !idleHandlersWoken;
+  if (terminated) return;
+  // determine how long we can sleep
+  MLMicroSeconds timeout = 0;
+  if (allCompleted) {
+    timeout = MAINLOOP_TICKLESS_MAX_SLEEP_uS;
+    if (!onetimeHandlers.empty()) {
+      // sleep until next one-time handler is due (rounded up to poll()'s millisecond resolution)
+      MLMicroSeconds untilNext = onetimeHandlers.front().executionTime-now();
+      untilNext = untilNext<=0 ? 0 : (untilNext+MilliSecond-1)/MilliSecond*MilliSecond;
+      if (untilNext<timeout) timeout = untilNext;
+    }
+    if (!waitHandlers.empty() && loopCycleTime<timeout) {
+      // child process termination is only detected by polling waitpid()
+      timeout = loopCycleTime;
+    }
+  }
+  #if MAINLOOP_STATISTICS
+  if (timeout>0) statisticsWakeups++;
+  #endif
+  handleIOPoll(timeout);
+}
+
+
 int MainLoop::run()
 {
   #if MAINLOOP_STATISTICS
@@ -608,38 +931,10 @@ int MainLoop::run()
   LOG(LOG_DEBUG,"- measurement 3: %.6f S, average: %.6f S\n", (double)t/Second, (double)(tsum/3)/Second);
   #endif
   while (!terminated) {
-    cycleStartTime = now();
-    // start of a new cycle
-    while (!terminated) {
-      bool allCompleted = runOnetimeHandlers();
-      if (terminated) break;
-			if (!runIdleHandlers()) allCompleted = false;
-      if (terminated) break;
-      if (!checkWait()) allCompleted = false;
-      if (terminated) break;
-      MLMicroSeconds timeLeft = remainingCycleTime();
-      // if other handlers have not completed yet, don't wait for I/O, just quickly check
-      bool iohandled = false;
-      if (!allCompleted || timeLeft<=0) {
-        // no time to wait for I/O, just check
-        ML_STAT_START
-        iohandled = handleIOPoll(0);
-        ML_STAT_ADD(ioHandlerTime);
-      }
-      else {
-        // nothing to do except waiting for I/O
-        iohandled = handleIOPoll(timeLeft);
-        if (!iohandled) {
-          // timed out, end of cycle
-          break;
-        }
-        // not timed out, means we might still have some time left
-      }
-      // if no time left, end the cycle, otherwise re-run handlers
-      if (terminated || remainingCycleTime()<=0) {
-        break; // no more time, end the cycle here
-      }
-    } // not terminated
+    if (tickless)
+      runTicklessPass();
+    else
+      runCycle();
     #if MAINLOOP_STATISTICS
     statisticsCycles ++; // one cycle completed
     #endif
@@ -654,10 +949,16 @@ string MainLoop::description()
   #if MAINLOOP_STATISTICS
   MLMicroSeconds statisticsPeriod = now()-statisticsStartTime;
   #endif
+  // - heap only knows the earliest handler, find latest by scanning
+  MLMicroSeconds latest = Never;
+  for (OnetimeHandlerHeap::iterator pos = onetimeHandlers.begin(); pos!=onetimeHandlers.end(); ++pos) {
+    if (pos->executionTime>latest) latest = pos->executionTime;
+  }
   return string_format(
-    "MainLoop: loopCycleTime        : %.6f S%s\n"
+    "MainLoop: loopCycleTime        : %.6f S%s%s\n"
     #if MAINLOOP_STATISTICS
     "- statistics period            : %.6f S (%ld cycles)\n"
+    "- wakeups per second           : %.1f\n"
     "- actual/specified cycle time  : %d%% (actual average = %.6f S)\n"
     "- idle handlers                : %d%%\n"
     "- one time handlers            : %d%%\n"
@@ -672,13 +973,17 @@ string MainLoop::description()
     #if MAINLOOP_STATISTICS
     "  max waiting in period        : %ld\n"
     #endif
-    "- number of I/O poll handlers  : %ld\n"
-    "- number of wait handlers      : %ld\n",
+    "- number of I/O poll handlers  : %ld (using %s)\n"
+    "- number of wait handlers      : %ld\n"
+    "- thread pool workers          : %d (%d idle, max %d)\n"
+    "  queued thread jobs           : %ld (max %ld)\n",
     (double)loopCycleTime/Second,
+    tickless ? " (tickless)" : "",
     terminated ? " (terminating)" : "",
     #if MAINLOOP_STATISTICS
     (double)statisticsPeriod/Second,
     statisticsCycles,
+    (double)(statisticsPeriod>0 ? (double)statisticsWakeups*Second/statisticsPeriod : 0),
     (int)(statisticsCycles>0 ? 100ll * statisticsPeriod/(statisticsCycles*loopCycleTime) : 0),
     (double)statisticsPeriod/statisticsCycles/Second,
     (int)(statisticsPeriod>0 ? 100ll * ioHandlerTime/statisticsPeriod : 0),
@@ -690,12 +995,19 @@ string MainLoop::description()
     (long)idleHandlers.size(),
     (long)onetimeHandlers.size(),
     (double)(onetimeHandlers.size()>0 ? onetimeHandlers.front().executionTime-now() : 0)/Second,
-    (double)(onetimeHandlers.size()>0 ? onetimeHandlers.back().executionTime-now() : 0)/Second,
+    (double)(onetimeHandlers.size()>0 ? latest-now() : 0)/Second,
     #if MAINLOOP_STATISTICS
     (long)maxOneTimeHandlers,
     #endif
     (long)ioPollHandlers.size(),
-    (long)waitHandlers.size()
+    #if MAINLOOP_LINUX_EPOLL
+    epollFd>=0 ? "epoll" : "poll",
+    #else
+    "poll",
+    #endif
+    (long)waitHandlers.size(),
+    numWorkerThreads, idleWorkerThreads, maxWorkerThreads,
+    (long)pendingThreadJobs.size(), (long)maxPendingThreadJobs
   );
 }
 
@@ -705,6 +1017,7 @@ void MainLoop::statistics_reset()
   #if MAINLOOP_STATISTICS
   statisticsStartTime = now();
   statisticsCycles = 0;
+  statisticsWakeups = 0;
   maxOneTimeHandlers = 0;
   ioHandlerTime = 0;
   idleHandlerTime = 0;
@@ -718,66 +1031,241 @@ void MainLoop::statistics_reset()
 #pragma mark - execution in subthreads
 
 
-ChildThreadWrapperPtr MainLoop::executeInThread(ThreadRoutine aThreadRoutine, ThreadSignalHandler aThreadSignalHandler)
+void MainLoop::setThreadPoolLimits(int aMaxThreads, size_t aMaxQueuedJobs)
 {
-  return ChildThreadWrapperPtr(new ChildThreadWrapper(*this, aThreadRoutine, aThreadSignalHandler));
+  pthread_mutex_lock(&threadPoolMutex);
+  maxWorkerThreads = aMaxThreads>0 ? aMaxThreads : 1;
+  maxPendingThreadJobs = aMaxQueuedJobs;
+  pthread_mutex_unlock(&threadPoolMutex);
 }
 
 
-#pragma mark - ChildThreadWrapper
+ChildThreadWrapperPtr MainLoop::executeInThread(ThreadRoutine aThreadRoutine, ThreadSignalHandler aThreadSignalHandler)
+{
+  ChildThreadWrapperPtr thread = ChildThreadWrapperPtr(new ChildThreadWrapper(*this, aThreadRoutine, aThreadSignalHandler));
+  // keep wrapper object alive until completion has been delivered
+  thread->selfRef = thread;
+  // make sure we have a channel for getting signals back from the workers
+  if (threadSignalFd<0) {
+    #ifdef __linux__
+    threadSignalFd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    threadSignalWriteFd = threadSignalFd;
+    #else
+    int pipeFdPair[2];
+    if (pipe(pipeFdPair)==0) {
+      threadSignalFd = pipeFdPair[0]; // 0 is the reading end
+      threadSignalWriteFd = pipeFdPair[1]; // 1 is the writing end
+      fcntl(threadSignalFd, F_SETFL, fcntl(threadSignalFd, F_GETFL) | O_NONBLOCK);
+    }
+    #endif
+    if (threadSignalFd>=0) {
+      registerPollHandler(threadSignalFd, POLLIN, boost::bind(&MainLoop::threadSignalHandler, this, _3));
+    }
+    else {
+      LOG(LOG_ERR,"MainLoop: cannot create thread signal channel (%s)\n", strerror(errno));
+    }
+  }
+  bool queued = false;
+  if (threadSignalFd>=0) {
+    pthread_mutex_lock(&threadPoolMutex);
+    if (pendingThreadJobs.size()<maxPendingThreadJobs) {
+      thread->threadPending = true;
+      pendingThreadJobs.push_back(thread.get());
+      // start another worker if all existing ones are busy
+      if (idleWorkerThreads<(int)pendingThreadJobs.size() && numWorkerThreads<maxWorkerThreads) {
+        pthread_t worker;
+        if (pthread_create(&worker, NULL, threadPoolWorkerStart, this)==0) {
+          numWorkerThreads++;
+          workerThreads.push_back(worker);
+        }
+        else {
+          LOG(LOG_WARNING,"MainLoop: cannot create additional worker thread (%s)\n", strerror(errno));
+        }
+      }
+      if (numWorkerThreads>0) {
+        queued = true;
+        pthread_cond_signal(&threadPoolCond);
+      }
+      else {
+        // no worker at all to run this job
+        pendingThreadJobs.pop_back();
+        thread->threadPending = false;
+      }
+    }
+    pthread_mutex_unlock(&threadPoolMutex);
+  }
+  if (!queued) {
+    // report failure asynchronously, so caller has the wrapper before the handler gets called
+    LOG(LOG_WARNING,"MainLoop: cannot execute routine in thread (job queue full or no worker thread)\n");
+    postThreadSignal(thread.get(), threadSignalFailedToStart);
+  }
+  return thread;
+}
 
 
-static void *thread_start_function(void *arg)
+void *MainLoop::threadPoolWorkerStart(void *aMainLoopP)
 {
-  // pass into method of wrapper
-  return static_cast<ChildThreadWrapper *>(arg)->startFunction();
+  // pass into method of mainloop
+  return static_cast<MainLoop *>(aMainLoopP)->threadPoolWorker();
 }
 
 
-void *ChildThreadWrapper::startFunction()
+// runs on worker thread
+void *MainLoop::threadPoolWorker()
 {
-  // run the routine
-  threadRoutine(*this);
-  // signal termination
-  terminated();
+  pthread_mutex_lock(&threadPoolMutex);
+  while (true) {
+    while (pendingThreadJobs.empty() && !stopWorkers) {
+      idleWorkerThreads++;
+      pthread_cond_wait(&threadPoolCond, &threadPoolMutex);
+      idleWorkerThreads--;
+    }
+    if (stopWorkers) break;
+    ChildThreadWrapper *job = pendingThreadJobs.front();
+    pendingThreadJobs.pop_front();
+    job->threadPending = false;
+    job->threadRunning = true;
+    runningThreadJobs.push_back(job);
+    pthread_mutex_unlock(&threadPoolMutex);
+    // run the routine
+    job->threadRoutine(*job);
+    pthread_mutex_lock(&threadPoolMutex);
+    job->threadRunning = false;
+    runningThreadJobs.remove(job);
+    // signal termination while still holding the lock, so a concurrent cancel() will see either a running job
+    // or the completion signal. A cancelled job only uses it to release the wrapper on the parent thread.
+    // (job must not be touched after unlocking, parent might delete it)
+    job->terminated();
+  }
+  numWorkerThreads--;
+  pthread_mutex_unlock(&threadPoolMutex);
   return NULL;
 }
 
 
+// called from parent thread, never blocks
+bool MainLoop::cancelThreadJob(ChildThreadWrapper *aThreadP, bool &aStillRunning)
+{
+  bool cancelled = false;
+  aStillRunning = false;
+  pthread_mutex_lock(&threadPoolMutex);
+  if (aThreadP->threadPending) {
+    // not yet started, just remove from queue
+    pendingThreadJobs.remove(aThreadP);
+    aThreadP->threadPending = false;
+    cancelled = true;
+  }
+  else if (aThreadP->threadRunning) {
+    // running: ask the routine to terminate, but don't wait for it
+    // (a worker is never cancelled asynchronously, as the routine might hold locks or heap state)
+    aThreadP->cancelRequested = true;
+    aStillRunning = true;
+    cancelled = true;
+  }
+  // signals from the job posted so far must not be delivered any more, even if the routine had already completed
+  // (worker posts the completion signal under threadPoolMutex, so it is visible here when job is no longer running)
+  purgeThreadSignals(aThreadP);
+  pthread_mutex_unlock(&threadPoolMutex);
+  return cancelled;
+}
 
-ChildThreadWrapper::ChildThreadWrapper(MainLoop &aParentThreadMainLoop, ThreadRoutine aThreadRoutine, ThreadSignalHandler aThreadSignalHandler) :
-  parentThreadMainLoop(aParentThreadMainLoop),
-  threadRoutine(aThreadRoutine),
-  parentSignalHandler(aThreadSignalHandler),
-  threadRunning(false)
-{
-  // create a signal pipe
-  int pipeFdPair[2];
-  if (pipe(pipeFdPair)==0) {
-    // pipe could be created
-    // - save FDs
-    parentSignalFd = pipeFdPair[0]; // 0 is the reading end
-    childSignalFd = pipeFdPair[1]; // 1 is the writing end
-    // - install poll handler in the parent mainloop
-    parentThreadMainLoop.registerPollHandler(parentSignalFd, POLLIN, boost::bind(&ChildThreadWrapper::signalPipeHandler, this, _3));
-    // create a pthread (with default attrs for now
-    threadRunning = true; // before creating it, to make sure it is set when child starts to run
-    if (pthread_create(&pthread, NULL, thread_start_function, this)!=0) {
-      // error, could not create thread, fake a signal callback immediately
-      threadRunning = false;
-      if (parentSignalHandler)
-        parentSignalHandler(*this, threadSignalFailedToStart);
+
+// can be called from any thread
+void MainLoop::postThreadSignal(ChildThreadWrapper *aThreadP, ThreadSignals aSignalCode)
+{
+  ThreadSignalRecord *rec = new ThreadSignalRecord;
+  rec->threadP = aThreadP;
+  rec->signalCode = aSignalCode;
+  // push onto lock-free LIFO
+  ThreadSignalRecord *head;
+  do {
+    head = postedThreadSignals;
+    rec->next = head;
+  } while (!__sync_bool_compare_and_swap(&postedThreadSignals, head, rec));
+  if (head==NULL) {
+    // first signal since parent last collected, wake parent
+    // (parent resets the wakeup before collecting, so later signals will be collected along with this one)
+    #ifdef __linux__
+    uint64_t one = 1;
+    write(threadSignalWriteFd, &one, sizeof(one));
+    #else
+    uint8_t sigByte = aSignalCode;
+    write(threadSignalWriteFd, &sigByte, 1);
+    #endif
+  }
+}
+
+
+// called from parent thread
+void MainLoop::collectThreadSignals()
+{
+  ThreadSignalRecord *rec = __sync_lock_test_and_set(&postedThreadSignals, (ThreadSignalRecord *)NULL);
+  // LIFO has newest first, restore posting order
+  ThreadSignalList collected;
+  while (rec) {
+    collected.push_front(rec);
+    rec = rec->next;
+  }
+  threadSignalsToDispatch.splice(threadSignalsToDispatch.end(), collected);
+}
+
+
+// called from parent thread
+void MainLoop::purgeThreadSignals(ChildThreadWrapper *aThreadP)
+{
+  collectThreadSignals();
+  ThreadSignalList::iterator pos = threadSignalsToDispatch.begin();
+  while (pos!=threadSignalsToDispatch.end()) {
+    if ((*pos)->threadP==aThreadP) {
+      delete *pos;
+      pos = threadSignalsToDispatch.erase(pos);
     }
     else {
-      // thread created ok, keep wrapper object alive
-      selfRef = ChildThreadWrapperPtr(this);
+      ++pos;
     }
   }
-  else {
-    // pipe could not be created
-    if (parentSignalHandler)
-      parentSignalHandler(*this, threadSignalFailedToStart);
+}
+
+
+// called on parent thread from Mainloop
+bool MainLoop::threadSignalHandler(int aPollFlags)
+{
+  if ((aPollFlags & POLLIN)==0) return false;
+  // reset wakeup first
+  #ifdef __linux__
+  uint64_t cnt;
+  read(threadSignalFd, &cnt, sizeof(cnt));
+  #else
+  uint8_t buf[64];
+  while (read(threadSignalFd, buf, sizeof(buf))>0);
+  #endif
+  // collect and dispatch all signals posted so far
+  collectThreadSignals();
+  while (!threadSignalsToDispatch.empty()) {
+    // Note: handlers may cancel other jobs and thus purge records from threadSignalsToDispatch
+    ThreadSignalRecord *rec = threadSignalsToDispatch.front();
+    threadSignalsToDispatch.pop_front();
+    ChildThreadWrapper *threadP = rec->threadP;
+    ThreadSignals sig = rec->signalCode;
+    delete rec;
+    threadP->signalReceived(sig);
   }
+  return true;
+}
+
+
+
+#pragma mark - ChildThreadWrapper
+
+
+ChildThreadWrapper::ChildThreadWrapper(MainLoop &aParentThreadMainLoop, ThreadRoutine aThreadRoutine, ThreadSignalHandler aThreadSignalHandler) :
+  threadPending(false),
+  threadRunning(false),
+  cancelRequested(false),
+  parentThreadMainLoop(aParentThreadMainLoop),
+  parentSignalHandler(aThreadSignalHandler),
+  threadRoutine(aThreadRoutine)
+{
 }
 
 
@@ -789,7 +1277,7 @@ ChildThreadWrapper::~ChildThreadWrapper()
 
 
 
-// called from child thread when terminated
+// called from worker thread when routine has returned
 void ChildThreadWrapper::terminated()
 {
   signalParentThread(threadSignalCompleted);
@@ -801,22 +1289,7 @@ void ChildThreadWrapper::terminated()
 // called from child thread to send signal
 void ChildThreadWrapper::signalParentThread(ThreadSignals aSignalCode)
 {
-  uint8_t sigByte = aSignalCode;
-  write(childSignalFd, &sigByte, 1);
-}
-
-
-// cleanup, called from parent thread
-void ChildThreadWrapper::finalizeThreadExecution()
-{
-  // synchronize with actual end of thread execution
-  pthread_join(pthread, NULL);
-  threadRunning = false;
-  // unregister the handler
-  MainLoop::currentMainLoop().unregisterPollHandler(parentSignalFd);
-  // close the pipes
-  close(childSignalFd);
-  close(parentSignalFd);
+  parentThreadMainLoop.postThreadSignal(this, aSignalCode);
 }
 
 
@@ -824,54 +1297,37 @@ void ChildThreadWrapper::finalizeThreadExecution()
 // can be called from parent thread
 void ChildThreadWrapper::cancel()
 {
-  if (threadRunning) {
-    // cancel it
-    pthread_cancel(pthread);
-    // wait for cancellation to complete
-    finalizeThreadExecution();
-    // cancelled
-    if (parentSignalHandler)
-      parentSignalHandler(*this, threadSignalCancelled);
+  // Note: whatever state the job was in, no queued signals for it remain after cancelThreadJob()
+  bool stillRunning;
+  bool cancelled = parentThreadMainLoop.cancelThreadJob(this, stillRunning);
+  // handler must not be called any more (it might be bound to an object that is about to be deleted)
+  ThreadSignalHandler handler = parentSignalHandler;
+  parentSignalHandler.clear();
+  if (cancelled && handler) {
+    handler(*this, threadSignalCancelled);
+  }
+  if (!stillRunning) {
+    // in case nobody keeps this object any more, it might be deleted now
+    selfRef.reset();
   }
+  // otherwise, the worker still uses this object. It is released when the completion signal arrives
+  // (which is not delivered to the detached handler any more)
 }
 
 
 
 // called on parent thread from Mainloop
-bool ChildThreadWrapper::signalPipeHandler(int aPollFlags)
-{
-  ThreadSignals sig = threadSignalNone;
-  //DBGLOG(LOG_DEBUG, "\nMAINTHREAD: signalPipeHandler with pollFlags=0x%X\n", aPollFlags);
-  if (aPollFlags & POLLIN) {
-    uint8_t sigByte;
-    ssize_t res = read(parentSignalFd, &sigByte, 1); // read signal byte
-    if (res==1) {
-      sig = (ThreadSignals)sigByte;
-    }
-  }
-  else if (aPollFlags & POLLHUP) {
-    // HUP means thread has terminated and closed the other end of the pipe already
-    // - treat like receiving a threadSignalCompleted
-    sig = threadSignalCompleted;
-  }
-  if (sig!=threadSignalNone) {
-    // check for thread terminated
-    if (sig==threadSignalCompleted) {
-      // finalize thread execution first
-      finalizeThreadExecution();
-    }
-    // got signal byte, call handler
-    if (parentSignalHandler) {
-      ML_STAT_START_AT(parentThreadMainLoop.now());
-      parentSignalHandler(*this, sig);
-      ML_STAT_ADD_AT(parentThreadMainLoop.threadSignalHandlerTime, parentThreadMainLoop.now());
-    }
-    // in case nobody keeps this object any more, it might be deleted now
+void ChildThreadWrapper::signalReceived(ThreadSignals aSignalCode)
+{
+  // keep alive while handler runs, handler might release the last external reference
+  ChildThreadWrapperPtr keepAlive = ChildThreadWrapperPtr(this);
+  if (parentSignalHandler) {
+    ML_STAT_START_AT(parentThreadMainLoop.now());
+    parentSignalHandler(*this, aSignalCode);
+    ML_STAT_ADD_AT(parentThreadMainLoop.threadSignalHandlerTime, parentThreadMainLoop.now());
+  }
+  if (aSignalCode==threadSignalCompleted || aSignalCode==threadSignalFailedToStart) {
+    // routine is done, no more signals will arrive
     selfRef.reset();
-    // handled some i/O
-    return true;
   }
-  return false; // did not handle any I/O
 }
-
-
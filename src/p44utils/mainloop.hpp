@@ -27,9 +27,32 @@
 #include <sys/poll.h>
 #include <pthread.h>
 
+#include <boost/unordered_map.hpp>
+#include <set>
+
 // if set to non-zero, mainloop will have some code to record statistics
 #define MAINLOOP_STATISTICS 1
 
+// if set to non-zero, mainloop will use epoll() instead of poll() to wait for I/O (Linux only)
+#ifndef MAINLOOP_LINUX_EPOLL
+  #ifdef __linux__
+    #define MAINLOOP_LINUX_EPOLL 1
+  #else
+    #define MAINLOOP_LINUX_EPOLL 0
+  #endif
+#endif
+
+// max number of epoll events fetched per mainloop I/O poll
+#define MAINLOOP_MAX_EPOLL_EVENTS 64
+
+// default limits for the thread pool executing executeInThread() routines
+#define MAINLOOP_DEFAULT_MAX_THREADS 8
+#define MAINLOOP_DEFAULT_MAX_QUEUED_THREAD_JOBS 64
+
+#if MAINLOOP_LINUX_EPOLL
+#include <sys/epoll.h>
+#endif
+
 using namespace std;
 
 namespace p44 {
@@ -50,7 +73,7 @@ namespace p44 {
   const MLMicroSeconds Minute = 60*Second;
 
 
-  /// subthread/maintthread communication signals (sent via pipe)
+  /// subthread/maintthread communication signals (posted via the parent mainloop's thread signal queue)
   typedef enum {
     threadSignalNone,
     threadSignalCompleted, ///< sent to parent when child thread terminates
@@ -93,7 +116,7 @@ namespace p44 {
   /// @return should true if callback really handled some I/O, false if it only checked flags and found nothing to do
   typedef boost::function<bool (MLMicroSeconds aCycleStartTime, int aFD, int aPollFlags)> IOPollCB;
 
-  /// thread routine, will be called on a separate thread
+  /// thread routine, will be called on a separate thread (a worker thread of the parent mainloop's thread pool)
   /// @param aThreadWrapper the object that wraps the thread and allows sending signals to the parent thread
   ///   Use this pointer to call signalParentThread() on
   /// @note when this routine exits, a threadSignalCompleted will be sent to the parent thread
@@ -138,16 +161,19 @@ namespace p44 {
 
     IdleHandlerList idleHandlers;
     bool idleHandlersChanged;
+    bool idleHandlersWoken; ///< tickless mode: idle handlers must run in the next loop pass
+    bool idleHandlersCompleted; ///< tickless mode: all idle handlers reported completion in their last run
 
     typedef struct {
       long ticketNo;
       MLMicroSeconds executionTime;
       OneTimeCB callback;
     } OnetimeHandler;
-    typedef std::list<OnetimeHandler> OnetimeHandlerList;
+    typedef std::vector<OnetimeHandler> OnetimeHandlerHeap;
+    typedef boost::unordered_map<long, size_t> TicketIndexMap;
 
-    OnetimeHandlerList onetimeHandlers;
-    bool oneTimeHandlersChanged;
+    OnetimeHandlerHeap onetimeHandlers; ///< binary min-heap, earliest executionTime (lowest ticketNo for same time) at front
+    TicketIndexMap ticketIndex; ///< maps ticket numbers to the current position of the handler in onetimeHandlers
 
     typedef struct {
       pid_t pid;
@@ -160,12 +186,51 @@ namespace p44 {
     typedef struct {
       int monitoredFD;
       int pollFlags;
+      bool edgeTriggered;
+      uint32_t generation; ///< identifies this registration, to tell it apart from an earlier one on a reused fd number
       IOPollCB pollHandler;
     } IOPollHandler;
     typedef std::map<int, IOPollHandler> IOPollHandlerMap;
 
     IOPollHandlerMap ioPollHandlers;
 
+    typedef std::vector<struct pollfd> PollFdVector;
+    PollFdVector pollFds; ///< poll() fallback: pollfd array, rebuilt only when ioPollHandlers change
+    bool pollFdsChanged; ///< poll() fallback: set when pollFds needs to be rebuilt
+
+    #if MAINLOOP_LINUX_EPOLL
+    int epollFd; ///< the epoll instance holding all active registrations, -1 if poll() fallback is used
+    struct epoll_event epollEvents[MAINLOOP_MAX_EPOLL_EVENTS]; ///< buffer for events returned by epoll_wait()
+    uint32_t pollHandlerGeneration; ///< counter for IOPollHandler::generation, stored with the fd in epoll_event.data
+    typedef std::set<int> FdSet;
+    FdSet alwaysReadyFds; ///< FDs epoll cannot monitor (regular files, /dev/null), treated as always ready like poll() does
+    #endif
+
+    typedef std::list<ChildThreadWrapper *> ThreadJobList;
+
+    pthread_mutex_t threadPoolMutex; ///< protects the thread pool vars below and the job state in ChildThreadWrapper
+    pthread_cond_t threadPoolCond; ///< signalled when new jobs are available for the workers
+    ThreadJobList pendingThreadJobs; ///< jobs waiting for a worker thread
+    ThreadJobList runningThreadJobs; ///< jobs currently executed by a worker thread
+    std::vector<pthread_t> workerThreads; ///< the worker threads, to be joined when the mainloop is destroyed
+    bool stopWorkers; ///< set when worker threads must exit (mainloop is being destroyed)
+    int numWorkerThreads; ///< number of worker threads
+    int idleWorkerThreads; ///< number of worker threads waiting for a job
+    int maxWorkerThreads; ///< max number of worker threads
+    size_t maxPendingThreadJobs; ///< max number of jobs waiting for a worker
+
+    typedef struct ThreadSignalRecord {
+      ChildThreadWrapper *threadP;
+      ThreadSignals signalCode;
+      struct ThreadSignalRecord *next;
+    } ThreadSignalRecord;
+    typedef std::list<ThreadSignalRecord *> ThreadSignalList;
+
+    ThreadSignalRecord * volatile postedThreadSignals; ///< lock-free LIFO of signals posted by worker threads, newest first
+    ThreadSignalList threadSignalsToDispatch; ///< signals collected from postedThreadSignals, in posting order (parent thread only)
+    int threadSignalFd; ///< eventfd (or reading end of pipe) signalling new postedThreadSignals, -1 if not yet created
+    int threadSignalWriteFd; ///< same as threadSignalFd for eventfd, writing end of pipe otherwise
+
     long ticketNo;
 
   protected:
@@ -175,10 +240,12 @@ namespace p44 {
 
     MLMicroSeconds loopCycleTime;
     MLMicroSeconds cycleStartTime;
+    bool tickless;
 
     #if MAINLOOP_STATISTICS
     MLMicroSeconds statisticsStartTime;
     long statisticsCycles;
+    long statisticsWakeups;
     size_t maxOneTimeHandlers;
     MLMicroSeconds ioHandlerTime;
     MLMicroSeconds idleHandlerTime;
@@ -193,6 +260,8 @@ namespace p44 {
 
   public:
 
+    virtual ~MainLoop();
+
     /// returns or creates the current thread's mainloop
     static MainLoop &currentMainLoop();
 
@@ -205,6 +274,16 @@ namespace p44 {
     /// get time left for current cycle
     MLMicroSeconds remainingCycleTime();
 
+    /// enable or disable tickless mode
+    /// @param aTickless if set, the mainloop does not wake up every loopCycleTime any more, but sleeps until the next
+    ///   one-time handler is due or an I/O event occurs. Idle handlers are only run after wakeIdleHandlers() was called,
+    ///   or as long as they return false (need more execution time).
+    /// @note all code relying on regular idle handler calls must use one-time handlers or wakeIdleHandlers() instead
+    void setTickless(bool aTickless);
+
+    /// @return true if mainloop runs in tickless mode
+    bool isTickless() { return tickless; };
+
     /// @name register handlers for idle time (once per mainloop cycle, when all other handlers have been called)
     /// @{
 
@@ -217,6 +296,11 @@ namespace p44 {
     /// @param aSubscriberP a value identifying the subscriber
     void unregisterIdleHandlers(void *aSubscriberP);
 
+    /// request running the idle handlers in the next mainloop pass
+    /// @note in tickless mode, idle handlers only get called after this was called. In normal mode, idle
+    ///   handlers are called every cycle anyway, so this is a NOP.
+    void wakeIdleHandlers();
+
     /// @}
 
 
@@ -287,7 +371,9 @@ namespace p44 {
     /// @param aFD the file descriptor to poll
     /// @param aPollFlags POLLxxx flags to specify events we want a callback for
     /// @param aFdEventCB the functor to be called when poll() reports an event for one of the flags set in aPollFlags
-    void registerPollHandler(int aFD, int aPollFlags, IOPollCB aPollEventHandler);
+    /// @param aEdgeTriggered if set, and the epoll backend is active, the handler is only called when the state of
+    ///   the FD changes (handler must consume all data until EAGAIN). With the poll() fallback, events are always level triggered.
+    void registerPollHandler(int aFD, int aPollFlags, IOPollCB aPollEventHandler, bool aEdgeTriggered = false);
 
     /// change the poll flags for an already registered handler
     /// @param aFD the file descriptor
@@ -309,8 +395,15 @@ namespace p44 {
     /// @param aThreadRoutine the routine to be executed in a separate thread
     /// @param aThreadSignalHandler will be called from main loop of parent thread when child thread uses signalParentThread()
     /// @return wrapper object for child thread.
+    /// @note the routine is queued for execution by a worker thread of this mainloop's thread pool. If the job queue is
+    ///   full, aThreadSignalHandler will be called with threadSignalFailedToStart.
     ChildThreadWrapperPtr executeInThread(ThreadRoutine aThreadRoutine, ThreadSignalHandler aThreadSignalHandler);
 
+    /// set thread pool limits
+    /// @param aMaxThreads max number of worker threads (which are created on demand)
+    /// @param aMaxQueuedJobs max number of routines waiting for a worker thread
+    void setThreadPoolLimits(int aMaxThreads, size_t aMaxQueuedJobs);
+
     /// @}
 
 
@@ -333,9 +426,12 @@ namespace p44 {
 
     bool runOnetimeHandlers();
     long scheduleOneTimeHandler(OnetimeHandler &aHandler);
+    void removeOneTimeHandlerAt(size_t aIndex);
     bool runIdleHandlers();
     bool checkWait();
     bool handleIOPoll(MLMicroSeconds aTimeout);
+    void runCycle();
+    void runTicklessPass();
 
   private:
 
@@ -343,6 +439,27 @@ namespace p44 {
     void childAnswerCollected(ExecCB aCallback, FdStringCollectorPtr aAnswerCollector, ErrorPtr aError);
     void IOPollHandlerForFd(int aFD, IOPollHandler &h);
 
+    bool handleIOPollWithPoll(MLMicroSeconds aTimeout);
+    #if MAINLOOP_LINUX_EPOLL
+    bool handleIOPollWithEpoll(MLMicroSeconds aTimeout);
+    void updateEpollRegistration(IOPollHandler &aHandler);
+    #endif
+    bool callIOPollHandler(IOPollHandlerMap::iterator aPos, int aPollFlags);
+    bool callIOPollHandler(int aFD, int aPollFlags);
+
+    void *threadPoolWorker();
+    static void *threadPoolWorkerStart(void *aMainLoopP);
+    bool cancelThreadJob(ChildThreadWrapper *aThreadP, bool &aStillRunning);
+    void postThreadSignal(ChildThreadWrapper *aThreadP, ThreadSignals aSignalCode);
+    void collectThreadSignals();
+    void purgeThreadSignals(ChildThreadWrapper *aThreadP);
+    bool threadSignalHandler(int aPollFlags);
+
+    bool onetimeHandlerBefore(size_t aIndexA, size_t aIndexB);
+    void swapOnetimeHandlers(size_t aIndexA, size_t aIndexB);
+    size_t siftOnetimeHandlerUp(size_t aIndex);
+    size_t siftOnetimeHandlerDown(size_t aIndex);
+
   };
 
 
@@ -350,13 +467,13 @@ namespace p44 {
   class ChildThreadWrapper : public P44Obj
   {
     typedef P44Obj inherited;
+    friend class MainLoop;
 
-    pthread_t pthread; ///< the pthread
-    bool threadRunning; ///< set if thread is active
+    bool threadPending; ///< set while waiting for a worker thread (protected by parent mainloop's threadPoolMutex)
+    bool threadRunning; ///< set while a worker thread executes the routine (protected by parent mainloop's threadPoolMutex)
+    volatile bool cancelRequested; ///< set when parent wants the routine to terminate (written under parent mainloop's threadPoolMutex)
 
     MainLoop &parentThreadMainLoop; ///< the parent mainloop which created this thread
-    int childSignalFd; ///< the pipe used to transmit signals from the child thread
-    int parentSignalFd; ///< the pipe monitored by parentThreadMainLoop to get signals from child
 
     ThreadSignalHandler parentSignalHandler; ///< the handler to call to deliver signals to the main thread
     ThreadRoutine threadRoutine; ///< the actual thread routine to run
@@ -366,6 +483,7 @@ namespace p44 {
   public:
 
     /// constructor
+    /// @note use MainLoop::executeInThread() to create and start thread routines
     ChildThreadWrapper(MainLoop &aParentThreadMainLoop, ThreadRoutine aThreadRoutine, ThreadSignalHandler aThreadSignalHandler);
 
     /// destructor
@@ -378,27 +496,32 @@ namespace p44 {
     /// @param aSignalCode a signal code to be sent to the parent thread
     void signalParentThread(ThreadSignals aSignalCode);
 
+    /// check if parent has requested termination
+    /// @return true if the thread routine should return as soon as possible
+    /// @note thread routines are never cancelled asynchronously, so long running routines must check this regularly
+    bool shouldTerminate() { return cancelRequested; };
+
     /// @}
 
 
     /// @name methods to call from parent thread
     /// @{
 
-    /// cancel execution and wait for cancellation to complete
+    /// cancel execution
+    /// @note this never blocks. A routine already running is asked to terminate (see shouldTerminate()), and is
+    ///   left to finish on its worker thread, which releases the job afterwards. In any case, no more signals will
+    ///   be delivered to the parent's signal handler, so the routine must not access objects owned by the caller
+    ///   any more once shouldTerminate() returns true (bind data the routine needs to the routine itself).
     void cancel();
 
-    /// confirm termination
-    void terminated();
-
     /// @}
 
-    /// method called from thread_start_function from this child thread
-    void *startFunction();
+    /// confirm termination (called from worker thread when routine has returned)
+    void terminated();
 
   private:
 
-    bool signalPipeHandler(int aPollFlags);
-    void finalizeThreadExecution();
+    void signalReceived(ThreadSignals aSignalCode);
 
   };
 
@@ -31,6 +31,7 @@ Operation::Operation() :
   timesOutAt(0), // no timeout time set
   initiationDelay(0), // no initiation delay
   initiatesNotBefore(0), // no initiation time
+  queuedAt(Never),
   inSequence(true) // by default, execute in sequence
 {
 }
@@ -113,12 +114,16 @@ bool Operation::hasTimedOutAt(MLMicroSeconds aRefTime)
 #pragma mark - OperationQueue
 
 
+#define RETRY_INITIATE_DELAY (10*MilliSecond) // retry delay for operations which cannot be initiated for other reasons than a known initiation time
+
+
 // create operation queue into specified mainloop
 OperationQueue::OperationQueue(MainLoop &aMainLoop) :
-  mainLoop(aMainLoop)
+  mainLoop(aMainLoop),
+  processingTicket(0),
+  processing(false)
 {
-  // register with mainloop
-  mainLoop.registerIdleHandler(this, boost::bind(&OperationQueue::idleHandler, this));
+  statistics_reset();
 }
 
 
@@ -126,29 +131,59 @@ OperationQueue::OperationQueue(MainLoop &aMainLoop) :
 OperationQueue::~OperationQueue()
 {
   // unregister from mainloop
-  mainLoop.unregisterIdleHandlers(this);
+  mainLoop.cancelExecutionTicket(processingTicket);
 }
 
 
 // queue a new operation
 void OperationQueue::queueOperation(OperationPtr aOperation)
 {
+  aOperation->queuedAt = MainLoop::now();
   operationQueue.push_back(aOperation);
+  if (operationQueue.size()>maxQueueDepth) maxQueueDepth = operationQueue.size();
+  // make sure queue gets processed ASAP
+  if (!processing) scheduleProcessingAt(aOperation->queuedAt);
 }
 
 
 // process all pending operations now
 void OperationQueue::processOperations()
 {
+  bool wasProcessing = processing;
+  processing = true;
 	bool completed = true;
+  MLMicroSeconds nextCheck;
 	do {
-		completed = idleHandler();
+    nextCheck = Never;
+		completed = processStep(nextCheck);
 	} while (!completed);
+  processing = wasProcessing;
+  // arm timer for earliest pending timeout or initiation
+  if (!processing) scheduleProcessingAt(nextCheck);
+}
+
+
+void OperationQueue::scheduleProcessingAt(MLMicroSeconds aProcessingTime)
+{
+  if (aProcessingTime==Never) {
+    // nothing to wait for
+    mainLoop.cancelExecutionTicket(processingTicket);
+  }
+  else if (!mainLoop.rescheduleExecutionTicketAt(processingTicket, aProcessingTime)) {
+    processingTicket = mainLoop.executeOnceAt(boost::bind(&OperationQueue::processingTimer, this), aProcessingTime);
+  }
+}
+
+
+void OperationQueue::processingTimer()
+{
+  processingTicket = 0; // has fired
+  processOperations();
 }
 
 
 
-bool OperationQueue::idleHandler()
+bool OperationQueue::processStep(MLMicroSeconds &aNextCheck)
 {
   bool pleaseCallAgainSoon = false; // assume nothing to do
   if (!operationQueue.empty()) {
@@ -168,11 +203,21 @@ bool OperationQueue::idleHandler()
       }
       if (!op->isInitiated()) {
         // initiate now
-        if (!op->initiate()) {
-          // cannot initiate this one now, check if we can continue with others
+        if (op->initiate()) {
+          // initiated, update statistics
+          MLMicroSeconds waitTime = MainLoop::now()-op->queuedAt;
+          initiatedOperations++;
+          totalWaitTime += waitTime;
+          if (waitTime>maxWaitTime) maxWaitTime = waitTime;
+        }
+        else {
+          // cannot initiate this one now, must check again at initiation time
+          MLMicroSeconds retryAt = op->initiatesNotBefore>now ? op->initiatesNotBefore : now+RETRY_INITIATE_DELAY;
+          if (aNextCheck==Never || retryAt<aNextCheck) aNextCheck = retryAt;
+          // check if we can continue with others
           if (op->inSequence) {
             // this op needs to be initiated before others can be checked
-            pleaseCallAgainSoon = false; // as we can't initate right now, let mainloop cycle pass
+            pleaseCallAgainSoon = false; // as we can't initate right now, wait for initiation time
             break;
           }
         }
@@ -186,6 +231,7 @@ bool OperationQueue::idleHandler()
           // - finalize. This might push new operations in front or back of the queue
           OperationPtr nextOp = op->finalize(this);
           if (nextOp) {
+            nextOp->queuedAt = MainLoop::now();
             operationQueue.insert(nextPos, nextOp);
           }
           // restart with start of (modified) queue
@@ -194,20 +240,50 @@ bool OperationQueue::idleHandler()
         }
         else {
           // operation has not yet completed
+          // - completion will be signalled by calling processOperations(), but timeout must be checked
+          if (op->timesOutAt!=0 && (aNextCheck==Never || op->timesOutAt<aNextCheck)) aNextCheck = op->timesOutAt;
           if (op->inSequence) {
             // this op needs to be complete before others can be checked
-            pleaseCallAgainSoon = false; // as we can't initate right now, let mainloop cycle pass
+            pleaseCallAgainSoon = false; // as we can't initate right now, wait for completion or timeout
             break;
           }
         }
       }
     } // for all ops in queue
   } // queue not empty
-  // if not everything is processed we'd like to process, return false, causing main loop to call us ASAP again
+  // if not everything is processed we'd like to process, return false, causing processOperations() to call us again
   return !pleaseCallAgainSoon;
 };
 
 
+string OperationQueue::description()
+{
+  MLMicroSeconds statisticsPeriod = MainLoop::now()-statisticsStartTime;
+  return string_format(
+    "OperationQueue: depth           : %ld (max %ld)\n"
+    "- statistics period             : %.6f S\n"
+    "- initiated operations          : %ld\n"
+    "- average/max wait time         : %.6f S / %.6f S\n",
+    (long)operationQueue.size(),
+    (long)maxQueueDepth,
+    (double)statisticsPeriod/Second,
+    initiatedOperations,
+    (double)(initiatedOperations>0 ? totalWaitTime/initiatedOperations : 0)/Second,
+    (double)maxWaitTime/Second
+  );
+}
+
+
+void OperationQueue::statistics_reset()
+{
+  statisticsStartTime = MainLoop::now();
+  maxQueueDepth = operationQueue.size();
+  initiatedOperations = 0;
+  totalWaitTime = 0;
+  maxWaitTime = 0;
+}
+
+
 
 // abort all pending operations
 void OperationQueue::abortOperations()
@@ -217,6 +293,8 @@ void OperationQueue::abortOperations()
   }
   // empty queue
   operationQueue.clear();
+  // nothing to wait for any more
+  scheduleProcessingAt(Never);
 }
 
 
@@ -61,6 +61,8 @@ namespace p44 {
     MLMicroSeconds timesOutAt; // absolute time for timeout
     MLMicroSeconds initiationDelay; // how much to delay initiation (after first attempt to initiate)
     MLMicroSeconds initiatesNotBefore; // absolute time for earliest initiation
+    MLMicroSeconds queuedAt; // absolute time when operation was queued (for statistics)
+    friend class OperationQueue;
   public:
     /// if this flag is set, no operation queued after this operation will execute
     bool inSequence;
@@ -99,6 +101,16 @@ namespace p44 {
   class OperationQueue : public P44Obj
   {
     MainLoop &mainLoop;
+    long processingTicket; ///< mainloop timer for next processing of the queue
+    bool processing; ///< set while processOperations() runs
+
+    // statistics
+    MLMicroSeconds statisticsStartTime;
+    size_t maxQueueDepth;
+    long initiatedOperations;
+    MLMicroSeconds totalWaitTime;
+    MLMicroSeconds maxWaitTime;
+
   protected:
     typedef list<OperationPtr> OperationList;
     OperationList operationQueue;
@@ -117,12 +129,30 @@ namespace p44 {
 
     /// abort all pending operations
     void abortOperations();
-    
+
+    /// @return number of operations currently in the queue
+    size_t queueDepth() { return operationQueue.size(); };
+
+    /// description (shows queue depth and wait time statistics)
+    string description();
+
+    /// reset statistics
+    void statistics_reset();
+
   private:
-    /// handler which is registered with mainloop
+    /// process queue once
+    /// @param aNextCheck will be lowered to the time when the queue needs to be checked again
+    ///   (timeout or initiation time of a pending operation), if any
     /// @return true if operations processed for now, i.e. no need to call again immediately
-    ///   false if processOperations() should be called ASAP again (in the same mainloop cycle if possible)
-    bool idleHandler();
+    ///   false if processStep() should be called again immediately
+    bool processStep(MLMicroSeconds &aNextCheck);
+
+    /// arm the mainloop timer for processing the queue at the specified time
+    /// @param aProcessingTime when to process the queue next, Never to cancel pending processing
+    void scheduleProcessingAt(MLMicroSeconds aProcessingTime);
+
+    /// mainloop timer handler
+    void processingTimer();
   };
 
 } // namespace p44
@@ -31,6 +31,508 @@
 using namespace p44;
 
 
+#pragma mark - PrefetchedTable and ParamRow
+
+const PrefetchedTable::RecordIndexes *PrefetchedTable::recordsFor(const char *aParentIdentifier) const
+{
+  RecordsByParent::const_iterator pos = recordsByParent.find(nonNullCStr(aParentIdentifier));
+  if (pos==recordsByParent.end()) return NULL;
+  return &(pos->second);
+}
+
+
+const ParamValue &ParamRow::recordColumn(int aIndex) const
+{
+  static const ParamValue nullValue = { SQLITE_NULL, { 0 }, 0 };
+  if (aIndex<0 || aIndex>=tableP->numColumns) return nullValue; // like SQLite, out-of-range columns are NULL
+  return recordP[aIndex];
+}
+
+
+long long ParamRow::recordValue(int aIndex, long long) const
+{
+  const ParamValue &v = recordColumn(aIndex);
+  switch (v.type) {
+    case SQLITE_INTEGER: return v.intValue;
+    case SQLITE_FLOAT: return (long long)v.floatValue;
+    case SQLITE_TEXT: return atoll(tableP->texts.c_str()+v.textOffset);
+    default: return 0;
+  }
+}
+
+
+double ParamRow::recordValue(int aIndex, double) const
+{
+  const ParamValue &v = recordColumn(aIndex);
+  switch (v.type) {
+    case SQLITE_INTEGER: return v.intValue;
+    case SQLITE_FLOAT: return v.floatValue;
+    case SQLITE_TEXT: return atof(tableP->texts.c_str()+v.textOffset);
+    default: return 0;
+  }
+}
+
+
+const char *ParamRow::recordValue(int aIndex, const char *) const
+{
+  const ParamValue &v = recordColumn(aIndex);
+  switch (v.type) {
+    case SQLITE_TEXT: return tableP->texts.c_str()+v.textOffset;
+    case SQLITE_INTEGER: convertedTexts.push_back(string_format("%lld", v.intValue)); break;
+    case SQLITE_FLOAT: convertedTexts.push_back(string_format("%.15g", v.floatValue)); break;
+    default: return NULL;
+  }
+  // numeric value converted to text, valid as long as this row
+  return convertedTexts.back().c_str();
+}
+
+
+
+#pragma mark - ParamStore
+
+ParamStore::ParamStore() :
+  numPrepared(0),
+  bulkLoadNesting(0),
+  bulkLoadSuspended(false),
+  batchNesting(0),
+  maxStall(0),
+  writerRunning(false),
+  writerStop(false),
+  writerConnectState(0),
+  queuedWrites(0),
+  committedWrites(0),
+  numCommits(0)
+{
+  pthread_mutex_init(&writerMutex, NULL);
+  pthread_cond_init(&writerCond, NULL);
+  pthread_cond_init(&committedCond, NULL);
+}
+
+
+ParamStore::~ParamStore()
+{
+  // make sure everything is written
+  stopBackgroundWriter();
+  // cached statements must be finalized before DB gets closed
+  clearStatementCache();
+  pthread_cond_destroy(&committedCond);
+  pthread_cond_destroy(&writerCond);
+  pthread_mutex_destroy(&writerMutex);
+}
+
+
+ErrorPtr ParamStore::connectAndInitialize(const char *aDatabaseFileName, int aNeededSchemaVersion, int aLowestValidSchemaVersion, bool aFactoryReset)
+{
+  // pending writes must go to the DB we had so far
+  stopBackgroundWriter();
+  dbFileName = nonNullCStr(aDatabaseFileName);
+  // cached statements must be finalized before DB might get closed and re-opened
+  clearStatementCache();
+  ErrorPtr err = inherited::connectAndInitialize(aDatabaseFileName, aNeededSchemaVersion, aLowestValidSchemaVersion, aFactoryReset);
+  if (Error::isOK(err)) {
+    // use write-ahead log (persistent setting of the DB file, SQLite keeps the rollback journal if WAL is not supported)
+    sqlite3pp::query qry(*this, "PRAGMA journal_mode=WAL");
+    sqlite3pp::query::iterator i = qry.begin();
+    if (i!=qry.end()) {
+      LOG(LOG_INFO, "ParamStore %s: journal mode is %s\n", aDatabaseFileName, nonNullCStr(i->get<const char *>(0)));
+    }
+  }
+  return err;
+}
+
+
+
+sqlite3pp::query *ParamStore::cachedQuery(const char *aClassKey, int aKind)
+{
+  QueryCache::iterator pos = queryCache.find(StatementKey(aClassKey, aKind));
+  if (pos==queryCache.end()) return NULL;
+  pos->second->reset();
+  return pos->second;
+}
+
+
+sqlite3pp::query *ParamStore::prepareCachedQuery(const char *aClassKey, int aKind, const string &aSQL)
+{
+  sqlite3pp::query *queryP = new sqlite3pp::query(*this);
+  numPrepared++;
+  if (queryP->prepare(aSQL.c_str())!=SQLITE_OK) {
+    delete queryP;
+    return NULL;
+  }
+  queryCache[StatementKey(aClassKey, aKind)] = queryP;
+  return queryP;
+}
+
+
+sqlite3pp::command *ParamStore::cachedCommand(const char *aClassKey, int aKind)
+{
+  CommandCache::iterator pos = commandCache.find(StatementKey(aClassKey, aKind));
+  if (pos==commandCache.end()) return NULL;
+  pos->second->reset();
+  return pos->second;
+}
+
+
+sqlite3pp::command *ParamStore::prepareCachedCommand(const char *aClassKey, int aKind, const string &aSQL)
+{
+  sqlite3pp::command *cmdP = new sqlite3pp::command(*this);
+  cmdP->record_bindings(true); // allows passing writes to the background writer
+  numPrepared++;
+  if (cmdP->prepare(aSQL.c_str())!=SQLITE_OK) {
+    delete cmdP;
+    return NULL;
+  }
+  commandCache[StatementKey(aClassKey, aKind)] = cmdP;
+  return cmdP;
+}
+
+
+void ParamStore::clearStatementCache()
+{
+  for (QueryCache::iterator pos = queryCache.begin(); pos!=queryCache.end(); ++pos) {
+    delete pos->second;
+  }
+  queryCache.clear();
+  for (CommandCache::iterator pos = commandCache.begin(); pos!=commandCache.end(); ++pos) {
+    delete pos->second;
+  }
+  commandCache.clear();
+}
+
+
+
+void ParamStore::beginBulkLoad()
+{
+  if (bulkLoadNesting++==0) {
+    bulkLoadSuspended = false;
+  }
+}
+
+
+void ParamStore::endBulkLoad()
+{
+  if (bulkLoadNesting>0 && --bulkLoadNesting==0) {
+    // free prefetched records
+    prefetchIndex.clear();
+  }
+}
+
+
+const PrefetchedTable *ParamStore::prefetchedTable(const char *aClassKey)
+{
+  if (!isBulkLoading()) return NULL;
+  PrefetchIndex::iterator pos = prefetchIndex.find(aClassKey);
+  if (pos==prefetchIndex.end()) return NULL; // not yet prefetched
+  return &(pos->second);
+}
+
+
+PrefetchedTable *ParamStore::newPrefetchedTable(const char *aClassKey)
+{
+  if (!isBulkLoading()) return NULL;
+  return &(prefetchIndex[aClassKey]);
+}
+
+
+void ParamStore::dataModified()
+{
+  if (bulkLoadNesting>0 && !bulkLoadSuspended) {
+    LOG(LOG_INFO, "ParamStore: modified during bulk load -> prefetched records are no longer used\n");
+    bulkLoadSuspended = true;
+  }
+}
+
+
+
+#pragma mark - writing
+
+
+// busy timeout for the main thread's connection while the background writer is running.
+// Must be short, as it blocks the mainloop. As reads flush() pending writes first, the writer is usually idle anyway.
+#define MAIN_CONNECTION_BUSY_TIMEOUT 250 // mS
+
+ErrorPtr ParamStore::startBackgroundWriter()
+{
+  if (writerRunning) return ErrorPtr();
+  if (!isAvailable()) return SQLite3Error::err(SQLITE_MISUSE, "DB not initialized");
+  writerStop = false;
+  writerConnectState = 0;
+  int ret = pthread_create(&writerThread, NULL, writerThreadStart, this);
+  if (ret!=0) {
+    return SysError::err(ret, "cannot start writer thread: ");
+  }
+  // wait until writer thread has its own connection
+  pthread_mutex_lock(&writerMutex);
+  while (writerConnectState==0) {
+    pthread_cond_wait(&committedCond, &writerMutex);
+  }
+  bool connected = writerConnectState>0;
+  pthread_mutex_unlock(&writerMutex);
+  if (!connected) {
+    // writer thread has already exited, writes remain synchronous on the main connection
+    pthread_join(writerThread, NULL);
+    return SQLite3Error::err(SQLITE_CANTOPEN, "background writer cannot open DB, writes remain synchronous");
+  }
+  // main thread connection might now have to wait for the writer's connection (schema updates, checkpoints)
+  set_busy_timeout(MAIN_CONNECTION_BUSY_TIMEOUT);
+  writerRunning = true;
+  LOG(LOG_INFO, "ParamStore %s: writes now done by background writer\n", dbFileName.c_str());
+  return ErrorPtr();
+}
+
+
+void ParamStore::stopBackgroundWriter()
+{
+  if (!writerRunning) return;
+  // have all writes committed, then let writer thread exit
+  passBatchToWriter();
+  pthread_mutex_lock(&writerMutex);
+  writerStop = true;
+  pthread_cond_signal(&writerCond);
+  pthread_mutex_unlock(&writerMutex);
+  pthread_join(writerThread, NULL);
+  writerRunning = false;
+  lastRowIds.clear(); // SQLite assigns ROWIDs again
+  LOG(LOG_INFO, "ParamStore %s: background writer stopped, %lu writes in %lu transactions\n", dbFileName.c_str(), committedWrites, numCommits);
+}
+
+
+void ParamStore::beginBatch()
+{
+  if (batchNesting++==0 && !writerRunning) {
+    execute("BEGIN");
+  }
+}
+
+
+int ParamStore::endBatch()
+{
+  if (batchNesting<=0 || --batchNesting>0) return SQLITE_OK;
+  if (!writerRunning) {
+    return execute("COMMIT");
+  }
+  passBatchToWriter();
+  return SQLITE_OK;
+}
+
+
+int ParamStore::write(sqlite3pp::command &aCommand)
+{
+  if (writerRunning) {
+    if (aCommand.recording_bindings()) {
+      // snapshot the command including its parameters (values are copied, with full precision)
+      batchWrites.push_back(Write());
+      batchWrites.back().sql = nonNullCStr(aCommand.sql());
+      batchWrites.back().values = aCommand.bindings();
+      if (batchNesting==0) {
+        // single write, pass it on now
+        passBatchToWriter();
+      }
+      return SQLITE_OK;
+    }
+    // cannot snapshot, must execute now, but not before all earlier writes are done
+    flush();
+  }
+  return aCommand.execute();
+}
+
+
+int ParamStore::write(const string &aSQL)
+{
+  if (!writerRunning) {
+    return execute(aSQL.c_str());
+  }
+  batchWrites.push_back(Write());
+  batchWrites.back().sql = aSQL;
+  if (batchNesting==0) {
+    // single write, pass it on now
+    passBatchToWriter();
+  }
+  return SQLITE_OK;
+}
+
+
+void ParamStore::passBatchToWriter()
+{
+  if (batchWrites.empty()) return;
+  pthread_mutex_lock(&writerMutex);
+  queuedWrites += batchWrites.size();
+  if (writeQueue.empty()) {
+    writeQueue.swap(batchWrites);
+  }
+  else {
+    writeQueue.insert(writeQueue.end(), batchWrites.begin(), batchWrites.end());
+    batchWrites.clear();
+  }
+  pthread_cond_signal(&writerCond);
+  pthread_mutex_unlock(&writerMutex);
+}
+
+
+void ParamStore::flush()
+{
+  if (!writerRunning) return;
+  // writes of a batch in progress are flushed as well, so they can be read back
+  passBatchToWriter();
+  MLMicroSeconds started = MainLoop::now();
+  pthread_mutex_lock(&writerMutex);
+  bool waited = committedWrites!=queuedWrites;
+  while (committedWrites!=queuedWrites) {
+    pthread_cond_wait(&committedCond, &writerMutex);
+  }
+  pthread_mutex_unlock(&writerMutex);
+  if (waited) noteStall(started);
+}
+
+
+long long ParamStore::newRowId(const char *aTableName)
+{
+  if (!writerRunning) return 0; // SQLite assigns ROWID on insert
+  RowIdMap::iterator pos = lastRowIds.find(aTableName);
+  if (pos==lastRowIds.end()) {
+    // first insert into this table since writer was started: all earlier inserts were done by SQLite
+    flush();
+    long long maxRowId = 0;
+    sqlite3pp::query qry(*this);
+    if (qry.prepare(string_format("SELECT max(ROWID) FROM %s", aTableName).c_str())==SQLITE_OK) {
+      sqlite3pp::query::iterator i = qry.begin();
+      if (i!=qry.end()) maxRowId = i->get<long long>(0);
+    }
+    pos = lastRowIds.insert(RowIdMap::value_type(aTableName, maxRowId)).first;
+  }
+  return ++(pos->second);
+}
+
+
+void ParamStore::noteStall(MLMicroSeconds aStarted)
+{
+  MLMicroSeconds stall = MainLoop::now()-aStarted;
+  if (stall>maxStall) maxStall = stall;
+}
+
+
+string ParamStore::statistics()
+{
+  pthread_mutex_lock(&writerMutex);
+  string s = string_format(
+    "ParamStore %s: max. main thread stall by persistence: %.1f mS, %s writer: %lu writes in %lu transactions, %lu pending",
+    dbFileName.c_str(), (double)maxStall/MilliSecond,
+    writerRunning ? "background" : "no background",
+    committedWrites, numCommits, queuedWrites-committedWrites
+  );
+  pthread_mutex_unlock(&writerMutex);
+  return s;
+}
+
+
+void ParamStore::statistics_reset()
+{
+  maxStall = 0;
+}
+
+
+void *ParamStore::writerThreadStart(void *aParamStoreP)
+{
+  return static_cast<ParamStore *>(aParamStoreP)->writerThreadFunc();
+}
+
+
+void *ParamStore::writerThreadFunc()
+{
+  // separate connection, SQLite connections must not be shared between threads
+  sqlite3pp::database db;
+  bool connected = db.connect(dbFileName.c_str())==SQLITE_OK;
+  if (connected) {
+    db.set_busy_timeout(10000); // blocking here does not matter
+  }
+  else {
+    LOG(LOG_ERR, "ParamStore writer: cannot open %s: %s\n", dbFileName.c_str(), db.error_msg());
+  }
+  // tell main thread if we can take over the writes
+  pthread_mutex_lock(&writerMutex);
+  writerConnectState = connected ? 1 : -1;
+  pthread_cond_broadcast(&committedCond);
+  if (!connected) {
+    pthread_mutex_unlock(&writerMutex);
+    return NULL;
+  }
+  // statements prepared on the writer's connection, by SQL
+  typedef std::map<string, sqlite3pp::command *> WriterCommands;
+  WriterCommands commands;
+  while (true) {
+    if (writeQueue.empty()) {
+      if (writerStop) break;
+      pthread_cond_wait(&writerCond, &writerMutex);
+      continue;
+    }
+    // take all writes queued so far...
+    WriteQueue batch;
+    batch.swap(writeQueue);
+    pthread_mutex_unlock(&writerMutex);
+    // ...and write them in one transaction
+    db.execute("BEGIN");
+    for (WriteQueue::iterator pos = batch.begin(); pos!=batch.end(); ++pos) {
+      int rc;
+      if (pos->values.empty()) {
+        // plain SQL
+        rc = db.execute(pos->sql.c_str());
+      }
+      else {
+        // statement with parameters: bind the snapshot values
+        rc = SQLITE_OK;
+        sqlite3pp::command *cmdP;
+        WriterCommands::iterator cpos = commands.find(pos->sql);
+        if (cpos!=commands.end()) {
+          cmdP = cpos->second;
+        }
+        else {
+          cmdP = new sqlite3pp::command(db);
+          rc = cmdP->prepare(pos->sql.c_str());
+          if (rc==SQLITE_OK) commands[pos->sql] = cmdP;
+          else delete cmdP;
+        }
+        if (rc==SQLITE_OK) {
+          for (size_t i=0; i<pos->values.size(); i++) {
+            const sqlite3pp::statement::bound_value &v = pos->values[i];
+            switch (v.type) {
+              case SQLITE_INTEGER: cmdP->bind((int)i+1, v.ival); break;
+              case SQLITE_FLOAT: cmdP->bind((int)i+1, v.dval); break;
+              case SQLITE_TEXT: cmdP->bind((int)i+1, v.data.c_str(), false); break;
+              case SQLITE_BLOB: cmdP->bind((int)i+1, v.data.data(), (int)v.data.size(), false); break;
+              default: cmdP->bind((int)i+1); break;
+            }
+          }
+          rc = cmdP->execute();
+          cmdP->reset();
+        }
+      }
+      if (rc!=SQLITE_OK) {
+        LOG(LOG_ERR, "ParamStore writer: '%s' failed: %s\n", pos->sql.c_str(), db.error_msg());
+      }
+    }
+    if (db.execute("COMMIT")!=SQLITE_OK) {
+      LOG(LOG_ERR, "ParamStore writer: commit of %d writes failed: %s\n", (int)batch.size(), db.error_msg());
+      db.execute("ROLLBACK");
+    }
+    pthread_mutex_lock(&writerMutex);
+    committedWrites += batch.size();
+    numCommits++;
+    pthread_cond_broadcast(&committedCond);
+  }
+  pthread_mutex_unlock(&writerMutex);
+  // statements must be finalized before the writer's connection is closed
+  for (WriterCommands::iterator pos = commands.begin(); pos!=commands.end(); ++pos) {
+    delete pos->second;
+  }
+  return NULL;
+}
+
+
+
+#pragma mark - PersistentParams
+
+
+
 PersistentParams::PersistentParams(ParamStore &aParamStore) :
   paramStore(aParamStore),
   dirty(false),
@@ -74,6 +576,8 @@ static string fieldDeclaration(const FieldDefinition *aFieldDefP)
 
 void PersistentParams::checkAndUpdateSchema()
 {
+  // schema is changed via the main connection, after all pending writes
+  paramStore.flush();
   // check for table
   string sql = string_format("SELECT name FROM sqlite_master WHERE name ='%s' and type='table'", tableName());
   sqlite3pp::query qry(paramStore, sql.c_str());
@@ -139,38 +643,45 @@ size_t PersistentParams::appendfieldList(string &sql, bool keyFields, bool aAppe
 
 
 // helper for implementation of loadChildren()
-sqlite3pp::query *PersistentParams::newLoadAllQuery(const char *aParentIdentifier)
+sqlite3pp::query *PersistentParams::getLoadAllQuery(const char *aParentIdentifier)
 {
-  sqlite3pp::query * queryP = new sqlite3pp::query(paramStore);
-  string sql = "SELECT ROWID";
-  // key fields
-  appendfieldList(sql, true , true, false);
-  // other fields
-  appendfieldList(sql, false, true, false);
-  // limit to entries linked to parent
-  string_format_append(sql, " FROM %s WHERE %s='%s'", tableName(), getKeyDef(0)->fieldName, aParentIdentifier);
-  FOCUSLOG("newLoadAllQuery for parent='%s': %s\n", aParentIdentifier, sql.c_str());
-  // now execute query
-  if (queryP->prepare(sql.c_str())!=SQLITE_OK) {
-    FOCUSLOG("- query not successful - assume wrong schema -> calling checkAndUpdateSchema()\n");
-    // - error could mean schema is not up to date
-    queryP->reset();
-    checkAndUpdateSchema();
-    FOCUSLOG("newLoadAllQuery: retrying newLoadAllQuery after schema update: %s\n", sql.c_str());
-    if (queryP->prepare(sql.c_str())!=SQLITE_OK) {
-      LOG(LOG_ERR, "newLoadAllQuery: %s - failed: %s\n", sql.c_str(), paramStore.error()->description().c_str());
-      // error now means something is really wrong
-      delete queryP;
-      return NULL;
+  // make sure we read what was written so far
+  paramStore.flush();
+  sqlite3pp::query *queryP = paramStore.cachedQuery(classKey(), stmt_loadAll);
+  if (!queryP) {
+    // not yet prepared for this class
+    string sql = "SELECT ROWID";
+    // key fields
+    appendfieldList(sql, true , true, false);
+    // other fields
+    appendfieldList(sql, false, true, false);
+    // limit to entries linked to parent
+    string_format_append(sql, " FROM %s WHERE %s=?", tableName(), getKeyDef(0)->fieldName);
+    FOCUSLOG("getLoadAllQuery: preparing: %s\n", sql.c_str());
+    queryP = paramStore.prepareCachedQuery(classKey(), stmt_loadAll, sql);
+    if (!queryP) {
+      FOCUSLOG("- query not successful - assume wrong schema -> calling checkAndUpdateSchema()\n");
+      // - error could mean schema is not up to date
+      checkAndUpdateSchema();
+      FOCUSLOG("getLoadAllQuery: retrying after schema update: %s\n", sql.c_str());
+      queryP = paramStore.prepareCachedQuery(classKey(), stmt_loadAll, sql);
+      if (!queryP) {
+        LOG(LOG_ERR, "getLoadAllQuery: %s - failed: %s\n", sql.c_str(), paramStore.error()->description().c_str());
+        // error now means something is really wrong
+        return NULL;
+      }
     }
   }
+  // bind the parent
+  FOCUSLOG("getLoadAllQuery for parent='%s'\n", aParentIdentifier);
+  queryP->bind(1, aParentIdentifier, false); // text not static
   return queryP;
 }
 
 
 
 /// load values from passed row
-void PersistentParams::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void PersistentParams::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   // - load ROWID which is always there
   rowid = aRow->get<long long>(aIndex++);
@@ -180,26 +691,98 @@ void PersistentParams::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex
 }
 
 
+const PrefetchedTable *PersistentParams::getPrefetchedTable()
+{
+  const PrefetchedTable *tableP = paramStore.prefetchedTable(classKey());
+  if (tableP || !paramStore.isBulkLoading()) return tableP;
+  // in bulk load mode, but table not yet prefetched: read entire table now
+  paramStore.flush();
+  string sql = "SELECT ROWID";
+  appendfieldList(sql, true , true, false);
+  appendfieldList(sql, false, true, false);
+  string_format_append(sql, " FROM %s", tableName());
+  sqlite3pp::query qry(paramStore);
+  if (qry.prepare(sql.c_str())!=SQLITE_OK) {
+    // probably schema not yet up to date, let normal query handle that
+    FOCUSLOG("getPrefetchedTable: cannot prefetch table %s: %s\n", tableName(), paramStore.error()->description().c_str());
+    return NULL;
+  }
+  PrefetchedTable *newTableP = paramStore.newPrefetchedTable(classKey());
+  newTableP->numColumns = qry.column_count();
+  size_t numRecords = 0;
+  const char *lastParent = NULL;
+  PrefetchedTable::RecordIndexes *parentRecordsP = NULL;
+  for (sqlite3pp::query::iterator row = qry.begin(); row!=qry.end(); ++row) {
+    // second column is the parent identifier (first key field), usually same as in previous row
+    const char *parent = nonNullCStr(row->get<const char *>(1));
+    if (!lastParent || strcmp(parent, lastParent)!=0) {
+      parentRecordsP = &(newTableP->recordsByParent[parent]);
+    }
+    parentRecordsP->push_back(numRecords);
+    for (int i=0; i<newTableP->numColumns; i++) {
+      ParamValue v;
+      v.type = row->column_type(i);
+      v.textLength = 0;
+      switch (v.type) {
+        case SQLITE_INTEGER: v.intValue = row->get<long long>(i); break;
+        case SQLITE_FLOAT: v.floatValue = row->get<double>(i); break;
+        case SQLITE_NULL: v.intValue = 0; break;
+        default: {
+          // text and blob
+          const char *t = row->get<const char *>(i);
+          v.type = SQLITE_TEXT;
+          v.textOffset = newTableP->texts.size();
+          v.textLength = t ? row->column_bytes(i) : 0;
+          newTableP->texts.append(nonNullCStr(t), v.textLength);
+          newTableP->texts.push_back(0); // terminator
+          break;
+        }
+      }
+      newTableP->values.push_back(v);
+    }
+    lastParent = newTableP->recordsByParent.find(parent)->first.c_str(); // key string in the map stays valid
+    numRecords++;
+  }
+  qry.finish();
+  LOG(LOG_DEBUG, "getPrefetchedTable: prefetched %d records for %d parents from table %s\n", (int)numRecords, (int)newTableP->recordsByParent.size(), tableName());
+  return newTableP;
+}
+
+
 ErrorPtr PersistentParams::loadFromStore(const char *aParentIdentifier)
 {
   ErrorPtr err;
   rowid = 0; // loading means that we'll get the rowid from the DB, so forget any previous one
-  sqlite3pp::query *queryP = newLoadAllQuery(aParentIdentifier);
-  if (queryP==NULL) {
-    // real error preparing query
-    err = paramStore.error();
-  }
-  else {
-    sqlite3pp::query::iterator row = queryP->begin();
+  int index = 0;
+  uint64_t flags; // storage to distribute flags over hierarchy
+  const PrefetchedTable *tableP = getPrefetchedTable();
+  if (tableP) {
+    // bulk load mode, get record from memory
     // Note: it might be OK to not find any stored params in the DB. If so, values are left untouched
-    if (row!=queryP->end()) {
-      // got record
-      int index = 0;
-      uint64_t flags; // storage to distribute flags over hierarchy
+    const PrefetchedTable::RecordIndexes *recordsP = tableP->recordsFor(aParentIdentifier);
+    if (recordsP) {
+      ParamRow row(*tableP, recordsP->front());
       loadFromRow(row, index, &flags); // might set dirty when assigning properties...
       dirty = false; // ...so: just loaded: make clean
     }
-    delete queryP; queryP = NULL;
+  }
+  else {
+    sqlite3pp::query *queryP = getLoadAllQuery(aParentIdentifier);
+    if (queryP==NULL) {
+      // real error preparing query
+      err = paramStore.error();
+    }
+    else {
+      sqlite3pp::query::iterator i = queryP->begin();
+      // Note: it might be OK to not find any stored params in the DB. If so, values are left untouched
+      if (i!=queryP->end()) {
+        // got record
+        ParamRow row(i);
+        loadFromRow(row, index, &flags); // might set dirty when assigning properties...
+        dirty = false; // ...so: just loaded: make clean
+      }
+      queryP->reset(); // done with the query, release it for next use
+    }
   }
   if (Error::isOK(err)) {
     err = loadChildren();
@@ -209,6 +792,34 @@ ErrorPtr PersistentParams::loadFromStore(const char *aParentIdentifier)
 
 
 
+ErrorPtr PersistentParams::loadAllFromStore(const char *aParentIdentifier, ParamRowCB aRowCB)
+{
+  const PrefetchedTable *tableP = getPrefetchedTable();
+  if (tableP) {
+    // bulk load mode, get records from memory
+    const PrefetchedTable::RecordIndexes *recordsP = tableP->recordsFor(aParentIdentifier);
+    if (recordsP) {
+      for (PrefetchedTable::RecordIndexes::const_iterator pos = recordsP->begin(); pos!=recordsP->end(); ++pos) {
+        ParamRow row(*tableP, *pos);
+        aRowCB(row);
+      }
+    }
+    return ErrorPtr();
+  }
+  sqlite3pp::query *queryP = getLoadAllQuery(aParentIdentifier);
+  if (queryP==NULL) {
+    return paramStore.error();
+  }
+  for (sqlite3pp::query::iterator i = queryP->begin(); i!=queryP->end(); ++i) {
+    ParamRow row(i);
+    aRowCB(row);
+  }
+  queryP->reset(); // done with the query, release it for next use
+  return ErrorPtr();
+}
+
+
+
 void PersistentParams::markDirty()
 {
   dirty = true;
@@ -228,39 +839,52 @@ ErrorPtr PersistentParams::saveToStore(const char *aParentIdentifier, bool aMult
 {
   ErrorPtr err;
   if (dirty) {
-    sqlite3pp::command cmd(paramStore);
+    paramStore.dataModified();
+    sqlite3pp::command *cmdP;
     string sql;
     // cleanup: remove all previous records for that parent if not multiple children allowed
     if (!aMultipleChildrenAllowed) {
-      sql = string_format("DELETE FROM %s WHERE %s='%s'", tableName(), getKeyDef(0)->fieldName, aParentIdentifier);
-      if (rowid!=0) {
-        string_format_append(sql, " AND ROWID!=%lld", rowid);
+      cmdP = paramStore.cachedCommand(classKey(), stmt_cleanup);
+      if (!cmdP) {
+        sql = string_format("DELETE FROM %s WHERE %s=? AND ROWID!=?", tableName(), getKeyDef(0)->fieldName);
+        cmdP = paramStore.prepareCachedCommand(classKey(), stmt_cleanup, sql);
       }
-      FOCUSLOG("- cleanup before save: %s\n", sql.c_str());
-      if (paramStore.executef(sql.c_str()) != SQLITE_OK) {
-        LOG(LOG_ERR, "- cleanup error (ignored): %s\n", sql.c_str(), paramStore.error()->description().c_str());
+      if (cmdP) {
+        FOCUSLOG("- cleanup before save: parent='%s', except ROWID=%lld\n", aParentIdentifier, rowid);
+        cmdP->bind(1, aParentIdentifier, false); // text not static
+        cmdP->bind(2, (long long)rowid); // no ROWID is 0, so this removes all records if we don't have one yet
+        if (paramStore.write(*cmdP)!=SQLITE_OK) cmdP = NULL;
+        else cmdP->reset(); // done, release it for next use
+      }
+      if (!cmdP) {
+        LOG(LOG_ERR, "- cleanup error (ignored) for table %s: %s\n", tableName(), paramStore.error()->description().c_str());
       }
     }
     // now save
     if (rowid!=0) {
       // already exists in the DB, just update
-      sql = string_format("UPDATE %s SET ", tableName());
-      // - update all fields, even key fields may change (as long as they don't collide with another entry)
-      appendfieldList(sql, true, false, true);
-      appendfieldList(sql, false, true, true);
-      string_format_append(sql, " WHERE ROWID=%lld", rowid);
-      // now execute command
-      FOCUSLOG("saveToStore: update existing row for parent='%s': %s\n", aParentIdentifier, sql.c_str());
-      if (cmd.prepare(sql.c_str())!=SQLITE_OK) {
-        // error on update is always a real error - if we loaded the params from the DB, schema IS ok!
-        err = paramStore.error();
+      cmdP = paramStore.cachedCommand(classKey(), stmt_update);
+      if (!cmdP) {
+        sql = string_format("UPDATE %s SET ", tableName());
+        // - update all fields, even key fields may change (as long as they don't collide with another entry)
+        appendfieldList(sql, true, false, true);
+        appendfieldList(sql, false, true, true);
+        sql += " WHERE ROWID=?";
+        FOCUSLOG("saveToStore: preparing update: %s\n", sql.c_str());
+        cmdP = paramStore.prepareCachedCommand(classKey(), stmt_update, sql);
+        if (!cmdP) {
+          // error on update is always a real error - if we loaded the params from the DB, schema IS ok!
+          err = paramStore.error();
+        }
       }
       if (Error::isOK(err)) {
         // bind the values
+        FOCUSLOG("saveToStore: update existing row %lld for parent='%s'\n", rowid, aParentIdentifier);
         int index = 1; // SQLite parameter indexes are 1-based!
-        bindToStatement(cmd, index, aParentIdentifier, 0); // no flags yet, class hierarchy will collect them
+        bindToStatement(*cmdP, index, aParentIdentifier, 0); // no flags yet, class hierarchy will collect them
+        cmdP->bind(index++, (long long)rowid);
         // now execute command
-        if (cmd.execute()==SQLITE_OK) {
+        if (paramStore.write(*cmdP)==SQLITE_OK) {
           // ok, updated ok
           dirty = false;
         }
@@ -268,52 +892,60 @@ ErrorPtr PersistentParams::saveToStore(const char *aParentIdentifier, bool aMult
           // failed
           err = paramStore.error();
         }
+        cmdP->reset(); // done, release it for next use
       }
     }
     else {
       // seems new, insert. But use INSERT OR REPLACE to make sure key constraints are enforced
-      sql = string_format("INSERT OR REPLACE INTO %s (", tableName());;
-      size_t numFields = appendfieldList(sql, true, false, false);
-      numFields += appendfieldList(sql, false, true, false);
-      sql += ") VALUES (";
-      bool first = true;
-      for (int i=0; i<numFields; i++) {
-        if (!first) sql += ", ";
-        sql += "?";
-        first = false;
-      }
-      sql += ")";
-      // prepare
-      FOCUSLOG("saveToStore: insert new row for parent='%s': %s\n", aParentIdentifier, sql.c_str());
-      if (cmd.prepare(sql.c_str())!=SQLITE_OK) {
-        FOCUSLOG("- insert not successful - assume wrong schema -> calling checkAndUpdateSchema()\n");
-        // - error on INSERT could mean schema is not up to date
-        cmd.reset();
-        checkAndUpdateSchema();
-        FOCUSLOG("saveToStore: retrying insert after schema update: %s\n", sql.c_str());
-        if (cmd.prepare(sql.c_str())!=SQLITE_OK) {
-          // error now means something is really wrong
-          err = paramStore.error();
+      cmdP = paramStore.cachedCommand(classKey(), stmt_insert);
+      if (!cmdP) {
+        // - ROWID is NULL when SQLite should assign it
+        sql = string_format("INSERT OR REPLACE INTO %s (ROWID", tableName());
+        size_t numFields = appendfieldList(sql, true, true, false);
+        numFields += appendfieldList(sql, false, true, false);
+        sql += ") VALUES (?";
+        for (int i=0; i<numFields; i++) {
+          sql += ", ?";
+        }
+        sql += ")";
+        // prepare
+        FOCUSLOG("saveToStore: preparing insert: %s\n", sql.c_str());
+        cmdP = paramStore.prepareCachedCommand(classKey(), stmt_insert, sql);
+        if (!cmdP) {
+          FOCUSLOG("- insert not successful - assume wrong schema -> calling checkAndUpdateSchema()\n");
+          // - error on INSERT could mean schema is not up to date
+          checkAndUpdateSchema();
+          FOCUSLOG("saveToStore: retrying insert after schema update: %s\n", sql.c_str());
+          cmdP = paramStore.prepareCachedCommand(classKey(), stmt_insert, sql);
+          if (!cmdP) {
+            // error now means something is really wrong
+            err = paramStore.error();
+          }
         }
       }
       if (Error::isOK(err)) {
         // bind the values
+        FOCUSLOG("saveToStore: insert new row for parent='%s'\n", aParentIdentifier);
         int index = 1; // SQLite parameter indexes are 1-based!
-        bindToStatement(cmd, index, aParentIdentifier, 0); // no flags yet, class hierarchy will collect them
+        long long newRowId = paramStore.newRowId(tableName()); // assigned in advance when writing in background
+        if (newRowId) cmdP->bind(index++, newRowId);
+        else cmdP->bind(index++); // NULL
+        bindToStatement(*cmdP, index, aParentIdentifier, 0); // no flags yet, class hierarchy will collect them
         // now execute command
-        if (cmd.execute()==SQLITE_OK) {
+        if (paramStore.write(*cmdP)==SQLITE_OK) {
           // get the new ROWID
-          rowid = paramStore.last_insert_rowid();
+          rowid = newRowId ? newRowId : paramStore.last_insert_rowid();
           dirty = false;
         }
         else {
           // failed
           err = paramStore.error();
         }
+        cmdP->reset(); // done, release it for next use
       }
     }
     if (!Error::isOK(err)) {
-      LOG(LOG_ERR, "saveToStore: %s - failed: %s\n", sql.c_str(), err->description().c_str());
+      LOG(LOG_ERR, "saveToStore: table %s, parent='%s' - failed: %s\n", tableName(), aParentIdentifier, err->description().c_str());
     }
   }
   // anyway, have children checked
@@ -329,10 +961,22 @@ ErrorPtr PersistentParams::deleteFromStore()
   ErrorPtr err;
   dirty = false; // forget any unstored changes
   if (rowid!=0) {
+    paramStore.dataModified();
     FOCUSLOG("deleteFromStore: deleting row %lld in table %s\n", rowid, tableName());
-    if (paramStore.executef("DELETE FROM %s WHERE ROWID=%lld", tableName(), rowid) != SQLITE_OK) {
+    sqlite3pp::command *cmdP = paramStore.cachedCommand(classKey(), stmt_delete);
+    if (!cmdP) {
+      cmdP = paramStore.prepareCachedCommand(classKey(), stmt_delete, string_format("DELETE FROM %s WHERE ROWID=?", tableName()));
+    }
+    if (!cmdP) {
       err = paramStore.error();
     }
+    else {
+      cmdP->bind(1, (long long)rowid);
+      if (paramStore.write(*cmdP)!=SQLITE_OK) {
+        err = paramStore.error();
+      }
+      cmdP->reset(); // done, release it for next use
+    }
     // deleted, forget
     rowid = 0;
   }
@@ -24,6 +24,11 @@
 
 #include "sqlite3persistence.hpp"
 
+#include <typeinfo>
+#include <list>
+#include <deque>
+#include <pthread.h>
+
 using namespace std;
 
 namespace p44 {
@@ -34,12 +39,276 @@ namespace p44 {
   } FieldDefinition;
 
 
+  /// value of a column of a record prefetched into memory
+  typedef struct {
+    int type; ///< SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_NULL (BLOBs are kept as SQLITE_TEXT)
+    union {
+      long long intValue; ///< value for SQLITE_INTEGER
+      double floatValue; ///< value for SQLITE_FLOAT
+      size_t textOffset; ///< for SQLITE_TEXT: offset of the NUL terminated text in PrefetchedTable::texts
+    };
+    size_t textLength; ///< for SQLITE_TEXT: length of the text (without terminator)
+  } ParamValue;
+
+
+  /// all records of a table, prefetched into memory by a single query
+  /// @note values and texts are kept in flat arrays, so prefetching a table needs only a few allocations
+  class PrefetchedTable
+  {
+  public:
+    typedef std::vector<size_t> RecordIndexes;
+    typedef std::map<string, RecordIndexes> RecordsByParent;
+
+    int numColumns; ///< number of columns per record
+    std::vector<ParamValue> values; ///< values of all records, numColumns per record
+    string texts; ///< all text values, NUL terminated
+    RecordsByParent recordsByParent; ///< indexes of the records, by parent identifier
+
+    PrefetchedTable() : numColumns(0) {};
+
+    /// @param aParentIdentifier the parent identifier
+    /// @return indexes of the records with the given parent, NULL if none
+    const RecordIndexes *recordsFor(const char *aParentIdentifier) const;
+  };
+
+
+  /// a record to load parameters from, either the current row of a query or a record prefetched into memory
+  /// @note for loadFromRow() implementations, this behaves like a sqlite3pp::query::iterator: aRow->get<type>(index)
+  class ParamRow
+  {
+    sqlite3pp::query::rows queryRow; ///< the current row of a query (if tableP is NULL)
+    const PrefetchedTable *tableP; ///< the table the prefetched record is in, NULL if reading from query
+    const ParamValue *recordP; ///< the first column value of the prefetched record
+    mutable std::list<string> convertedTexts; ///< numeric values requested as text
+
+  public:
+
+    /// row from a query
+    ParamRow(sqlite3pp::query::iterator &aQueryRow) : queryRow(*aQueryRow), tableP(NULL), recordP(NULL) {};
+
+    /// row from a prefetched record
+    ParamRow(const PrefetchedTable &aTable, size_t aRecordIndex) :
+      queryRow(NULL), tableP(&aTable), recordP(&aTable.values[aRecordIndex*aTable.numColumns]) {};
+
+    /// access column values like with a sqlite3pp::query::iterator
+    const ParamRow *operator->() const { return this; };
+
+    /// get column value
+    /// @param aIndex the column index
+    /// @return value converted to T (int, long long, double or const char *) like sqlite3 does it
+    template<class T> T get(int aIndex) const { return tableP ? recordValue(aIndex, T()) : queryRow.get<T>(aIndex); };
+
+    /// get column type
+    /// @param aIndex the column index
+    /// @return SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+    int column_type(int aIndex) const { return tableP ? recordColumn(aIndex).type : queryRow.column_type(aIndex); };
+
+  private:
+
+    const ParamValue &recordColumn(int aIndex) const;
+    int recordValue(int aIndex, int) const { return (int)recordValue(aIndex, (long long)0); };
+    long long recordValue(int aIndex, long long) const;
+    double recordValue(int aIndex, double) const;
+    const char *recordValue(int aIndex, const char *) const;
+
+  };
+
+
   class ParamStore : public SQLite3Persistence
   {
     typedef SQLite3Persistence inherited;
+
+    typedef std::pair<const char *, int> StatementKey; ///< class identifier and statement kind
+    typedef std::map<StatementKey, sqlite3pp::query *> QueryCache;
+    typedef std::map<StatementKey, sqlite3pp::command *> CommandCache;
+
+    QueryCache queryCache; ///< prepared queries, by class and kind
+    CommandCache commandCache; ///< prepared commands, by class and kind
+    size_t numPrepared; ///< statistics: number of statements prepared for the caches
+
+    typedef std::map<const char *, PrefetchedTable> PrefetchIndex;
+
+    int bulkLoadNesting; ///< >0 while in bulk load mode
+    bool bulkLoadSuspended; ///< set when DB was written during bulk load, which makes prefetched data stale
+    PrefetchIndex prefetchIndex; ///< tables prefetched in bulk load mode, by class
+
+    /// a write snapshot for the writer thread
+    typedef struct {
+      string sql; ///< the SQL statement
+      sqlite3pp::statement::bound_values values; ///< the values bound to the statement's parameters at the time of the write, empty for plain SQL
+    } Write;
+    typedef std::deque<Write> WriteQueue;
+    typedef std::map<string, long long> RowIdMap;
+
+    int batchNesting; ///< >0 while writes are collected into a batch
+    MLMicroSeconds maxStall; ///< longest time the main thread was blocked by a save run or a flush since last statistics_reset()
+
+    // background writer
+    string dbFileName; ///< the database file, for the writer thread's own connection
+    bool writerRunning; ///< set while the writer thread is running (main thread only)
+    WriteQueue batchWrites; ///< writes of the current batch, not yet passed to the writer thread (main thread only)
+    RowIdMap lastRowIds; ///< last ROWID assigned per table to inserts passed to the writer thread (main thread only)
+    pthread_t writerThread;
+    pthread_mutex_t writerMutex; ///< protects the members below
+    pthread_cond_t writerCond; ///< signalled to wake writer thread
+    pthread_cond_t committedCond; ///< signalled by writer thread after committing a batch
+    bool writerStop; ///< set to make writer thread exit
+    int writerConnectState; ///< 0 while writer thread is opening its DB connection, 1 when connected, -1 when connecting failed
+    WriteQueue writeQueue; ///< writes waiting for the writer thread, in order
+    unsigned long queuedWrites; ///< number of writes passed to the writer thread so far
+    unsigned long committedWrites; ///< number of writes done by the writer thread so far
+    unsigned long numCommits; ///< number of transactions committed by the writer thread so far
+
+  public:
+    ParamStore();
+    virtual ~ParamStore();
+
+    /// connects to DB, and performs initialisation/migration like SQLite3Persistence::connectAndInitialize().
+    /// In addition, switches the DB to write-ahead logging, so saving parameters in a transaction
+    /// does not block readers and needs fewer fsyncs than with the default rollback journal
+    ErrorPtr connectAndInitialize(const char *aDatabaseFileName, int aNeededSchemaVersion, int aLowestValidSchemaVersion, bool aFactoryReset);
+
+    /// @name cache of prepared statements (used by PersistentParams)
+    /// @{
+
+    /// get cached query
+    /// @param aClassKey identifies the class the query is for (PersistentParams use their typeid name)
+    /// @param aKind identifies the query among those of the class
+    /// @return the query, reset and ready for binding new values, or NULL if not cached yet
+    sqlite3pp::query *cachedQuery(const char *aClassKey, int aKind);
+
+    /// prepare query and add it to the cache
+    /// @param aClassKey identifies the class the query is for
+    /// @param aKind identifies the query among those of the class
+    /// @param aSQL the SQL text
+    /// @return the query (owned by the cache), NULL if it could not be prepared
+    sqlite3pp::query *prepareCachedQuery(const char *aClassKey, int aKind, const string &aSQL);
+
+    /// get cached command
+    /// @param aClassKey identifies the class the command is for (PersistentParams use their typeid name)
+    /// @param aKind identifies the command among those of the class
+    /// @return the command, reset and ready for binding new values, or NULL if not cached yet
+    sqlite3pp::command *cachedCommand(const char *aClassKey, int aKind);
+
+    /// prepare command and add it to the cache
+    /// @param aClassKey identifies the class the command is for
+    /// @param aKind identifies the command among those of the class
+    /// @param aSQL the SQL text
+    /// @return the command (owned by the cache), NULL if it could not be prepared
+    sqlite3pp::command *prepareCachedCommand(const char *aClassKey, int aKind, const string &aSQL);
+
+    /// finalize and forget all cached statements
+    /// @note this is done automatically before the DB is (re)connected or closed
+    void clearStatementCache();
+
+    /// @return number of statements prepared for the caches so far
+    size_t statementsPrepared() { return numPrepared; };
+
+    /// @}
+
+
+    /// @name writing (used by PersistentParams)
+    /// @{
+
+    /// start background writer: from now on, writes are captured as SQL plus a copy of all bound parameter values
+    /// (an immutable snapshot of the parameters at the time of the write), and executed on a separate thread
+    /// using a separate DB connection. So the calling thread never waits for disk I/O when saving.
+    /// @return ok or error (e.g. writer thread cannot open the DB; writes then remain synchronous)
+    /// @note with the writer running, reads first wait for all pending writes (see flush()),
+    ///   and new records get their ROWID assigned in advance (see newRowId())
+    ErrorPtr startBackgroundWriter();
+
+    /// stop background writer, after all pending writes are committed
+    void stopBackgroundWriter();
+
+    /// @return true if writes are executed by the background writer
+    bool hasBackgroundWriter() { return writerRunning; };
+
+    /// begin batch of writes: all writes up to the matching endBatch() are written in one transaction
+    /// @note calls can be nested, batch ends with the last endBatch()
+    void beginBatch();
+
+    /// end batch of writes
+    /// @return SQLITE_OK, or error code of the commit (when writing synchronously)
+    int endBatch();
+
+    /// execute a write
+    /// @param aCommand the command, with all parameters bound. Must be reset() by the caller afterwards
+    /// @note with the background writer running, only commands recording their bindings (all cached commands)
+    ///   can be passed to the writer thread, others are executed right away after a flush()
+    /// @return SQLITE_OK or error code. Errors of background writes are only logged by the writer thread.
+    int write(sqlite3pp::command &aCommand);
+
+    /// execute a write
+    /// @param aSQL the SQL statement
+    /// @return SQLITE_OK or error code. Errors of background writes are only logged by the writer thread.
+    int write(const string &aSQL);
+
+    /// wait until all writes done so far are committed
+    /// @note this is a no-op without background writer
+    void flush();
+
+    /// @param aTableName name of the table to insert a record into
+    /// @return ROWID the new record must be inserted with, 0 if ROWID should be assigned by SQLite
+    long long newRowId(const char *aTableName);
+
+    /// note time the main thread was blocked by persistence
+    /// @param aStarted time when the blocking operation started
+    void noteStall(MLMicroSeconds aStarted);
+
+    /// @return statistics of writes and main thread stalls
+    string statistics();
+
+    /// reset statistics
+    void statistics_reset();
+
+    /// @}
+
+
+    /// @name bulk loading (used by PersistentParams)
+    /// @{
+
+    /// start bulk load mode: PersistentParams then read their entire table once and serve
+    /// loadFromStore() from memory, instead of issuing queries for every single object.
+    /// @note calls can be nested, bulk load mode ends with the last endBulkLoad()
+    void beginBulkLoad();
+
+    /// end bulk load mode, frees the prefetched records
+    void endBulkLoad();
+
+    /// @return true if in bulk load mode and prefetched records can be used
+    bool isBulkLoading() { return bulkLoadNesting>0 && !bulkLoadSuspended; };
+
+    /// get prefetched table
+    /// @param aClassKey identifies the class the records were prefetched for
+    /// @return the table, NULL if not (yet) prefetched or prefetched records cannot be used
+    const PrefetchedTable *prefetchedTable(const char *aClassKey);
+
+    /// create new table to prefetch records into
+    /// @param aClassKey identifies the class the records are prefetched for
+    /// @return the (empty) table, NULL if not in bulk load mode
+    PrefetchedTable *newPrefetchedTable(const char *aClassKey);
+
+    /// note that DB is being modified, which makes prefetched records stale
+    /// @note prefetched records are not used any more until the end of bulk load mode. They are not freed before,
+    ///   because they might still be iterated in loadAllFromStore().
+    void dataModified();
+
+    /// @}
+
+  private:
+
+    void passBatchToWriter();
+    static void *writerThreadStart(void *aParamStoreP);
+    void *writerThreadFunc();
+
   };
 
 
+  /// callback for loading parameter sets from records
+  typedef boost::function<void (ParamRow &aRow)> ParamRowCB;
+
+
   /// @note this class does NOT derive from P44Obj, so it can be added as "interface" using multiple-inheritance
   class PersistentParams
   {
@@ -87,7 +356,7 @@ namespace p44 {
     /// @param aCommonFlags flag word already containing flags from superclasses (which are included in a flagword saved by subclasses)
     /// @note the base class loads ROWID and the parent identifier (first item in keyDefs) automatically.
     ///   subclasses should always call inherited loadFromRow() FIRST
-    virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
+    virtual void loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP);
 
     /// bind values to passed statement
     /// @param aStatement statement to bind parameter values to
@@ -109,6 +378,8 @@ namespace p44 {
     /// @}
 
     /// mark the parameter set dirty (so it will be saved to DB next time saveToStore is called
+    /// @note subclasses can override this to register the object (or its owner) for the next save run,
+    ///   so not all objects need to be visited to find the dirty ones
     virtual void markDirty();
 
     /// @return true if needs to be saved
@@ -131,10 +402,31 @@ namespace p44 {
     /// helper for implementation of loadChildren()
     /// @return a prepared query set up to iterate through all records with a given parent identifier, or NULL on error
     /// @param aParentIdentifier identifies the parent of this parameter set (a string (G)UID or the ROWID of a parent parameter set)
-    sqlite3pp::query *newLoadAllQuery(const char *aParentIdentifier);
+    /// @note the query is owned by the paramStore's statement cache and must not be deleted. It must be reset() after use,
+    ///   and it is only valid until the next getLoadAllQuery() for the same class.
+    sqlite3pp::query *getLoadAllQuery(const char *aParentIdentifier);
+
+    /// helper for implementation of loadChildren()
+    /// @param aParentIdentifier identifies the parent of the parameter sets to load
+    /// @param aRowCB will be called with every record found for aParentIdentifier
+    /// @note in bulk load mode, records are served from memory
+    ErrorPtr loadAllFromStore(const char *aParentIdentifier, ParamRowCB aRowCB);
 
 
   private:
+    /// kinds of statements cached per class in the paramStore
+    enum {
+      stmt_loadAll, ///< SELECT all records of a parent
+      stmt_cleanup, ///< DELETE all records of a parent except one
+      stmt_update, ///< UPDATE record by ROWID
+      stmt_insert, ///< INSERT OR REPLACE record
+      stmt_delete ///< DELETE record by ROWID
+    };
+    /// @return key identifying this object's class in the paramStore's statement cache
+    const char *classKey() { return typeid(*this).name(); };
+    /// get prefetched table (prefetching it first if needed)
+    /// @return the table to serve records from in bulk load mode, NULL if records must be queried
+    const PrefetchedTable *getPrefetchedTable();
     /// check and update schema to hold the parameters
     void checkAndUpdateSchema();
     /// append field list
@@ -23,21 +23,24 @@
 
 #include <sys/ioctl.h>
 #include <sys/poll.h>
+#include <netinet/tcp.h>
 
 using namespace p44;
 
 SocketComm::SocketComm(MainLoop &aMainLoop) :
   FdComm(aMainLoop),
-  connectionOpen(false),
-  isConnecting(false),
-  isClosing(false),
-  serving(false),
+  connectionLess(false),
+  connectionFd(-1),
   addressInfoList(NULL),
   currentAddressInfo(NULL),
   currentSockAddrP(NULL),
+  isConnecting(false),
+  isClosing(false),
+  connectionOpen(false),
+  serving(false),
+  tcpNoDelay(false),
   maxServerConnections(1),
-  serverConnection(NULL),
-  connectionFd(-1)
+  serverConnection(NULL)
 {
 }
 
@@ -205,6 +208,7 @@ void SocketComm::passClientConnection(int aFd, SocketCommPtr aServerConnection)
   makeNonBlocking(aFd);
   // save and mark open
   serverConnection = aServerConnection;
+  setSocketOptions(aFd);
   // set Fd and let FdComm base class install receive & transmit handlers
   setFd(aFd);
   // save fd for my own use
@@ -437,6 +441,7 @@ bool SocketComm::connectionMonitorHandler(MLMicroSeconds aCycleStartTime, int aF
       // connection ok
       connectionStatusHandler(this, ErrorPtr());
     }
+    setSocketOptions(aFd);
     // let FdComm base class operate open connection (will install handlers)
     setFd(aFd);
   }
@@ -560,6 +565,62 @@ size_t SocketComm::transmitBytes(size_t aNumBytes, const uint8_t *aBytes, ErrorP
 }
 
 
+size_t SocketComm::transmitVector(const struct iovec *aIov, int aIovCnt, ErrorPtr &aError)
+{
+  if (connectionLess) {
+    // each buffer is a separate datagram
+    if (aIovCnt<1) return 0;
+    return transmitBytes(aIov[0].iov_len, (const uint8_t *)aIov[0].iov_base, aError);
+  }
+  else {
+    return inherited::transmitVector(aIov, aIovCnt, aError);
+  }
+}
+
+
+
+#pragma mark - TCP options
+
+
+void SocketComm::setSocketOptions(int aFd)
+{
+  if (tcpNoDelay && !connectionLess) {
+    // Note: fails harmlessly on non-TCP stream sockets
+    int one = 1;
+    setsockopt(aFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+}
+
+
+void SocketComm::setTcpNoDelay(bool aNoDelay)
+{
+  tcpNoDelay = aNoDelay;
+  if (dataFd>=0 && !connectionLess) {
+    int flag = aNoDelay ? 1 : 0;
+    setsockopt(dataFd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+  }
+}
+
+
+void SocketComm::setTcpCork(bool aCork)
+{
+  if (dataFd>=0 && !connectionLess) {
+    int flag = aCork ? 1 : 0;
+    #if defined(TCP_CORK)
+    setsockopt(dataFd, IPPROTO_TCP, TCP_CORK, &flag, sizeof(flag));
+    #elif defined(TCP_NOPUSH)
+    setsockopt(dataFd, IPPROTO_TCP, TCP_NOPUSH, &flag, sizeof(flag));
+    #endif
+  }
+}
+
+
+void SocketComm::holdTransmit(bool aHold)
+{
+  setTcpCork(aHold);
+}
+
+
 
 #pragma mark - handling data exception
 
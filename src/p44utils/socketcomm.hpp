@@ -96,6 +96,7 @@ namespace p44 {
     bool isClosing; ///< in progress of closing connection
     bool connectionOpen; ///< regular data connection is open
     bool serving; ///< is serving socket
+    bool tcpNoDelay; ///< TCP_NODELAY to be set on connection
     SocketCommCB connectionStatusHandler;
     // server connection internals
     int maxServerConnections;
@@ -178,6 +179,28 @@ namespace p44 {
     /// @note for UDP, the host/port specified in setConnectionParams() will be used to send datagrams to
     virtual size_t transmitBytes(size_t aNumBytes, const uint8_t *aBytes, ErrorPtr &aError);
 
+    /// write data from multiple buffers (non-blocking)
+    /// @param aIov array of buffers
+    /// @param aIovCnt number of buffers in aIov
+    /// @param aError reference to ErrorPtr. Will be left untouched if no error occurs
+    /// @return number ob bytes actually written, can be 0 (e.g. if connection is still in process of opening)
+    /// @note for UDP, only the first buffer is sent per call (as one datagram)
+    virtual size_t transmitVector(const struct iovec *aIov, int aIovCnt, ErrorPtr &aError);
+
+    /// enable or disable Nagle's algorithm (TCP_NODELAY)
+    /// @param aNoDelay if set, small segments are sent immediately instead of waiting for more data or ACKs
+    /// @note can be called before the connection is open, will be applied when it opens
+    void setTcpNoDelay(bool aNoDelay);
+
+    /// cork or uncork the connection (TCP_CORK on Linux, TCP_NOPUSH on BSD)
+    /// @param aCork if set, partial segments are held back until uncorked
+    void setTcpCork(bool aCork);
+
+  protected:
+
+    /// hold back partial segments while a burst of queued data is sent
+    virtual void holdTransmit(bool aHold);
+
 
   private:
     void freeAddressInfo();
@@ -185,6 +208,7 @@ namespace p44 {
     ErrorPtr connectNextAddress();
     bool connectionMonitorHandler(MLMicroSeconds aCycleStartTime, int aFd, int aPollFlags);
     void internalCloseConnection();
+    void setSocketOptions(int aFd);
     virtual void dataExceptionHandler(int aFd, int aPollFlags);
 
     bool connectionAcceptHandler(MLMicroSeconds aCycleStartTime, int aFd, int aPollFlags);
@@ -184,7 +184,7 @@ namespace sqlite3pp
   }
 
 
-  statement::statement(database& db, char const* stmt) : db_(db), stmt_(0), tail_(0)
+  statement::statement(database& db, char const* stmt) : db_(db), stmt_(0), tail_(0), record_(false)
   {
     if (stmt) {
       int rc = prepare(stmt);
@@ -211,7 +211,7 @@ namespace sqlite3pp
 
   int statement::prepare_impl(char const* stmt)
   {
-    return sqlite3_prepare(db_.db_, stmt, strlen(stmt), &stmt_, &tail_);
+    return sqlite3_prepare_v2(db_.db_, stmt, strlen(stmt), &stmt_, &tail_);
   }
 
   int statement::finish()
@@ -241,34 +241,78 @@ namespace sqlite3pp
     return sqlite3_reset(stmt_);
   }
 
+  void statement::record_bindings(bool record)
+  {
+    record_ = record;
+    bindings_.clear();
+  }
+
+  char const* statement::sql()
+  {
+    return stmt_ ? sqlite3_sql(stmt_) : 0;
+  }
+
+  statement::bound_value& statement::recorded(int idx, int type)
+  {
+    if (idx > static_cast<int>(bindings_.size())) {
+      bound_value null_value;
+      null_value.type = SQLITE_NULL;
+      null_value.ival = 0;
+      null_value.dval = 0;
+      bindings_.resize(idx, null_value);
+    }
+    bound_value& v = bindings_[idx-1];
+    v.type = type;
+    v.data.clear();
+    return v;
+  }
+
   int statement::bind(int idx, int value)
   {
-    return sqlite3_bind_int(stmt_, idx, value);
+    int rc = sqlite3_bind_int(stmt_, idx, value);
+    if (record_ && rc == SQLITE_OK)
+      recorded(idx, SQLITE_INTEGER).ival = value;
+    return rc;
   }
 
   int statement::bind(int idx, double value)
   {
-    return sqlite3_bind_double(stmt_, idx, value);
+    int rc = sqlite3_bind_double(stmt_, idx, value);
+    if (record_ && rc == SQLITE_OK)
+      recorded(idx, SQLITE_FLOAT).dval = value;
+    return rc;
   }
 
   int statement::bind(int idx, long long int value)
   {
-    return sqlite3_bind_int64(stmt_, idx, value);
+    int rc = sqlite3_bind_int64(stmt_, idx, value);
+    if (record_ && rc == SQLITE_OK)
+      recorded(idx, SQLITE_INTEGER).ival = value;
+    return rc;
   }
 
   int statement::bind(int idx, char const* value, bool fstatic)
   {
-    return sqlite3_bind_text(stmt_, idx, value, strlen(value), fstatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    int rc = sqlite3_bind_text(stmt_, idx, value, strlen(value), fstatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    if (record_ && rc == SQLITE_OK)
+      recorded(idx, SQLITE_TEXT).data = value;
+    return rc;
   }
 
   int statement::bind(int idx, void const* value, int n, bool fstatic)
   {
-    return sqlite3_bind_blob(stmt_, idx, value, n, fstatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    int rc = sqlite3_bind_blob(stmt_, idx, value, n, fstatic ? SQLITE_STATIC : SQLITE_TRANSIENT);
+    if (record_ && rc == SQLITE_OK)
+      recorded(idx, SQLITE_BLOB).data.assign(static_cast<char const*>(value), n);
+    return rc;
   }
 
   int statement::bind(int idx)
   {
-    return sqlite3_bind_null(stmt_, idx);
+    int rc = sqlite3_bind_null(stmt_, idx);
+    if (record_ && rc == SQLITE_OK)
+      recorded(idx, SQLITE_NULL);
+    return rc;
   }
 
   int statement::bind(int idx, null_type)
@@ -26,6 +26,7 @@
 #define SQLITE3PP_H
 
 #include <string>
+#include <vector>
 #include <stdexcept>
 #include <sqlite3.h>
 #include <boost/utility.hpp>
@@ -128,6 +129,21 @@ namespace sqlite3pp
     int step();
     int reset();
 
+    // recording of bound values, so the statement can be executed again later or on another connection
+    struct bound_value
+    {
+      int type; // SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL
+      long long int ival;
+      double dval;
+      std::string data; // text or blob
+    };
+    typedef std::vector<bound_value> bound_values;
+
+    void record_bindings(bool record);
+    bool recording_bindings() const { return record_; }
+    bound_values const& bindings() const { return bindings_; }
+    char const* sql();
+
    protected:
     explicit statement(database& db, char const* stmt = 0);
     virtual ~statement();
@@ -139,6 +155,12 @@ namespace sqlite3pp
     database& db_;
     sqlite3_stmt* stmt_;
     char const* tail_;
+
+   private:
+    bound_value& recorded(int idx, int type);
+
+    bool record_;
+    bound_values bindings_;
   };
 
   class command : public statement
@@ -80,6 +80,22 @@ string Device::modelUID()
 }
 
 
+string Device::announcementFingerprint()
+{
+  // combine model and zone information and make UUID based dSUID of it
+  DsUid vdcNamespace(DSUID_P44VDC_MODELUID_UUID);
+  string s = string_format(
+    "%s:%s:%s:%s:%d:%d:%d:%d:%d",
+    modelUID().c_str(), modelName().c_str(), hardwareGUID().c_str(), vendorId().c_str(),
+    deviceSettings ? deviceSettings->zoneID : 0,
+    (int)buttons.size(), (int)binaryInputs.size(), (int)sensors.size(), output ? (int)output->numChannels() : -1
+  );
+  DsUid fingerprint;
+  fingerprint.setNameInSpace(s, vdcNamespace);
+  return fingerprint.getString();
+}
+
+
 Device::~Device()
 {
   buttons.clear();
@@ -361,153 +377,167 @@ ErrorPtr Device::handleMethod(VdcApiRequestPtr aRequest, const string &aMethod,
 
 void Device::handleNotification(const string &aMethod, ApiValuePtr aParams)
 {
+  // decode generic parameters into a typed notification
   ErrorPtr err;
+  VdcApiNotification notification;
+  notification.method = aMethod.c_str();
+  string controlValueName; // storage for notification.name
+  ApiValuePtr o;
   if (aMethod=="callScene") {
-    // call scene
-    ApiValuePtr o;
+    notification.type = vdcapi_callScene;
     if (Error::isOK(err = checkParam(aParams, "scene", o))) {
-      SceneNo sceneNo = (SceneNo)o->int32Value();
-      bool force = false;
+      notification.scene = o->int32Value();
       // check for force flag
       if (Error::isOK(err = checkParam(aParams, "force", o))) {
-        force = o->boolValue();
-        // now call
-        callScene(sceneNo, force);
+        notification.force = o->boolValue();
       }
     }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "callScene error: %s\n", err->description().c_str());
-    }
   }
-  else if (aMethod=="saveScene") {
-    // save scene
-    ApiValuePtr o;
+  else if (aMethod=="saveScene" || aMethod=="undoScene" || aMethod=="setLocalPriority" || aMethod=="callSceneMin") {
+    if (aMethod=="saveScene") notification.type = vdcapi_saveScene;
+    else if (aMethod=="undoScene") notification.type = vdcapi_undoScene;
+    else if (aMethod=="setLocalPriority") notification.type = vdcapi_setLocalPriority;
+    else notification.type = vdcapi_callSceneMin;
     if (Error::isOK(err = checkParam(aParams, "scene", o))) {
-      SceneNo sceneNo = (SceneNo)o->int32Value();
-      // now save
-      saveScene(sceneNo);
-    }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "saveScene error: %s\n", err->description().c_str());
-    }
-  }
-  else if (aMethod=="undoScene") {
-    // save scene
-    ApiValuePtr o;
-    if (Error::isOK(err = checkParam(aParams, "scene", o))) {
-      SceneNo sceneNo = (SceneNo)o->int32Value();
-      // now save
-      undoScene(sceneNo);
-    }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "undoScene error: %s\n", err->description().c_str());
-    }
-  }
-  else if (aMethod=="setLocalPriority") {
-    // set local priority
-    ApiValuePtr o;
-    if (Error::isOK(err = checkParam(aParams, "scene", o))) {
-      SceneNo sceneNo = (SceneNo)o->int32Value();
-      // now save
-      setLocalPriority(sceneNo);
-    }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "setLocalPriority error: %s\n", err->description().c_str());
+      notification.scene = o->int32Value();
     }
   }
   else if (aMethod=="setControlValue") {
-    // set control value
-    ApiValuePtr o;
+    notification.type = vdcapi_setControlValue;
     if (Error::isOK(err = checkParam(aParams, "name", o))) {
-      string controlValueName = o->stringValue();
+      controlValueName = o->stringValue();
+      notification.name = controlValueName.c_str();
       if (Error::isOK(err = checkParam(aParams, "value", o))) {
-        // get value
-        double value = o->doubleValue();
-        // now process the value (updates channel values, but does not yet apply them)
-        LOG(LOG_NOTICE, "processControlValue(%s, %f) in device %s:\n", controlValueName.c_str(), value, shortDesc().c_str());
-        processControlValue(controlValueName, value);
-        // apply the values
-        requestApplyingChannels(NULL, false);
+        notification.value = o->doubleValue();
       }
     }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "setControlValue error: %s\n", err->description().c_str());
-    }
-  }
-  else if (aMethod=="callSceneMin") {
-    // switch device on with minimum output level if not already on (=prepare device for dimming from zero)
-    ApiValuePtr o;
-    if (Error::isOK(err = checkParam(aParams, "scene", o))) {
-      SceneNo sceneNo = (SceneNo)o->int32Value();
-      // now call
-      callSceneMin(sceneNo);
-    }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "callSceneMin error: %s\n", err->description().c_str());
-    }
   }
   else if (aMethod=="dimChannel") {
-    // start or stop dimming a channel
-    ApiValuePtr o;
+    notification.type = vdcapi_dimChannel;
     if (Error::isOK(err = checkParam(aParams, "channel", o))) {
-      DsChannelType channel = (DsChannelType)o->int32Value();
+      notification.channel = o->int32Value();
       if (Error::isOK(err = checkParam(aParams, "mode", o))) {
-        int mode = o->int32Value();
-        int area = 0;
+        notification.mode = o->int32Value();
         o = aParams->get("area");
         if (o) {
-          area = o->int32Value();
+          notification.area = o->int32Value();
         }
-        // start/stop dimming
-        dimChannelForArea(channel,mode==0 ? dimmode_stop : (mode<0 ? dimmode_down : dimmode_up), area, MOC_DIM_STEP_TIMEOUT);
       }
     }
-    if (!Error::isOK(err)) {
-      LOG(LOG_WARNING, "callSceneMin error: %s\n", err->description().c_str());
-    }
   }
   else if (aMethod=="setOutputChannelValue") {
-    // set output channel value (alias for setProperty outputStates)
-    ApiValuePtr o;
+    // set output channel value (alias for setProperty channelStates)
+    // Note: handled here rather than via handleTypedNotification(), as the property value must be built
+    //   with the caller's API value factory (there might not be a vdSM session, e.g. with local config API)
     if (Error::isOK(err = checkParam(aParams, "channel", o))) {
       DsChannelType channel = (DsChannelType)o->int32Value();
       if (Error::isOK(err = checkParam(aParams, "value", o))) {
         double value = o->doubleValue();
         // check optional apply_now flag
-        bool apply_now = true; // non-buffered write by default
+        bool applyNow = true; // non-buffered write by default
         o = aParams->get("apply_now");
         if (o) {
-          apply_now = o->boolValue();
+          applyNow = o->boolValue();
         }
-        // reverse build the correctly structured property value: { channelStates: { <channel>: { value:<value> } } }
-        // - value
-        o = aParams->newObject();
-        o->add("value", o->newDouble(value));
-        // - channel id
-        ApiValuePtr ch = o->newObject();
-        ch->add(string_format("%d",channel), o);
-        // - channelStates
-        ApiValuePtr propValue = ch->newObject();
-        propValue->add("channelStates", ch);
-        // now access the property
-        err = accessProperty(apply_now ? access_write : access_write_preload, propValue, ApiValuePtr(), VDC_API_DOMAIN, PropertyDescriptorPtr());
+        err = setOutputChannelValue(channel, value, applyNow, aParams);
       }
     }
     if (!Error::isOK(err)) {
       LOG(LOG_WARNING, "setOutputChannelValue error: %s\n", err->description().c_str());
     }
+    return;
   }
   else if (aMethod=="identify") {
-    // identify to user
-    LOG(LOG_NOTICE, "Identify in device %s:\n", shortDesc().c_str());
-    identifyToUser();
+    notification.type = vdcapi_identify;
   }
   else {
     inherited::handleNotification(aMethod, aParams);
+    return;
+  }
+  if (Error::isOK(err)) {
+    handleTypedNotification(notification);
+  }
+  else {
+    LOG(LOG_WARNING, "%s error: %s\n", aMethod.c_str(), err->description().c_str());
   }
 }
 
 
+void Device::handleTypedNotification(const VdcApiNotification &aNotification)
+{
+  switch (aNotification.type) {
+    case vdcapi_callScene:
+      callScene((SceneNo)aNotification.scene, aNotification.force);
+      break;
+    case vdcapi_saveScene:
+      saveScene((SceneNo)aNotification.scene);
+      break;
+    case vdcapi_undoScene:
+      undoScene((SceneNo)aNotification.scene);
+      break;
+    case vdcapi_setLocalPriority:
+      setLocalPriority((SceneNo)aNotification.scene);
+      break;
+    case vdcapi_callSceneMin:
+      // switch device on with minimum output level if not already on (=prepare device for dimming from zero)
+      callSceneMin((SceneNo)aNotification.scene);
+      break;
+    case vdcapi_setControlValue:
+      // process the value (updates channel values, but does not yet apply them)
+      LOG(LOG_NOTICE, "processControlValue(%s, %f) in device %s:\n", aNotification.name, aNotification.value, shortDesc().c_str());
+      processControlValue(aNotification.name, aNotification.value);
+      // apply the values
+      requestApplyingChannels(NULL, false);
+      break;
+    case vdcapi_dimChannel:
+      // start or stop dimming a channel
+      dimChannelForArea(
+        (DsChannelType)aNotification.channel,
+        aNotification.mode==0 ? dimmode_stop : (aNotification.mode<0 ? dimmode_down : dimmode_up),
+        aNotification.area,
+        MOC_DIM_STEP_TIMEOUT
+      );
+      break;
+    case vdcapi_setOutputChannelValue: {
+      // set output channel value (alias for setProperty channelStates)
+      // - typed notifications only come from a vdSM session, so use its API value factory
+      VdcApiConnectionPtr api = getDeviceContainer().getSessionConnection();
+      if (!api) break;
+      ErrorPtr err = setOutputChannelValue((DsChannelType)aNotification.channel, aNotification.value, aNotification.applyNow, api->newApiValue());
+      if (!Error::isOK(err)) {
+        LOG(LOG_WARNING, "setOutputChannelValue error: %s\n", err->description().c_str());
+      }
+      break;
+    }
+    case vdcapi_identify:
+      // identify to user
+      LOG(LOG_NOTICE, "Identify in device %s:\n", shortDesc().c_str());
+      identifyToUser();
+      break;
+    default:
+      inherited::handleTypedNotification(aNotification);
+      break;
+  }
+}
+
+
+ErrorPtr Device::setOutputChannelValue(DsChannelType aChannel, double aValue, bool aApplyNow, ApiValuePtr aFactory)
+{
+  // reverse build the correctly structured property value: { channelStates: { <channel>: { value:<value> } } }
+  // - value
+  ApiValuePtr o = aFactory->newObject();
+  o->add("value", o->newDouble(aValue));
+  // - channel id
+  ApiValuePtr ch = o->newObject();
+  ch->add(string_format("%d",aChannel), o);
+  // - channelStates
+  ApiValuePtr propValue = ch->newObject();
+  propValue->add("channelStates", ch);
+  // now access the property, exactly as setProperty would (writtenProperty() applies non-preload writes)
+  return accessProperty(aApplyNow ? access_write : access_write_preload, propValue, ApiValuePtr(), VDC_API_DOMAIN, PropertyDescriptorPtr());
+}
+
+
 void Device::disconnect(bool aForgetParams, DisconnectCB aDisconnectResultHandler)
 {
   // remove from container management
@@ -523,6 +553,8 @@ void Device::hasVanished(bool aForgetParams)
 {
   // have device send a vanish message
   sendRequest("vanish", ApiValuePtr());
+  // vdSMs will need a new announcement should the device reappear
+  getDeviceContainer().forgetKnownFingerprint(getApiDsUid());
   // then disconnect it in software
   // Note that disconnect() might delete the Device object (so 'this' gets invalid)
   disconnect(aForgetParams, NULL);
@@ -753,7 +785,7 @@ void Device::dimChannel(DsChannelType aChannelType, DsDimMode aDimMode)
       isDimming = true;
       // wait for all apply operations to really complete before starting to dim
       DoneCB dd = boost::bind(&Device::dimDoneHandler, this, ch, increment, MainLoop::now()+10*MilliSecond);
-      waitForApplyComplete(boost::bind(&Device::requestApplyingChannels, this, dd, false));
+      waitForApplyComplete(boost::bind(&Device::requestApplyingChannels, this, dd, false, 0));
     }
   }
 }
@@ -790,7 +822,7 @@ void Device::dimDoneHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLM
 #define SERIALIZER_WATCHDOG 1
 #define SERIALIZER_WATCHDOG_TIMEOUT (20*Second)
 
-void Device::requestApplyingChannels(DoneCB aAppliedOrSupersededCB, bool aForDimming)
+void Device::requestApplyingChannels(DoneCB aAppliedOrSupersededCB, bool aForDimming, long aBatchToken)
 {
   FOCUSLOG("requestApplyingChannels entered in device %s\n", shortDesc().c_str());
   // Caller wants current channel values applied to hardware
@@ -834,11 +866,24 @@ void Device::requestApplyingChannels(DoneCB aAppliedOrSupersededCB, bool aForDim
     // - start applying
     appliedOrSupersededCB = aAppliedOrSupersededCB;
     applyInProgress = true;
-    applyChannelValues(boost::bind(&Device::applyingChannelsComplete, this), aForDimming);
+    if (!aForDimming && classContainerP->deferApply(DevicePtr(this), aBatchToken)) {
+      // container collects devices to apply them in one batch (e.g. multicast scene call), applyDeferredChannelValues() will be called later
+      FOCUSLOG("- apply deferred until container's apply batch is committed\n");
+    }
+    else {
+      applyChannelValues(boost::bind(&Device::applyingChannelsComplete, this), aForDimming);
+    }
   }
 }
 
 
+void Device::applyDeferredChannelValues()
+{
+  FOCUSLOG("applyDeferredChannelValues: batch committed, calling applyChannelValues() in device %s\n", shortDesc().c_str());
+  applyChannelValues(boost::bind(&Device::applyingChannelsComplete, this), false);
+}
+
+
 void Device::waitForApplyComplete(DoneCB aApplyCompleteCB)
 {
   if (!applyInProgress) {
@@ -1109,7 +1154,10 @@ void Device::callScene(SceneNo aSceneNo, bool aForce)
           // Note: the actual updating might happen later (when the hardware responds) but
           //   implementations must make sure access to the hardware is serialized such that
           //   the values are captured before values from applyScene() below are applied.
-          output->captureScene(previousState, true, boost::bind(&Device::outputUndoStateSaved,this,output,scene)); // apply only after capture is complete
+          // - when called as part of a multicast callScene, keep the container's apply batch open until the new
+          //   values are ready, so devices called together still apply together even if capturing is asynchronous
+          long batchToken = classContainerP->joinApplyBatch();
+          output->captureScene(previousState, true, boost::bind(&Device::outputUndoStateSaved,this,output,scene,batchToken)); // apply only after capture is complete
         } // if output
       } // not dontCare
       else {
@@ -1125,16 +1173,18 @@ void Device::callScene(SceneNo aSceneNo, bool aForce)
 
 
 // deferred applying of state, after current state has been captured for this output
-void Device::outputUndoStateSaved(DsBehaviourPtr aOutput, DsScenePtr aScene)
+void Device::outputUndoStateSaved(DsBehaviourPtr aOutput, DsScenePtr aScene, long aBatchToken)
 {
   OutputBehaviourPtr output = boost::dynamic_pointer_cast<OutputBehaviour>(aOutput);
   if (output) {
     // apply scene logically
     if (output->applyScene(aScene)) {
       // now apply values to hardware
-      requestApplyingChannels(boost::bind(&Device::sceneValuesApplied, this, aScene), false);
+      requestApplyingChannels(boost::bind(&Device::sceneValuesApplied, this, aScene), false, aBatchToken);
     }
   }
+  // new values are ready (or need not be applied), done with the apply batch (if any)
+  classContainerP->leaveApplyBatch(aBatchToken);
 }
 
 
@@ -1313,18 +1363,25 @@ ErrorPtr Device::load()
 }
 
 
+void Device::markDirty()
+{
+  getDeviceContainer().markDirty(getApiDsUid());
+}
+
+
 ErrorPtr Device::save()
 {
   ErrorPtr err;
   // save the device settings
   if (deviceSettings) err = deviceSettings->saveToStore(dSUID.getString().c_str(), false); // only one record per device
   if (!Error::isOK(err)) LOG(LOG_ERR,"Error saving settings for device %s: %s", shortDesc().c_str(), err->description().c_str());
-  // save the behaviours
-  for (BehaviourVector::iterator pos = buttons.begin(); pos!=buttons.end(); ++pos) (*pos)->save();
-  for (BehaviourVector::iterator pos = binaryInputs.begin(); pos!=binaryInputs.end(); ++pos) (*pos)->save();
-  for (BehaviourVector::iterator pos = sensors.begin(); pos!=sensors.end(); ++pos) (*pos)->save();
-  if (output) output->save();
-  return ErrorPtr();
+  // save the behaviours (report first error, if any)
+  ErrorPtr berr;
+  for (BehaviourVector::iterator pos = buttons.begin(); pos!=buttons.end(); ++pos) if (!Error::isOK(berr = (*pos)->save()) && Error::isOK(err)) err = berr;
+  for (BehaviourVector::iterator pos = binaryInputs.begin(); pos!=binaryInputs.end(); ++pos) if (!Error::isOK(berr = (*pos)->save()) && Error::isOK(err)) err = berr;
+  for (BehaviourVector::iterator pos = sensors.begin(); pos!=sensors.end(); ++pos) if (!Error::isOK(berr = (*pos)->save()) && Error::isOK(err)) err = berr;
+  if (output && !Error::isOK(berr = output->save()) && Error::isOK(err)) err = berr;
+  return err;
 }
 
 
@@ -1474,7 +1531,7 @@ PropertyDescriptorPtr Device::getDescriptorByIndex(int aPropIndex, int aDomain,
 
 
 
-PropertyDescriptorPtr Device::getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+PropertyDescriptorPtr Device::getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
 {
   if (
     aParentDescriptor && aParentDescriptor->isArrayContainer() &&
@@ -1506,13 +1563,13 @@ PropertyDescriptorPtr Device::getDescriptorByName(string aPropMatch, int &aStart
           // wildcard, result object is named after channelType
           ChannelBehaviourPtr cb = getChannelByIndex(aStartIndex);
           if (cb) {
-            descP->propertyName = string_format("%d", cb->getChannelType());
+            descP->setNumericName(cb->getChannelType());
           }
         }
       }
       else {
         // by index
-        descP->propertyName = string_format("%d", aStartIndex);
+        descP->setNumericName(aStartIndex);
       }
       descP->propertyType = aParentDescriptor->type();
       descP->propertyFieldKey = aStartIndex;
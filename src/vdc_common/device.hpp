@@ -118,6 +118,11 @@ namespace p44 {
     /// @return the entity type (one of dSD|vdSD|vDC|dSM|vdSM|dSS|*)
     virtual const char *entityType() { return "vdSD"; }
 
+    /// @return fingerprint of everything the vdSM learns about this device when it is announced
+    ///   (model, behaviours, zone). A device whose fingerprint has not changed since the vdSM last
+    ///   acknowledged its announcement does not need to be announced again to that vdSM.
+    string announcementFingerprint();
+
     /// Get icon data or name
     /// @param aIcon string to put result into (when method returns true)
     /// - if aWithData is set, binary PNG icon data for given resolution prefix is returned
@@ -195,6 +200,10 @@ namespace p44 {
     /// forget any parameters stored in persistent DB
     virtual ErrorPtr forget();
 
+    /// have the device saved in the next save run
+    /// @note called by the device's settings, behaviours and scenes when they get dirty
+    void markDirty();
+
     /// @}
 
 
@@ -216,6 +225,18 @@ namespace p44 {
     ///   used already to route the notification to this device.
     virtual void handleNotification(const string &aMethod, ApiValuePtr aParams);
 
+    /// called to let device handle device-level notification with typed parameters
+    /// @param aNotification the notification
+    virtual void handleTypedNotification(const VdcApiNotification &aNotification);
+
+    /// set output channel value, same as writing channelStates.<channel>.value via setProperty
+    /// @param aChannel the channel type
+    /// @param aValue the new channel value
+    /// @param aApplyNow if set, new value is applied to hardware, otherwise it is only preloaded
+    /// @param aFactory any API value of the API the request came from, used to create the property value
+    /// @return error if property could not be written
+    ErrorPtr setOutputChannelValue(DsChannelType aChannel, double aValue, bool aApplyNow, ApiValuePtr aFactory);
+
     /// call scene on this device
     /// @param aSceneNo the scene to call.
     void callScene(SceneNo aSceneNo, bool aForce);
@@ -262,7 +283,14 @@ namespace p44 {
     ///   such that aAppliedOrSupersededCB of the previous request is always called BEFORE initiating subsequent
     ///   channel updates in the hardware. It also may discard requests (but still calling aAppliedOrSupersededCB) to
     ///   avoid stacking up delayed requests.
-    void requestApplyingChannels(DoneCB aAppliedOrSupersededCB, bool aForDimming);
+    /// @param aBatchToken token from DeviceClassContainer::joinApplyBatch() when the new values were prepared asynchronously
+    ///   as part of a multicast, 0 otherwise
+    /// @note when the apply belongs to an apply batch of the device class container, actual applying is deferred until the batch is committed.
+    void requestApplyingChannels(DoneCB aAppliedOrSupersededCB, bool aForDimming, long aBatchToken = 0);
+
+    /// actually apply channel values that were deferred by requestApplyingChannels() while the container had an apply batch open
+    /// @note this is called by the device class container when committing the batch
+    void applyDeferredChannelValues();
 
     /// request callback when apply is really complete (all pending applies done)
     /// @param aApplyCompleteCB will called when values are applied and no other change is pending
@@ -391,7 +419,7 @@ namespace p44 {
     // property access implementation
     virtual int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
-    virtual PropertyDescriptorPtr getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+    virtual PropertyDescriptorPtr getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyContainerPtr getContainer(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain);
     virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor);
     virtual ErrorPtr writtenProperty(PropertyAccessMode aMode, PropertyDescriptorPtr aPropertyDescriptor, int aDomain, PropertyContainerPtr aContainer);
@@ -414,7 +442,7 @@ namespace p44 {
     void dimHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLMicroSeconds aNow);
     void dimDoneHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLMicroSeconds aNextDimAt);
     void outputSceneValueSaved(DsScenePtr aScene);
-    void outputUndoStateSaved(DsBehaviourPtr aOutput, DsScenePtr aScene);
+    void outputUndoStateSaved(DsBehaviourPtr aOutput, DsScenePtr aScene, long aBatchToken);
     void sceneValuesApplied(DsScenePtr aScene);
     void sceneActionsComplete(DsScenePtr aScene);
 
@@ -32,7 +32,11 @@ DeviceClassContainer::DeviceClassContainer(int aInstanceNumber, DeviceContainer
   instanceNumber(aInstanceNumber),
   defaultZoneID(0),
   vdcFlags(0),
-  tag(aTag)
+  tag(aTag),
+  applyBatchNesting(0),
+  applyBatchDispatching(0),
+  applyBatchGeneration(0),
+  applyBatchTimeoutTicket(0)
 {
 }
 
@@ -171,6 +175,106 @@ void DeviceClassContainer::removeDevices(bool aForget)
 
 
 
+#pragma mark - batched applying of channel values
+
+// max time a batch can delay applying channel values (in case a device never completes preparing its values)
+#define APPLY_BATCH_TIMEOUT (2*Second)
+
+long DeviceClassContainer::beginApplyBatch()
+{
+  if (applyBatchNesting++==0) {
+    // new batch
+    ++applyBatchGeneration;
+    MainLoop::currentMainLoop().cancelExecutionTicket(applyBatchTimeoutTicket);
+    applyBatchTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceClassContainer::applyBatchTimeout, this), APPLY_BATCH_TIMEOUT);
+  }
+  ++applyBatchDispatching;
+  return applyBatchGeneration;
+}
+
+
+long DeviceClassContainer::joinApplyBatch()
+{
+  if (applyBatchNesting==0) return 0; // no batch open, nothing to join
+  ++applyBatchNesting;
+  return applyBatchGeneration;
+}
+
+
+void DeviceClassContainer::endApplyBatch(long aBatchToken)
+{
+  if (aBatchToken==0 || aBatchToken!=applyBatchGeneration) {
+    // not part of a batch, or batch has already been forced to apply by timeout
+    return;
+  }
+  if (applyBatchDispatching>0) --applyBatchDispatching;
+  leaveApplyBatch(aBatchToken);
+}
+
+
+void DeviceClassContainer::leaveApplyBatch(long aBatchToken)
+{
+  if (aBatchToken==0 || aBatchToken!=applyBatchGeneration) {
+    // not part of a batch, or batch has already been forced to apply by timeout
+    return;
+  }
+  if (applyBatchNesting>0 && --applyBatchNesting==0) {
+    // outermost batch ends
+    commitApplyBatch();
+  }
+}
+
+
+bool DeviceClassContainer::deferApply(DevicePtr aDevice, long aBatchToken)
+{
+  if (applyBatchNesting==0) return false; // no batch open, apply now
+  if (aBatchToken==0) {
+    // requested right away: only part of the batch while the multicast is being dispatched,
+    // otherwise it is unrelated (e.g. local button action, unicast call while batch waits for a device) and must not be delayed
+    if (applyBatchDispatching==0) return false;
+  }
+  else if (aBatchToken!=applyBatchGeneration) {
+    // prepared for a batch that has already been forced to apply by timeout
+    return false;
+  }
+  applyBatch.push_back(aDevice);
+  return true;
+}
+
+
+void DeviceClassContainer::applyBatchTimeout()
+{
+  applyBatchTimeoutTicket = 0;
+  LOG(LOG_WARNING, "%s %s: apply batch not ended in time -> forced to apply %d device(s) now\n", entityType(), shortDesc().c_str(), (int)applyBatch.size());
+  applyBatchNesting = 0;
+  applyBatchDispatching = 0;
+  ++applyBatchGeneration; // late endApplyBatch() calls for the forced batch will be ignored
+  commitApplyBatch();
+}
+
+
+void DeviceClassContainer::commitApplyBatch()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(applyBatchTimeoutTicket);
+  if (!applyBatch.empty()) {
+    // take the batch, so new batches can already start while this one is applied
+    DeviceVector batch;
+    batch.swap(applyBatch);
+    LOG(LOG_INFO, "%s %s: applying channel values of %d device(s) as a batch\n", entityType(), shortDesc().c_str(), (int)batch.size());
+    applyChannelValuesBatch(batch);
+  }
+}
+
+
+void DeviceClassContainer::applyChannelValuesBatch(DeviceVector &aDevices)
+{
+  for (DeviceVector::iterator pos = aDevices.begin(); pos!=aDevices.end(); ++pos) {
+    (*pos)->applyDeferredChannelValues();
+  }
+}
+
+
+
 #pragma mark - persistent vdc level params
 
 
@@ -184,12 +288,20 @@ ErrorPtr DeviceClassContainer::load()
 }
 
 
+void DeviceClassContainer::markDirty()
+{
+  inheritedParams::markDirty();
+  getDeviceContainer().markDirty(getApiDsUid());
+}
+
+
 ErrorPtr DeviceClassContainer::save()
 {
   ErrorPtr err;
   // save the vdc settings
   err = saveToStore(dSUID.getString().c_str(), false); // only one record per vdc
-  return ErrorPtr();
+  if (!Error::isOK(err)) LOG(LOG_ERR,"Error saving settings for vdc %s: %s", shortDesc().c_str(), err->description().c_str());
+  return err;
 }
 
 
@@ -239,7 +351,7 @@ int DeviceClassContainer::numProps(int aDomain, PropertyDescriptorPtr aParentDes
 }
 
 
-PropertyDescriptorPtr DeviceClassContainer::getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+PropertyDescriptorPtr DeviceClassContainer::getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
 {
   if (aParentDescriptor && aParentDescriptor->hasObjectKey(device_container_key)) {
     // accessing one of the devices by numeric index
@@ -382,7 +494,7 @@ const FieldDefinition *DeviceClassContainer::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void DeviceClassContainer::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void DeviceClassContainer::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inheritedParams::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the field value
@@ -74,6 +74,13 @@ namespace p44 {
     /// default dS zone ID
     int defaultZoneID;
 
+    /// batched applying of channel values
+    int applyBatchNesting; ///< number of beginApplyBatch()/joinApplyBatch() calls not yet balanced by endApplyBatch()/leaveApplyBatch()
+    int applyBatchDispatching; ///< number of beginApplyBatch() calls not yet balanced by endApplyBatch(), i.e. multicast still being dispatched
+    long applyBatchGeneration; ///< identifies the currently open batch, so ends of batches already forced by timeout can be ignored
+    DeviceVector applyBatch; ///< devices waiting for their channel values to be applied when the batch is committed
+    long applyBatchTimeoutTicket; ///< makes sure a batch cannot stall applying channel values forever
+
   protected:
   
     DeviceVector devices; ///< the devices of this class
@@ -202,6 +209,38 @@ namespace p44 {
 		/// @}
 
 
+    /// @name batched applying of channel values
+    /// @{
+
+    /// start collecting devices with new channel values instead of applying them one by one
+    /// @return token identifying the batch, to be passed to endApplyBatch()
+    /// @note calls can be nested, the batch is committed when the outermost batch ends
+    long beginApplyBatch();
+
+    /// keep the currently open batch (if any) open, e.g. while a device is still preparing its new values
+    /// @return token identifying the batch, to be passed to leaveApplyBatch() and deferApply(), 0 if no batch is open
+    long joinApplyBatch();
+
+    /// end collecting devices. When the outermost batch ends, the collected devices are applied all at once
+    /// @param aBatchToken the token returned by beginApplyBatch()
+    /// @note tokens of batches that were already forced to apply by the batch timeout are ignored
+    void endApplyBatch(long aBatchToken);
+
+    /// release a batch joined with joinApplyBatch(). When the outermost batch ends, the collected devices are applied all at once
+    /// @param aBatchToken the token returned by joinApplyBatch()
+    /// @note tokens of batches that were already forced to apply by the batch timeout are ignored
+    void leaveApplyBatch(long aBatchToken);
+
+    /// add device to the currently open apply batch, if the apply belongs to it
+    /// @param aDevice the device which has channel values ready to be applied
+    /// @param aBatchToken the token returned by joinApplyBatch() when the apply was prepared asynchronously,
+    ///   0 for applies requested right away (which only belong to the batch while its multicast is being dispatched)
+    /// @return false if the apply does not belong to an open batch, so device must apply its channel values right away
+    bool deferApply(DevicePtr aDevice, long aBatchToken);
+
+    /// @}
+
+
     /// @name vdc level property persistence
     /// @{
 
@@ -216,6 +255,9 @@ namespace p44 {
     /// forget any parameters stored in persistent DB
     ErrorPtr forget();
 
+    /// mark vdc parameters dirty, and have the vdc saved in the next save run
+    virtual void markDirty();
+
 		/// @}
 
 
@@ -267,10 +309,17 @@ namespace p44 {
 
   protected:
 
+    /// apply the channel values of a batch of devices
+    /// @param aDevices the devices which have new channel values ready to be applied
+    /// @note base class just applies each device separately. Subclasses may override this to send group or
+    ///   broadcast commands for devices getting the same values, but must call inherited afterwards to let
+    ///   all devices complete applying (devices already updated by a group command will find nothing left to send)
+    virtual void applyChannelValuesBatch(DeviceVector &aDevices);
+
     // property access implementation
     virtual int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
-    virtual PropertyDescriptorPtr getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+    virtual PropertyDescriptorPtr getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyContainerPtr getContainer(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain);
     virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor);
 
@@ -278,12 +327,17 @@ namespace p44 {
     virtual const char *tableName();
     virtual size_t numFieldDefs();
     virtual const FieldDefinition *getFieldDef(size_t aIndex);
-    virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
+    virtual void loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
     // derive dSUID
     void deriveDsUid();
 
+  private:
+
+    void commitApplyBatch();
+    void applyBatchTimeout();
+
   };
 
 } // namespace p44
@@ -50,15 +50,125 @@ using namespace p44;
 // how often to write mainloop statistics into log output
 #define DEFAULT_MAINLOOP_STATS_INTERVAL (60) // every 5 min (with periodic activity every 5 seconds: 60*5 = 300 = 5min)
 
-// how long until a not acknowledged registrations is considered timed out (and next device can be attempted)
+// how long the vdSM may not acknowledge any announcement until the pending ones are considered timed out (and next device can be attempted)
 #define ANNOUNCE_TIMEOUT (30*Second)
 
 // how long until a not acknowledged announcement for a device is retried again for the same device
 #define ANNOUNCE_RETRY_TIMEOUT (300*Second)
 
+// max number of announcements waiting for acknowledgement from the vdSM at the same time
+#define DEFAULT_ANNOUNCE_WINDOW 16
+
+// the announce window is reduced when vdSM response time gets larger than this...
+#define ANNOUNCE_LATENCY_LIMIT (100*MilliSecond)
+// ...and larger than this factor times the fastest response seen
+#define ANNOUNCE_LATENCY_FACTOR 4
+
+// max age of a vdSM's acknowledgement of a device (in seconds). Older ones are re-announced even if unchanged,
+// to recover from vdSMs which have lost their device list without us noticing
+#define KNOWN_FINGERPRINT_MAX_AGE (7*24*3600)
+
 // default product name
 #define DEFAULT_PRODUCT_NAME "plan44.ch vdcd"
 
+// default memory budget for cached icons (a 16x16 icon is usually around 3.4kB)
+#define DEFAULT_ICON_CACHE_SIZE (256*1024)
+
+// how long the fact that an icon does not exist is cached
+#define ICON_NOT_FOUND_TTL (5*Minute)
+
+
+#pragma mark - IconCache
+
+IconCache::IconCache() :
+  maxBytes(DEFAULT_ICON_CACHE_SIZE),
+  cachedBytes(0),
+  hits(0),
+  misses(0)
+{
+}
+
+
+void IconCache::setMaxBytes(size_t aMaxBytes)
+{
+  maxBytes = aMaxBytes;
+  // make sure we are within the new budget
+  while (cachedBytes>maxBytes && !icons.empty()) {
+    cachedBytes -= entrySize(icons.back());
+    iconIndex.erase(icons.back().key);
+    icons.pop_back();
+  }
+}
+
+
+bool IconCache::lookup(const string &aKey, bool &aFound, string *aIconData)
+{
+  IconIndex::iterator pos = iconIndex.find(aKey);
+  if (
+    pos==iconIndex.end() ||
+    (!pos->second->found && MainLoop::now()>=pos->second->expires) || // "not found" info is outdated
+    (pos->second->found && aIconData && !pos->second->hasData) // data needed, but only existence known
+  ) {
+    misses++;
+    return false;
+  }
+  // move to front (most recently used)
+  icons.splice(icons.begin(), icons, pos->second);
+  aFound = pos->second->found;
+  if (aFound && aIconData) *aIconData = pos->second->data;
+  hits++;
+  return true;
+}
+
+
+void IconCache::store(const string &aKey, bool aFound, const string *aIconData)
+{
+  IconEntry e;
+  e.key = aKey;
+  e.found = aFound;
+  e.hasData = aFound && aIconData;
+  if (e.hasData) e.data = *aIconData;
+  e.expires = aFound ? Never : MainLoop::now()+ICON_NOT_FOUND_TTL;
+  size_t sz = entrySize(e);
+  if (sz>maxBytes) return; // caching disabled or icon too large
+  // make room
+  while (cachedBytes+sz>maxBytes && !icons.empty()) {
+    cachedBytes -= entrySize(icons.back());
+    iconIndex.erase(icons.back().key);
+    icons.pop_back();
+  }
+  // add as most recently used
+  IconIndex::iterator pos = iconIndex.find(aKey);
+  if (pos!=iconIndex.end()) {
+    // replace existing entry
+    cachedBytes -= entrySize(*pos->second);
+    icons.erase(pos->second);
+  }
+  iconIndex[aKey] = icons.insert(icons.begin(), e);
+  cachedBytes += sz;
+}
+
+
+void IconCache::clear()
+{
+  icons.clear();
+  iconIndex.clear();
+  cachedBytes = 0;
+}
+
+
+string IconCache::statistics()
+{
+  return string_format(
+    "Icon cache: %ld entries, %ld of %ld bytes used, %ld hits, %ld misses",
+    (long)icons.size(), (long)cachedBytes, (long)maxBytes, (long)hits, (long)misses
+  );
+}
+
+
+
+#pragma mark - DeviceContainer
+
 DeviceContainer::DeviceContainer() :
   mac(0),
   externalDsuid(false),
@@ -68,11 +178,21 @@ DeviceContainer::DeviceContainer() :
   lastPeriodicRun(0),
   learningMode(false),
   announcementTicket(0),
+  announceTimeoutTicket(0),
   periodicTaskTicket(0),
   localDimDirection(0), // undefined
   mainloopStatsInterval(DEFAULT_MAINLOOP_STATS_INTERVAL),
   mainLoopStatsCounter(0),
   announcePause(DEFAULT_ANNOUNCE_PAUSE),
+  announceWindow(DEFAULT_ANNOUNCE_WINDOW),
+  announceWindowCurrent(1),
+  announceGeneration(0),
+  skipKnownAnnouncements(false),
+  announceLatency(Never),
+  announceLatencyMin(Never),
+  announceStarted(Never),
+  announcedCount(0),
+  announceSkippedCount(0),
   productName(DEFAULT_PRODUCT_NAME)
 {
   // obtain MAC address
@@ -132,6 +252,8 @@ void DeviceContainer::setIdMode(DsUidPtr aExternalDsUid)
 void DeviceContainer::addDeviceClassContainer(DeviceClassContainerPtr aDeviceClassContainerPtr)
 {
   deviceClassContainers[aDeviceClassContainerPtr->getApiDsUid()] = aDeviceClassContainerPtr;
+  // parameters might have been changed before the vdc got its final dSUID, so have it checked in next save run
+  markDirty(aDeviceClassContainerPtr->getApiDsUid());
 }
 
 
@@ -142,6 +264,7 @@ void DeviceContainer::setIconDir(const char *aIconDir)
 	if (!iconDir.empty() && iconDir[iconDir.length()-1]!='/') {
 		iconDir.append("/");
 	}
+	iconCache.clear(); // cached icons (or their absence) might be different in new dir
 }
 
 
@@ -228,8 +351,19 @@ private:
 //  1 : alpha/beta phase DB
 //  2 : no schema change, but forced re-creation due to changed scale of brightness (0..100 now, was 0..255 before)
 //  3 : no schema change, but forced re-creation due to bug in storing output behaviour settings
+//  4 : added announcedDevices table
+//  5 : added acknowledged timestamp to announcedDevices
 #define DSPARAMS_SCHEMA_MIN_VERSION 3 // minimally supported version, anything older will be deleted
-#define DSPARAMS_SCHEMA_VERSION 3 // current version
+#define DSPARAMS_SCHEMA_VERSION 5 // current version
+
+#define ANNOUNCED_DEVICES_TABLE_SQL \
+  "CREATE TABLE announcedDevices (" \
+  " vdsmDsUid TEXT," \
+  " dSUID TEXT," \
+  " fingerprint TEXT," \
+  " acknowledged INTEGER," /* unix time of the last acknowledged announcement */ \
+  " PRIMARY KEY (vdsmDsUid, dSUID)" \
+  ");"
 
 string DsParamStore::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
 {
@@ -238,11 +372,22 @@ string DsParamStore::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
     // create DB from scratch
 		// - use standard globs table for schema version
     sql = inherited::dbSchemaUpgradeSQL(aFromVersion, aToVersion);
-		// - no devicecontainer level table to create at this time
-    //   (PersistentParams create and update their tables as needed)
+		// - devicecontainer level table for announcement state
+    //   (PersistentParams create and update their own tables as needed)
+    sql.append(ANNOUNCED_DEVICES_TABLE_SQL);
     // reached final version in one step
     aToVersion = DSPARAMS_SCHEMA_VERSION;
   }
+  else if (aFromVersion==3) {
+    // V3->V5: add announcedDevices table
+    sql = ANNOUNCED_DEVICES_TABLE_SQL;
+    aToVersion = 5;
+  }
+  else if (aFromVersion==4) {
+    // V4->V5: add acknowledged timestamp (entries without one count as expired)
+    sql = "ALTER TABLE announcedDevices ADD acknowledged INTEGER;";
+    aToVersion = 5;
+  }
   return sql;
 }
 
@@ -260,6 +405,13 @@ void DeviceContainer::initialize(CompletedCB aCompletedCB, bool aFactoryReset)
 	string databaseName = getPersistentDataDir();
 	string_format_append(databaseName, "DsParams.sqlite3");
   ErrorPtr error = dsParamStore.connectAndInitialize(databaseName.c_str(), DSPARAMS_SCHEMA_VERSION, DSPARAMS_SCHEMA_MIN_VERSION, aFactoryReset);
+  if (Error::isOK(error)) {
+    // write parameters from a separate thread, so mainloop does not wait for the disk when saving
+    error = dsParamStore.startBackgroundWriter();
+    if (!Error::isOK(error)) {
+      LOG(LOG_WARNING, "Parameters will be written synchronously: %s\n", error->description().c_str());
+    }
+  }
 
   // start initialisation of class containers
   DeviceClassInitializer::initialize(*this, aCompletedCB, aFactoryReset);
@@ -300,6 +452,8 @@ private:
     incremental(aIncremental),
     exhaustive(aExhaustive)
   {
+    // devices get their settings loaded while being added: read each settings table only once
+    deviceContainerP->dsParamStore.beginBulkLoad();
     nextContainer = deviceContainerP->deviceClassContainers.begin();
     queryNextContainer(ErrorPtr());
   }
@@ -333,6 +487,8 @@ private:
 
   void collectedAll(ErrorPtr aError)
   {
+    // all settings loaded, free prefetched records
+    deviceContainerP->dsParamStore.endBulkLoad();
     // now have each of them initialized
     nextDevice = deviceContainerP->dSDevices.begin();
     initializeNextDevice(ErrorPtr());
@@ -409,6 +565,8 @@ bool DeviceContainer::addDevice(DevicePtr aDevice)
   }
   // set for given dSUID in the container-wide map of devices
   dSDevices[aDevice->getApiDsUid()] = aDevice;
+  // parameters might have been changed before the device got its final dSUID, so have it checked in next save run
+  markDirty(aDevice->getApiDsUid());
   LOG(LOG_NOTICE,"--- added device: %s (not yet initialized)\n",aDevice->shortDesc().c_str());
   // load the device's persistent params
   aDevice->load();
@@ -562,21 +720,17 @@ void DeviceContainer::periodicTask(MLMicroSeconds aCycleStartTime)
       // check again for devices that need to be announced
       startAnnouncing();
       // do a save run as well
-      // - device containers
-      for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end(); ++pos) {
-        pos->second->save();
-      }
-      // - devices
-      for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-        pos->second->save();
-      }
+      saveDirty();
     }
   }
   if (mainloopStatsInterval>0) {
     // show mainloop statistics
     if (mainLoopStatsCounter<=0) {
       LOG(LOG_INFO, "%s", MainLoop::currentMainLoop().description().c_str());
+      LOG(LOG_INFO, "%s\n", iconCache.statistics().c_str());
+      LOG(LOG_INFO, "%s\n", dsParamStore.statistics().c_str());
       MainLoop::currentMainLoop().statistics_reset();
+      dsParamStore.statistics_reset();
       mainLoopStatsCounter = mainloopStatsInterval;
     }
     else {
@@ -588,6 +742,52 @@ void DeviceContainer::periodicTask(MLMicroSeconds aCycleStartTime)
 }
 
 
+/// save the devices and vdcs that have unsaved parameters, all in one transaction
+void DeviceContainer::saveDirty()
+{
+  if (dirtySet.empty()) return;
+  MLMicroSeconds started = MainLoop::now();
+  // objects getting dirty while saving go to the next save run
+  DsUidSet toSave;
+  toSave.swap(dirtySet);
+  int saved = 0;
+  dsParamStore.beginBatch();
+  for (DsUidSet::iterator pos = toSave.begin(); pos!=toSave.end(); ++pos) {
+    bool retry = false;
+    DsDeviceMap::iterator dpos = dSDevices.find(*pos);
+    if (dpos!=dSDevices.end()) {
+      retry = !Error::isOK(dpos->second->save());
+      saved++;
+    }
+    else {
+      ContainerMap::iterator cpos = deviceClassContainers.find(*pos);
+      if (cpos!=deviceClassContainers.end()) {
+        retry = !Error::isOK(cpos->second->save()) || cpos->second->isDirty();
+        saved++;
+      }
+      // Note: devices removed in the meantime were already saved or forgotten by removeDevice()
+    }
+    if (retry) {
+      // not (completely) saved, retry in next save run
+      dirtySet.insert(*pos);
+    }
+  }
+  if (dsParamStore.endBatch()!=SQLITE_OK) {
+    LOG(LOG_ERR, "Error committing save run: %s\n", dsParamStore.error()->description().c_str());
+  }
+  dsParamStore.noteStall(started);
+  LOG(LOG_INFO, "Saved parameters of %d devices and vdcs in %.1f mS\n", saved, (double)(MainLoop::now()-started)/MilliSecond);
+}
+
+
+void DeviceContainer::flushParams()
+{
+  saveDirty();
+  saveKnownFingerprints();
+  dsParamStore.flush();
+}
+
+
 #pragma mark - local operation mode
 
 
@@ -699,15 +899,31 @@ bool DeviceContainer::sendApiRequest(const string &aMethod, ApiValuePtr aParams,
 }
 
 
+bool DeviceContainer::sendApiPushNotification(const string &aKey, const string &aMethod, ApiValuePtr aParams)
+{
+  if (activeSessionConnection) {
+    signalActivity();
+    return Error::isOK(activeSessionConnection->sendPushNotification(aKey, aMethod, aParams));
+  }
+  // cannot send
+  return false;
+}
+
+
 void DeviceContainer::vdcApiConnectionStatusHandler(VdcApiConnectionPtr aApiConnection, ErrorPtr &aError)
 {
   if (Error::isOK(aError)) {
     // new connection, set up reequest handler
     aApiConnection->setRequestHandler(boost::bind(&DeviceContainer::vdcApiRequestHandler, this, _1, _2, _3, _4));
+    aApiConnection->setNotificationHandler(boost::bind(&DeviceContainer::vdcApiNotificationHandler, this, _1, _2));
   }
   else {
     // error or connection closed
     LOG(LOG_ERR,"vDC API connection closing, reason: %s\n", aError->description().c_str());
+    LOG(LOG_INFO,
+      "- push notifications: %d superseded by newer values, %d dropped, %d still queued\n",
+      (int)aApiConnection->pushQueueSuperseded(), (int)aApiConnection->pushQueueDropped(), (int)aApiConnection->pushQueueSize()
+    );
     // - close if not already closed
     aApiConnection->closeConnection();
     if (aApiConnection==activeSessionConnection) {
@@ -767,11 +983,15 @@ void DeviceContainer::vdcApiRequestHandler(VdcApiConnectionPtr aApiConnection, V
         // can be single dSUID or array of dSUIDs
         if (o->isType(apivalue_array)) {
           // array of dSUIDs
+          // - when multicast, collect resulting channel changes, so each vdc can apply them together
+          ApplyBatchTokens batchTokens;
+          if (o->arrayLength()>1) beginApplyBatches(batchTokens);
           for (int i=0; i<o->arrayLength(); i++) {
             ApiValuePtr e = o->arrayGet(i);
             dsuid.setAsBinary(e->binaryValue());
             handleNotificationForDsUid(aMethod, dsuid, aParams);
           }
+          endApplyBatches(batchTokens);
         }
         else {
           // single dSUID
@@ -798,6 +1018,54 @@ void DeviceContainer::vdcApiRequestHandler(VdcApiConnectionPtr aApiConnection, V
 }
 
 
+void DeviceContainer::vdcApiNotificationHandler(VdcApiConnectionPtr aApiConnection, const VdcApiNotification &aNotification)
+{
+  signalActivity();
+  // Note: out of session, notifications are simply ignored
+  if (!activeSessionConnection) {
+    LOG(LOG_DEBUG,"Received notification '%s' out of session -> ignored\n", aNotification.method);
+    return;
+  }
+  // deliver to all addressed entities
+  // - when multicast, collect resulting channel changes, so each vdc can apply them together
+  ApplyBatchTokens batchTokens;
+  if (aNotification.numDsUids>1) beginApplyBatches(batchTokens);
+  for (size_t i=0; i<aNotification.numDsUids; i++) {
+    DsUid dsuid(aNotification.dsUids[i]);
+    DsAddressablePtr addressable = addressableForParams(dsuid, ApiValuePtr());
+    if (addressable) {
+      if (addressable->announced==Never) prioritizeAnnouncement(addressable);
+      addressable->handleTypedNotification(aNotification);
+    }
+    else {
+      LOG(LOG_WARNING, "Target entity %s not found for notification '%s'\n", dsuid.getString().c_str(), aNotification.method);
+    }
+  }
+  endApplyBatches(batchTokens);
+}
+
+
+void DeviceContainer::beginApplyBatches(ApplyBatchTokens &aTokens)
+{
+  aTokens.clear();
+  for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end(); ++pos) {
+    aTokens.push_back(pos->second->beginApplyBatch());
+  }
+}
+
+
+void DeviceContainer::endApplyBatches(ApplyBatchTokens &aTokens)
+{
+  // Note: devices still preparing their new values (e.g. capturing undo state from hardware) keep their vdc's batch open
+  if (aTokens.empty()) return; // no batches were opened
+  ApplyBatchTokens::iterator tpos = aTokens.begin();
+  for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end() && tpos!=aTokens.end(); ++pos, ++tpos) {
+    pos->second->endApplyBatch(*tpos);
+  }
+  aTokens.clear();
+}
+
+
 /// vDC API version
 /// 1 (aka 1.0 in JSON) : first version, used in P44-DSB-DEH versions up to 0.5.0.x
 /// 2 : cleanup, no official JSON support any more, added MOC extensions
@@ -825,6 +1093,8 @@ ErrorPtr DeviceContainer::helloHandler(VdcApiRequestPtr aRequest, ApiValuePtr aP
           }
           // - start session with this vdSM
           connectedVdsm = vdsmDsUid;
+          // - devices this vdSM already knows in their current configuration need not be announced again
+          loadKnownFingerprints(connectedVdsm);
           // - remember the session's connection
           activeSessionConnection = aRequest->connection();
           // - create answer
@@ -867,7 +1137,8 @@ DsAddressablePtr DeviceContainer::addressableForParams(const DsUid &aDsUid, ApiV
 {
   if (aDsUid.empty()) {
     // not addressing by dSUID, check for alternative addressing methods
-    ApiValuePtr o = aParams->get("x-p44-itemSpec");
+    ApiValuePtr o;
+    if (aParams) o = aParams->get("x-p44-itemSpec");
     if (o) {
       string query = o->stringValue();
       if(query.find("vdc:")==0) {
@@ -928,6 +1199,7 @@ ErrorPtr DeviceContainer::handleMethodForDsUid(const string &aMethod, VdcApiRequ
 {
   DsAddressablePtr addressable = addressableForParams(aDsUid, aParams);
   if (addressable) {
+    if (addressable->announced==Never) prioritizeAnnouncement(addressable);
     // check special case of device remove command - we must execute this because device should not try to remove itself
     DevicePtr dev = boost::dynamic_pointer_cast<Device>(addressable);
     if (dev && aMethod=="remove") {
@@ -948,6 +1220,7 @@ void DeviceContainer::handleNotificationForDsUid(const string &aMethod, const Ds
 {
   DsAddressablePtr addressable = addressableForParams(aDsUid, aParams);
   if (addressable) {
+    if (addressable->announced==Never) prioritizeAnnouncement(addressable);
     addressable->handleNotification(aMethod, aParams);
   }
   else {
@@ -972,8 +1245,10 @@ ErrorPtr DeviceContainer::removeHandler(VdcApiRequestPtr aRequest, DevicePtr aDe
 
 void DeviceContainer::removeResultHandler(DevicePtr aDevice, VdcApiRequestPtr aRequest, bool aDisconnected)
 {
-  if (aDisconnected)
+  if (aDisconnected) {
+    forgetKnownFingerprint(aDevice->getApiDsUid()); // vdSM will need a new announcement should the device reappear
     aRequest->sendResult(ApiValuePtr()); // disconnected successfully
+  }
   else
     aRequest->sendError(ErrorPtr(new VdcApiError(403, "Device cannot be removed, is still connected")));
 }
@@ -992,6 +1267,15 @@ void DeviceContainer::resetAnnouncing()
 {
   // end pending announcement
   MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
+  MainLoop::currentMainLoop().cancelExecutionTicket(announceTimeoutTicket);
+  announcesPending.clear();
+  announceGeneration++; // acknowledgements still underway belong to the old session and are no longer relevant
+  announceWindowCurrent = 1; // start slowly again, vdSM latency is not yet known
+  announcePriority.clear();
+  announceCursor = DsUid();
+  announceStarted = Never;
+  // keep what the vdSM has acknowledged so far
+  saveKnownFingerprints();
   // end all device sessions
   for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
     DevicePtr dev = pos->second;
@@ -1017,12 +1301,22 @@ void DeviceContainer::startAnnouncing()
 }
 
 
-void DeviceContainer::announceNext()
+/// vdSM addresses a device that is not yet announced, which means it is probably in use -> announce it next
+void DeviceContainer::prioritizeAnnouncement(DsAddressablePtr aAddressable)
 {
-  if (collecting) return; // prevent announcements during collect.
-  // cancel re-announcing
-  MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
-  // announce vdcs first
+  DevicePtr dev = boost::dynamic_pointer_cast<Device>(aAddressable);
+  if (dev && dev->announced==Never && dev->announcing==Never) {
+    announcePriority.push_back(dev->getApiDsUid());
+    if (!collecting && activeSessionConnection && (int)announcesPending.size()<announceWindowCurrent) {
+      announceNext();
+    }
+  }
+}
+
+
+DsAddressablePtr DeviceContainer::nextToAnnounce()
+{
+  // vdcs first
   for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end(); ++pos) {
     DeviceClassContainerPtr vdc = pos->second;
     if (
@@ -1030,69 +1324,249 @@ void DeviceContainer::announceNext()
       (vdc->announcing==Never || MainLoop::now()>vdc->announcing+ANNOUNCE_RETRY_TIMEOUT) &&
       (!vdc->invisibleWhenEmpty() || vdc->getNumberOfDevices()>0)
     ) {
-      // mark device as being in process of getting announced
-      vdc->announcing = MainLoop::now();
+      return vdc;
+    }
+  }
+  // then devices the vdSM has asked for
+  while (!announcePriority.empty()) {
+    DsDeviceMap::iterator pos = dSDevices.find(announcePriority.front());
+    announcePriority.pop_front();
+    if (pos!=dSDevices.end() && needsAnnouncement(pos->second)) {
+      return pos->second;
+    }
+  }
+  // then all other devices, continuing after the one returned last (devices before it are only checked again when wrapping around)
+  DsDeviceMap::iterator start = dSDevices.upper_bound(announceCursor);
+  for (DsDeviceMap::iterator pos = start; pos!=dSDevices.end(); ++pos) {
+    if (needsAnnouncement(pos->second)) {
+      announceCursor = pos->first;
+      return pos->second;
+    }
+  }
+  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=start; ++pos) {
+    if (needsAnnouncement(pos->second)) {
+      announceCursor = pos->first;
+      return pos->second;
+    }
+  }
+  return DsAddressablePtr();
+}
+
+
+bool DeviceContainer::needsAnnouncement(DevicePtr aDevice)
+{
+  return
+    aDevice->isPublicDS() && // only public ones
+    (aDevice->classContainerP->announced!=Never) && // class container must have already completed an announcement
+    aDevice->announced==Never &&
+    (aDevice->announcing==Never || MainLoop::now()>aDevice->announcing+ANNOUNCE_RETRY_TIMEOUT);
+}
+
+
+void DeviceContainer::announceNext()
+{
+  if (collecting) return; // prevent announcements during collect.
+  // cancel scheduled announcing, we are doing it now
+  MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
+  // send as many announcements as the window allows
+  while ((int)announcesPending.size()<announceWindowCurrent) {
+    DsAddressablePtr a = nextToAnnounce();
+    if (!a) {
+      if (announcesPending.empty() && announceStarted!=Never) {
+        // all announced
+        LOG(LOG_NOTICE,
+          "All %d vdcs and devices announced in %.3f seconds, %d unchanged devices skipped (window size %d, vdSM response time %.1f mS)\n",
+          announcedCount, (double)(MainLoop::now()-announceStarted)/Second, announceSkippedCount, announceWindowCurrent, (double)announceLatency/MilliSecond
+        );
+        announceStarted = Never;
+        saveKnownFingerprints();
+      }
+      break; // nothing (more) to announce
+    }
+    if (announceStarted==Never) {
+      announceStarted = MainLoop::now();
+      announcedCount = 0;
+      announceSkippedCount = 0;
+    }
+    DevicePtr dev = boost::dynamic_pointer_cast<Device>(a);
+    if (dev && skipKnownAnnouncements) {
+      // check if vdSM already knows this device in its current configuration
+      FingerprintMap::iterator fpos = knownFingerprints.find(dev->getApiDsUid());
+      if (fpos!=knownFingerprints.end() && fpos->second==dev->announcementFingerprint()) {
+        // yes, no need to announce it again
+        LOG(LOG_INFO, "Device %s is unchanged since last acknowledged announcement, not announcing again\n", dev->shortDesc().c_str());
+        dev->announced = MainLoop::now();
+        announceSkippedCount++;
+        continue;
+      }
+    }
+    // mark device as being in process of getting announced
+    a->announcing = MainLoop::now();
+    VdcApiResponseCB handler = boost::bind(&DeviceContainer::announceResultHandler, this, a, a->announcing, announceGeneration, _2, _3, _4);
+    bool sent;
+    DeviceClassContainerPtr vdc = boost::dynamic_pointer_cast<DeviceClassContainer>(a);
+    if (vdc) {
       // call announcevdc method (need to construct here, because dSUID must be sent as vdcdSUID)
       ApiValuePtr params = getSessionConnection()->newApiValue();
       params->setType(apivalue_object);
       params->add("dSUID", params->newBinary(vdc->getApiDsUid().getBinary()));
-      if (!sendApiRequest("announcevdc", params, boost::bind(&DeviceContainer::announceResultHandler, this, vdc, _2, _3, _4))) {
-        LOG(LOG_ERR, "Could not send vdc announcement message for %s %s\n", vdc->entityType(), vdc->shortDesc().c_str());
-        vdc->announcing = Never; // not registering
-      }
-      else {
-        LOG(LOG_NOTICE, "Sent vdc announcement for %s %s\n", vdc->entityType(), vdc->shortDesc().c_str());
-      }
-      // schedule a retry
-      announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), ANNOUNCE_TIMEOUT);
-      // done for now, continues after ANNOUNCE_TIMEOUT or when registration acknowledged
-      return;
+      sent = sendApiRequest("announcevdc", params, handler);
     }
-  }
-  // check all devices for unnannounced ones and announce those
-  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-    DevicePtr dev = pos->second;
-    if (
-      dev->isPublicDS() && // only public ones
-      (dev->classContainerP->announced!=Never) && // class container must have already completed an announcement
-      dev->announced==Never &&
-      (dev->announcing==Never || MainLoop::now()>dev->announcing+ANNOUNCE_RETRY_TIMEOUT)
-    ) {
-      // mark device as being in process of getting announced
-      dev->announcing = MainLoop::now();
+    else {
       // call announce method
       ApiValuePtr params = getSessionConnection()->newApiValue();
       params->setType(apivalue_object);
       // include link to vdc for device announcements
       params->add("vdc_dSUID", params->newBinary(dev->classContainerP->getApiDsUid().getBinary()));
-      if (!dev->sendRequest("announcedevice", params, boost::bind(&DeviceContainer::announceResultHandler, this, dev, _2, _3, _4))) {
-        LOG(LOG_ERR, "Could not send device announcement message for %s %s\n", dev->entityType(), dev->shortDesc().c_str());
-        dev->announcing = Never; // not registering
-      }
-      else {
-        LOG(LOG_NOTICE, "Sent device announcement for %s %s\n", dev->entityType(), dev->shortDesc().c_str());
-      }
-      // schedule a retry
-      announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), ANNOUNCE_TIMEOUT);
-      // done for now, continues after ANNOUNCE_TIMEOUT or when registration acknowledged
-      return;
+      sent = dev->sendRequest("announcedevice", params, handler);
     }
+    if (!sent) {
+      LOG(LOG_ERR, "Could not send announcement message for %s %s\n", a->entityType(), a->shortDesc().c_str());
+      a->announcing = Never; // not registering
+      break; // no point in trying others now
+    }
+    LOG(LOG_NOTICE, "Sent announcement for %s %s\n", a->entityType(), a->shortDesc().c_str());
+    if (announcesPending.empty()) {
+      // window was empty: make sure we don't wait forever in case answers get lost (re-armed by every acknowledgement)
+      MainLoop::currentMainLoop().cancelExecutionTicket(announceTimeoutTicket);
+      announceTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceTimeout, this), ANNOUNCE_TIMEOUT);
+    }
+    announcesPending.insert(a->getApiDsUid());
   }
+  // done for now, continues after ANNOUNCE_TIMEOUT or when announcements are acknowledged
+}
+
+
+void DeviceContainer::announceTimeout()
+{
+  announceTimeoutTicket = 0;
+  LOG(LOG_WARNING, "vdSM has not acknowledged any of %d pending announcements within timeout\n", (int)announcesPending.size());
+  // consider the unanswered announcements lost (these will be retried after ANNOUNCE_RETRY_TIMEOUT)
+  // Note: late acknowledgements will still mark their entity announced, but no longer count for the window
+  announcesPending.clear();
+  announceWindowCurrent = 1; // vdSM seems overloaded, restart slowly
+  announceNext();
 }
 
 
-void DeviceContainer::announceResultHandler(DsAddressablePtr aAddressable, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData)
+void DeviceContainer::announceResultHandler(DsAddressablePtr aAddressable, MLMicroSeconds aSentAt, long aGeneration, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData)
 {
+  if (aGeneration!=announceGeneration) {
+    // announcement was sent in an earlier session, ignore
+    LOG(LOG_INFO, "Response to announcement for %s %s from earlier session ignored\n", aAddressable->entityType(), aAddressable->shortDesc().c_str());
+    return;
+  }
+  // response is current if it answers the most recent announcement and it was not given up by announceTimeout()
+  bool current = aSentAt==aAddressable->announcing && announcesPending.count(aAddressable->getApiDsUid())>0;
+  if (current || Error::isOK(aError)) {
+    announcesPending.erase(aAddressable->getApiDsUid());
+  }
+  if (announcesPending.empty()) {
+    // nothing in flight any more, no timeout needed until next announcement is sent
+    MainLoop::currentMainLoop().cancelExecutionTicket(announceTimeoutTicket);
+  }
+  else if (current) {
+    // vdSM makes progress: restart timeout for the remaining pending announcements
+    MainLoop::currentMainLoop().cancelExecutionTicket(announceTimeoutTicket);
+    announceTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceTimeout, this), ANNOUNCE_TIMEOUT);
+  }
   if (Error::isOK(aError)) {
     // set device announced successfully
     LOG(LOG_NOTICE, "Announcement for %s %s acknowledged by vdSM\n", aAddressable->entityType(), aAddressable->shortDesc().c_str());
     aAddressable->announced = MainLoop::now();
     aAddressable->announcing = Never; // not announcing any more
+    announcedCount++;
+    // remember in which configuration the vdSM knows the device now
+    DevicePtr dev = boost::dynamic_pointer_cast<Device>(aAddressable);
+    if (dev && knownFingerprintsVdsm==connectedVdsm) {
+      string fingerprint = dev->announcementFingerprint();
+      knownFingerprints[dev->getApiDsUid()] = fingerprint;
+      unsavedFingerprints[dev->getApiDsUid()] = fingerprint;
+    }
+    if (current) {
+      // adapt window to the vdSM's response time: grow while it answers quickly, shrink when answers get slower
+      // Note: late acknowledgements of announcements already given up mark the entity announced, but do not affect the window
+      MLMicroSeconds latency = MainLoop::now()-aSentAt;
+      if (announceLatencyMin==Never || latency<announceLatencyMin) announceLatencyMin = latency;
+      announceLatency = announceLatency==Never ? latency : (announceLatency*7+latency)/8;
+      if (announceLatency>ANNOUNCE_LATENCY_LIMIT && announceLatency>ANNOUNCE_LATENCY_FACTOR*announceLatencyMin) {
+        if (announceWindowCurrent>1) announceWindowCurrent /= 2;
+      }
+      else if (announceWindowCurrent<announceWindow) {
+        announceWindowCurrent++;
+      }
+    }
   }
-  // cancel retry timer
+  // try next announcement(s), after a pause
   MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
-  // try next announcement, after a pause
-  announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), announcePause);
+  if (announcePause>0) {
+    announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), announcePause);
+  }
+  else {
+    announceNext();
+  }
+}
+
+
+/// load the fingerprints of the devices a vdSM has acknowledged in earlier sessions
+void DeviceContainer::loadKnownFingerprints(const DsUid &aVdsmDsUid)
+{
+  knownFingerprints.clear();
+  unsavedFingerprints.clear();
+  knownFingerprintsVdsm = aVdsmDsUid;
+  // expired entries must be announced again, in case the vdSM has lost them without us noticing
+  dsParamStore.write(string_format(
+    "DELETE FROM announcedDevices WHERE acknowledged IS NULL OR acknowledged < strftime('%%s','now')-%d",
+    KNOWN_FINGERPRINT_MAX_AGE
+  ));
+  dsParamStore.flush(); // make sure we read what was written so far
+  sqlite3pp::query qry(dsParamStore);
+  string sql = string_format("SELECT dSUID, fingerprint FROM announcedDevices WHERE vdsmDsUid = '%s'", aVdsmDsUid.getString().c_str());
+  if (qry.prepare(sql.c_str())==SQLITE_OK) {
+    for (sqlite3pp::query::iterator i = qry.begin(); i!=qry.end(); ++i) {
+      knownFingerprints[DsUid(nonNullCStr(i->get<const char *>(0)))] = nonNullCStr(i->get<const char *>(1));
+    }
+  }
+  LOG(LOG_INFO, "vdSM %s already knows %d devices from earlier sessions\n", aVdsmDsUid.getString().c_str(), (int)knownFingerprints.size());
+}
+
+
+/// save the fingerprints acknowledged since last save (all in one transaction)
+void DeviceContainer::saveKnownFingerprints()
+{
+  if (unsavedFingerprints.empty()) return;
+  dsParamStore.beginBatch();
+  for (FingerprintMap::iterator pos = unsavedFingerprints.begin(); pos!=unsavedFingerprints.end(); ++pos) {
+    dsParamStore.write(string_format(
+      "INSERT OR REPLACE INTO announcedDevices (vdsmDsUid, dSUID, fingerprint, acknowledged) VALUES ('%s','%s','%s',strftime('%%s','now'))",
+      knownFingerprintsVdsm.getString().c_str(),
+      pos->first.getString().c_str(),
+      pos->second.c_str()
+    ));
+  }
+  if (dsParamStore.endBatch()!=SQLITE_OK) {
+    LOG(LOG_ERR, "Error saving announcement state: %s\n", dsParamStore.error()->description().c_str());
+  }
+  unsavedFingerprints.clear();
+}
+
+
+/// forget that any vdSM knows a device
+void DeviceContainer::forgetKnownFingerprint(const DsUid &aDsUid)
+{
+  knownFingerprints.erase(aDsUid);
+  unsavedFingerprints.erase(aDsUid);
+  dsParamStore.write(string_format("DELETE FROM announcedDevices WHERE dSUID = '%s'", aDsUid.getString().c_str()));
+}
+
+
+/// forget everything vdSMs have acknowledged
+void DeviceContainer::forgetAllKnownFingerprints()
+{
+  LOG(LOG_NOTICE, "Forgetting all acknowledged announcements, all devices will be announced again\n");
+  knownFingerprints.clear();
+  unsavedFingerprints.clear();
+  dsParamStore.write("DELETE FROM announcedDevices");
 }
 
 
@@ -1100,6 +1574,12 @@ void DeviceContainer::announceResultHandler(DsAddressablePtr aAddressable, VdcAp
 
 ErrorPtr DeviceContainer::handleMethod(VdcApiRequestPtr aRequest,  const string &aMethod, ApiValuePtr aParams)
 {
+  if (aMethod=="x-p44-forgetKnownDevices") {
+    // vdSM has lost its device list (e.g. was reset): announce all devices again in the next session
+    forgetAllKnownFingerprints();
+    aRequest->sendResult(ApiValuePtr());
+    return ErrorPtr();
+  }
   return inherited::handleMethod(aRequest, aMethod, aParams);
 }
 
@@ -1152,7 +1632,7 @@ PropertyDescriptorPtr DeviceContainer::getDescriptorByIndex(int aPropIndex, int
 }
 
 
-PropertyDescriptorPtr DeviceContainer::getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+PropertyDescriptorPtr DeviceContainer::getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
 {
   if (aParentDescriptor && aParentDescriptor->hasObjectKey(vdc_container_key)) {
     // accessing one of the vdcs by numeric index
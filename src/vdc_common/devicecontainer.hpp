@@ -32,6 +32,7 @@
 
 #include "vdcapi.hpp"
 
+#include <set>
 
 using namespace std;
 
@@ -61,6 +62,191 @@ namespace p44 {
   typedef boost::function<void (DevicePtr aDevice, bool aRegular)> DeviceUserActionCB;
 
 
+  /// map from dSUID to T, iterating in dSUID order like std::map, but finding entries via a flat open addressing
+  /// hash index over the dSUIDs' (cached) hashes instead of walking the tree with dSUID comparisons
+  template<class T> class DsUidMap
+  {
+  public:
+    typedef std::map<DsUid, T> Map;
+    typedef typename Map::iterator iterator;
+    typedef typename Map::value_type value_type;
+
+  private:
+    typedef struct {
+      uint32_t hash; ///< hash of the entry's dSUID, 0 for empty slot
+      iterator entry; ///< the entry in entries
+    } Slot;
+    typedef std::vector<Slot> SlotVector;
+
+    Map entries; ///< the entries, in dSUID order
+    SlotVector slots; ///< hash index into entries, linear probing, power of 2 size, at most half full
+
+    // not copyable: slots hold iterators into entries, which would still point into the original after a copy
+    DsUidMap(const DsUidMap &);
+    DsUidMap &operator=(const DsUidMap &);
+
+  public:
+
+    DsUidMap() {};
+
+    iterator begin() { return entries.begin(); };
+    iterator end() { return entries.end(); };
+    size_t size() const { return entries.size(); };
+    bool empty() const { return entries.empty(); };
+
+    /// find entry
+    /// @param aDsUid the dSUID to look up
+    /// @return iterator to the entry, end() if none
+    iterator find(const DsUid &aDsUid)
+    {
+      size_t i;
+      return findSlot(aDsUid, i) ? slots[i].entry : entries.end();
+    };
+
+    /// find first entry with a dSUID greater than the given one (in iteration order)
+    /// @param aDsUid the dSUID to start after
+    /// @return iterator to the entry, end() if none
+    iterator upper_bound(const DsUid &aDsUid) { return entries.upper_bound(aDsUid); };
+
+    /// access entry, creates a default constructed entry if none exists yet
+    T &operator[](const DsUid &aDsUid)
+    {
+      iterator pos = find(aDsUid);
+      if (pos==entries.end()) {
+        pos = entries.insert(value_type(aDsUid, T())).first;
+        if (entries.size()*2>slots.size())
+          rehash(slots.empty() ? 16 : slots.size()*2); // also indexes the new entry
+        else
+          indexEntry(pos);
+      }
+      return pos->second;
+    };
+
+    /// remove entry
+    /// @param aDsUid the dSUID of the entry to remove
+    /// @return number of entries removed (0 or 1)
+    size_t erase(const DsUid &aDsUid)
+    {
+      size_t i;
+      if (!findSlot(aDsUid, i)) return 0;
+      entries.erase(slots[i].entry);
+      // close the gap by moving back entries of the same probe sequence (no tombstones needed)
+      size_t mask = slots.size()-1;
+      size_t j = i;
+      while (true) {
+        j = (j+1) & mask;
+        if (slots[j].hash==0) break;
+        size_t home = slots[j].hash & mask;
+        // entry can move into the gap unless its home slot lies cyclically in (i,j]
+        if (i<j ? (home<=i || home>j) : (home<=i && home>j)) {
+          slots[i] = slots[j];
+          i = j;
+        }
+      }
+      slots[i].hash = 0;
+      return 1;
+    };
+
+    /// remove all entries
+    void clear()
+    {
+      entries.clear();
+      slots.clear();
+    };
+
+  private:
+
+    bool findSlot(const DsUid &aDsUid, size_t &aIndex)
+    {
+      if (slots.empty()) return false;
+      uint32_t h = aDsUid.hash();
+      size_t mask = slots.size()-1;
+      for (aIndex = h & mask; slots[aIndex].hash!=0; aIndex = (aIndex+1) & mask) {
+        if (slots[aIndex].hash==h && slots[aIndex].entry->first==aDsUid) return true;
+      }
+      return false;
+    };
+
+    void indexEntry(iterator aEntry)
+    {
+      uint32_t h = aEntry->first.hash();
+      size_t mask = slots.size()-1;
+      size_t i = h & mask;
+      while (slots[i].hash!=0) i = (i+1) & mask;
+      slots[i].hash = h;
+      slots[i].entry = aEntry;
+    };
+
+    void rehash(size_t aNumSlots)
+    {
+      Slot emptySlot;
+      emptySlot.hash = 0;
+      slots.assign(aNumSlots, emptySlot);
+      for (iterator pos = entries.begin(); pos!=entries.end(); ++pos) {
+        indexEntry(pos);
+      }
+    };
+
+  };
+
+
+  /// in-memory LRU cache for device icons, so repeated icon property reads do not cause file I/O
+  /// @note also remembers icons that do not exist, as getIcon() usually tries several names until one is found
+  class IconCache
+  {
+    typedef struct {
+      string key; ///< resolution prefix and icon name
+      bool found; ///< set if icon file exists
+      bool hasData; ///< set if data has been loaded (name-only lookups only check for existence)
+      string data; ///< icon data (empty if not found or not loaded)
+      MLMicroSeconds expires; ///< when a "not found" entry must be checked again, Never for found icons
+    } IconEntry;
+    typedef std::list<IconEntry> IconList;
+    typedef std::map<string, IconList::iterator> IconIndex;
+
+    IconList icons; ///< cached icons, most recently used first
+    IconIndex iconIndex; ///< cached icons by key
+    size_t maxBytes; ///< memory budget for the cache
+    size_t cachedBytes; ///< memory currently used by cached entries (approximately)
+    size_t hits; ///< statistics: number of lookups answered from the cache
+    size_t misses; ///< statistics: number of lookups that needed file access
+
+  public:
+
+    IconCache();
+
+    /// set memory budget
+    /// @param aMaxBytes max number of bytes (icon data plus per entry overhead) to keep in the cache. 0 disables caching
+    void setMaxBytes(size_t aMaxBytes);
+
+    /// look up icon
+    /// @param aKey key of the icon (resolution prefix and name)
+    /// @param aFound will be set to true if the icon exists
+    /// @param aIconData if not NULL and the icon exists, will be set to the icon data
+    /// @return true if the cache knows the icon (existing or not, and with data if aIconData was passed),
+    ///   false if it must be checked or loaded from file and store()d
+    bool lookup(const string &aKey, bool &aFound, string *aIconData);
+
+    /// store icon
+    /// @param aKey key of the icon (resolution prefix and name)
+    /// @param aFound true if the icon exists
+    /// @param aIconData the icon data, NULL if only existence was checked
+    /// @note "not found" entries expire after a while, so icons added later are found without clearing the cache
+    void store(const string &aKey, bool aFound, const string *aIconData);
+
+    /// remove all entries
+    void clear();
+
+    /// @return cache statistics as text
+    string statistics();
+
+  private:
+
+    size_t entrySize(const IconEntry &aEntry) { return aEntry.key.size()+aEntry.data.size()+64; };
+
+  };
+
+
   /// persistence for digitalSTROM paramters
   class DsParamStore : public ParamStore
   {
@@ -74,8 +260,10 @@ namespace p44 {
 
   class DeviceContainer;
   typedef boost::intrusive_ptr<DeviceContainer> DeviceContainerPtr;
-  typedef map<DsUid, DeviceClassContainerPtr> ContainerMap;
-  typedef map<DsUid, DevicePtr> DsDeviceMap;
+  typedef DsUidMap<DeviceClassContainerPtr> ContainerMap;
+  typedef map<DsUid, string> FingerprintMap;
+  typedef std::set<DsUid> DsUidSet;
+  typedef DsUidMap<DevicePtr> DsDeviceMap;
 
 
   /// container for all devices hosted by this application
@@ -97,19 +285,37 @@ namespace p44 {
 
     DsDeviceMap dSDevices; ///< available devices by API-exposed ID (dSUID or derived dsid)
     DsParamStore dsParamStore; ///< the database for storing dS device parameters
+    DsUidSet dirtySet; ///< API dSUIDs of devices and vdcs with unsaved parameters
 
     string iconDir; ///< the directory where to load icons from
+    IconCache iconCache; ///< cache for icons loaded from iconDir
     string persistentDataDir; ///< the directory for the vdcd to store SQLite DBs and possibly other persistent data
 
     string productName; ///< the name of the vdcd product as a a whole
     string productVersion; ///< the version string of the vdcd product as a a whole
 
     bool collecting;
-    long announcementTicket;
+    long announcementTicket; ///< schedules the next announcement(s) after announcePause
+    long announceTimeoutTicket; ///< gives up unacknowledged announcements when the vdSM has not acknowledged any for ANNOUNCE_TIMEOUT
     long periodicTaskTicket;
     MLMicroSeconds lastActivity;
     MLMicroSeconds lastPeriodicRun;
     MLMicroSeconds announcePause;
+    int announceWindow; ///< max number of announcements waiting for acknowledgement at the same time
+    int announceWindowCurrent; ///< current number of announcements allowed in flight, adapted to vdSM response time
+    std::set<DsUid> announcesPending; ///< entities with an announcement sent and neither acknowledged nor given up yet
+    long announceGeneration; ///< incremented for every new vdSM session, acknowledgements from earlier sessions are ignored
+    DsUid announceCursor; ///< the device announced last, scanning for devices to announce continues after it
+    bool skipKnownAnnouncements; ///< if set, devices the vdSM has acknowledged in an earlier session in their current configuration are not announced again
+    MLMicroSeconds announceLatency; ///< smoothed vdSM response time for announcements, Never if none seen yet
+    MLMicroSeconds announceLatencyMin; ///< fastest vdSM response time seen for an announcement, Never if none seen yet
+    MLMicroSeconds announceStarted; ///< when the current announcing run started, Never if not running
+    int announcedCount; ///< number of entities announced in the current announcing run
+    int announceSkippedCount; ///< number of devices not announced in the current run because the vdSM already knows them
+    std::list<DsUid> announcePriority; ///< not yet announced devices the vdSM has addressed, to be announced first
+    DsUid knownFingerprintsVdsm; ///< the vdSM knownFingerprints belong to
+    FingerprintMap knownFingerprints; ///< fingerprints of devices as last acknowledged by knownFingerprintsVdsm
+    FingerprintMap unsavedFingerprints; ///< acknowledged fingerprints not yet saved to dsParamStore
 
     int8_t localDimDirection;
 
@@ -172,10 +378,38 @@ namespace p44 {
     /// @return the path to the icon dir, always with a trailing path separator, ready to append subpaths and filenames
     const char *getIconDir();
 
+    /// Set memory budget for caching device icons
+    /// @param aMaxBytes max number of bytes to use for cached icons, 0 to disable caching
+    void setIconCacheSize(size_t aMaxBytes) { iconCache.setMaxBytes(aMaxBytes); };
+
     /// Set pause between announces
     /// @param aAnnouncePause how long to wait between device announcements
     void setAnnouncePause(MLMicroSeconds aAnnouncePause) { announcePause = aAnnouncePause; };
 
+    /// Set max number of announcements waiting for acknowledgement at the same time
+    /// @param aAnnounceWindow max number of announcements in flight (1 = strictly one after the other)
+    /// @note the actual number starts at 1 and grows up to aAnnounceWindow as long as the vdSM answers quickly
+    void setAnnounceWindow(int aAnnounceWindow) { announceWindow = aAnnounceWindow>0 ? aAnnounceWindow : 1; };
+
+    /// Enable skipping announcements of devices the vdSM already knows
+    /// @param aSkip if set, devices the same vdSM has acknowledged in an earlier session (and unchanged since) are not announced again
+    /// @note off by default, as a vdSM which has lost its device list (reset, replaced with same dSUID) would not see
+    ///   these devices until forgetAllKnownFingerprints() is called or their acknowledgement expires
+    void setSkipKnownAnnouncements(bool aSkip) { skipKnownAnnouncements = aSkip; };
+
+    /// Remember that a device or vdc has unsaved parameters, to be saved in the next save run
+    /// @param aDsUid API dSUID of the device or vdc
+    void markDirty(const DsUid &aDsUid) { dirtySet.insert(aDsUid); };
+
+    /// Forget that vdSMs have acknowledged the announcement of a device
+    /// @param aDsUid the device's API dSUID
+    /// @note must be called whenever vdSMs are told a device is gone, so it gets announced again should it reappear
+    void forgetKnownFingerprint(const DsUid &aDsUid);
+
+    /// Forget all announcements vdSMs have acknowledged
+    /// @note to be used when a vdSM has lost its device list, so all devices get announced again
+    void forgetAllKnownFingerprints();
+
 
     /// Set how often mainloop statistics are printed out log (LOG_INFO)
     /// @param aInterval 0=none, N=every PERIODIC_TASK_INTERVAL*N seconds
@@ -198,6 +432,11 @@ namespace p44 {
     /// start running normally
     void startRunning();
 
+    /// save all unsaved parameters now and wait until they are written to disk
+    /// @note call before terminating the application, as parameters are otherwise saved periodically only,
+    ///   and written by a background thread
+    void flushParams();
+
     /// activity monitor
     /// @param aActivityCB will be called when there is user-relevant activity. Can be used to trigger flashing an activity LED.
     void setActivityMonitor(DoneCB aActivityCB);
@@ -345,6 +584,13 @@ namespace p44 {
     /// @return true if message could be sent, false otherwise (e.g. no vdSM connection)
     bool sendApiRequest(const string &aMethod, ApiValuePtr aParams, VdcApiResponseCB aResponseHandler = VdcApiResponseCB());
 
+    /// send a notification reporting a value to the vdSM, which can be superseded by a newer value while the connection is busy
+    /// @param aKey identifies the reported value, empty for events which must not be superseded, see VdcApiConnection::sendPushNotification()
+    /// @param aMethod the notification
+    /// @param aParams the parameters object
+    /// @return true if message could be sent or queued, false otherwise (e.g. no vdSM connection)
+    bool sendApiPushNotification(const string &aKey, const string &aMethod, ApiValuePtr aParams);
+
 
     /// @}
 
@@ -353,7 +599,7 @@ namespace p44 {
     // property access implementation
     virtual int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
-    virtual PropertyDescriptorPtr getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+    virtual PropertyDescriptorPtr getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyContainerPtr getContainer(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain);
     virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor);
 
@@ -376,6 +622,10 @@ namespace p44 {
 
     // API request handling
     void vdcApiRequestHandler(VdcApiConnectionPtr aApiConnection, VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams);
+    void vdcApiNotificationHandler(VdcApiConnectionPtr aApiConnection, const VdcApiNotification &aNotification);
+    typedef std::vector<long> ApplyBatchTokens;
+    void beginApplyBatches(ApplyBatchTokens &aTokens);
+    void endApplyBatches(ApplyBatchTokens &aTokens);
 
     // vDC level method and notification handlers
     ErrorPtr helloHandler(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
@@ -387,14 +637,21 @@ namespace p44 {
     // announcing dSUID addressable entities within the device container (vdc host)
     void resetAnnouncing();
     void startAnnouncing();
+    void prioritizeAnnouncement(DsAddressablePtr aAddressable);
+    DsAddressablePtr nextToAnnounce();
+    bool needsAnnouncement(DevicePtr aDevice);
     void announceNext();
-    void announceResultHandler(DsAddressablePtr aAddressable, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData);
+    void announceTimeout();
+    void announceResultHandler(DsAddressablePtr aAddressable, MLMicroSeconds aSentAt, long aGeneration, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData);
+    void loadKnownFingerprints(const DsUid &aVdsmDsUid);
+    void saveKnownFingerprints();
 
     // activity monitor
     void signalActivity();
 
     // periodic task
     void periodicTask(MLMicroSeconds aCycleStartTime);
+    void saveDirty();
 
     // getting MAC
     void getMyMac(CompletedCB aCompletedCB, bool aFactoryReset);
@@ -35,6 +35,13 @@ DeviceSettings::DeviceSettings(Device &aDevice) :
 }
 
 
+void DeviceSettings::markDirty()
+{
+  inherited::markDirty();
+  device.markDirty();
+}
+
+
 // SQLIte3 table name to store these parameters to
 const char *DeviceSettings::tableName()
 {
@@ -69,7 +76,7 @@ const FieldDefinition *DeviceSettings::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void DeviceSettings::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void DeviceSettings::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the field value
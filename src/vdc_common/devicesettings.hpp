@@ -57,11 +57,14 @@ namespace p44 {
     DeviceSettings(Device &aDevice);
     virtual ~DeviceSettings() {}; // important for multiple inheritance!
 
+    /// mark settings dirty, and have the device saved in the next save run
+    virtual void markDirty();
+
     // persistence implementation
     virtual const char *tableName();
     virtual size_t numFieldDefs();
     virtual const FieldDefinition *getFieldDef(size_t aIndex);
-    virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
+    virtual void loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
     /// @}
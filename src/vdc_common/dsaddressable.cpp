@@ -131,10 +131,32 @@ ErrorPtr DsAddressable::handleMethod(VdcApiRequestPtr aRequest, const string &aM
     // query must be present
     ApiValuePtr query;
     if (Error::isOK(respErr = checkParam(aParams, "query", query))) {
+      // caller can request large results to be delivered in chunks fitting the connection's message size limit
+      // - chunking is opt-in: caller passes a pseudo query element x-p44-continue, empty for the first chunk,
+      //   the continuation token of the previous chunk for the following ones
+      // - without it, the result is delivered in a single message as usual (vdSMs not knowing about chunking)
+      // Note: the continuation token is positional, see PropertyChunk
+      bool chunked = false;
+      string resumeAt;
+      if (query->isType(apivalue_object)) {
+        ApiValuePtr o = query->get("x-p44-continue");
+        if (o) {
+          chunked = true;
+          resumeAt = o->stringValue();
+          query->del("x-p44-continue");
+        }
+      }
+      PropertyChunk chunk(aRequest->maxResultSize(), resumeAt);
       // now read
       ApiValuePtr result = aRequest->newApiValue();
-      respErr = accessProperty(access_read, query, result, VDC_API_DOMAIN, PropertyDescriptorPtr());
+      respErr = accessProperty(access_read, query, result, VDC_API_DOMAIN, PropertyDescriptorPtr(), chunked ? &chunk : NULL);
       if (Error::isOK(respErr)) {
+        if (chunked && chunk.full()) {
+          // result is incomplete, tell caller how to get the next chunk
+          ApiValuePtr c = result->newValue(apivalue_string);
+          c->setStringValue(chunk.continuation);
+          result->add("x-p44-continue", c);
+        }
         // send back property result
         aRequest->sendResult(result);
       }
@@ -164,7 +186,7 @@ ErrorPtr DsAddressable::handleMethod(VdcApiRequestPtr aRequest, const string &aM
 }
 
 
-bool DsAddressable::pushProperty(ApiValuePtr aQuery, int aDomain)
+bool DsAddressable::pushProperty(ApiValuePtr aQuery, int aDomain, bool aIsEvent)
 {
   if (announced!=Never) {
     // device is announced: push value changes
@@ -172,10 +194,13 @@ bool DsAddressable::pushProperty(ApiValuePtr aQuery, int aDomain)
     ApiValuePtr value = aQuery->newValue(apivalue_object);
     ErrorPtr err = accessProperty(access_read, aQuery, value, aDomain, PropertyDescriptorPtr());
     if (Error::isOK(err)) {
-      // - send pushProperty
+      // - send pushProperty (unless it is an event, a value for the same property still waiting to be sent is superseded by this one)
       ApiValuePtr pushParams = aQuery->newValue(apivalue_object);
       pushParams->add("properties", value);
-      return sendRequest("pushProperty", pushParams);
+      pushParams->add("dSUID", pushParams->newBinary(getApiDsUid().getBinary()));
+      string key;
+      if (!aIsEvent) key = string_format("%s:%d:%s", getApiDsUid().getString().c_str(), aDomain, aQuery->description().c_str());
+      return getDeviceContainer().sendApiPushNotification(key, "pushProperty", pushParams);
     }
   }
   else {
@@ -190,13 +215,29 @@ bool DsAddressable::pushProperty(ApiValuePtr aQuery, int aDomain)
 void DsAddressable::handleNotification(const string &aMethod, ApiValuePtr aParams)
 {
   if (aMethod=="ping") {
+    // handled in typed notification handler
+    VdcApiNotification notification;
+    notification.type = vdcapi_ping;
+    notification.method = aMethod.c_str();
+    handleTypedNotification(notification);
+  }
+  else {
+    // unknown notification
+    LOG(LOG_WARNING, "unknown notification '%s' for %s %s\n", aMethod.c_str(), entityType(), shortDesc().c_str());
+  }
+}
+
+
+void DsAddressable::handleTypedNotification(const VdcApiNotification &aNotification)
+{
+  if (aNotification.type==vdcapi_ping) {
     // issue device ping (which will issue a pong when device is reachable)
     LOG(LOG_INFO,"ping to %s %s -> checking presence...\n", entityType(), shortDesc().c_str());
     checkPresence(boost::bind(&DsAddressable::presenceResultHandler, this, _1));
   }
   else {
     // unknown notification
-    LOG(LOG_WARNING, "unknown notification '%s' for %s %s\n", aMethod.c_str(), entityType(), shortDesc().c_str());
+    LOG(LOG_WARNING, "unknown notification '%s' for %s %s\n", aNotification.method, entityType(), shortDesc().c_str());
   }
 }
 
@@ -340,38 +381,52 @@ bool DsAddressable::getIcon(const char *aIconName, string &aIcon, bool aWithData
   DBGLOG(LOG_DEBUG,"Trying to load icon named '%s/%s' for dSUID %s\n", aResolutionPrefix, aIconName, dSUID.getString().c_str());
   const char *iconDir = getDeviceContainer().getIconDir();
   if (iconDir && *iconDir) {
-    string iconPath = string_format("%s%s/%s.png", iconDir, aResolutionPrefix, aIconName);
-    // TODO: maybe add cache lookup here
-    // try to access this file
-    int fildes = open(iconPath.c_str(), O_RDONLY);
-    if (fildes<0) {
-      return false; // can't load from this location
-    }
-    // file seems to exist
-    if (aWithData) {
-      // load it
-      ssize_t bytes = 0;
-      const size_t bufsize = 4096; // usually a 16x16 png is 3.4kB
-      char buffer[bufsize];
-      aIcon.clear();
-      while (true) {
-        bytes = read(fildes, buffer, bufsize);
-        if (bytes<=0)
-          break; // done
-        aIcon.append(buffer, bytes);
+    // icons (and the fact that an icon does not exist) are cached, as they are requested over and over again
+    IconCache &iconCache = getDeviceContainer().iconCache;
+    string iconKey = string_format("%s/%s", aResolutionPrefix, aIconName);
+    bool found = false;
+    if (!iconCache.lookup(iconKey, found, aWithData ? &aIcon : NULL)) {
+      // not cached yet, try to access the file
+      string iconPath = string_format("%s%s/%s.png", iconDir, aResolutionPrefix, aIconName);
+      if (!aWithData) {
+        // only name needed, just check if the file exists
+        found = access(iconPath.c_str(), R_OK)==0;
+        iconCache.store(iconKey, found, NULL);
       }
-      close(fildes);
-      // done
-      if (bytes<0) {
-        // read error, do not return half-read icon
-        aIcon.clear();
-        return false;
+      else {
+        int fildes = open(iconPath.c_str(), O_RDONLY);
+        if (fildes<0) {
+          iconCache.store(iconKey, false, NULL);
+          return false; // can't load from this location
+        }
+        // file seems to exist, load it
+        ssize_t bytes = 0;
+        const size_t bufsize = 4096; // usually a 16x16 png is 3.4kB
+        char buffer[bufsize];
+        string iconData;
+        while (true) {
+          bytes = read(fildes, buffer, bufsize);
+          if (bytes<=0)
+            break; // done
+          iconData.append(buffer, bytes);
+        }
+        close(fildes);
+        // done
+        if (bytes<0) {
+          // read error, do not return (or cache) half-read icon
+          return false;
+        }
+        DBGLOG(LOG_DEBUG,"- successfully loaded icon named '%s'\n", aIconName);
+        iconCache.store(iconKey, true, &iconData);
+        found = true;
+        aIcon = iconData;
       }
-      DBGLOG(LOG_DEBUG,"- successfully loaded icon named '%s'\n", aIconName);
     }
-    else {
+    if (!found) {
+      return false; // known not to exist
+    }
+    if (!aWithData) {
       // just name
-      close(fildes);
       aIcon = aIconName; // this is a name for which the file exists
     }
     return true;
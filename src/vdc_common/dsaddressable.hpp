@@ -113,6 +113,10 @@ namespace p44 {
     ///   used already to route the notification to this DsAddressable.
     virtual void handleNotification(const string &aMethod, ApiValuePtr aParams);
 
+    /// called by DeviceContainer to handle notifications with typed parameters directed to a dSUID
+    /// @param aNotification the notification
+    virtual void handleTypedNotification(const VdcApiNotification &aNotification);
+
     /// send a DsAddressable method or notification to vdSM
     /// @param aMethod the method or notification
     /// @param aParams the parameters object, or NULL if none
@@ -124,8 +128,11 @@ namespace p44 {
     /// push property value
     /// @param aQuery description of what should be pushed (same syntax as in getProperty API)
     /// @param aDomain the domain for which to access properties (different APIs might have different properties for the same PropertyContainer)
-    /// @return true if push could be sent, false otherwise (e.g. no vdSM connection, or device not yet announced)
-    bool pushProperty(ApiValuePtr aQuery, int aDomain);
+    /// @return true if push could be sent or queued, false otherwise (e.g. no vdSM connection, or device not yet announced)
+    /// @param aIsEvent set if the push reports an event (e.g. a button click), which must be delivered in any case
+    /// @note while the vdSM connection is busy, pushes are queued, and a queued push for the same property is replaced by
+    ///   the newer one. Events are never superseded or dropped.
+    bool pushProperty(ApiValuePtr aQuery, int aDomain, bool aIsEvent = false);
 
     /// @}
 
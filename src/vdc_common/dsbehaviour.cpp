@@ -59,7 +59,7 @@ void DsBehaviour::setHardwareError(DsHardwareError aHardwareError)
 }
 
 
-bool DsBehaviour::pushBehaviourState()
+bool DsBehaviour::pushBehaviourState(bool aIsEvent)
 {
   VdcApiConnectionPtr api = device.getDeviceContainer().getSessionConnection();
   if (api) {
@@ -68,7 +68,7 @@ bool DsBehaviour::pushBehaviourState()
     ApiValuePtr subQuery = query->newValue(apivalue_object);
     subQuery->add(string_format("%d",index), subQuery->newValue(apivalue_null));
     query->add(string(getTypeName()).append("States"), subQuery);
-    return device.pushProperty(query, VDC_API_DOMAIN);
+    return device.pushProperty(query, VDC_API_DOMAIN, aIsEvent);
   }
   // could not push
   return false;
@@ -89,6 +89,13 @@ ErrorPtr DsBehaviour::load()
 }
 
 
+void DsBehaviour::markDirty()
+{
+  inheritedParams::markDirty();
+  device.markDirty();
+}
+
+
 ErrorPtr DsBehaviour::save()
 {
   ErrorPtr err = saveToStore(getDbKey().c_str(), false); // only one record per dbkey (=per device+behaviourindex)
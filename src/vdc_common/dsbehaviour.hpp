@@ -125,8 +125,9 @@ namespace p44 {
     virtual void setGroup(DsGroup aGroup) { /* NOP in base class */ };
 
     /// push state
+    /// @param aIsEvent set if the state change represents an event (e.g. a button click), which must not be superseded by later pushes
     /// @return true if API was connected and push could be sent
-    bool pushBehaviourState();
+    bool pushBehaviourState(bool aIsEvent = false);
 
 
     /// @name persistent settings management
@@ -141,6 +142,9 @@ namespace p44 {
     /// forget any parameters stored in persistent DB
     ErrorPtr forget();
 
+    /// mark behaviour parameters dirty, and have the device saved in the next save run
+    virtual void markDirty();
+
     /// @}
 
     /// get the index value
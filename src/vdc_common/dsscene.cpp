@@ -76,7 +76,7 @@ protected:
   }
 
 
-  PropertyDescriptorPtr getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+  PropertyDescriptorPtr getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
   {
     if (aParentDescriptor->hasObjectKey(dsscene_channels_key)) {
       // array-like container of channels
@@ -95,7 +95,7 @@ protected:
         // within range, create descriptor
         DynamicPropertyDescriptor *descP = new DynamicPropertyDescriptor(aParentDescriptor);
         // name by channel
-        descP->propertyName = string_format("%d", scene.getDevice().getChannelByIndex(aStartIndex)->getChannelType());
+        descP->setNumericName(scene.getDevice().getChannelByIndex(aStartIndex)->getChannelType());
         descP->propertyType = aParentDescriptor->type();
         descP->propertyFieldKey = aStartIndex;
         descP->propertyObjectKey = OKEY(scenevalue_key);
@@ -179,6 +179,15 @@ Device &DsScene::getDevice()
 }
 
 
+void DsScene::markDirty()
+{
+  // setting default values is not a modification
+  if (sceneDeviceSettings.creatingDefaultScene) return;
+  inheritedParams::markDirty();
+  getDevice().markDirty();
+}
+
+
 OutputBehaviourPtr DsScene::getOutputBehaviour()
 {
   return sceneDeviceSettings.device.output;
@@ -249,7 +258,7 @@ enum {
 
 
 /// load values from passed row
-void DsScene::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void DsScene::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inheritedParams::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
@@ -330,7 +339,7 @@ void DsScene::setSceneValueFlags(size_t aOutputIndex, uint32_t aFlagMask, bool a
     uint32_t flagmask = globalflags_valueDontCare0<<aOutputIndex;
     uint32_t newFlags;
     if (aSet)
-      newFlags = globalSceneFlags | (aFlagMask & valueflags_dontCare) ? flagmask : 0;
+      newFlags = globalSceneFlags | ((aFlagMask & valueflags_dontCare) ? flagmask : 0);
     else
       newFlags = globalSceneFlags & ~((aFlagMask & valueflags_dontCare) ? flagmask : 0);
     if (newFlags!=globalSceneFlags) {
@@ -431,7 +440,8 @@ bool DsScene::accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, Prop
 
 
 SceneDeviceSettings::SceneDeviceSettings(Device &aDevice) :
-  inherited(aDevice)
+  inherited(aDevice),
+  creatingDefaultScene(false)
 {
 }
 
@@ -454,10 +464,19 @@ DsScenePtr SceneDeviceSettings::getScene(SceneNo aSceneNo)
     // found scene params in map
     return pos->second;
   }
-  else {
-    // just return default values for this scene
-    return newDefaultScene(aSceneNo);
+  // see if we have an unmodified default scene object already
+  pos = defaultScenes.find(aSceneNo);
+  if (pos!=defaultScenes.end() && !pos->second->isDirty()) {
+    // still pristine, can be shared
+    return pos->second;
   }
+  // create default values for this scene, and keep them for sharing with further calls
+  // Note: a dirty default scene is left to whoever modified it (it is expected to post it via updateScene())
+  creatingDefaultScene = true;
+  DsScenePtr defaultScene = newDefaultScene(aSceneNo);
+  creatingDefaultScene = false;
+  defaultScenes[aSceneNo] = defaultScene;
+  return defaultScene;
 }
 
 
@@ -467,6 +486,11 @@ void SceneDeviceSettings::updateScene(DsScenePtr aScene)
   if (aScene->rowid==0) {
     // unstored so far, add to map of non-default scenes
     scenes[aScene->sceneNo] = aScene;
+    // no longer a default scene to be shared
+    DsSceneMap::iterator pos = defaultScenes.find(aScene->sceneNo);
+    if (pos!=defaultScenes.end() && pos->second==aScene) {
+      defaultScenes.erase(pos);
+    }
   }
   // anyway, mark scene dirty
   aScene->markDirty();
@@ -484,32 +508,25 @@ void SceneDeviceSettings::updateScene(DsScenePtr aScene)
 // load child parameters (scenes)
 ErrorPtr SceneDeviceSettings::loadChildren()
 {
-  ErrorPtr err;
   // my own ROWID is the parent key for the children
   string parentID = string_format("%d",rowid);
-  // create a template
+  // create a template, determines the table the scenes are loaded from
   DsScenePtr scene = newDefaultScene(0);
-  // get the query
-  sqlite3pp::query *queryP = scene->newLoadAllQuery(parentID.c_str());
-  if (queryP==NULL) {
-    // real error preparing query
-    err = paramStore.error();
-  }
-  else {
-    for (sqlite3pp::query::iterator row = queryP->begin(); row!=queryP->end(); ++row) {
-      // got record
-      // - load record fields into scene object
-      int index = 0;
-      uint64_t flags;
-      scene->loadFromRow(row, index, &flags);
-      // - put scene into map of non-default scenes
-      scenes[scene->sceneNo] = scene;
-      // - fresh object for next row
-      scene = newDefaultScene(0);
-    }
-    delete queryP; queryP = NULL;
-  }
-  return err;
+  // load all scenes of this device (from memory when bulk loading at startup)
+  return scene->loadAllFromStore(parentID.c_str(), boost::bind(&SceneDeviceSettings::loadSceneFromRow, this, _1));
+}
+
+
+void SceneDeviceSettings::loadSceneFromRow(ParamRow &aRow)
+{
+  // - fresh object for this row
+  DsScenePtr scene = newDefaultScene(0);
+  // - load record fields into scene object
+  int index = 0;
+  uint64_t flags;
+  scene->loadFromRow(aRow, index, &flags);
+  // - put scene into map of non-default scenes
+  scenes[scene->sceneNo] = scene;
 }
 
 // save child parameters (scenes)
@@ -159,6 +159,9 @@ namespace p44 {
     /// @return the device this scene belongs to
     Device &getDevice();
 
+    /// mark scene dirty, and have the device saved in the next save run
+    virtual void markDirty();
+
     /// get device
     /// @return the output behaviour controlled by this scene
     OutputBehaviourPtr getOutputBehaviour();
@@ -178,7 +181,7 @@ namespace p44 {
     virtual const FieldDefinition *getKeyDef(size_t aIndex);
     virtual size_t numFieldDefs();
     virtual const FieldDefinition *getFieldDef(size_t aIndex);
-    virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
+    virtual void loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
   private:
@@ -208,6 +211,8 @@ namespace p44 {
     friend class SceneChannels;
 
     DsSceneMap scenes; ///< the user defined scenes (default scenes will be created on the fly)
+    DsSceneMap defaultScenes; ///< shared default scene objects, created on first use and handed out until modified
+    bool creatingDefaultScene; ///< set while a shared default scene is set up, to avoid marking it dirty
 
   public:
     SceneDeviceSettings(Device &aDevice);
@@ -220,6 +225,8 @@ namespace p44 {
     /// @param aSceneNo the scene to get current settings for.
     /// @note the object returned may not be attached to a container (if it is a default scene
     ///   created on the fly). Scene modifications must be posted using updateScene()
+    /// @note unmodified default scenes are shared between calls. A default scene that gets modified
+    ///   (marked dirty) is no longer handed out, and becomes a user defined scene with updateScene().
     DsScenePtr getScene(SceneNo aSceneNo);
 
     /// update scene (mark dirty, add to list of non-default scene objects)
@@ -247,6 +254,9 @@ namespace p44 {
     virtual ErrorPtr loadChildren();
     virtual ErrorPtr saveChildren();
     virtual ErrorPtr deleteChildren();
+
+    /// load a scene from a record of the scenes table into the map of non-default scenes
+    void loadSceneFromRow(ParamRow &aRow);
     
     /// @}
   };
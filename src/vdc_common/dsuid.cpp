@@ -32,6 +32,7 @@ using namespace p44;
 
 void DsUid::internalInit()
 {
+  hashValue = 0; // content changes, invalidate cached hash
   idType = idtype_undefined;
   // init such that what we'd read out will be all-zero dSUID
   idBytes = dsuidBytes;
@@ -67,6 +68,7 @@ void DsUid::clear()
 void DsUid::setIdType(DsUidType aIdType)
 {
   if (aIdType!=idType) {
+    hashValue = 0; // content changes, invalidate cached hash
     // new type, reset
     idType = aIdType;
     memset(raw, 0, sizeof(raw));
@@ -100,6 +102,7 @@ void DsUid::setIdType(DsUidType aIdType)
 
 void DsUid::setSubdeviceIndex(uint8_t aSubDeviceIndex)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   if (idBytes==dsuidBytes) {
     // is a dSUID, can set subdevice index
     raw[16] = aSubDeviceIndex;
@@ -125,6 +128,7 @@ static uint8_t gcpBitLength[7] = { 40, 37, 34, 30, 27, 24, 20 };
 
 void DsUid::setGTIN(uint64_t aGCP, uint64_t aItemRef, uint8_t aPartition)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   // setting GTIN switches to sgtin dSUID
   setIdType(idtype_sgtin);
   // total bit length for CGP + itemRef combined are 44bits
@@ -146,6 +150,7 @@ void DsUid::setGTIN(uint64_t aGCP, uint64_t aItemRef, uint8_t aPartition)
 
 void DsUid::setSerial(uint64_t aSerial)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   // setting GTIN switches to sgtin dSUID
   setIdType(idtype_sgtin);
   raw[11] = (raw[11] & 0xC0) | ((aSerial>>32)&0x3F); // combine lowest 2 bits of GTIN with highest 6 of serial
@@ -198,6 +203,7 @@ void DsUid::setSerial(uint64_t aSerial)
 
 void DsUid::setNameInSpace(const string &aName, const DsUid &aNameSpace)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   uint8_t sha1[SHA_DIGEST_LENGTH]; // buffer for calculating SHA1
   SHA_CTX sha_context;
 
@@ -265,6 +271,7 @@ void DsUid::setNameInSpace(const string &aName, const DsUid &aNameSpace)
 
 void DsUid::setObjectClass(ObjectClass aObjectClass)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   // setting object class switches to classic dSUID
   setIdType(idtype_classic);
   // first nibble of object class shares byte 4 with last nibble of ManagerNo
@@ -288,6 +295,7 @@ void DsUid::setObjectClass(ObjectClass aObjectClass)
 
 void DsUid::setDsSerialNo(DsSerialNo aSerialNo)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   // setting dS serial number switches to classic dSUID
   setIdType(idtype_classic);
   // object class 0xFFxxxx is special, contains bits 32..47 of MAC address
@@ -315,6 +323,7 @@ void DsUid::setDsSerialNo(DsSerialNo aSerialNo)
 
 bool DsUid::setAsBinary(const string &aBinary)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   if (aBinary.size()==dsuidBytes) {
     idBytes = dsuidBytes;
     memcpy(raw, aBinary.c_str(), idBytes);
@@ -371,6 +380,7 @@ void DsUid::detectSubType()
 
 bool DsUid::setAsString(const string &aString)
 {
+  hashValue = 0; // content changes, invalidate cached hash
   const char *p = aString.c_str();
   int byteIndex = 0;
   uint8_t b = 0;
@@ -441,10 +451,25 @@ string DsUid::getString() const
 bool DsUid::operator== (const DsUid &aDsUid) const
 {
   if (idType!=aDsUid.idType) return false;
+  if (hashValue && aDsUid.hashValue && hashValue!=aDsUid.hashValue) return false; // both hashes known, and different
   return memcmp(raw, aDsUid.raw, idBytes)==0;
 }
 
 
+uint32_t DsUid::hash() const
+{
+  if (hashValue==0) {
+    // FNV-1a over the raw bytes
+    uint32_t h = 2166136261u;
+    for (int i=0; i<idBytes; i++) {
+      h = (h ^ raw[i]) * 16777619u;
+    }
+    hashValue = h ? h : 1; // 0 is reserved for "not yet calculated"
+  }
+  return hashValue;
+}
+
+
 bool DsUid::operator< (const DsUid &aDsUid) const
 {
   if (idType==aDsUid.idType)
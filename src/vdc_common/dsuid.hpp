@@ -89,6 +89,7 @@ namespace p44 {
     DsUidType idType; ///< the type of ID
     uint8_t idBytes; ///< the length of the ID in bytes
     RawID raw; ///< the raw dSUID
+    mutable uint32_t hashValue; ///< cached hash(), 0 if not yet calculated
 
     void internalInit();
 
@@ -146,6 +147,10 @@ namespace p44 {
     bool operator== (const DsUid &aDsUid) const;
     bool operator< (const DsUid &aDsUid) const;
 
+    /// get hash of the dSUID for use in hash tables
+    /// @return hash value over the raw bytes, never 0. Calculated once and cached until dSUID changes.
+    uint32_t hash() const;
+
     // test
     // @return true if empty (no value assigned)
     bool empty() const;
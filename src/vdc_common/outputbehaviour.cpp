@@ -159,7 +159,7 @@ void OutputBehaviour::saveChannelsToScene(DsScenePtr aScene)
       double oldval = aScene->sceneValue(0);
       if (newval!=oldval) {
         aScene->setSceneValue(0, newval);
-        markDirty();
+        aScene->markDirty();
       }
     }
     aScene->setSceneValueFlags(0, valueflags_dontCare, false);
@@ -242,7 +242,7 @@ const FieldDefinition *OutputBehaviour::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void OutputBehaviour::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void OutputBehaviour::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, NULL); // common flags are loaded here, not in superclasses
   // get the fields
@@ -297,7 +297,7 @@ PropertyContainerPtr OutputBehaviour::getContainer(PropertyDescriptorPtr &aPrope
 }
 
 
-PropertyDescriptorPtr OutputBehaviour::getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+PropertyDescriptorPtr OutputBehaviour::getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
 {
   if (aParentDescriptor && aParentDescriptor->hasObjectKey(output_groups_key)) {
     // array-like container
@@ -307,7 +307,7 @@ PropertyDescriptorPtr OutputBehaviour::getDescriptorByName(string aPropMatch, in
     if (aStartIndex!=PROPINDEX_NONE && aStartIndex<n) {
       // within range, create descriptor
       DynamicPropertyDescriptor *descP = new DynamicPropertyDescriptor(aParentDescriptor);
-      descP->propertyName = string_format("%d", aStartIndex);
+      descP->setNumericName(aStartIndex);
       descP->propertyType = aParentDescriptor->type();
       descP->propertyFieldKey = aStartIndex;
       descP->propertyObjectKey = aParentDescriptor->objectKey();
@@ -37,6 +37,124 @@ void protobufMessagePrint(FILE *aOutFile, const ProtobufCMessage *aMessageP, int
 #endif // FOCUSLOGGING
 
 
+#pragma mark - PbufArena
+
+#define ARENA_ALIGN(s) (((s)+PBUF_ARENA_ALIGNMENT-1) & ~((size_t)PBUF_ARENA_ALIGNMENT-1))
+
+PbufArena::PbufArena() :
+  blocks(NULL),
+  nextFree(NULL),
+  blockEnd(NULL),
+  blockSize(PBUF_ARENA_BLOCK_SIZE),
+  users(0),
+  numAllocs(0),
+  numBytes(0),
+  peakBytes(0),
+  numCycles(0)
+{
+  allocator.alloc = &PbufArena::arenaAlloc;
+  allocator.free = &PbufArena::arenaFree;
+  allocator.allocator_data = this;
+}
+
+
+PbufArena::~PbufArena()
+{
+  freeBlocks();
+}
+
+
+void PbufArena::freeBlocks()
+{
+  while (blocks) {
+    Block *b = blocks;
+    blocks = b->next;
+    free(b);
+  }
+  nextFree = NULL;
+  blockEnd = NULL;
+}
+
+
+bool PbufArena::newBlock(size_t aMinSize)
+{
+  size_t sz = blockSize>aMinSize ? blockSize : aMinSize;
+  Block *b = (Block *)malloc(ARENA_ALIGN(sizeof(Block))+sz);
+  if (!b) return false;
+  b->next = blocks;
+  b->size = sz;
+  blocks = b;
+  nextFree = (uint8_t *)b+ARENA_ALIGN(sizeof(Block));
+  blockEnd = nextFree+sz;
+  return true;
+}
+
+
+void *PbufArena::alloc(size_t aSize)
+{
+  size_t sz = ARENA_ALIGN(aSize>0 ? aSize : 1);
+  if ((size_t)(blockEnd-nextFree)<sz) {
+    // current block exhausted (or none yet)
+    if (!newBlock(sz)) return NULL;
+  }
+  void *p = nextFree;
+  nextFree += sz;
+  numAllocs++;
+  numBytes += sz;
+  return p;
+}
+
+
+char *PbufArena::allocString(const string &aString)
+{
+  char *p = (char *)alloc(aString.size()+1);
+  if (p) memcpy(p, aString.c_str(), aString.size()+1);
+  return p;
+}
+
+
+void PbufArena::release()
+{
+  if (users>0 && --users==0) {
+    reset();
+  }
+}
+
+
+void PbufArena::reset()
+{
+  FOCUSLOG("pbuf arena: %d allocations, %d bytes for this message\n", (int)numAllocs, (int)numBytes);
+  if (numBytes>peakBytes) peakBytes = numBytes;
+  numCycles++;
+  if (blocks && (blocks->next || blocks->size>PBUF_ARENA_MAX_KEPT_SIZE)) {
+    // message needed more than one block: next time, get a single block large enough (within limits)
+    size_t total = 0;
+    for (Block *b = blocks; b; b = b->next) total += b->size;
+    freeBlocks();
+    blockSize = total>PBUF_ARENA_MAX_KEPT_SIZE ? PBUF_ARENA_MAX_KEPT_SIZE : total;
+  }
+  else if (blocks) {
+    // rewind single block
+    nextFree = (uint8_t *)blocks+ARENA_ALIGN(sizeof(Block));
+  }
+  numAllocs = 0;
+  numBytes = 0;
+}
+
+
+void *PbufArena::arenaAlloc(void *aAllocatorData, size_t aSize)
+{
+  return static_cast<PbufArena *>(aAllocatorData)->alloc(aSize);
+}
+
+
+void PbufArena::arenaFree(void *aAllocatorData, void *aPointer)
+{
+  // nop: memory is returned all at once when the arena is reset
+}
+
+
+
 #pragma mark - PbufApiValue
 
 PbufApiValue::PbufApiValue() :
@@ -459,7 +577,7 @@ void PbufApiValue::getValueFromMessageField(const ProtobufCFieldDescriptor &aFie
 
 
 
-void PbufApiValue::putValueIntoMessageField(const ProtobufCFieldDescriptor &aFieldDescriptor, const ProtobufCMessage &aMessage)
+void PbufApiValue::putValueIntoMessageField(const ProtobufCFieldDescriptor &aFieldDescriptor, const ProtobufCMessage &aMessage, PbufArena &aArena)
 {
   uint8_t *baseP = (uint8_t *)(&aMessage);
   uint8_t *fieldBaseP = baseP+aFieldDescriptor.offset;
@@ -474,7 +592,7 @@ void PbufApiValue::putValueIntoMessageField(const ProtobufCFieldDescriptor &aFie
       // - set contents
       Vdcapi__PropertyElement **elems = NULL;
       if (numElems>0) {
-        elems = new Vdcapi__PropertyElement *[numElems];
+        elems = aArena.allocArray<Vdcapi__PropertyElement *>(numElems);
         Vdcapi__PropertyElement **elemP = elems;
         // fill in fields
         resetKeyIteration();
@@ -482,7 +600,7 @@ void PbufApiValue::putValueIntoMessageField(const ProtobufCFieldDescriptor &aFie
         ApiValuePtr val;
         while (nextKeyValue(key, val)) {
           PbufApiValuePtr pval = boost::dynamic_pointer_cast<PbufApiValue>(val);
-          pval->storeKeyValIntoPropertyElementField(key, *(elemP++));
+          pval->storeKeyValIntoPropertyElementField(key, *(elemP++), aArena);
         }
       }
       *((Vdcapi__PropertyElement ***)fieldBaseP) = elems;
@@ -494,14 +612,14 @@ void PbufApiValue::putValueIntoMessageField(const ProtobufCFieldDescriptor &aFie
       // iterate over existing elements
       for (int i = 0; i<arrayLength(); i++) {
         PbufApiValuePtr element = boost::dynamic_pointer_cast<PbufApiValue>(arrayGet(i));
-        element->putValueIntoField(aFieldDescriptor, fieldBaseP, i, arrayLength());
+        element->putValueIntoField(aFieldDescriptor, fieldBaseP, i, arrayLength(), aArena);
       }
     }
     else {
       // non array value into repeated field - store as single repetition
       *((size_t *)(baseP+aFieldDescriptor.quantifier_offset)) = 1; // single element
       // put value into that single element
-      putValueIntoField(aFieldDescriptor, fieldBaseP, 0, 1);
+      putValueIntoField(aFieldDescriptor, fieldBaseP, 0, 1, aArena);
     }
   }
   else {
@@ -528,10 +646,10 @@ void PbufApiValue::putValueIntoMessageField(const ProtobufCFieldDescriptor &aFie
         ApiValuePtr val;
         nextKeyValue(key, val);
         PbufApiValuePtr pval = boost::dynamic_pointer_cast<PbufApiValue>(val);
-        pval->storeKeyValIntoPropertyElementField(key, *((Vdcapi__PropertyElement **)fieldBaseP));
+        pval->storeKeyValIntoPropertyElementField(key, *((Vdcapi__PropertyElement **)fieldBaseP), aArena);
       }
       else {
-        putValueIntoField(aFieldDescriptor, fieldBaseP, 0, -1); // not array
+        putValueIntoField(aFieldDescriptor, fieldBaseP, 0, -1, aArena); // not array
       }
     }
   }
@@ -559,7 +677,7 @@ void PbufApiValue::getObjectFromMessageFields(const ProtobufCMessage &aMessage)
 
 
 
-void PbufApiValue::putObjectIntoMessageFields(ProtobufCMessage &aMessage)
+void PbufApiValue::putObjectIntoMessageFields(ProtobufCMessage &aMessage, PbufArena &aArena)
 {
   // only if we actually have any object data
   if (allocatedType==apivalue_object) {
@@ -569,7 +687,7 @@ void PbufApiValue::putObjectIntoMessageFields(ProtobufCMessage &aMessage)
       // see if value object has a key for this field
       PbufApiValuePtr val = boost::dynamic_pointer_cast<PbufApiValue>(get(fieldDescP->name));
       if (val) {
-        val->putValueIntoMessageField(*fieldDescP, aMessage);
+        val->putValueIntoMessageField(*fieldDescP, aMessage, aArena);
       }
       fieldDescP++; // next field descriptor
     }
@@ -595,14 +713,14 @@ void PbufApiValue::addObjectFieldFromMessage(const ProtobufCMessage &aMessage, c
 
 
 
-void PbufApiValue::putObjectFieldIntoMessage(ProtobufCMessage &aMessage, const char* aFieldName)
+void PbufApiValue::putObjectFieldIntoMessage(ProtobufCMessage &aMessage, const char* aFieldName, PbufArena &aArena)
 {
   if (isType(apivalue_object)) {
     const ProtobufCFieldDescriptor *fieldDescP = protobuf_c_message_descriptor_get_field_by_name(aMessage.descriptor, aFieldName);
     if (fieldDescP) {
       PbufApiValuePtr val = boost::dynamic_pointer_cast<PbufApiValue>(get(aFieldName));
       if (val) {
-        val->putValueIntoMessageField(*fieldDescP, aMessage);
+        val->putValueIntoMessageField(*fieldDescP, aMessage, aArena);
       }
     }
   }
@@ -682,7 +800,7 @@ void PbufApiValue::setValueFromField(const ProtobufCFieldDescriptor &aFieldDescr
 
 
 
-void PbufApiValue::putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescriptor, void *aData, size_t aIndex, ssize_t aArraySize)
+void PbufApiValue::putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescriptor, void *aData, size_t aIndex, ssize_t aArraySize, PbufArena &aArena)
 {
   // check array case
   bool allocArray = false;
@@ -702,7 +820,7 @@ void PbufApiValue::putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescr
   switch (aFieldDescriptor.type) {
     case PROTOBUF_C_TYPE_BOOL:
       if (allocatedType==apivalue_bool) {
-        if (allocArray) dataP = new protobuf_c_boolean[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<protobuf_c_boolean>(aArraySize);
         *((protobuf_c_boolean *)dataP+aIndex) = boolValue();
       }
       break;
@@ -710,7 +828,7 @@ void PbufApiValue::putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescr
     case PROTOBUF_C_TYPE_SINT32:
     case PROTOBUF_C_TYPE_SFIXED32:
       if (allocatedType==apivalue_int64 || allocatedType==apivalue_uint64) {
-        if (allocArray) dataP = new int32_t[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<int32_t>(aArraySize);
         *((int32_t *)dataP+aIndex) = int32Value();
       }
       break;
@@ -718,62 +836,54 @@ void PbufApiValue::putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescr
     case PROTOBUF_C_TYPE_SINT64:
     case PROTOBUF_C_TYPE_SFIXED64:
       if (allocatedType==apivalue_int64 || allocatedType==apivalue_uint64) {
-        if (allocArray) dataP = new int64_t[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<int64_t>(aArraySize);
         *((int64_t *)dataP+aIndex) = int64Value();
       }
       break;
     case PROTOBUF_C_TYPE_UINT32:
     case PROTOBUF_C_TYPE_FIXED32:
       if (allocatedType==apivalue_uint64 || allocatedType==apivalue_int64) {
-        if (allocArray) dataP = new uint32_t[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<uint32_t>(aArraySize);
         *((uint32_t *)dataP+aIndex) = uint32Value();
       }
       break;
     case PROTOBUF_C_TYPE_UINT64:
     case PROTOBUF_C_TYPE_FIXED64:
       if (allocatedType==apivalue_uint64 || allocatedType==apivalue_int64) {
-        if (allocArray) dataP = new uint64_t[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<uint64_t>(aArraySize);
         *((uint64_t *)dataP+aIndex) = uint64Value();
       }
       break;
     case PROTOBUF_C_TYPE_FLOAT:
       if (allocatedType==apivalue_double) {
-        if (allocArray) dataP = new float[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<float>(aArraySize);
         *((float *)dataP+aIndex) = doubleValue();
       }
       break;
     case PROTOBUF_C_TYPE_DOUBLE:
       if (allocatedType==apivalue_double) {
-        if (allocArray) dataP = new double[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<double>(aArraySize);
         *((double *)dataP+aIndex) = doubleValue();
       }
       break;
     case PROTOBUF_C_TYPE_ENUM:
       if (allocatedType==apivalue_uint64) {
-        if (allocArray) dataP = new int[aArraySize];
+        if (allocArray) dataP = aArena.allocArray<int>(aArraySize);
         *((int *)dataP+aIndex) = int32Value();
       }
       break;
     case PROTOBUF_C_TYPE_STRING:
       if (allocatedType==apivalue_string || allocatedType==apivalue_binary) {
-        if (allocArray) {
-          dataP = new char*[aArraySize];
-          memset(dataP, 0, aArraySize*sizeof(char *)); // null the array
-        }
-        string s = stringValue(); // might also be binary converted to hex string
-        char * p = new char [s.size()+1];
-        strcpy(p, s.c_str());
-        *((char **)dataP+aIndex) = p;
+        if (allocArray) dataP = aArena.allocArray<char *>(aArraySize); // nulled array
+        // might also be binary converted to hex string
+        *((char **)dataP+aIndex) = aArena.allocString(stringValue());
       }
       break;
     case PROTOBUF_C_TYPE_BYTES:
       if (allocatedType==apivalue_binary) {
-        if (allocArray) {
-          dataP = new ProtobufCBinaryData[aArraySize];
-          memset(dataP, 0, aArraySize*sizeof(ProtobufCBinaryData)); // null the array
-        }
+        if (allocArray) dataP = aArena.allocArray<ProtobufCBinaryData>(aArraySize); // nulled array
         string b = binaryValue();
-        uint8_t *p = new uint8_t[b.size()];
+        uint8_t *p = (uint8_t *)aArena.alloc(b.size());
         memcpy(p, b.c_str(), b.size());
         ((ProtobufCBinaryData *)dataP+aIndex)->data = p;
         ((ProtobufCBinaryData *)dataP+aIndex)->len = b.size();
@@ -782,15 +892,12 @@ void PbufApiValue::putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescr
     case PROTOBUF_C_TYPE_MESSAGE: {
       // submessage
       // - field is a message, we might need to allocate the pointer array
-      if (allocArray) {
-        dataP = new void *[aArraySize];
-        memset(dataP, 0, aArraySize*sizeof(void *)); // null the array
-      }
+      if (allocArray) dataP = aArena.allocArray<void *>(aArraySize); // nulled array
       if (allocatedType==apivalue_object && !allocArray) {
         ProtobufCMessage *aSubMessageP = *((ProtobufCMessage **)dataP+aIndex);
         if (aSubMessageP) {
           // submessage exists, have it filled in
-          putObjectIntoMessageFields(*aSubMessageP);
+          putObjectIntoMessageFields(*aSubMessageP, aArena);
         }
       }
       break;
@@ -842,27 +949,26 @@ void PbufApiValue::addKeyValFromPropertyElementField(const Vdcapi__PropertyEleme
 
 
 
-void PbufApiValue::storeKeyValIntoPropertyElementField(string aKey, Vdcapi__PropertyElement *&aPropertyElementP)
+void PbufApiValue::storeKeyValIntoPropertyElementField(string aKey, Vdcapi__PropertyElement *&aPropertyElementP, PbufArena &aArena)
 {
   // create a PropertyElement and store my value plus specified key into
   // - create the element
-  aPropertyElementP = new Vdcapi__PropertyElement;
+  aPropertyElementP = aArena.allocObject<Vdcapi__PropertyElement>();
   vdcapi__property_element__init(aPropertyElementP);
   // - store the value/subvalues
   if (isType(apivalue_object)) {
     // create nested value, "elements" is field #2
-    putValueIntoMessageField(aPropertyElementP->base.descriptor->fields[2], aPropertyElementP->base);
+    putValueIntoMessageField(aPropertyElementP->base.descriptor->fields[2], aPropertyElementP->base, aArena);
   }
   else if (!isNull()) {
     // create the value
-    aPropertyElementP->value = new Vdcapi__PropertyValue;
+    aPropertyElementP->value = aArena.allocObject<Vdcapi__PropertyValue>();
     vdcapi__property_value__init(aPropertyElementP->value);
     // store value
-    putValueIntoPropVal(*aPropertyElementP->value);
+    putValueIntoPropVal(*aPropertyElementP->value, aArena);
   }
   // store name
-  aPropertyElementP->name = new char[aKey.size()+1];
-  strcpy(aPropertyElementP->name, aKey.c_str());
+  aPropertyElementP->name = aArena.allocString(aKey);
 }
 
 
@@ -903,7 +1009,7 @@ void PbufApiValue::getValueFromPropVal(Vdcapi__PropertyValue &aPropVal)
 }
 
 
-void PbufApiValue::putValueIntoPropVal(Vdcapi__PropertyValue &aPropVal)
+void PbufApiValue::putValueIntoPropVal(Vdcapi__PropertyValue &aPropVal, PbufArena &aArena)
 {
   switch (allocatedType) {
     case apivalue_bool:
@@ -923,17 +1029,14 @@ void PbufApiValue::putValueIntoPropVal(Vdcapi__PropertyValue &aPropVal)
       aPropVal.v_double = doubleValue();
       break;
     case apivalue_string: {
-      string s = stringValue();
-      char *p = new char [s.size()+1];
-      strcpy(p, s.c_str());
-      aPropVal.v_string = p;
+      aPropVal.v_string = aArena.allocString(stringValue());
       break;
     }
     case apivalue_binary: {
       aPropVal.has_v_bytes = true;
       string b = binaryValue();
       aPropVal.v_bytes.len = b.size();
-      uint8_t *p = new uint8_t [b.size()];
+      uint8_t *p = (uint8_t *)aArena.alloc(b.size());
       memcpy(p, b.c_str(),b.size());
       aPropVal.v_bytes.data = p;
       break;
@@ -986,6 +1089,7 @@ ErrorPtr VdcPbufApiRequest::sendResult(ApiValuePtr aResult)
   else {
     // we might have a specific result
     PbufApiValuePtr result = boost::dynamic_pointer_cast<PbufApiValue>(aResult);
+    PbufArena &arena = pbufConnection->arena;
     ProtobufCMessage *subMessageP = NULL;
     // create a message
     Vdcapi__Message msg = VDCAPI__MESSAGE__INIT;
@@ -993,33 +1097,35 @@ ErrorPtr VdcPbufApiRequest::sendResult(ApiValuePtr aResult)
     msg.message_id = reqId; // use same message id as in method call
     // set correct type and generate appropriate submessage
     msg.type = responseType;
+    arena.retain();
     switch (responseType) {
       case VDCAPI__TYPE__VDC_RESPONSE_HELLO:
-        msg.vdc_response_hello = new Vdcapi__VdcResponseHello;
+        msg.vdc_response_hello = arena.allocObject<Vdcapi__VdcResponseHello>();
         vdcapi__vdc__response_hello__init(msg.vdc_response_hello);
         subMessageP = &(msg.vdc_response_hello->base);
         if (result) {
-          result->putObjectFieldIntoMessage(*subMessageP, "dSUID");
+          result->putObjectFieldIntoMessage(*subMessageP, "dSUID", arena);
         }
         break;
       case VDCAPI__TYPE__VDC_RESPONSE_GET_PROPERTY:
-        msg.vdc_response_get_property = new Vdcapi__VdcResponseGetProperty;
+        msg.vdc_response_get_property = arena.allocObject<Vdcapi__VdcResponseGetProperty>();
         vdcapi__vdc__response_get_property__init(msg.vdc_response_get_property);
         subMessageP = &(msg.vdc_response_get_property->base);
         // result object is property value(s)
         // and only field in VdcResponseGetProperty is the "properties" repeating field
         if (result) {
-          result->putValueIntoMessageField(subMessageP->descriptor->fields[0], *subMessageP);
+          result->putValueIntoMessageField(subMessageP->descriptor->fields[0], *subMessageP, arena);
         }
         break;
       default:
         LOG(LOG_INFO,"vdSM <- vDC (pbuf) response '%s' cannot be sent because no message is implemented for it at the pbuf level\n", aResult->description().c_str());
+        arena.release();
         return ErrorPtr(new VdcApiError(500,"Error: Method is not implemented in the pbuf API"));
     }
     // send
     err = pbufConnection->sendMessage(&msg);
-    // dispose allocated submessage
-    protobuf_c_message_free_unpacked(subMessageP, NULL);
+    // dispose allocated submessage (returns it to the arena)
+    arena.release();
     // log
     LOG(LOG_INFO,"vdSM <- vDC (pbuf) result sent: requestid='%d', result=%s\n", reqId, aResult ? aResult->description().c_str() : "<none>");
   }
@@ -1054,7 +1160,6 @@ ErrorPtr VdcPbufApiRequest::sendError(uint32_t aErrorCode, string aErrorMessage,
 
 VdcPbufApiConnection::VdcPbufApiConnection() :
   closeWhenSent(false),
-  expectedMsgBytes(0),
   requestIdCounter(0)
 {
   socketComm = SocketCommPtr(new SocketComm(MainLoop::currentMainLoop()));
@@ -1065,64 +1170,50 @@ VdcPbufApiConnection::VdcPbufApiConnection() :
 
 // max message size accepted - everything bigger must be an error
 #define MAX_DATA_SIZE 16384
+// max size of result data in a single message (estimated sizes, so leave headroom for encoding overhead)
+#define MAX_RESULT_SIZE (MAX_DATA_SIZE*7/8)
+
+
+size_t VdcPbufApiConnection::maxResultSize()
+{
+  return MAX_RESULT_SIZE;
+}
 
 
 void VdcPbufApiConnection::gotData(ErrorPtr aError)
 {
   // got data
   if (Error::isOK(aError)) {
-    // no error
-    size_t dataSz = socketComm->numBytesReady();
-    DBGFOCUSLOG("gotData: numBytesReady()=%d\n", dataSz);
-    // read data we've got so far
-    if (dataSz>0) {
-      // temporary buffer
-      uint8_t *buf = new uint8_t[dataSz];
-      size_t receivedBytes = socketComm->receiveBytes(dataSz, buf, aError);
-      DBGFOCUSLOG("gotData: receiveBytes(%d)=%d\n", dataSz, receivedBytes);
-      DBGFOCUSLOG("gotData: before appending: receivedMessage.size()=%d\n", receivedMessage.size());
-      if (Error::isOK(aError)) {
-        // append to receive buffer
-        receivedMessage.append((const char *)buf, receivedBytes);
-        DBGFOCUSLOG("gotData: after appending: receivedMessage.size()=%d\n", receivedMessage.size());
-        // single message extraction
-        while(true) {
-          DBGFOCUSLOG("gotData: processing loop beginning, expectedMsgBytes=%d\n", expectedMsgBytes);
-          if(expectedMsgBytes==0 && receivedMessage.size()>=2) {
-            // got 2-byte length header, decode it
-            const uint8_t *sz = (const uint8_t *)receivedMessage.c_str();
-            expectedMsgBytes =
-              (sz[0]<<8) +
-              sz[1];
-            receivedMessage.erase(0,2);
-            FOCUSLOG("gotData: parsed new header, now expectedMsgBytes=%d\n", expectedMsgBytes);
-            DBGFOCUSLOG("gotData: after removing header: receivedMessage.size()=%d\n", receivedMessage.size());
-            if (expectedMsgBytes>MAX_DATA_SIZE) {
-              aError = ErrorPtr(new VdcApiError(413, "message exceeds maximum length of 16kB"));
-              break;
-            }
-          }
-          // check for complete message
-          if (expectedMsgBytes && (receivedMessage.size()>=expectedMsgBytes)) {
-            FOCUSLOG("gotData: receivedMessage.size()=%d >= expectedMsgBytes=%d -> process\n", receivedMessage.size(), expectedMsgBytes);
-            // process message
-            aError = processMessage((uint8_t *)receivedMessage.c_str(),expectedMsgBytes);
-            // erase processed message
-            receivedMessage.erase(0,expectedMsgBytes);
-            DBGFOCUSLOG("gotData: after removing message: receivedMessage.size()=%d\n", receivedMessage.size());
-            expectedMsgBytes = 0; // reset to unknown
-            // repeat evaluation with remaining bytes (could be another message)
-          }
-          else {
-            // no complete message yet, done for now
-            break;
-          }
+    // no error, read data we've got so far into the socket's receive buffer
+    aError = socketComm->receiveIntoBuffer();
+    if (Error::isOK(aError)) {
+      // single message extraction, in place from the receive buffer
+      while(true) {
+        size_t bufferedBytes = socketComm->receiveBufferBytes();
+        DBGFOCUSLOG("gotData: processing loop beginning, bufferedBytes=%d\n", bufferedBytes);
+        if (bufferedBytes<2) break; // no complete 2-byte length header yet
+        // decode 2-byte length header
+        const uint8_t *msg = socketComm->receiveBufferData();
+        uint32_t msgBytes =
+          (msg[0]<<8) +
+          msg[1];
+        if (msgBytes>MAX_DATA_SIZE) {
+          aError = ErrorPtr(new VdcApiError(413, "message exceeds maximum length of 16kB"));
+          break;
+        }
+        // check for complete message
+        if (bufferedBytes<2+msgBytes) {
+          // no complete message yet, done for now
+          break;
         }
-        DBGFOCUSLOG("gotData: end of processing loop: receivedMessage.size()=%d\n", receivedMessage.size());
+        FOCUSLOG("gotData: bufferedBytes=%d >= 2+msgBytes=%d -> process\n", bufferedBytes, msgBytes);
+        // process message directly from the receive buffer
+        aError = processMessage(msg+2, msgBytes);
+        // consume processed message including header
+        socketComm->consumeReceiveBuffer(2+msgBytes);
+        // repeat evaluation with remaining bytes (could be another message)
       }
-      // forget buffer
-      delete[] buf; buf = NULL;
-    } // some data seems to be ready
+    }
   } // no connection error
   if (!Error::isOK(aError)) {
     // error occurred
@@ -1141,42 +1232,30 @@ ErrorPtr VdcPbufApiConnection::sendMessage(const Vdcapi__Message *aVdcApiMessage
     protobufMessagePrint(stdout, &aVdcApiMessage->base, 0);
   }
   #endif
-  // generate the binary message
+  // generate the binary message directly into a transmit buffer
   size_t packedSize = vdcapi__message__get_packed_size(aVdcApiMessage);
-  uint8_t *packedMsg = new uint8_t[packedSize+2]; // leave room for header
-  // - add the header
-  packedMsg[0] = (packedSize>>8) & 0xFF;
-  packedMsg[1] = packedSize & 0xFF;
-  // - add the message data
-  vdcapi__message__pack(aVdcApiMessage, packedMsg+2);
-  // - adjust the total message length
-  packedSize += 2;
-  // send the message
-  if (transmitBuffer.size()>0) {
-    // other messages are already waiting, append entire message
-    transmitBuffer.append((const char *)packedMsg, packedSize);
-  }
-  else {
-    // nothing in buffer yet, start new send
-    size_t sentBytes = socketComm->transmitBytes(packedSize, packedMsg, err);
-    if (Error::isOK(err)) {
-      // check if all could be sent
-      if (sentBytes<packedSize) {
-        // Not everything (or maybe nothing, transmitBytes() can return 0) was sent
-        // - enable callback for ready-for-send
-        socketComm->setTransmitHandler(boost::bind(&VdcPbufApiConnection::canSendData, this, _1));
-        // buffer the rest, canSendData handler will take care of writing it out
-        transmitBuffer.assign((char *)packedMsg+sentBytes, packedSize-sentBytes);
-      }
-			else {
-				// all sent
-				// - disable transmit handler
-        socketComm->setTransmitHandler(NULL);
-			}
+  FdTransmitBuffer msgBuf = socketComm->newTransmitBuffer(packedSize+2); // leave room for header
+  if (msgBuf.data) {
+    // - add the header
+    msgBuf.data[0] = (packedSize>>8) & 0xFF;
+    msgBuf.data[1] = packedSize & 0xFF;
+    // - add the message data
+    vdcapi__message__pack(aVdcApiMessage, msgBuf.data+2);
+  }
+  // send the message (or queue it behind other messages already waiting)
+  err = socketComm->queueTransmitBuffer(msgBuf);
+  if (Error::isOK(err)) {
+    if (socketComm->transmitQueueBytes()>0) {
+      // Not everything (or maybe nothing) was sent
+      // - enable callback for ready-for-send, canSendData handler will take care of writing it out
+      socketComm->setTransmitHandler(boost::bind(&VdcPbufApiConnection::canSendData, this, _1));
+    }
+    else {
+      // all sent
+      // - disable transmit handler
+      socketComm->setTransmitHandler(NULL);
     }
   }
-  // return the buffer
-  delete[] packedMsg;
   // done
   return err;
 }
@@ -1184,26 +1263,20 @@ ErrorPtr VdcPbufApiConnection::sendMessage(const Vdcapi__Message *aVdcApiMessage
 
 void VdcPbufApiConnection::canSendData(ErrorPtr aError)
 {
-  size_t bytesToSend = transmitBuffer.size();
-  if (bytesToSend>0 && Error::isOK(aError)) {
-    // send data from transmit buffer
-    size_t sentBytes = socketComm->transmitBytes(bytesToSend, (const uint8_t *)transmitBuffer.c_str(), aError);
+  if (socketComm->transmitQueueBytes()>0 && Error::isOK(aError)) {
+    // send data from transmit queue
+    aError = socketComm->flushTransmitQueue();
     if (Error::isOK(aError)) {
-      if (sentBytes==bytesToSend) {
+      if (socketComm->transmitQueueBytes()==0) {
         // all sent
-        transmitBuffer.erase();
-				// - disable transmit handler
+        // - disable transmit handler
         socketComm->setTransmitHandler(NULL);
-      }
-      else {
-        // partially sent, remove sent bytes
-        transmitBuffer.erase(0, sentBytes);
-      }
-      // check for closing connection when no data pending to be sent any more
-      if (closeWhenSent && transmitBuffer.size()==0) {
-        closeWhenSent = false; // done
-        LOG(LOG_NOTICE,"vDC API request demands ending connection now\n");
-        closeConnection();
+        // check for closing connection when no data pending to be sent any more
+        if (closeWhenSent) {
+          closeWhenSent = false; // done
+          LOG(LOG_NOTICE,"vDC API request demands ending connection now\n");
+          closeConnection();
+        }
       }
     }
   }
@@ -1257,17 +1330,106 @@ Vdcapi__ResultCode VdcPbufApiConnection::internalToPbufError(ErrorCode aErrorCod
 
 
 
+// helper macro for notifications consisting of dSUIDs and a scene number only
+#define DECODE_SCENE_NOTIFICATION(notificationType, methodName, field) \
+  if (!aMsg->field || !aMsg->field->has_scene) return false; \
+  aNotification.type = notificationType; \
+  aNotification.method = methodName; \
+  aNotification.numDsUids = aMsg->field->n_dsuid; \
+  aNotification.dsUids = aMsg->field->dsuid; \
+  aNotification.scene = aMsg->field->scene;
+
+
+bool VdcPbufApiConnection::decodeNotification(const Vdcapi__Message *aMsg, VdcApiNotification &aNotification)
+{
+  if (aMsg->has_message_id) return false; // method call, not notification
+  switch (aMsg->type) {
+    case VDCAPI__TYPE__VDSM_SEND_PING:
+      if (!aMsg->vdsm_send_ping) return false;
+      aNotification.type = vdcapi_ping;
+      aNotification.method = "ping";
+      aNotification.numDsUids = aMsg->vdsm_send_ping->dsuid ? 1 : 0;
+      aNotification.dsUids = &aMsg->vdsm_send_ping->dsuid;
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_CALL_SCENE:
+      DECODE_SCENE_NOTIFICATION(vdcapi_callScene, "callScene", vdsm_send_call_scene);
+      if (!aMsg->vdsm_send_call_scene->has_force) return false;
+      aNotification.force = aMsg->vdsm_send_call_scene->force;
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_SAVE_SCENE:
+      DECODE_SCENE_NOTIFICATION(vdcapi_saveScene, "saveScene", vdsm_send_save_scene);
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_UNDO_SCENE:
+      DECODE_SCENE_NOTIFICATION(vdcapi_undoScene, "undoScene", vdsm_send_undo_scene);
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_SET_LOCAL_PRIO:
+      DECODE_SCENE_NOTIFICATION(vdcapi_setLocalPriority, "setLocalPriority", vdsm_send_set_local_prio);
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_CALL_MIN_SCENE:
+      DECODE_SCENE_NOTIFICATION(vdcapi_callSceneMin, "callSceneMin", vdsm_send_call_min_scene);
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_IDENTIFY:
+      if (!aMsg->vdsm_send_identify) return false;
+      aNotification.type = vdcapi_identify;
+      aNotification.method = "identify";
+      aNotification.numDsUids = aMsg->vdsm_send_identify->n_dsuid;
+      aNotification.dsUids = aMsg->vdsm_send_identify->dsuid;
+      return true;
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_SET_CONTROL_VALUE: {
+      Vdcapi__VdsmNotificationSetControlValue *m = aMsg->vdsm_send_set_control_value;
+      if (!m || !m->name || !m->has_value) return false;
+      aNotification.type = vdcapi_setControlValue;
+      aNotification.method = "setControlValue";
+      aNotification.numDsUids = m->n_dsuid;
+      aNotification.dsUids = m->dsuid;
+      aNotification.name = m->name;
+      aNotification.value = m->value;
+      return true;
+    }
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_DIM_CHANNEL: {
+      Vdcapi__VdsmNotificationDimChannel *m = aMsg->vdsm_send_dim_channel;
+      if (!m || !m->has_channel || !m->has_mode) return false;
+      aNotification.type = vdcapi_dimChannel;
+      aNotification.method = "dimChannel";
+      aNotification.numDsUids = m->n_dsuid;
+      aNotification.dsUids = m->dsuid;
+      aNotification.channel = m->channel;
+      aNotification.mode = m->mode;
+      aNotification.area = m->has_area ? m->area : 0;
+      return true;
+    }
+    case VDCAPI__TYPE__VDSM_NOTIFICATION_SET_OUTPUT_CHANNEL_VALUE: {
+      Vdcapi__VdsmNotificationSetOutputChannelValue *m = aMsg->vdsm_send_output_channel_value;
+      if (!m || !m->has_channel || !m->has_value) return false;
+      aNotification.type = vdcapi_setOutputChannelValue;
+      aNotification.method = "setOutputChannelValue";
+      aNotification.numDsUids = m->n_dsuid;
+      aNotification.dsUids = m->dsuid;
+      aNotification.channel = m->channel;
+      aNotification.value = m->value;
+      aNotification.applyNow = m->has_apply_now ? m->apply_now : true;
+      return true;
+    }
+    default:
+      // not a notification we can decode directly
+      return false;
+  }
+}
+
+
 ErrorPtr VdcPbufApiConnection::processMessage(const uint8_t *aPackedMessageP, size_t aPackedMessageSize)
 {
   Vdcapi__Message *decodedMsg;
   ProtobufCMessage *paramsMsg = NULL;
-  PbufApiValuePtr msgFieldsObj = PbufApiValuePtr(new PbufApiValue);
+  PbufApiValuePtr msgFieldsObj;
 
   ErrorPtr err;
 
-  decodedMsg = vdcapi__message__unpack(NULL, aPackedMessageSize, aPackedMessageP); // Deserialize the serialized input
+  arena.retain(); // unpacked message lives in the arena until released at end of processing
+  decodedMsg = vdcapi__message__unpack(&arena.allocator, aPackedMessageSize, aPackedMessageP); // Deserialize the serialized input
   if (decodedMsg == NULL) {
     err = ErrorPtr(new VdcApiError(400,"error unpacking incoming message"));
+    arena.release();
   }
   else {
     // print it
@@ -1276,6 +1438,18 @@ ErrorPtr VdcPbufApiConnection::processMessage(const uint8_t *aPackedMessageP, si
       protobufMessagePrint(stdout, &decodedMsg->base, 0);
     }
     #endif
+    // fast path: frequent notifications are delivered with typed parameters, without building a PbufApiValue tree
+    if (apiNotificationHandler) {
+      VdcApiNotification notification;
+      if (decodeNotification(decodedMsg, notification)) {
+        LOG(LOG_INFO,"vdSM -> vDC (pbuf) notification received: method='%s' (direct), %d target(s)\n", notification.method, (int)notification.numDsUids);
+        apiNotificationHandler(VdcPbufApiConnectionPtr(this), notification);
+        arena.release();
+        return err;
+      }
+    }
+    // generic path
+    msgFieldsObj = PbufApiValuePtr(new PbufApiValue);
     // successful message decoding
     string method;
     int responseType = 0; // none
@@ -1472,8 +1646,8 @@ ErrorPtr VdcPbufApiConnection::processMessage(const uint8_t *aPackedMessageP, si
         apiRequestHandler(VdcPbufApiConnectionPtr(this), request, method, msgFieldsObj);
       }
     }
-    // free the unpacked message
-    vdcapi__message__free_unpacked(decodedMsg, NULL); // Free the message from unpack()
+    // free the unpacked message (returns all of its memory to the arena at once)
+    arena.release();
   }
   // return error, in case protobuf message is not decodeable
   return err;
@@ -1501,33 +1675,34 @@ ErrorPtr VdcPbufApiConnection::sendRequest(const string &aMethod, ApiValuePtr aP
   Vdcapi__Message msg = VDCAPI__MESSAGE__INIT;
   // find out which type and which submessage applies
   ProtobufCMessage *subMessageP = NULL;
+  arena.retain();
   if (aMethod=="pong") {
     msg.type = VDCAPI__TYPE__VDC_SEND_PONG;
-    msg.vdc_send_pong = new Vdcapi__VdcSendPong;
+    msg.vdc_send_pong = arena.allocObject<Vdcapi__VdcSendPong>();
     vdcapi__vdc__send_pong__init(msg.vdc_send_pong);
     subMessageP = &(msg.vdc_send_pong->base);
   }
   else if (aMethod=="announcedevice") {
     msg.type = VDCAPI__TYPE__VDC_SEND_ANNOUNCE_DEVICE;
-    msg.vdc_send_announce_device = new Vdcapi__VdcSendAnnounceDevice;
+    msg.vdc_send_announce_device = arena.allocObject<Vdcapi__VdcSendAnnounceDevice>();
     vdcapi__vdc__send_announce_device__init(msg.vdc_send_announce_device);
     subMessageP = &(msg.vdc_send_announce_device->base);
   }
   else if (aMethod=="announcevdc") {
     msg.type = VDCAPI__TYPE__VDC_SEND_ANNOUNCE_VDC;
-    msg.vdc_send_announce_vdc = new Vdcapi__VdcSendAnnounceVdc;
+    msg.vdc_send_announce_vdc = arena.allocObject<Vdcapi__VdcSendAnnounceVdc>();
     vdcapi__vdc__send_announce_vdc__init(msg.vdc_send_announce_vdc);
     subMessageP = &(msg.vdc_send_announce_vdc->base);
   }
   else if (aMethod=="vanish") {
     msg.type = VDCAPI__TYPE__VDC_SEND_VANISH;
-    msg.vdc_send_vanish = new Vdcapi__VdcSendVanish;
+    msg.vdc_send_vanish = arena.allocObject<Vdcapi__VdcSendVanish>();
     vdcapi__vdc__send_vanish__init(msg.vdc_send_vanish);
     subMessageP = &(msg.vdc_send_vanish->base);
   }
   else if (aMethod=="pushProperty") {
     msg.type = VDCAPI__TYPE__VDC_SEND_PUSH_PROPERTY;
-    msg.vdc_send_push_property = new Vdcapi__VdcSendPushProperty;
+    msg.vdc_send_push_property = arena.allocObject<Vdcapi__VdcSendPushProperty>();
     vdcapi__vdc__send_push_property__init(msg.vdc_send_push_property);
     subMessageP = &(msg.vdc_send_push_property->base);
   }
@@ -1535,13 +1710,14 @@ ErrorPtr VdcPbufApiConnection::sendRequest(const string &aMethod, ApiValuePtr aP
     // Note: this method has the same (JSON) name as the method from the vdsm used to identify (blink) a device.
     //   In protobuf API however this is a different message type
     msg.type = VDCAPI__TYPE__VDC_SEND_IDENTIFY;
-    msg.vdc_send_identify = new Vdcapi__VdcSendIdentify;
+    msg.vdc_send_identify = arena.allocObject<Vdcapi__VdcSendIdentify>();
     vdcapi__vdc__send_identify__init(msg.vdc_send_identify);
     subMessageP = &(msg.vdc_send_identify->base);
   }
   else {
     // no suitable submessage, cannot send
     LOG(LOG_INFO,"vdSM <- vDC (pbuf) method '%s' cannot be sent because no message is implemented for it at the pbuf level\n", aMethod.c_str());
+    arena.release();
     return ErrorPtr(new VdcApiError(500,"Error: Method is not implemented in the pbuf API"));
   }
   if (Error::isOK(err)) {
@@ -1554,12 +1730,10 @@ ErrorPtr VdcPbufApiConnection::sendRequest(const string &aMethod, ApiValuePtr aP
     }
     // now generically fill parameters into submessage (if any, and if not handled above explicitly)
     if (params) {
-      params->putObjectIntoMessageFields(*subMessageP);
+      params->putObjectIntoMessageFields(*subMessageP, arena);
     }
     // send
     err = sendMessage(&msg);
-    // dispose allocated submessage
-    protobuf_c_message_free_unpacked(subMessageP, NULL);
     // log
     if (aResponseHandler) {
       LOG(LOG_INFO,"vdSM <- vDC (pbuf) method call sent: requestid='%d', method='%s', params=%s\n", requestIdCounter, aMethod.c_str(), aParams ? aParams->description().c_str() : "<none>");
@@ -1568,6 +1742,8 @@ ErrorPtr VdcPbufApiConnection::sendRequest(const string &aMethod, ApiValuePtr aP
       LOG(LOG_INFO,"vdSM <- vDC (pbuf) notification sent: method='%s', params=%s\n", aMethod.c_str(), aParams ? aParams->description().c_str() : "<none>");
     }
   }
+  // dispose allocated submessage (returns it to the arena)
+  arena.release();
   // done
   return err;
 }
@@ -43,6 +43,87 @@ namespace p44 {
 
 
 
+  #define PBUF_ARENA_BLOCK_SIZE 4096 ///< default size of arena memory blocks
+  #define PBUF_ARENA_MAX_KEPT_SIZE (64*1024) ///< arena blocks larger than this are returned to the heap at reset
+  #define PBUF_ARENA_ALIGNMENT 8 ///< alignment of arena allocations
+
+  /// Resettable bump allocator for protobuf-c message trees
+  /// @note all memory for unpacking a message or building a message for sending is taken from the arena
+  ///   and released at once by resetting the arena, instead of one malloc/free per submessage, string or array.
+  class PbufArena
+  {
+    struct Block
+    {
+      Block *next; ///< next (older) block
+      size_t size; ///< usable size of this block
+    };
+
+    Block *blocks; ///< list of blocks, current block first
+    uint8_t *nextFree; ///< next free byte in current block
+    uint8_t *blockEnd; ///< end of current block
+    size_t blockSize; ///< size for new blocks
+    int users; ///< number of retain() calls not yet balanced by release()
+
+    // statistics
+    size_t numAllocs; ///< allocations since last reset
+    size_t numBytes; ///< bytes allocated since last reset
+    size_t peakBytes; ///< max bytes allocated between two resets
+    size_t numCycles; ///< number of resets
+
+  public:
+
+    /// protobuf-c allocator using this arena, to be passed to protobuf-c functions
+    ProtobufCAllocator allocator;
+
+    PbufArena();
+    ~PbufArena();
+
+    /// allocate memory from the arena
+    /// @param aSize number of bytes needed
+    /// @return pointer to aligned memory, valid until arena gets reset, NULL if out of memory
+    void *alloc(size_t aSize);
+
+    /// allocate and zero an array of objects from the arena
+    /// @param aCount number of objects
+    /// @return pointer to array, valid until arena gets reset
+    template<typename T> T *allocArray(size_t aCount) { T *p = (T *)alloc(aCount*sizeof(T)); if (p) memset(p, 0, aCount*sizeof(T)); return p; }
+
+    /// allocate a single object from the arena
+    /// @return pointer to uninitialized object, valid until arena gets reset
+    template<typename T> T *allocObject() { return (T *)alloc(sizeof(T)); }
+
+    /// copy a string into the arena
+    /// @param aString string to copy
+    /// @return pointer to null terminated copy of the string, valid until arena gets reset
+    char *allocString(const string &aString);
+
+    /// start using the arena (for unpacking a received message or building a message to send)
+    void retain() { users++; };
+
+    /// done using the arena. When all users have released the arena, it is reset
+    void release();
+
+    /// @name statistics
+    /// @{
+    size_t allocations() { return numAllocs; }; ///< allocations since last reset
+    size_t allocatedBytes() { return numBytes; }; ///< bytes allocated since last reset
+    size_t peakAllocatedBytes() { return peakBytes; }; ///< max bytes allocated between two resets
+    size_t cycles() { return numCycles; }; ///< number of times the arena was reset
+    /// @}
+
+  private:
+
+    void reset();
+    bool newBlock(size_t aMinSize);
+    void freeBlocks();
+
+    static void *arenaAlloc(void *aAllocatorData, size_t aSize);
+    static void arenaFree(void *aAllocatorData, void *aPointer);
+
+  };
+
+
+
   class PbufApiValue;
 
   typedef boost::intrusive_ptr<PbufApiValue> PbufApiValuePtr;
@@ -119,12 +200,14 @@ namespace p44 {
 
     /// put all values in this ApiValue into name-matching fields of the passed protobuf message
     /// @param aFieldName the protobuf-c message to put the fields into
-    void putObjectIntoMessageFields(ProtobufCMessage &aMessage);
+    /// @param aArena the arena to allocate submessages, arrays and strings from
+    void putObjectIntoMessageFields(ProtobufCMessage &aMessage, PbufArena &aArena);
 
     /// put specified field of this ApiValue (must be of type object) into the protobuf message as a field
     /// @param aMessage the protobuf-c message to put the the field into
     /// @param aFieldName the name of the protobuf-c message field
-    void putObjectFieldIntoMessage(ProtobufCMessage &aMessage, const char* aFieldName);
+    /// @param aArena the arena to allocate submessages, arrays and strings from
+    void putObjectFieldIntoMessage(ProtobufCMessage &aMessage, const char* aFieldName, PbufArena &aArena);
 
 
     /// extract a single field from a protobuf message into this value
@@ -135,7 +218,8 @@ namespace p44 {
     /// extract a single field from a protobuf message into this value
     /// @param aFieldDescriptor the protobuf-c field descriptor for this field
     /// @param aMessage the protobuf-c message to put the field value into
-    void putValueIntoMessageField(const ProtobufCFieldDescriptor &aFieldDescriptor, const ProtobufCMessage &aMessage);
+    /// @param aArena the arena to allocate submessages, arrays and strings from
+    void putValueIntoMessageField(const ProtobufCFieldDescriptor &aFieldDescriptor, const ProtobufCMessage &aMessage, PbufArena &aArena);
 
     /// @}
 
@@ -145,14 +229,14 @@ namespace p44 {
     bool allocateIf(ApiValueType aIsType);
 
     void setValueFromField(const ProtobufCFieldDescriptor &aFieldDescriptor, const void *aData, size_t aIndex, ssize_t aArraySize);
-    void putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescriptor, void *aData, size_t aIndex, ssize_t aArraySize);
+    void putValueIntoField(const ProtobufCFieldDescriptor &aFieldDescriptor, void *aData, size_t aIndex, ssize_t aArraySize, PbufArena &aArena);
 
     void addKeyValFromPropertyElementField(const Vdcapi__PropertyElement *aPropertyElementP);
-    void storeKeyValIntoPropertyElementField(string aKey, Vdcapi__PropertyElement *&aPropertyElementP);
+    void storeKeyValIntoPropertyElementField(string aKey, Vdcapi__PropertyElement *&aPropertyElementP, PbufArena &aArena);
 
 
     void getValueFromPropVal(Vdcapi__PropertyValue &aPropVal);
-    void putValueIntoPropVal(Vdcapi__PropertyValue &aPropVal);
+    void putValueIntoPropVal(Vdcapi__PropertyValue &aPropVal, PbufArena &aArena);
 
     size_t numObjectFields();
 
@@ -222,12 +306,10 @@ namespace p44 {
 
     SocketCommPtr socketComm;
 
-    // receiving
-    uint32_t expectedMsgBytes; ///< number of bytes expected of next message
-    string receivedMessage; ///< accumulated message bytes, including 4-byte length header
+    // memory for unpacking received and building outgoing protobuf-c messages
+    PbufArena arena;
 
     // sending
-    string transmitBuffer; ///< binary buffer for data to be sent
     bool closeWhenSent;
 
     // pending requests
@@ -243,6 +325,10 @@ namespace p44 {
     /// @return socket connection
     virtual SocketCommPtr socketConnection() { return socketComm; };
 
+    /// max size of result data a single response message can carry on this connection
+    /// @return approximate max size in bytes
+    virtual size_t maxResultSize();
+
     /// request closing connection after last message has been sent
     virtual void closeAfterSend();
 
@@ -265,6 +351,7 @@ namespace p44 {
     void canSendData(ErrorPtr aError);
 
     ErrorPtr processMessage(const uint8_t *aPackedMessageP, size_t aPackedMessageSize);
+    bool decodeNotification(const Vdcapi__Message *aMsg, VdcApiNotification &aNotification);
     ErrorPtr sendMessage(const Vdcapi__Message *aVdcApiMessage);
 
     static ErrorCode pbufToInternalError(Vdcapi__ResultCode aVdcApiResultCode);
@@ -27,14 +27,55 @@
 #define FOCUSLOGLEVEL 0
 
 #include "propertycontainer.hpp"
+#include <typeinfo>
 
 using namespace p44;
 
 
+#pragma mark - chunked reading
+
+
+bool PropertyChunk::popResumePosition(int &aQueryElement, int &aPropIndex)
+{
+  if (resumeAt.empty()) return false;
+  size_t e = resumeAt.find('/');
+  if (sscanf(resumeAt.c_str(), "%d:%d", &aQueryElement, &aPropIndex)!=2) {
+    resumeAt.clear(); // invalid token, start from beginning
+    return false;
+  }
+  resumeAt.erase(0, e==string::npos ? e : e+1);
+  return true;
+}
+
+
+bool PropertyChunk::addResult(const char *aName, ApiValuePtr aValue)
+{
+  // estimate encoded size: name, value, plus tags and lengths
+  size_t sz = strlen(aName)+PROPERTY_CHUNK_ELEMENT_OVERHEAD;
+  if (aValue->isType(apivalue_string)) sz += aValue->stringValue().size();
+  else if (aValue->isType(apivalue_binary)) sz += aValue->binaryValue().size();
+  else if (!aValue->isType(apivalue_object)) sz += 10; // max size of a varint
+  // a chunk always contains at least one value, so reading always progresses
+  if (maxBytes>0 && usedBytes>0 && usedBytes+sz>maxBytes) return false;
+  usedBytes += sz;
+  return true;
+}
+
+
+void PropertyChunk::markResumePosition(int aQueryElement, int aPropIndex)
+{
+  if (continuation.empty())
+    continuation = string_format("%d:%d", aQueryElement, aPropIndex);
+  else
+    continuation = string_format("%d:%d/", aQueryElement, aPropIndex) + continuation;
+}
+
+
+
 #pragma mark - property access API
 
 
-ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor, PropertyChunk *aChunk)
 {
   ErrorPtr err;
   #if DEBUGFOCUSLOGGING
@@ -56,12 +97,21 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
       return ErrorPtr(new VdcApiError(415, "accessing property for read must provide result object"));
     aResultObject->setType(apivalue_object); // must be object
   }
+  // when continuing a chunked read, get the position to resume at on this level
+  int resumeElement = -1;
+  int resumeIndex = 0;
+  if (aChunk && aMode==access_read) {
+    aChunk->popResumePosition(resumeElement, resumeIndex);
+  }
   // Iterate trough elements of query object
   aQueryObject->resetKeyIteration();
   string queryName;
   ApiValuePtr queryValue;
   string errorMsg;
+  int queryElement = -1;
   while (aQueryObject->nextKeyValue(queryName, queryValue)) {
+    queryElement++;
+    if (queryElement<resumeElement) continue; // already delivered in previous chunk(s)
     FOCUSLOG("- starting to process query element named '%s' : %s\n", queryName.c_str(), queryValue->description().c_str());
     if (aMode==access_read && queryName=="#") {
       // asking for number of elements at this level -> generate and return int value
@@ -75,8 +125,10 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
       // - find all descriptor(s) for this queryName
       PropertyDescriptorPtr propDesc;
       int propIndex = 0;
+      if (queryElement==resumeElement) propIndex = resumeIndex;
       bool foundone = false;
       do {
+        int descIndex = propIndex; // start index that finds this descriptor again when resuming
         propDesc = getDescriptorByName(queryName, propIndex, aDomain, aParentDescriptor);
         if (propDesc) {
           foundone = true; // found at least one descriptor for this query element
@@ -106,12 +158,17 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
                 if (aMode==access_read) {
                   // read needs a result object
                   ApiValuePtr resultValue = queryValue->newValue(apivalue_object);
-                  err = container->accessProperty(aMode, subQuery, resultValue, containerDomain, containerPropDesc);
+                  err = container->accessProperty(aMode, subQuery, resultValue, containerDomain, containerPropDesc, aChunk);
                   if (Error::isOK(err)) {
                     // add to result with actual name (from descriptor)
                     FOCUSLOG("\n  <<<< RETURNED from accessProperty() recursion\n");
                     FOCUSLOG("  - accessProperty of container for '%s' returns %s\n", propDesc->name(), resultValue->description().c_str());
+                    if (aChunk) aChunk->addResult(propDesc->name(), resultValue); // account for container overhead
                     aResultObject->add(propDesc->name(), resultValue);
+                    if (aChunk && aChunk->full()) {
+                      // chunk filled up within container, next chunk continues there
+                      aChunk->markResumePosition(queryElement, descIndex);
+                    }
                   }
                 }
                 else {
@@ -141,6 +198,11 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
               // for read, not getting an OK from accessField means: property does not exist (even if known per descriptor),
               // so it will not be added to the result
               if (accessOk) {
+                if (aChunk && !aChunk->addResult(propDesc->name(), fieldValue)) {
+                  // chunk is full, this value will be the first one of the next chunk
+                  aChunk->markResumePosition(queryElement, descIndex);
+                  break;
+                }
                 // add to result with actual name (from descriptor)
                 aResultObject->add(propDesc->name(), fieldValue);
               }
@@ -170,7 +232,9 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
             errorMsg += string_format("Unknown property '%s' -> ignored", queryName.c_str());
           }
         }
-      } while (Error::isOK(err) && propIndex!=PROPINDEX_NONE);
+        // resume position (if any) only applies to the first descriptor processed
+        if (aChunk) aChunk->resumeAt.clear();
+      } while (Error::isOK(err) && propIndex!=PROPINDEX_NONE && !(aChunk && aChunk->full()));
     }
     // now generate error if we have collected a non-empty error message
     if (!errorMsg.empty()) {
@@ -181,19 +245,20 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
       FOCUSLOG("- query element named '%s' now has result object: %s\n", queryName.c_str(), aResultObject->description().c_str());
     }
     #endif
+    if (aChunk && aChunk->full()) break; // rest goes into next chunk
   }
   return err;
 }
 
 
-bool PropertyContainer::isMatchAll(string &aPropMatch)
+bool PropertyContainer::isMatchAll(const string &aPropMatch)
 {
   return aPropMatch=="*" || aPropMatch.empty();
 }
 
 
 
-bool PropertyContainer::isNamedPropSpec(string &aPropMatch)
+bool PropertyContainer::isNamedPropSpec(const string &aPropMatch)
 {
   if (isMatchAll(aPropMatch)) return false; // matchall is not named access
   if (aPropMatch[0]=='#') return false; // #n is not named access
@@ -201,7 +266,21 @@ bool PropertyContainer::isNamedPropSpec(string &aPropMatch)
 }
 
 
-bool PropertyContainer::getNextPropIndex(string aPropMatch, int &aStartIndex)
+// parse decimal number at beginning of aStr (like sscanf "%d", but without the overhead)
+static bool parseIndex(const char *aStr, int &aIndex)
+{
+  while (*aStr==' ') aStr++;
+  bool neg = false;
+  if (*aStr=='-' || *aStr=='+') neg = *aStr++=='-';
+  if (*aStr<'0' || *aStr>'9') return false;
+  int v = 0;
+  while (*aStr>='0' && *aStr<='9') v = v*10 + (*aStr++ - '0');
+  aIndex = neg ? -v : v;
+  return true;
+}
+
+
+bool PropertyContainer::getNextPropIndex(const string &aPropMatch, int &aStartIndex)
 {
   if (isMatchAll(aPropMatch)) {
     // next property to return is just the aStartIndex we are on as-is
@@ -212,7 +291,7 @@ bool PropertyContainer::getNextPropIndex(string aPropMatch, int &aStartIndex)
   int currentIndex = aStartIndex;
   const char *s = aPropMatch.c_str();
   if (*s=='#') { s++; numericName = false; }
-  if (sscanf(s, "%d", &aStartIndex)==1) {
+  if (parseIndex(s, aStartIndex)) {
     // index found, must be higher or same as than current start
     if (aStartIndex<currentIndex)
       aStartIndex = PROPINDEX_NONE; // index out of range
@@ -224,10 +303,43 @@ bool PropertyContainer::getNextPropIndex(string aPropMatch, int &aStartIndex)
 
 
 
+#pragma mark - hashed name lookup
+
+// Hints for finding plain property names without scanning all descriptors of a level.
+// Entries are only hints (the descriptor found is always checked against the name), so the table
+// is simply direct mapped, with newer entries overwriting colliding older ones.
+typedef struct {
+  uint32_t hash; ///< hash of name and lookup context
+  int propIndex; ///< index where the name was found last time
+} PropertyNameHint;
+
+static PropertyNameHint propertyNameHints[PROPERTY_NAME_HINTS];
+
+
+uint32_t PropertyContainer::nameHash(const string &aName, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  // FNV-1a over name, then context (container class, domain and parent property)
+  uint32_t h = 2166136261u;
+  for (const char *p = aName.c_str(); *p; p++) {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  h = (h ^ (uint32_t)(intptr_t)typeid(*this).name()) * 16777619u;
+  h = (h ^ (uint32_t)aDomain) * 16777619u;
+  if (aParentDescriptor) {
+    h = (h ^ (uint32_t)aParentDescriptor->objectKey()) * 16777619u;
+    h = (h ^ (uint32_t)aParentDescriptor->fieldKey()) * 16777619u;
+  }
+  return h ? h : 1; // 0 marks unused entries
+}
+
+
+
+#pragma mark - property descriptors
+
 
 // default implementation based on numProps/getDescriptorByIndex
 // Derived classes with array-like container may directly override this method for more efficient access
-PropertyDescriptorPtr PropertyContainer::getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+PropertyDescriptorPtr PropertyContainer::getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor)
 {
   int n = numProps(aDomain, aParentDescriptor);
   if (aStartIndex<n && aStartIndex!=PROPINDEX_NONE) {
@@ -237,37 +349,58 @@ PropertyDescriptorPtr PropertyContainer::getDescriptorByName(string aPropMatch,
     // - name part with a trailing asterisk: wildcard.
     // - #n to access n-th property
     PropertyDescriptorPtr propDesc;
-    bool wildcard = false; // assume no wildcard
+    size_t matchLen = aPropMatch.size(); // number of chars that must match
+    int newIndex = n; // index for #n, out of range by default
     if (aPropMatch.empty()) {
-      wildcard = true; // implicit wildcard, empty name counts like "*"
+      // implicit wildcard, empty name counts like "*"
     }
-    else if (aPropMatch[aPropMatch.size()-1]=='*') {
-      wildcard = true; // explicit wildcard at end of string
-      aPropMatch.erase(aPropMatch.size()-1); // remove the wildcard char
+    else if (aPropMatch[matchLen-1]=='*') {
+      matchLen--; // explicit wildcard at end of string, match only the part before
     }
-    else if (aPropMatch[0]=='#') {
+    else if (aPropMatch[0]=='#' && parseIndex(aPropMatch.c_str()+1, newIndex)) {
       // special case 2 for reading: #n to access n-th subproperty
-      int newIndex = n; // set out of range by default
-      if (sscanf(aPropMatch.c_str()+1, "%d", &newIndex)==1) {
-        // name does not matter, pick item at newIndex unless below current start
-        wildcard = true;
-        aPropMatch.clear();
-        if(newIndex>=aStartIndex)
-          aStartIndex = newIndex; // not yet passed this index in iteration -> use it
-        else
-          aStartIndex = n; // already passed -> make out of range
+      // name does not matter, pick item at newIndex unless below current start
+      matchLen = 0;
+      if(newIndex>=aStartIndex)
+        aStartIndex = newIndex; // not yet passed this index in iteration -> use it
+      else
+        aStartIndex = n; // already passed -> make out of range
+    }
+    else {
+      // plain name (including names starting with # which are not a valid index)
+      // names are unique within a level, so there is at most one match, which is
+      // usually found at once via the hint from an earlier lookup of the same name in the same context
+      uint32_t h = nameHash(aPropMatch, aDomain, aParentDescriptor);
+      PropertyNameHint &hint = propertyNameHints[h & (PROPERTY_NAME_HINTS-1)];
+      if (hint.hash==h && hint.propIndex>=aStartIndex && hint.propIndex<n) {
+        propDesc = getDescriptorByIndex(hint.propIndex, aDomain, aParentDescriptor);
+        if (propDesc && aPropMatch==propDesc->name()) {
+          aStartIndex = PROPINDEX_NONE; // no other match possible
+          return propDesc;
+        }
+      }
+      // no valid hint, search
+      while (aStartIndex<n) {
+        propDesc = getDescriptorByIndex(aStartIndex, aDomain, aParentDescriptor);
+        if (propDesc && aPropMatch==propDesc->name()) {
+          // found, remember where
+          hint.hash = h;
+          hint.propIndex = aStartIndex;
+          aStartIndex = PROPINDEX_NONE; // no other match possible
+          return propDesc;
+        }
+        aStartIndex++;
       }
+      aStartIndex = PROPINDEX_NONE;
+      return PropertyDescriptorPtr(); // no descriptor
     }
     while (aStartIndex<n) {
       propDesc = getDescriptorByIndex(aStartIndex, aDomain, aParentDescriptor);
       // check for match
-      if (wildcard && aPropMatch.size()==0)
+      if (matchLen==0)
         break; // shortcut for "match all" case
       // match beginning
-      if (
-        (!wildcard && aPropMatch==propDesc->name()) || // complete match
-        (wildcard && (strncmp(aPropMatch.c_str(),propDesc->name(),aPropMatch.size())==0)) // match of name's beginning
-      ) {
+      if (propDesc && strncmp(aPropMatch.c_str(), propDesc->name(), matchLen)==0) {
         break; // this entry matches
       }
       // next
@@ -291,7 +424,7 @@ PropertyDescriptorPtr PropertyContainer::getDescriptorByName(string aPropMatch,
 
 
 PropertyDescriptorPtr PropertyContainer::getDescriptorByNumericName(
-  string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor,
+  const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor,
   intptr_t aObjectKey
 )
 {
@@ -301,7 +434,7 @@ PropertyDescriptorPtr PropertyContainer::getDescriptorByNumericName(
   if (aStartIndex!=PROPINDEX_NONE && aStartIndex<n) {
     // within range, create descriptor
     DynamicPropertyDescriptor *descP = new DynamicPropertyDescriptor(aParentDescriptor);
-    descP->propertyName = string_format("%d", aStartIndex);
+    descP->setNumericName(aStartIndex);
     descP->propertyType = aParentDescriptor->type();
     descP->propertyFieldKey = aStartIndex;
     descP->propertyObjectKey = aObjectKey;
@@ -316,3 +449,57 @@ PropertyDescriptorPtr PropertyContainer::getDescriptorByNumericName(
 
 
 
+#pragma mark - PropertyDescriptor memory recycling
+
+typedef struct {
+  void *firstFree; ///< linked list of free blocks (link stored in the block itself)
+  int numFree; ///< number of blocks in the list
+} PropertyDescriptorPoolClass;
+
+static PropertyDescriptorPoolClass propertyDescriptorPool[PROPERTY_DESCRIPTOR_POOL_CLASSES];
+
+
+void *PropertyDescriptor::operator new(size_t aSize)
+{
+  size_t sc = (aSize+7)/8;
+  if (sc<PROPERTY_DESCRIPTOR_POOL_CLASSES) {
+    PropertyDescriptorPoolClass &pc = propertyDescriptorPool[sc];
+    if (pc.firstFree) {
+      void *p = pc.firstFree;
+      pc.firstFree = *(void **)p;
+      pc.numFree--;
+      return p;
+    }
+    return ::operator new(sc*8);
+  }
+  return ::operator new(aSize);
+}
+
+
+void PropertyDescriptor::operator delete(void *aPtr, size_t aSize)
+{
+  if (!aPtr) return;
+  size_t sc = (aSize+7)/8;
+  if (sc<PROPERTY_DESCRIPTOR_POOL_CLASSES) {
+    PropertyDescriptorPoolClass &pc = propertyDescriptorPool[sc];
+    if (pc.numFree<PROPERTY_DESCRIPTOR_POOL_MAX_KEPT) {
+      *(void **)aPtr = pc.firstFree;
+      pc.firstFree = aPtr;
+      pc.numFree++;
+      return;
+    }
+  }
+  ::operator delete(aPtr);
+}
+
+
+void DynamicPropertyDescriptor::setNumericName(int aNumber)
+{
+  char buf[sizeof(numericName)];
+  char *p = buf+sizeof(buf);
+  unsigned v = aNumber<0 ? -(unsigned)aNumber : aNumber;
+  *(--p) = 0;
+  do { *(--p) = '0' + v%10; v /= 10; } while (v);
+  if (aNumber<0) *(--p) = '-';
+  memcpy(numericName, p, buf+sizeof(buf)-p);
+}
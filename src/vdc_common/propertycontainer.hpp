@@ -37,6 +37,10 @@ namespace p44 {
 
   #define PROPINDEX_NONE -1 ///< special value to signal "no next descriptor" for getDescriptorByName
 
+  #define PROPERTY_NAME_HINTS 2048 ///< number of entries in the hashed property name lookup table (must be power of 2)
+  #define PROPERTY_DESCRIPTOR_POOL_CLASSES 16 ///< number of size classes (multiples of 8 bytes) of recycled property descriptor memory
+  #define PROPERTY_DESCRIPTOR_POOL_MAX_KEPT 64 ///< max number of unused descriptor memory blocks kept per size class
+
   /// type for const tables describing static properties
   typedef struct PropertyDescription {
     const char *propertyName; ///< name of the property
@@ -65,6 +69,10 @@ namespace p44 {
   public:
     /// constructor
     PropertyDescriptor(PropertyDescriptorPtr aParentDescriptor) : parentDescriptor(aParentDescriptor) {};
+    /// descriptors are created and discarded for every property accessed, so their memory is recycled
+    /// @note property access happens on the mainloop thread only
+    static void *operator new(size_t aSize);
+    static void operator delete(void *aPtr, size_t aSize);
     /// the parent descriptor (NULL at root level of DsAdressables)
     PropertyDescriptorPtr parentDescriptor;
     /// name of the property
@@ -113,14 +121,19 @@ namespace p44 {
     DynamicPropertyDescriptor(PropertyDescriptorPtr aParentDescriptor) :
       inherited(aParentDescriptor),
       arrayContainer(false)
-    {};
+    { numericName[0] = 0; };
     string propertyName; ///< name of the property
     ApiValueType propertyType; ///< type of the property value
     size_t propertyFieldKey; ///< key for accessing the property within its container. (size_t to allow using offset into struct)
     intptr_t propertyObjectKey; ///< identifier for object this property belongs to (for properties spread over sublcasses)
     bool arrayContainer;
+    char numericName[12]; ///< name set by setNumericName(), takes precedence over propertyName when set
+
+    /// set name to the decimal representation of a number (e.g. element index in array-like containers)
+    /// @param aNumber the number
+    void setNumericName(int aNumber);
 
-    virtual const char *name() const { return propertyName.c_str(); }
+    virtual const char *name() const { return numericName[0] ? numericName : propertyName.c_str(); }
     virtual ApiValueType type() const { return propertyType; }
     virtual size_t fieldKey() const { return propertyFieldKey; }
     virtual intptr_t objectKey() const { return propertyObjectKey; }
@@ -130,6 +143,47 @@ namespace p44 {
 
 
 
+  #define PROPERTY_CHUNK_ELEMENT_OVERHEAD 6 ///< estimated encoding overhead (tags, lengths) per property element
+
+  /// state for reading large property trees in size limited chunks
+  /// @note the continuation token describes the position of the first property not yet delivered as a path of
+  ///   "queryelement:propertyindex" pairs separated by slashes, from the root down to the property.
+  ///   Passing it back with the same query resumes reading at that position.
+  /// @note the position is by index, not by identity: when properties are added or removed between reading two chunks
+  ///   (e.g. devices appearing or disappearing in a vdc's device list), the next chunk may skip or repeat entries.
+  class PropertyChunk
+  {
+  public:
+    /// create chunk
+    /// @param aMaxBytes approximate max size of the result, 0 for unlimited
+    /// @param aResumeAt continuation token from a previous chunk, or empty to start at the beginning
+    PropertyChunk(size_t aMaxBytes, const string &aResumeAt = "") :
+      maxBytes(aMaxBytes),
+      usedBytes(0),
+      resumeAt(aResumeAt)
+    {};
+
+    size_t maxBytes; ///< approximate max size of the result, 0 for unlimited
+    size_t usedBytes; ///< estimated size of the result so far
+    string resumeAt; ///< remaining part of the continuation token to resume at (consumed while descending)
+    string continuation; ///< when chunk is full: continuation token for reading the next chunk
+
+    /// @return true if chunk is full and the query result is not complete
+    bool full() { return !continuation.empty(); };
+
+    /// get (and remove) the resume position for the current level from resumeAt
+    /// @return true if there is a resume position on this level
+    bool popResumePosition(int &aQueryElement, int &aPropIndex);
+
+    /// account for a value to be added to the result
+    /// @return false if the value does not fit into this chunk any more
+    bool addResult(const char *aName, ApiValuePtr aValue);
+
+    /// prepend the position on the current level to the continuation token
+    void markResumePosition(int aQueryElement, int aPropIndex);
+  };
+
+
   typedef boost::intrusive_ptr<PropertyContainer> PropertyContainerPtr;
 
   /// Base class for objects providing API properties
@@ -151,8 +205,10 @@ namespace p44 {
     /// @param aQueryObject the object defining the read or write query
     /// @param aResultObject for read, must be an object
     /// @param aParentDescriptor the descriptor of the parent property, can be NULL at root level
+    /// @param aChunk if not NULL, reading stops when the result reaches the chunk's size limit, and
+    ///   the chunk's continuation token is set to allow reading the rest with subsequent calls
     /// @return Error 501 if property is unknown, 403 if property exists but cannot be accessed, 415 if value type is incompatible with the property
-    ErrorPtr accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+    ErrorPtr accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor, PropertyChunk *aChunk = NULL);
 
     /// @}
 
@@ -186,7 +242,7 @@ namespace p44 {
     /// @note base class provides a default implementation which uses numProps/getDescriptorByIndex and compares names.
     ///   Subclasses may override this to more efficiently access array-like containers where aPropMatch can directly be used
     ///   to find an element (without iterating through all indices).
-    virtual PropertyDescriptorPtr getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+    virtual PropertyDescriptorPtr getDescriptorByName(const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
 
     /// get subcontainer for a apivalue_object property
     /// @param aPropertyDescriptor descriptor for a structured (object) property. Call might modify this pointer such as setting it to
@@ -227,15 +283,15 @@ namespace p44 {
     ///   if no next index available for this aPropMatch
     /// @return true if aPropMatch actually specifies a numeric name, false if aPropMatch is a wildcard
     ///   (The #n notation is not considered a numeric name!)
-    bool getNextPropIndex(string aPropMatch, int &aStartIndex);
+    bool getNextPropIndex(const string &aPropMatch, int &aStartIndex);
 
     /// @param aPropMatch property name to match
     /// @return true if aPropMatch specifies a name (vs. "*"/"" or "#n")
-    bool isNamedPropSpec(string &aPropMatch);
+    bool isNamedPropSpec(const string &aPropMatch);
 
     /// @param aPropMatch property name to match
     /// @return true if aPropMatch specifies a match-all wildcard ("*" or "")
-    bool isMatchAll(string &aPropMatch);
+    bool isMatchAll(const string &aPropMatch);
 
     /// utility method to get next property descriptor in numerically addressed containers by numeric name
     /// @param aPropMatch a match-all wildcard (* or empty), a numeric name or indexed access specifier #n
@@ -248,13 +304,15 @@ namespace p44 {
     /// @note the returned descriptor will have its fieldKey set to the index position of the to-be-accessed element,
     ///   and its type inherited from the parent descriptor
     PropertyDescriptorPtr getDescriptorByNumericName(
-      string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor,
+      const string &aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor,
       intptr_t aObjectKey
     );
 
+    /// @}
 
+  private:
 
-    /// @}
+    uint32_t nameHash(const string &aName, int aDomain, PropertyDescriptorPtr aParentDescriptor);
 
   };
   
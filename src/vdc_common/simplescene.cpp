@@ -72,7 +72,7 @@ const FieldDefinition *SimpleScene::getFieldDef(size_t aIndex)
 
 
 /// load values from passed row
-void SimpleScene::loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP)
+void SimpleScene::loadFromRow(ParamRow &aRow, int &aIndex, uint64_t *aCommonFlagsP)
 {
   inherited::loadFromRow(aRow, aIndex, aCommonFlagsP);
   // get the fields
@@ -27,7 +27,9 @@ using namespace p44;
 #pragma mark - VdcApiServer
 
 VdcApiServer::VdcApiServer() :
-  inherited(MainLoop::currentMainLoop())
+  inherited(MainLoop::currentMainLoop()),
+  coalesceOutput(false),
+  coalesceWindow(0)
 {
 }
 
@@ -51,6 +53,9 @@ SocketCommPtr VdcApiServer::serverConnectionHandler(SocketCommPtr aServerSocketC
   SocketCommPtr socketComm = apiConnection->socketConnection();
   socketComm->relatedObject = apiConnection; // bind object to connection
   socketComm->setConnectionStatusHandler(boost::bind(&VdcApiServer::connectionStatusHandler, this, _1, _2));
+  if (coalesceOutput) {
+    apiConnection->setOutputCoalescing(true, coalesceWindow);
+  }
   // return the socketComm object which handles this connection
   return socketComm;
 }
@@ -75,6 +80,12 @@ void VdcApiServer::connectionStatusHandler(SocketCommPtr aSocketComm, ErrorPtr a
 
 #pragma mark - VdcApiConnection
 
+VdcApiConnection::VdcApiConnection() :
+  pushesSuperseded(0),
+  pushesDropped(0)
+{
+}
+
 
 void VdcApiConnection::setRequestHandler(VdcApiRequestCB aApiRequestHandler)
 {
@@ -82,6 +93,12 @@ void VdcApiConnection::setRequestHandler(VdcApiRequestCB aApiRequestHandler)
 }
 
 
+void VdcApiConnection::setNotificationHandler(VdcApiNotificationCB aApiNotificationHandler)
+{
+  apiNotificationHandler = aApiNotificationHandler;
+}
+
+
 void VdcApiConnection::closeConnection()
 {
   if (socketConnection()) {
@@ -90,6 +107,86 @@ void VdcApiConnection::closeConnection()
 }
 
 
+void VdcApiConnection::setOutputCoalescing(bool aCoalesce, MLMicroSeconds aWindow)
+{
+  SocketCommPtr sc = socketConnection();
+  if (sc) {
+    sc->setTransmitCoalescing(aCoalesce, aWindow);
+    sc->setTcpNoDelay(aCoalesce);
+  }
+}
+
+
+#pragma mark - push queue
+
+bool VdcApiConnection::pushBacklogged()
+{
+  SocketCommPtr sc = socketConnection();
+  return sc && sc->transmitQueueBytes()>=VDCAPI_PUSH_QUEUE_TX_LIMIT;
+}
+
+
+ErrorPtr VdcApiConnection::sendPushNotification(const string &aKey, const string &aMethod, ApiValuePtr aParams)
+{
+  bool isEvent = aKey.empty();
+  if (!isEvent) {
+    PushQueueIndex::iterator pos = pushQueueIndex.find(aKey);
+    if (pos!=pushQueueIndex.end()) {
+      // older value still waiting, just replace it (keeps its position in the queue)
+      pos->second->method = aMethod;
+      pos->second->params = aParams;
+      pushesSuperseded++;
+      return ErrorPtr();
+    }
+  }
+  if (pushQueue.empty() && !pushBacklogged()) {
+    // connection is not busy, send right now
+    return sendRequest(aMethod, aParams);
+  }
+  // connection is busy, queue
+  if (pushQueue.size()>=VDCAPI_PUSH_QUEUE_MAX_ENTRIES) {
+    // queue full, drop oldest state push (events must not get lost, they are queued in any case)
+    for (PushQueue::iterator qpos = pushQueue.begin(); qpos!=pushQueue.end(); ++qpos) {
+      if (!qpos->key.empty()) {
+        LOG(LOG_WARNING, "vDC API push queue full -> dropping oldest %s for '%s'\n", qpos->method.c_str(), qpos->key.c_str());
+        pushQueueIndex.erase(qpos->key);
+        pushQueue.erase(qpos);
+        pushesDropped++;
+        break;
+      }
+    }
+  }
+  PushEntry e;
+  e.key = aKey;
+  e.method = aMethod;
+  e.params = aParams;
+  PushQueue::iterator qpos = pushQueue.insert(pushQueue.end(), e);
+  if (!isEvent) pushQueueIndex[aKey] = qpos;
+  SocketCommPtr sc = socketConnection();
+  if (sc) {
+    // continue when the connection has sent what it has queued so far
+    sc->setTransmitQueueDrainedHandler(boost::bind(&VdcApiConnection::processPushQueue, this));
+  }
+  return ErrorPtr();
+}
+
+
+void VdcApiConnection::processPushQueue()
+{
+  while (!pushQueue.empty() && !pushBacklogged()) {
+    PushEntry e = pushQueue.front();
+    if (!e.key.empty()) pushQueueIndex.erase(e.key);
+    pushQueue.pop_front();
+    sendRequest(e.method, e.params);
+  }
+  if (pushQueue.empty()) {
+    SocketCommPtr sc = socketConnection();
+    if (sc) sc->setTransmitQueueDrainedHandler(NULL);
+  }
+}
+
+
+
 #pragma mark - VdcApiRequest
 
 ErrorPtr VdcApiRequest::sendError(ErrorPtr aErrorToSend)
@@ -28,6 +28,11 @@
 #include "socketcomm.hpp"
 
 
+// max number of push notifications waiting in a connection's push queue
+#define VDCAPI_PUSH_QUEUE_MAX_ENTRIES 200
+// queued push notifications are only sent while the connection's transmit queue holds less than this many bytes
+#define VDCAPI_PUSH_QUEUE_TX_LIMIT (4*1024)
+
 using namespace std;
 
 namespace p44 {
@@ -70,6 +75,53 @@ namespace p44 {
   typedef boost::function<void (VdcApiConnectionPtr aApiConnection, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData)> VdcApiResponseCB;
 
 
+  /// notifications that can be delivered with typed parameters
+  typedef enum {
+    vdcapi_ping,
+    vdcapi_callScene,
+    vdcapi_saveScene,
+    vdcapi_undoScene,
+    vdcapi_setLocalPriority,
+    vdcapi_callSceneMin,
+    vdcapi_identify,
+    vdcapi_setControlValue,
+    vdcapi_dimChannel,
+    vdcapi_setOutputChannelValue
+  } VdcApiNotificationType;
+
+
+  /// a notification with already decoded, typed parameters
+  /// @note API implementations which can decode frequent notifications directly from the wire format (e.g. protobuf)
+  ///   deliver them this way, without building a ApiValue parameter tree first.
+  ///   All pointers are only valid during the call of the VdcApiNotificationCB handler.
+  class VdcApiNotification
+  {
+  public:
+    VdcApiNotificationType type; ///< the notification type
+    const char *method; ///< the method name, as used for the same notification delivered via VdcApiRequestCB
+    // target entities
+    size_t numDsUids; ///< number of target dSUIDs
+    const char * const *dsUids; ///< target dSUIDs as hex strings
+    // parameters (which ones are valid depends on type)
+    int scene; ///< scene number (callScene, saveScene, undoScene, setLocalPriority, callSceneMin)
+    bool force; ///< force flag (callScene)
+    const char *name; ///< control value name (setControlValue)
+    double value; ///< value (setControlValue, setOutputChannelValue)
+    int channel; ///< channel type (dimChannel, setOutputChannelValue)
+    int mode; ///< dim mode: 0=stop, <0=down, >0=up (dimChannel)
+    int area; ///< area, 0 if none (dimChannel)
+    bool applyNow; ///< apply now or only preload (setOutputChannelValue)
+
+    VdcApiNotification() : type(vdcapi_ping), method(""), numDsUids(0), dsUids(NULL), scene(0), force(false), name(""), value(0), channel(0), mode(0), area(0), applyNow(true) {};
+  };
+
+
+  /// callback for delivering a notification with typed parameters
+  /// @param aApiConnection the VdcApiConnection calling this handler
+  /// @param aNotification the notification
+  typedef boost::function<void (VdcApiConnectionPtr aApiConnection, const VdcApiNotification &aNotification)> VdcApiNotificationCB;
+
+
   /// callback for announcing new API connection (which may or may not lead to a session) or termination of a connection
   /// @param aApiConnection the VdcApiConnection calling this handler
   /// @param aError set if an error occurred on the connection (including remote having closed the connection)
@@ -85,19 +137,47 @@ namespace p44 {
   {
     typedef P44Obj inherited;
 
+    /// a push notification waiting to be sent
+    typedef struct {
+      string key; ///< key identifying the pushed value, empty for events (never superseded or dropped)
+      string method; ///< the notification name
+      ApiValuePtr params; ///< the notification parameters
+    } PushEntry;
+    typedef std::list<PushEntry> PushQueue;
+    typedef std::map<string, PushQueue::iterator> PushQueueIndex;
+
+    PushQueue pushQueue; ///< push notifications waiting for the connection to accept more data, oldest first
+    PushQueueIndex pushQueueIndex; ///< queued push notifications by key (state pushes only)
+    size_t pushesSuperseded; ///< statistics: number of queued push notifications replaced by a newer value
+    size_t pushesDropped; ///< statistics: number of state push notifications dropped because the queue was full
+
   protected:
 
     VdcApiRequestCB apiRequestHandler;
+    VdcApiNotificationCB apiNotificationHandler;
 
   public:
 
+    VdcApiConnection();
+
     /// install callback for received API requests
     /// @param aApiRequestHandler will be called when a API request has been received
     void setRequestHandler(VdcApiRequestCB aApiRequestHandler);
 
+    /// install callback for notifications with typed parameters
+    /// @param aApiNotificationHandler will be called for notifications the API implementation can decode directly.
+    ///   If not set, all notifications are delivered via the request handler.
+    void setNotificationHandler(VdcApiNotificationCB aApiNotificationHandler);
+
     /// end connection
     void closeConnection();
 
+    /// enable or disable coalescing of outgoing messages
+    /// @param aCoalesce if set, messages sent within aWindow are collected and then sent with a single write
+    ///   (and Nagle's algorithm is disabled, as it would only add latency to the already coalesced data)
+    /// @param aWindow how long to collect messages. 0 means until the end of the current mainloop cycle
+    void setOutputCoalescing(bool aCoalesce, MLMicroSeconds aWindow = 0);
+
     /// get a new API value suitable for this connection
     /// @return new API value of suitable internal implementation to be used on this API connection
     virtual ApiValuePtr newApiValue() = 0;
@@ -106,6 +186,12 @@ namespace p44 {
     /// @return socket connection
     virtual SocketCommPtr socketConnection() = 0;
 
+    /// max size of result data a single response message can carry on this connection
+    /// @return approximate max size in bytes, or 0 if unlimited
+    /// @note callers can request results that are larger (such as getProperty for large property trees) to be delivered
+    ///   in chunks of this size by passing x-p44-continue in the query, otherwise they are sent in one message
+    virtual size_t maxResultSize() { return 0; };
+
 
     /// send a API request
     /// @param aMethod the vDC API method or notification name to be sent
@@ -118,6 +204,38 @@ namespace p44 {
 
     /// request closing connection after last message has been sent
     virtual void closeAfterSend() = 0;
+
+    /// @name push notifications with backpressure
+    /// @{
+
+    /// send a notification which reports the current value of something, and can be superseded by a newer value
+    /// @param aKey identifies the reported value (e.g. dSUID plus property path). A notification with the same key
+    ///   that is still waiting in the push queue is replaced by this one. Empty for events (e.g. button clicks),
+    ///   which are always sent, in order, and are never superseded or dropped.
+    /// @param aMethod the vDC API notification name to be sent
+    /// @param aParams the parameters for the notification
+    /// @return empty or Error object in case of error
+    /// @note the notification is sent right away when the connection is not busy. Otherwise it is queued and sent
+    ///   as the connection accepts more data, so obsolete values are not sent at all, and method results do
+    ///   not have to wait behind a backlog of pushed values. When the queue is full, the oldest state push is dropped.
+    ErrorPtr sendPushNotification(const string &aKey, const string &aMethod, ApiValuePtr aParams);
+
+    /// @return number of push notifications currently waiting to be sent
+    size_t pushQueueSize() { return pushQueue.size(); };
+
+    /// @return number of queued push notifications that were replaced by a newer value
+    size_t pushQueueSuperseded() { return pushesSuperseded; };
+
+    /// @return number of state push notifications dropped because the push queue was full
+    size_t pushQueueDropped() { return pushesDropped; };
+
+    /// @}
+
+  private:
+
+    bool pushBacklogged();
+    void processPushQueue();
+
   };
 
 
@@ -129,6 +247,9 @@ namespace p44 {
 
     VdcApiConnectionCB apiConnectionStatusHandler; ///< connection status handler
 
+    bool coalesceOutput; ///< if set, new connections coalesce outgoing messages
+    MLMicroSeconds coalesceWindow; ///< time window for coalescing outgoing messages
+
   public:
 
     VdcApiServer();
@@ -137,6 +258,11 @@ namespace p44 {
     /// @param aConnectionCB will be called when connections opens, ends or has error
     void setConnectionStatusHandler(VdcApiConnectionCB aConnectionCB);
 
+    /// enable or disable coalescing of outgoing messages for new connections
+    /// @param aCoalesce if set, messages sent within aWindow are collected and then sent with a single write
+    /// @param aWindow how long to collect messages. 0 means until the end of the current mainloop cycle
+    void setOutputCoalescing(bool aCoalesce, MLMicroSeconds aWindow = 0) { coalesceOutput = aCoalesce; coalesceWindow = aWindow; };
+
     /// start API server
     void start();
 
@@ -177,6 +303,10 @@ namespace p44 {
     /// @return new API value of suitable internal implementation to be used on this API connection
     virtual ApiValuePtr newApiValue() { return connection()->newApiValue(); }; // default is asking connection
 
+    /// max size of result data the response to this request can carry
+    /// @return approximate max size in bytes, or 0 if unlimited
+    virtual size_t maxResultSize() { VdcApiConnectionPtr c = connection(); return c ? c->maxResultSize() : 0; }; // default is asking connection
+
     /// send a vDC API result (answer for successful method call)
     /// @param aResult the result as a ApiValue. Can be NULL for procedure calls without return value
     /// @result empty or object in case of error sending result response